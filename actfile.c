@@ -0,0 +1,509 @@
+/**
+ * @file actfile.c
+ *
+ * Skin editing on a mapped, indexed actor. Moved out of tga2gebmp_core.c so
+ * that it builds without the engine.
+ */
+#include <stdio.h>
+#include "actfile.h"
+#include "actindex.h"
+#include "actwriter.h"
+#include "fasthash.h"
+#include "trace.h"
+
+
+typedef struct	ActFile_Skin
+{
+	char		*Name;
+	void		*Data;			/* replacement, NULL while the skin is the one in the file */
+	ActFile_FreeFunc Free;		/* releases Data */
+	size_t		Size;
+	int			Entry;			/* index entry the skin was read from, -1 if gone */
+	int			Dirty;			/* differs from the bytes in the file */
+	uint64_t	Hash;			/* of the skin's bytes, valid if HashValid */
+	int			HashValid;
+}	ActFile_Skin;
+
+struct ActFile
+{
+	char		FileName[_MAX_PATH];
+	ActIndex	*Index;
+	ActFile_Skin *Skins;
+	int			SkinCount;
+	int			SkinCapacity;
+	int			DirtyCount;
+	ActFile_Stats Stats;
+	IoQueue		*Queue;			/* for the splices of a save, may be NULL */
+};
+
+
+static char *ActFile_StrDup(const char *Str)
+{
+	char *Copy;
+
+	Copy = (char*)malloc(strlen(Str) + 1);
+	if(Copy)
+		strcpy(Copy, Str);
+
+	return Copy;
+}
+
+
+static void ActFile_FreeSkinData(ActFile_Skin *Skin)
+{
+	if(Skin->Data)
+		Skin->Free(Skin->Data);
+	Skin->Data = NULL;
+}
+
+
+static int ActFile_AddSkin(ActFile *File, const char *Name, int Entry, size_t Size)
+{
+	ActFile_Skin *Skin;
+
+	if(File->SkinCount == File->SkinCapacity)
+	{
+		ActFile_Skin *NewSkins;
+		int NewCapacity = File->SkinCapacity ? File->SkinCapacity * 2 : 16;
+
+		NewSkins = (ActFile_Skin*)realloc(File->Skins, NewCapacity * sizeof(ActFile_Skin));
+		if(!NewSkins)
+			return 0;
+
+		File->Skins = NewSkins;
+		File->SkinCapacity = NewCapacity;
+	}
+
+	Skin = &File->Skins[File->SkinCount];
+	Skin->Name = ActFile_StrDup(Name);
+	if(!Skin->Name)
+		return 0;
+
+	Skin->Data = NULL;
+	Skin->Free = free;
+	Skin->Size = Size;
+	Skin->Entry = Entry;
+	Skin->Dirty = 0;
+	Skin->HashValid = 0;
+
+	File->SkinCount++;
+	return 1;
+}
+
+
+ActFile *ActFile_Open(const char *FileName)
+{
+	ActFile *File;
+	const ActIndex_Entry *Body;
+	const ActIndex_Entry *Bitmaps;
+	int e;
+	TRACE_SPAN(Span)
+
+	if(strlen(FileName) >= sizeof(File->FileName))
+		return NULL;
+
+	File = (ActFile*)malloc(sizeof(ActFile));
+	if(!File)
+		return NULL;
+
+	memset(File, 0, sizeof(*File));
+	strcpy(File->FileName, FileName);
+
+	TRACE_BEGIN(Span, TRACE_OPEN);
+	File->Index = ActIndex_Open(FileName);
+	if(!File->Index)
+	{
+		free(File);
+		return NULL;
+	}
+	TRACE_END(Span, ActIndex_GetEntryCount(File->Index), ActIndex_GetSize(File->Index));
+
+	Body = ActIndex_Find(File->Index, "Body");
+	if(!Body || !(Body->Flags & ACTINDEX_CONTAINER))
+	{
+		ActFile_Close(&File);
+		return NULL;
+	}
+
+	// list the encoded geBitmaps in the nested body; their bytes stay in the
+	// file until something reads them
+	TRACE_BEGIN(Span, TRACE_FIND);
+	Bitmaps = ActIndex_Find(File->Index, "Body\\Bitmaps");
+	for(e = Bitmaps ? Bitmaps->FirstChild : -1; e >= 0; e = ActIndex_GetEntry(File->Index, e)->NextSibling)
+	{
+		const ActIndex_Entry *Entry = ActIndex_GetEntry(File->Index, e);
+
+		if(Entry->Flags & ACTINDEX_DIRECTORY)
+			continue;
+
+		if(!ActFile_AddSkin(File, Entry->Name, e, Entry->Size))
+		{
+			ActFile_Close(&File);
+			return NULL;
+		}
+	}
+	TRACE_END(Span, File->SkinCount, 0);
+
+	return File;
+}
+
+
+void ActFile_Close(ActFile **pFile)
+{
+	ActFile *File = *pFile;
+	int i;
+
+	if(!File)
+		return;
+
+	for(i = 0; i < File->SkinCount; i++)
+	{
+		free(File->Skins[i].Name);
+		ActFile_FreeSkinData(&File->Skins[i]);
+	}
+
+	free(File->Skins);
+	ActIndex_Destroy(&File->Index);
+	free(File);
+	*pFile = NULL;
+}
+
+
+const char *ActFile_GetFileName(const ActFile *File)
+{
+	return File->FileName;
+}
+
+
+int ActFile_GetSkinCount(const ActFile *File)
+{
+	return File->SkinCount;
+}
+
+
+const char *ActFile_GetSkinName(const ActFile *File, int Index)
+{
+	if(Index < 0 || Index >= File->SkinCount)
+		return NULL;
+
+	return File->Skins[Index].Name;
+}
+
+
+int ActFile_FindSkin(const ActFile *File, const char *SkinName)
+{
+	int i;
+
+	for(i = 0; i < File->SkinCount; i++)
+	{
+		if(tga2gebmp_stricmp(File->Skins[i].Name, SkinName) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+const void *ActFile_GetStoredSkinData(const ActFile *File, int Index, size_t *pSize)
+{
+	const ActIndex_Entry *Entry;
+
+	if(File->Skins[Index].Entry < 0)
+		return NULL;
+
+	Entry = ActIndex_GetEntry(File->Index, File->Skins[Index].Entry);
+	*pSize = Entry->Size;
+	return ActIndex_GetData(File->Index, Entry);
+}
+
+
+// the replacement if there is one, otherwise a view of the mapped file
+const void *ActFile_GetSkinData(const ActFile *File, int Index, size_t *pSize)
+{
+	const ActFile_Skin *Skin = &File->Skins[Index];
+
+	if(!Skin->Data)
+		return ActFile_GetStoredSkinData(File, Index, pSize);
+
+	*pSize = Skin->Size;
+	return Skin->Data;
+}
+
+
+uint64_t ActFile_GetSkinHash(ActFile *File, int Index)
+{
+	ActFile_Skin *Skin = &File->Skins[Index];
+
+	if(!Skin->HashValid)
+	{
+		size_t Size = 0;
+		const void *Data = ActFile_GetSkinData(File, Index, &Size);
+
+		// a skin a save lost has no bytes to hash, and is tried again next time
+		if(!Data)
+			return FastHash_64("", 0, 0);
+
+		Skin->Hash = FastHash_64(Data, Size, 0);
+		Skin->HashValid = 1;
+	}
+
+	return Skin->Hash;
+}
+
+
+int ActFile_SetSkinData(ActFile *File, int Index, void *Data, size_t Size, ActFile_FreeFunc Free)
+{
+	ActFile_Skin *Skin;
+	const void *Stored;
+	size_t StoredSize = 0;
+
+	if(!Free)
+		Free = free;
+
+	if(Index < 0 || Index >= File->SkinCount)
+	{
+		Free(Data);
+		return 0;
+	}
+
+	Skin = &File->Skins[Index];
+	ActFile_FreeSkinData(Skin);
+	Skin->Data = Data;
+	Skin->Free = Free;
+	Skin->Size = Size;
+	Skin->HashValid = 0;
+
+	// an image that encodes to what the file already holds changes nothing,
+	// and the copy is not needed either
+	Stored = ActFile_GetStoredSkinData(File, Index, &StoredSize);
+	if(Stored && StoredSize == Size && memcmp(Stored, Data, Size) == 0)
+	{
+		ActFile_FreeSkinData(Skin);
+		Skin->Size = StoredSize;
+
+		if(Skin->Dirty)
+			File->DirtyCount--;
+		Skin->Dirty = 0;
+	}
+	else if(!Skin->Dirty)
+	{
+		Skin->Dirty = 1;
+		File->DirtyCount++;
+	}
+
+	return 1;
+}
+
+
+int ActFile_PutSkinData(ActFile *File, int Index, const void *Data, size_t Size)
+{
+	void *Copy;
+
+	Copy = malloc(Size > 0 ? Size : 1);
+	if(!Copy)
+		return 0;
+
+	memcpy(Copy, Data, Size);
+	return ActFile_SetSkinData(File, Index, Copy, Size, free);
+}
+
+
+int ActFile_GetDirtyCount(const ActFile *File)
+{
+	return File->DirtyCount;
+}
+
+
+void ActFile_GetStats(const ActFile *File, ActFile_Stats *Stats)
+{
+	*Stats = File->Stats;
+}
+
+
+void ActFile_SetIoQueue(ActFile *File, IoQueue *Queue)
+{
+	File->Queue = Queue;
+}
+
+
+static const ActFile_Skin *ActFile_FindSkinByEntry(const ActFile *File, int Entry)
+{
+	int i;
+
+	for(i = 0; i < File->SkinCount; i++)
+	{
+		if(File->Skins[i].Entry == Entry)
+			return &File->Skins[i];
+	}
+
+	return NULL;
+}
+
+
+// stream the nested body: replaced skins from memory, everything else spliced
+static int ActFile_WriteBody(const ActFile *File, ActWriter *Writer, const ActIndex_Entry *Body)
+{
+	const ActIndex *Index = File->Index;
+	ActWriter_Props Props;
+	int e;
+
+	ActWriter_GetProps(Index, Body, &Props);
+	if(!ActWriter_BeginContainer(Writer, Body->Name, &Props))
+		return 0;
+
+	for(e = Body->FirstChild; e >= 0; e = ActIndex_GetEntry(Index, e)->NextSibling)
+	{
+		const ActIndex_Entry *Entry = ActIndex_GetEntry(Index, e);
+		int c;
+
+		if(!(Entry->Flags & ACTINDEX_DIRECTORY) || tga2gebmp_stricmp(Entry->Name, "Bitmaps") != 0)
+		{
+			if(!ActWriter_AddIndexedTree(Writer, Index, Entry))
+				return 0;
+			continue;
+		}
+
+		ActWriter_GetProps(Index, Entry, &Props);
+		if(!ActWriter_BeginDirectory(Writer, Entry->Name, &Props))
+			return 0;
+
+		for(c = Entry->FirstChild; c >= 0; c = ActIndex_GetEntry(Index, c)->NextSibling)
+		{
+			const ActIndex_Entry *Child = ActIndex_GetEntry(Index, c);
+			const ActFile_Skin *Skin = ActFile_FindSkinByEntry(File, c);
+
+			if(Skin && Skin->Dirty)
+			{
+				ActWriter_GetProps(Index, Child, &Props);
+				ActWriter_GetCurrentTime(Props.Time);
+				if(!ActWriter_AddData(Writer, Child->Name, Skin->Data, (uint32_t)Skin->Size, &Props))
+					return 0;
+			}
+			else if(!ActWriter_AddIndexedTree(Writer, Index, Child))
+			{
+				return 0;
+			}
+		}
+
+		if(!ActWriter_EndDirectory(Writer))
+			return 0;
+	}
+
+	return ActWriter_EndContainer(Writer);
+}
+
+
+static int ActFile_Write(ActFile *File)
+{
+	ActWriter	*Writer;
+	ActWriter_Stats Stats;
+	int			Result = 1;
+	int			e;
+	int			i;
+
+	// the index allows longer names than a path holds on some systems; such
+	// a skin could not be found again after the save, so nothing is written
+	for(i = 0; i < File->SkinCount; i++)
+	{
+		if(strlen(File->Skins[i].Name) + sizeof("Body\\Bitmaps\\") > _MAX_PATH)
+			return 0;
+	}
+
+	// one pass over the source in its own order, written next to the original
+	Writer = ActWriter_Create(File->FileName);
+	if(!Writer)
+		return 0;
+
+	if(File->Queue)
+		ActWriter_SetIoQueue(Writer, File->Queue);
+
+	for(e = ActIndex_GetFirstEntry(File->Index); Result && e >= 0; e = ActIndex_GetEntry(File->Index, e)->NextSibling)
+	{
+		const ActIndex_Entry *Entry = ActIndex_GetEntry(File->Index, e);
+
+		if((Entry->Flags & ACTINDEX_CONTAINER) && tga2gebmp_stricmp(Entry->Name, "Body") == 0)
+			Result = ActFile_WriteBody(File, Writer, Entry);
+		else
+			Result = ActWriter_AddIndexedTree(Writer, File->Index, Entry);
+	}
+
+	// queued splices still read from the mapped file
+	if(!Result || !ActWriter_Drain(Writer))
+	{
+		ActWriter_Abort(&Writer);
+		return 0;
+	}
+
+	// the mapping has to go before the original can be replaced
+	ActIndex_Destroy(&File->Index);
+
+	Result = ActWriter_Commit(&Writer, &Stats);
+	if(Result)
+	{
+		File->Stats.EntriesRewritten = Stats.EntriesWritten;
+		File->Stats.EntriesReused = Stats.EntriesSpliced;
+		File->Stats.BytesWritten = Stats.BytesWritten;
+		File->Stats.BytesReused = Stats.BytesSpliced;
+	}
+
+	// reopen whichever file is there now and point the skins at its entries;
+	// skins that were written no longer need their copies
+	File->Index = ActIndex_Open(File->FileName);
+	if(!File->Index)
+		return -1;
+
+	File->DirtyCount = 0;
+	for(i = 0; i < File->SkinCount; i++)
+	{
+		ActFile_Skin *Skin = &File->Skins[i];
+		char Path[_MAX_PATH];
+
+		if((unsigned)snprintf(Path, sizeof(Path), "Body\\Bitmaps\\%s", Skin->Name) >= sizeof(Path))
+			return -1;
+		Skin->Entry = ActIndex_FindIndex(File->Index, Path);
+
+		// the file changed under us, the skin's bytes are gone
+		if(Skin->Entry < 0 && !Skin->Data)
+			return -1;
+
+		if(Result && Skin->Entry >= 0 && Skin->Dirty)
+		{
+			ActFile_FreeSkinData(Skin);
+			Skin->Dirty = 0;
+		}
+
+		if(Skin->Dirty)
+			File->DirtyCount++;
+	}
+
+	return Result;
+}
+
+
+int ActFile_Save(ActFile **pFile)
+{
+	ActFile *File = *pFile;
+	int Result;
+	TRACE_SPAN(Span)
+
+	memset(&File->Stats, 0, sizeof(File->Stats));
+
+	// nothing to write, the file on disk is already what we hold
+	if(File->DirtyCount == 0)
+	{
+		File->Stats.Skipped = 1;
+		return 1;
+	}
+
+	TRACE_BEGIN(Span, TRACE_SAVE);
+	Result = ActFile_Write(File);
+	TRACE_END(Span, File->Stats.EntriesRewritten + File->Stats.EntriesReused, File->Stats.BytesWritten);
+
+	if(Result < 0)
+	{
+		ActFile_Close(pFile);
+		return 0;
+	}
+
+	return Result;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file actfile.h
+ *
+ * An actor opened for editing its skins, the part of skin replacement that
+ * needs no engine: list the encoded geBitmap files under Body\Bitmaps, read
+ * them, put new bytes in their place and save. This is the C API for tools
+ * that embed the reskinning without the dialog or the Genesis libraries;
+ * tga2gebmp_core.h builds image conversion on top of it.
+ *
+ * Opening maps and indexes the file (actindex.h) and reads nothing else.
+ * Skins that have not been replaced are views into the mapping. Saving
+ * streams a new file with actwriter.h, splicing everything that did not
+ * change (optionally on an IoQueue), renames it over the original and maps
+ * the result, so the same ActFile can go on being edited. Skins whose new
+ * bytes equal the stored ones are not dirty, and an actor with nothing
+ * dirty is not rewritten.
+ *
+ * An ActFile is used by one thread at a time.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef ACTFILE_H
+#define ACTFILE_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "ioqueue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ActFile ActFile;
+
+/* what the last ActFile_Save did */
+typedef struct	ActFile_Stats
+{
+	int			Skipped;			/* nothing was dirty, no file was written */
+	int			EntriesRewritten;	/* skins written from memory */
+	int			EntriesReused;		/* files copied unchanged from the original */
+	uint64_t	BytesWritten;		/* size of the new actor */
+	uint64_t	BytesReused;		/* part of BytesWritten copied unchanged */
+}	ActFile_Stats;
+
+typedef void (*ActFile_FreeFunc)(void *Data);
+
+/* NULL if the file cannot be read or has no Body */
+ActFile *ActFile_Open(const char *FileName);
+/* drops replacements that have not been saved */
+void ActFile_Close(ActFile **pFile);
+const char *ActFile_GetFileName(const ActFile *File);
+
+int ActFile_GetSkinCount(const ActFile *File);
+const char *ActFile_GetSkinName(const ActFile *File, int Index);
+/* case-insensitive, -1 if the actor has no such skin */
+int ActFile_FindSkin(const ActFile *File, const char *SkinName);
+
+/* the encoded skin, replacement or not; valid until the skin is replaced or
+   the actor saved or closed */
+const void *ActFile_GetSkinData(const ActFile *File, int Index, size_t *pSize);
+/* the skin as stored in the file, NULL if a save lost it */
+const void *ActFile_GetStoredSkinData(const ActFile *File, int Index, size_t *pSize);
+/* hash of the skin's bytes, changes whenever the skin is replaced; a skin
+   without bytes hashes as an empty one */
+uint64_t ActFile_GetSkinHash(ActFile *File, int Index);
+
+/* replaces a skin with a copy of Data; 0 if out of memory */
+int ActFile_PutSkinData(ActFile *File, int Index, const void *Data, size_t Size);
+/* replaces a skin with Data itself, which the ActFile releases with Free
+   (NULL for free) once it no longer needs it, also on failure */
+int ActFile_SetSkinData(ActFile *File, int Index, void *Data, size_t Size, ActFile_FreeFunc Free);
+
+/* number of skins that differ from the file */
+int ActFile_GetDirtyCount(const ActFile *File);
+/* writes only if something is dirty. Returns 0 if the actor could not be
+   written, which leaves the file and *pFile as they were, or if the new
+   file could not be read back, in which case *pFile is closed */
+int ActFile_Save(ActFile **pFile);
+void ActFile_GetStats(const ActFile *File, ActFile_Stats *Stats);
+/* saves copy unchanged entries through Queue, NULL for the default; the
+   queue must outlive the actor or be replaced first */
+void ActFile_SetIoQueue(ActFile *File, IoQueue *Queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
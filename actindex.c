@@ -0,0 +1,646 @@
+/**
+ * @file actindex.c
+ *
+ * Memory-mapped, flattened index of Genesis virtual file containers.
+ */
+#include <stdio.h>
+#include "actindex.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#define ACTINDEX_LIST_TERMINATED	0xffffffff
+#define ACTINDEX_MAX_NESTING		4
+#define ACTINDEX_MAX_NAME			1024
+
+#define ACTINDEX_SLOT_ROOT			-2
+
+
+struct ActIndex
+{
+	const uint8_t	*Base;
+	uint64_t		Size;
+	int				Mapped;
+	int				fd;				/* kept open for raw copies, -1 if none */
+#ifdef _WIN32
+	HANDLE			File;
+	HANDLE			Mapping;
+#endif
+
+	ActIndex_Entry	*Entries;
+	size_t			*PathOffsets;	/* into Strings, resolved once parsing is done */
+	int				EntryCount;
+	int				EntryCapacity;
+	int				FirstEntry;
+
+	char			*Strings;
+	size_t			StringsUsed;
+	size_t			StringsCapacity;
+
+	int				*Hash;
+	unsigned int	HashMask;
+};
+
+/* pending child or sibling list while walking the serialized tree */
+typedef struct	ActIndex_Slot
+{
+	int				Parent;			/* entry index, the container's parent or ACTINDEX_SLOT_ROOT */
+	int				Previous;		/* previous sibling, -1 for the head of a list */
+}	ActIndex_Slot;
+
+
+static uint32_t ActIndex_ReadU32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static char ActIndex_FoldChar(char c)
+{
+	if(c == '/')
+		return '\\';
+	if(c >= 'A' && c <= 'Z')
+		return (char)(c - 'A' + 'a');
+	return c;
+}
+
+
+static unsigned int ActIndex_HashPath(const char *Path)
+{
+	unsigned int Hash = 2166136261u;
+
+	while(*Path)
+	{
+		Hash ^= (unsigned char)ActIndex_FoldChar(*Path++);
+		Hash *= 16777619u;
+	}
+
+	return Hash;
+}
+
+
+static int ActIndex_PathEqual(const char *a, const char *b)
+{
+	while(*a && ActIndex_FoldChar(*a) == ActIndex_FoldChar(*b))
+	{
+		a++;
+		b++;
+	}
+
+	return *a == '\0' && *b == '\0';
+}
+
+
+static int ActIndex_AddString(ActIndex *Index, const char *Prefix, size_t PrefixLength, const char *Name, size_t NameLength, size_t *pOffset)
+{
+	size_t Needed = PrefixLength + (PrefixLength ? 1 : 0) + NameLength + 1;
+	char *Dest;
+
+	if(Index->StringsUsed + Needed > Index->StringsCapacity)
+	{
+		char *NewStrings;
+		size_t NewCapacity = Index->StringsCapacity ? Index->StringsCapacity * 2 : 4096;
+
+		while(NewCapacity < Index->StringsUsed + Needed)
+			NewCapacity *= 2;
+
+		NewStrings = (char*)realloc(Index->Strings, NewCapacity);
+		if(!NewStrings)
+			return 0;
+
+		Index->Strings = NewStrings;
+		Index->StringsCapacity = NewCapacity;
+	}
+
+	Dest = Index->Strings + Index->StringsUsed;
+	if(PrefixLength)
+	{
+		memcpy(Dest, Prefix, PrefixLength);
+		Dest[PrefixLength] = '\\';
+		Dest += PrefixLength + 1;
+	}
+	memcpy(Dest, Name, NameLength);
+	Dest[NameLength] = '\0';
+
+	*pOffset = Index->StringsUsed;
+	Index->StringsUsed += Needed;
+	return 1;
+}
+
+
+static int ActIndex_AddEntry(ActIndex *Index)
+{
+	ActIndex_Entry *Entry;
+
+	if(Index->EntryCount == Index->EntryCapacity)
+	{
+		ActIndex_Entry *NewEntries;
+		size_t *NewOffsets;
+		int NewCapacity = Index->EntryCapacity ? Index->EntryCapacity * 2 : 64;
+
+		NewEntries = (ActIndex_Entry*)realloc(Index->Entries, NewCapacity * sizeof(ActIndex_Entry));
+		if(!NewEntries)
+			return -1;
+		Index->Entries = NewEntries;
+
+		NewOffsets = (size_t*)realloc(Index->PathOffsets, NewCapacity * sizeof(size_t));
+		if(!NewOffsets)
+			return -1;
+		Index->PathOffsets = NewOffsets;
+
+		Index->EntryCapacity = NewCapacity;
+	}
+
+	Entry = &Index->Entries[Index->EntryCount];
+	memset(Entry, 0, sizeof(*Entry));
+	Entry->Parent = -1;
+	Entry->FirstChild = -1;
+	Entry->NextSibling = -1;
+
+	return Index->EntryCount++;
+}
+
+
+static int ActIndex_ParseContainer(ActIndex *Index, uint64_t Base, uint64_t Size, int ParentEntry, int Depth);
+
+
+/* index the file entries of one container that hold a nested container */
+static void ActIndex_ParseNested(ActIndex *Index, int First, int Last, int Depth)
+{
+	int i;
+
+	if(Depth >= ACTINDEX_MAX_NESTING)
+		return;
+
+	for(i = First; i < Last; i++)
+	{
+		ActIndex_Entry *Entry = &Index->Entries[i];
+		int SavedCount;
+		size_t SavedStrings;
+
+		if(Entry->Flags & ACTINDEX_DIRECTORY)
+			continue;
+		if(Entry->Size < ACTINDEX_VFS_HEADER_SIZE)
+			continue;
+		if(ActIndex_ReadU32(Index->Base + Entry->Offset) != ACTINDEX_VFS_SIGNATURE)
+			continue;
+
+		SavedCount = Index->EntryCount;
+		SavedStrings = Index->StringsUsed;
+
+		if(ActIndex_ParseContainer(Index, Index->Entries[i].Offset, Index->Entries[i].Size, i, Depth + 1))
+		{
+			Index->Entries[i].Flags |= ACTINDEX_CONTAINER;
+		}
+		else
+		{
+			// looked like a container but is not one, keep it as a plain file
+			Index->EntryCount = SavedCount;
+			Index->StringsUsed = SavedStrings;
+			Index->Entries[i].FirstChild = -1;
+		}
+	}
+}
+
+
+static int ActIndex_ParseContainer(ActIndex *Index, uint64_t Base, uint64_t Size, int ParentEntry, int Depth)
+{
+	const uint8_t	*Header = Index->Base + Base;
+	const uint8_t	*Pos;
+	const uint8_t	*End;
+	uint32_t		DirectoryOffset;
+	uint32_t		DirectorySize;
+	ActIndex_Slot	*Stack = NULL;
+	int				StackCount = 0;
+	int				StackCapacity = 0;
+	int				FirstNew = Index->EntryCount;
+	int				Result = 0;
+
+	if(Size < ACTINDEX_VFS_HEADER_SIZE)
+		return 0;
+	if(ActIndex_ReadU32(Header) != ACTINDEX_VFS_SIGNATURE)
+		return 0;
+
+	// dispersed systems keep their data outside the container
+	if(ActIndex_ReadU32(Header + 8) != 0)
+		return 0;
+
+	DirectoryOffset = ActIndex_ReadU32(Header + 12);
+	if(DirectoryOffset < ACTINDEX_VFS_HEADER_SIZE || (uint64_t)DirectoryOffset + 8 > Size)
+		return 0;
+
+	Pos = Header + DirectoryOffset;
+	if(ActIndex_ReadU32(Pos) != ACTINDEX_DIRTREE_SIGNATURE)
+		return 0;
+
+	End = Header + Size;
+	DirectorySize = ActIndex_ReadU32(Pos + 4);
+	if(DirectorySize > 0 && (uint64_t)DirectoryOffset + 8 + DirectorySize <= Size)
+		End = Pos + 8 + DirectorySize;
+	Pos += 8;
+
+	#define ACTINDEX_PUSH(p, prev)													\
+		do {																		\
+			if(StackCount == StackCapacity)											\
+			{																		\
+				ActIndex_Slot *NewStack;											\
+				StackCapacity = StackCapacity ? StackCapacity * 2 : 32;				\
+				NewStack = (ActIndex_Slot*)realloc(Stack, StackCapacity * sizeof(ActIndex_Slot)); \
+				if(!NewStack)														\
+					goto done;														\
+				Stack = NewStack;													\
+			}																		\
+			Stack[StackCount].Parent = (p);											\
+			Stack[StackCount].Previous = (prev);									\
+			StackCount++;															\
+		} while(0)
+
+	ACTINDEX_PUSH(ACTINDEX_SLOT_ROOT, -1);
+
+	while(StackCount > 0)
+	{
+		ActIndex_Slot	Slot = Stack[--StackCount];
+		uint32_t		Terminator;
+		uint32_t		NameLength;
+		const char		*Name;
+		uint32_t		HintsSize;
+		const uint8_t	*Node;
+		int				e;
+
+		if(Pos + 4 > End)
+			goto done;
+		Terminator = ActIndex_ReadU32(Pos);
+		Pos += 4;
+
+		if(Terminator == ACTINDEX_LIST_TERMINATED)
+			continue;
+		if(Terminator != 0)
+			goto done;
+
+		if(Pos + 4 > End)
+			goto done;
+		NameLength = ActIndex_ReadU32(Pos);
+		Pos += 4;
+		if(NameLength == 0 || NameLength > ACTINDEX_MAX_NAME || Pos + NameLength > End)
+			goto done;
+		Name = (const char*)Pos;
+		if(Name[NameLength - 1] != '\0')
+			goto done;
+		Pos += NameLength;
+
+		// time, attributes, size, offset, hints length
+		if(Pos + 24 > End)
+			goto done;
+		Node = Pos;
+		HintsSize = ActIndex_ReadU32(Node + 20);
+		Pos += 24;
+		if(HintsSize > (uint32_t)(End - Pos))
+			goto done;
+		Pos += HintsSize;
+
+		if(Slot.Parent == ACTINDEX_SLOT_ROOT)
+		{
+			// the unnamed root, its children are the container's top level
+			ACTINDEX_PUSH(ACTINDEX_SLOT_ROOT, -1);
+			ACTINDEX_PUSH(ParentEntry, -1);
+			continue;
+		}
+
+		e = ActIndex_AddEntry(Index);
+		if(e < 0)
+			goto done;
+
+		{
+			ActIndex_Entry	*Entry = &Index->Entries[e];
+			const char		*Prefix = NULL;
+			size_t			PrefixLength = 0;
+			size_t			PathOffset;
+
+			Entry->Time[0]		= ActIndex_ReadU32(Node);
+			Entry->Time[1]		= ActIndex_ReadU32(Node + 4);
+			Entry->Attributes	= ActIndex_ReadU32(Node + 8);
+			Entry->Size			= ActIndex_ReadU32(Node + 12);
+			Entry->Offset		= Base + ActIndex_ReadU32(Node + 16);
+			Entry->HintsSize	= HintsSize;
+			Entry->HintsOffset	= (uint64_t)((Node + 24) - Index->Base);
+			Entry->Parent		= Slot.Parent;
+
+			if(Entry->Attributes & ACTINDEX_ATTRIB_DIRECTORY)
+			{
+				Entry->Flags |= ACTINDEX_DIRECTORY;
+				Entry->Size = 0;
+				Entry->Offset = 0;
+			}
+			else if((uint64_t)ActIndex_ReadU32(Node + 16) + Entry->Size > Size)
+			{
+				goto done;
+			}
+
+			if(Slot.Parent >= 0)
+			{
+				Prefix = Index->Strings + Index->PathOffsets[Slot.Parent];
+				PrefixLength = strlen(Prefix);
+			}
+
+			// the prefix may move when the pool grows, so copy it out first
+			{
+				char	PrefixCopy[ACTINDEX_MAX_NAME * ACTINDEX_MAX_NESTING];
+
+				if(PrefixLength >= sizeof(PrefixCopy))
+					goto done;
+				if(PrefixLength)
+					memcpy(PrefixCopy, Prefix, PrefixLength);
+
+				if(!ActIndex_AddString(Index, PrefixCopy, PrefixLength, Name, NameLength - 1, &PathOffset))
+					goto done;
+			}
+			Index->PathOffsets[e] = PathOffset;
+
+			if(Slot.Previous >= 0)
+				Index->Entries[Slot.Previous].NextSibling = e;
+			else if(Slot.Parent >= 0)
+				Index->Entries[Slot.Parent].FirstChild = e;
+			else
+				Index->FirstEntry = e;
+		}
+
+		ACTINDEX_PUSH(Slot.Parent, e);
+		ACTINDEX_PUSH(e, -1);
+	}
+
+	#undef ACTINDEX_PUSH
+
+	ActIndex_ParseNested(Index, FirstNew, Index->EntryCount, Depth);
+	Result = 1;
+
+done:
+	if(Stack)
+		free(Stack);
+
+	return Result;
+}
+
+
+static int ActIndex_BuildHash(ActIndex *Index)
+{
+	unsigned int Capacity = 16;
+	int i;
+
+	while(Capacity < (unsigned int)Index->EntryCount * 2)
+		Capacity *= 2;
+
+	Index->Hash = (int*)malloc(Capacity * sizeof(int));
+	if(!Index->Hash)
+		return 0;
+
+	for(i = 0; i < (int)Capacity; i++)
+		Index->Hash[i] = -1;
+	Index->HashMask = Capacity - 1;
+
+	for(i = 0; i < Index->EntryCount; i++)
+	{
+		ActIndex_Entry *Entry = &Index->Entries[i];
+		unsigned int Slot;
+
+		Entry->Path = Index->Strings + Index->PathOffsets[i];
+		Entry->Name = strrchr(Entry->Path, '\\');
+		Entry->Name = Entry->Name ? Entry->Name + 1 : Entry->Path;
+
+		Slot = ActIndex_HashPath(Entry->Path) & Index->HashMask;
+		while(Index->Hash[Slot] != -1)
+			Slot = (Slot + 1) & Index->HashMask;
+		Index->Hash[Slot] = i;
+	}
+
+	return 1;
+}
+
+
+static ActIndex *ActIndex_Build(ActIndex *Index)
+{
+	Index->FirstEntry = -1;
+
+	if(!ActIndex_ParseContainer(Index, 0, Index->Size, -1, 0) || !ActIndex_BuildHash(Index))
+	{
+		ActIndex_Destroy(&Index);
+		return NULL;
+	}
+
+	return Index;
+}
+
+
+ActIndex *ActIndex_CreateFromMemory(const void *Data, size_t Size)
+{
+	ActIndex *Index;
+
+	Index = (ActIndex*)calloc(1, sizeof(ActIndex));
+	if(!Index)
+		return NULL;
+
+	Index->Base = (const uint8_t*)Data;
+	Index->Size = Size;
+	Index->fd = -1;
+
+	return ActIndex_Build(Index);
+}
+
+
+ActIndex *ActIndex_Open(const char *FileName)
+{
+	ActIndex *Index;
+
+	Index = (ActIndex*)calloc(1, sizeof(ActIndex));
+	if(!Index)
+		return NULL;
+
+	Index->fd = -1;
+
+#ifdef _WIN32
+	{
+		LARGE_INTEGER FileSize;
+
+		Index->File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(Index->File == INVALID_HANDLE_VALUE)
+		{
+			free(Index);
+			return NULL;
+		}
+
+		if(!GetFileSizeEx(Index->File, &FileSize) || FileSize.QuadPart == 0)
+		{
+			CloseHandle(Index->File);
+			free(Index);
+			return NULL;
+		}
+
+		Index->Mapping = CreateFileMapping(Index->File, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(!Index->Mapping)
+		{
+			CloseHandle(Index->File);
+			free(Index);
+			return NULL;
+		}
+
+		Index->Base = (const uint8_t*)MapViewOfFile(Index->Mapping, FILE_MAP_READ, 0, 0, 0);
+		if(!Index->Base)
+		{
+			CloseHandle(Index->Mapping);
+			CloseHandle(Index->File);
+			free(Index);
+			return NULL;
+		}
+
+		Index->Size = (uint64_t)FileSize.QuadPart;
+	}
+#else
+	{
+		struct stat Stat;
+		void *Base;
+		int fd;
+
+		fd = open(FileName, O_RDONLY);
+		if(fd < 0)
+		{
+			free(Index);
+			return NULL;
+		}
+
+		if(fstat(fd, &Stat) != 0 || Stat.st_size == 0)
+		{
+			close(fd);
+			free(Index);
+			return NULL;
+		}
+
+		Base = mmap(NULL, (size_t)Stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(Base == MAP_FAILED)
+		{
+			close(fd);
+			free(Index);
+			return NULL;
+		}
+
+		Index->Base = (const uint8_t*)Base;
+		Index->Size = (uint64_t)Stat.st_size;
+		Index->fd = fd;
+	}
+#endif
+
+	Index->Mapped = 1;
+
+	return ActIndex_Build(Index);
+}
+
+
+void ActIndex_Destroy(ActIndex **pIndex)
+{
+	ActIndex *Index = *pIndex;
+
+	if(!Index)
+		return;
+
+	if(Index->Mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile((LPCVOID)Index->Base);
+		CloseHandle(Index->Mapping);
+		CloseHandle(Index->File);
+#else
+		munmap((void*)Index->Base, (size_t)Index->Size);
+		close(Index->fd);
+#endif
+	}
+
+	free(Index->Entries);
+	free(Index->PathOffsets);
+	free(Index->Strings);
+	free(Index->Hash);
+	free(Index);
+
+	*pIndex = NULL;
+}
+
+
+int ActIndex_GetEntryCount(const ActIndex *Index)
+{
+	return Index->EntryCount;
+}
+
+
+const ActIndex_Entry *ActIndex_GetEntry(const ActIndex *Index, int EntryIndex)
+{
+	if(EntryIndex < 0 || EntryIndex >= Index->EntryCount)
+		return NULL;
+
+	return &Index->Entries[EntryIndex];
+}
+
+
+int ActIndex_GetFirstEntry(const ActIndex *Index)
+{
+	return Index->FirstEntry;
+}
+
+
+int ActIndex_FindIndex(const ActIndex *Index, const char *Path)
+{
+	unsigned int Slot;
+
+	Slot = ActIndex_HashPath(Path) & Index->HashMask;
+	while(Index->Hash[Slot] != -1)
+	{
+		int e = Index->Hash[Slot];
+
+		if(ActIndex_PathEqual(Index->Entries[e].Path, Path))
+			return e;
+
+		Slot = (Slot + 1) & Index->HashMask;
+	}
+
+	return -1;
+}
+
+
+const ActIndex_Entry *ActIndex_Find(const ActIndex *Index, const char *Path)
+{
+	int e = ActIndex_FindIndex(Index, Path);
+
+	return e < 0 ? NULL : &Index->Entries[e];
+}
+
+
+const void *ActIndex_GetData(const ActIndex *Index, const ActIndex_Entry *Entry)
+{
+	return Index->Base + Entry->Offset;
+}
+
+
+const void *ActIndex_GetHints(const ActIndex *Index, const ActIndex_Entry *Entry)
+{
+	return Entry->HintsSize ? Index->Base + Entry->HintsOffset : NULL;
+}
+
+
+const void *ActIndex_GetBase(const ActIndex *Index)
+{
+	return Index->Base;
+}
+
+
+uint64_t ActIndex_GetSize(const ActIndex *Index)
+{
+	return Index->Size;
+}
+
+
+int ActIndex_GetFileDescriptor(const ActIndex *Index)
+{
+	return Index->fd;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file actindex.h
+ *
+ * Read-only, memory-mapped index of a Genesis virtual file (ACT, BDY).
+ *
+ * The container is mapped once and its directory tree is flattened into an
+ * array of entries with absolute offsets and sizes. File entries that are
+ * themselves virtual files (the Body inside an actor) are indexed too, so
+ * "Body\Bitmaps\skin.bmp" is a single O(1) lookup and its bytes are a view
+ * into the mapping. Nothing is copied or extracted.
+ *
+ * Container layout, all fields little-endian:
+ *
+ *   header     uint32 Signature ('VF01'), uint16 Version, uint16 pad,
+ *              int32 Dispersed, int32 DirectoryOffset, int32 DataLength,
+ *              int32 EndPosition
+ *   data       file contents, at offsets recorded in the directory
+ *   directory  uint32 Signature ('RTRD'), int32 Size, then the tree
+ *
+ * Every tree node is written as uint32 0, int32 NameLength, Name (with its
+ * terminating zero), uint32 Time[2], uint32 Attributes, int32 Size,
+ * int32 Offset, int32 HintsLength, Hints, followed by the node's children
+ * list and then its siblings list. A list ends with uint32 0xffffffff.
+ * Offsets are relative to the start of the container they belong to.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef ACTINDEX_H
+#define ACTINDEX_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ACTINDEX_VFS_SIGNATURE		0x56463031	/* 'VF01' */
+#define ACTINDEX_DIRTREE_SIGNATURE	0x52545244	/* 'RTRD' */
+#define ACTINDEX_VFS_HEADER_SIZE	24
+
+#define ACTINDEX_ATTRIB_READONLY	0x00000001
+#define ACTINDEX_ATTRIB_DIRECTORY	0x00000002
+
+/* entry flags */
+#define ACTINDEX_DIRECTORY			0x0001
+#define ACTINDEX_CONTAINER			0x0002	/* file holding a nested, indexed virtual file */
+
+typedef struct ActIndex ActIndex;
+
+typedef struct	ActIndex_Entry
+{
+	const char	*Path;			/* full path, '\' separated, e.g. "Body\Bitmaps\skin.bmp" */
+	const char	*Name;			/* last component of Path */
+	uint64_t	Offset;			/* absolute offset in the mapped file */
+	uint32_t	Size;
+	uint32_t	Attributes;		/* ACTINDEX_ATTRIB_* as stored in the directory */
+	uint32_t	Time[2];
+	uint64_t	HintsOffset;	/* absolute offset of the hint data */
+	uint32_t	HintsSize;
+	int			Flags;
+	int			Parent;			/* enclosing entry, -1 at the top level */
+	int			FirstChild;		/* -1 if none */
+	int			NextSibling;	/* -1 if none */
+}	ActIndex_Entry;
+
+ActIndex *ActIndex_Open(const char *FileName);
+/* index a container already in memory; Data must outlive the index */
+ActIndex *ActIndex_CreateFromMemory(const void *Data, size_t Size);
+void ActIndex_Destroy(ActIndex **pIndex);
+
+int ActIndex_GetEntryCount(const ActIndex *Index);
+const ActIndex_Entry *ActIndex_GetEntry(const ActIndex *Index, int EntryIndex);
+/* first top-level entry, -1 if the container is empty */
+int ActIndex_GetFirstEntry(const ActIndex *Index);
+/* case-insensitive, accepts '\' or '/' separators, NULL if not found */
+const ActIndex_Entry *ActIndex_Find(const ActIndex *Index, const char *Path);
+int ActIndex_FindIndex(const ActIndex *Index, const char *Path);
+
+/* zero-copy view of an entry's bytes, valid until the index is destroyed */
+const void *ActIndex_GetData(const ActIndex *Index, const ActIndex_Entry *Entry);
+const void *ActIndex_GetHints(const ActIndex *Index, const ActIndex_Entry *Entry);
+const void *ActIndex_GetBase(const ActIndex *Index);
+uint64_t ActIndex_GetSize(const ActIndex *Index);
+/* descriptor of the mapped file for raw copies, -1 if there is none */
+int ActIndex_GetFileDescriptor(const ActIndex *Index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,811 @@
+/**
+ * @file actwriter.c
+ *
+ * Streaming writer for Genesis virtual file containers.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "actwriter.h"
+#include "trace.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <errno.h>
+	#include <io.h>
+	#include <fcntl.h>
+	#include <process.h>
+	#include <sys/stat.h>
+	#define getpid			_getpid
+#else
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#ifdef __linux__
+		#include <sys/sendfile.h>
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+#define ACTWRITER_BUFFER_SIZE		65536
+#define ACTWRITER_MAX_LEVELS		8
+#define ACTWRITER_LIST_TERMINATED	0xffffffff
+
+
+typedef struct	ActWriter_Node
+{
+	char			*Name;
+	uint32_t		Time[2];
+	uint32_t		Attributes;
+	uint32_t		Size;
+	uint32_t		Offset;			/* relative to the enclosing container */
+	void			*Hints;
+	uint32_t		HintsSize;
+	int				Parent;
+	int				FirstChild;
+	int				LastChild;
+	int				NextSibling;
+}	ActWriter_Node;
+
+/* one open container: the file itself or a nested one such as Body */
+typedef struct	ActWriter_Level
+{
+	uint64_t		Base;			/* absolute position of the container header */
+	int				Root;			/* unnamed root node of the container's tree */
+	int				Directory;		/* node new entries are added to */
+	int				File;			/* node of the container in the enclosing level, -1 at the top */
+}	ActWriter_Level;
+
+struct ActWriter
+{
+	int				fd;
+	char			FileName[_MAX_PATH];
+	char			TempFileName[_MAX_PATH];
+	uint64_t		Position;
+	int				Failed;
+
+	unsigned char	*Buffer;
+	uint32_t		BufferUsed;
+
+	ActWriter_Node	*Nodes;
+	int				NodeCount;
+	int				NodeCapacity;
+
+	ActWriter_Level	Levels[ACTWRITER_MAX_LEVELS];
+	int				LevelCount;
+
+	ActWriter_Stats	Stats;
+
+	IoQueue			*Queue;			/* splices in flight, NULL to copy them in place */
+	uint64_t		Queued;			/* bytes spliced through Queue since the last drain */
+};
+
+
+static void ActWriter_PutU32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v);
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+
+void ActWriter_GetCurrentTime(uint32_t Time[2])
+{
+#ifdef _WIN32
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	Time[0] = Now.dwLowDateTime;
+	Time[1] = Now.dwHighDateTime;
+#else
+	/* FILETIME: 100ns ticks since 1601-01-01 */
+	uint64_t Ticks = ((uint64_t)time(NULL) + 11644473600u) * 10000000u;
+	Time[0] = (uint32_t)Ticks;
+	Time[1] = (uint32_t)(Ticks >> 32);
+#endif
+}
+
+
+static int ActWriter_WriteRaw(ActWriter *Writer, const void *Data, size_t Size)
+{
+	const char *p = (const char*)Data;
+	TRACE_SPAN(Span)
+
+	TRACE_BEGIN(Span, TRACE_WRITE);
+	while(Size > 0)
+	{
+		unsigned int Chunk = (unsigned int)TGA2GEBMP_MIN(Size, 1u << 30);
+#ifdef _WIN32
+		int Written = _write(Writer->fd, p, Chunk);
+#else
+		ssize_t Written = write(Writer->fd, p, Chunk);
+		if(Written < 0 && errno == EINTR)
+			continue;
+#endif
+		if(Written <= 0)
+		{
+			Writer->Failed = 1;
+			return 0;
+		}
+		p += Written;
+		Size -= (size_t)Written;
+	}
+	TRACE_END(Span, 1, p - (const char*)Data);
+
+	return 1;
+}
+
+
+static int ActWriter_Flush(ActWriter *Writer)
+{
+	int Result = 1;
+
+	if(Writer->BufferUsed > 0)
+	{
+		Result = ActWriter_WriteRaw(Writer, Writer->Buffer, Writer->BufferUsed);
+		Writer->BufferUsed = 0;
+	}
+
+	return Result;
+}
+
+
+static int ActWriter_Write(ActWriter *Writer, const void *Data, uint32_t Size)
+{
+	if(Writer->Failed)
+		return 0;
+
+	Writer->Position += Size;
+	Writer->Stats.BytesWritten += Size;
+
+	if(Writer->BufferUsed + Size <= ACTWRITER_BUFFER_SIZE)
+	{
+		memcpy(Writer->Buffer + Writer->BufferUsed, Data, Size);
+		Writer->BufferUsed += Size;
+		return 1;
+	}
+
+	if(!ActWriter_Flush(Writer))
+		return 0;
+
+	// large payloads go straight out
+	if(Size >= ACTWRITER_BUFFER_SIZE)
+		return ActWriter_WriteRaw(Writer, Data, Size);
+
+	memcpy(Writer->Buffer, Data, Size);
+	Writer->BufferUsed = Size;
+	return 1;
+}
+
+
+static int ActWriter_WriteU32(ActWriter *Writer, uint32_t Value)
+{
+	unsigned char Bytes[4];
+
+	ActWriter_PutU32(Bytes, Value);
+	return ActWriter_Write(Writer, Bytes, 4);
+}
+
+
+/* overwrite already written bytes, the buffer must have been flushed */
+static int ActWriter_Patch(ActWriter *Writer, uint64_t Position, const void *Data, uint32_t Size)
+{
+#ifdef _WIN32
+	if(_lseeki64(Writer->fd, (__int64)Position, SEEK_SET) < 0)
+		return 0;
+	if(!ActWriter_WriteRaw(Writer, Data, Size))
+		return 0;
+	return _lseeki64(Writer->fd, (__int64)Writer->Position, SEEK_SET) >= 0;
+#else
+	return pwrite(Writer->fd, Data, Size, (off_t)Position) == (ssize_t)Size;
+#endif
+}
+
+
+/* raw copy from another file, falling back to a plain write of the mapped bytes */
+static int ActWriter_Splice(ActWriter *Writer, int SrcFd, uint64_t Offset, const void *Data, uint32_t Size)
+{
+	uint32_t Done = 0;
+
+	if(Writer->Failed || !ActWriter_Flush(Writer))
+		return 0;
+
+#ifndef _WIN32
+	// queued copies land in a hole the next write skips over
+	if(Writer->Queue && SrcFd >= 0)
+	{
+		if(!IoQueue_Copy(Writer->Queue, SrcFd, Offset, Writer->fd, Writer->Position, Size) ||
+		   lseek(Writer->fd, (off_t)Size, SEEK_CUR) < 0)
+		{
+			Writer->Failed = 1;
+			return 0;
+		}
+		Writer->Queued += Size;
+		Done = Size;
+	}
+#endif
+
+#if defined(__linux__)
+	if(SrcFd >= 0 && Done < Size)
+	{
+		TRACE_SPAN(Span)
+
+		TRACE_BEGIN(Span, TRACE_WRITE);
+	#ifdef SYS_copy_file_range
+		while(Done < Size)
+		{
+			loff_t SrcOffset = (loff_t)(Offset + Done);
+			long Copied = syscall(SYS_copy_file_range, SrcFd, &SrcOffset, Writer->fd, NULL, (size_t)(Size - Done), 0u);
+			if(Copied <= 0)
+				break;
+			Done += (uint32_t)Copied;
+		}
+	#endif
+		while(Done < Size)
+		{
+			off_t SrcOffset = (off_t)(Offset + Done);
+			ssize_t Copied = sendfile(Writer->fd, SrcFd, &SrcOffset, (size_t)(Size - Done));
+			if(Copied <= 0)
+				break;
+			Done += (uint32_t)Copied;
+		}
+		TRACE_END(Span, 1, Done);
+	}
+#else
+	(void)SrcFd;
+	(void)Offset;
+#endif
+
+	if(Done < Size && !ActWriter_WriteRaw(Writer, (const char*)Data + Done, Size - Done))
+		return 0;
+
+	Writer->Position += Size;
+	Writer->Stats.BytesWritten += Size;
+	Writer->Stats.BytesSpliced += Size;
+	return 1;
+}
+
+
+static char *ActWriter_StrDup(const char *Str)
+{
+	char *Copy = (char*)malloc(strlen(Str) + 1);
+
+	if(Copy)
+		strcpy(Copy, Str);
+
+	return Copy;
+}
+
+
+static int ActWriter_AddNode(ActWriter *Writer, int Parent, const char *Name, const ActWriter_Props *Props)
+{
+	ActWriter_Node *Node;
+	int n;
+
+	if(Writer->NodeCount == Writer->NodeCapacity)
+	{
+		ActWriter_Node *NewNodes;
+		int NewCapacity = Writer->NodeCapacity ? Writer->NodeCapacity * 2 : 64;
+
+		NewNodes = (ActWriter_Node*)realloc(Writer->Nodes, NewCapacity * sizeof(ActWriter_Node));
+		if(!NewNodes)
+			return -1;
+
+		Writer->Nodes = NewNodes;
+		Writer->NodeCapacity = NewCapacity;
+	}
+
+	n = Writer->NodeCount;
+	Node = &Writer->Nodes[n];
+	memset(Node, 0, sizeof(*Node));
+	Node->Parent = Parent;
+	Node->FirstChild = -1;
+	Node->LastChild = -1;
+	Node->NextSibling = -1;
+
+	Node->Name = ActWriter_StrDup(Name);
+	if(!Node->Name)
+		return -1;
+
+	if(Props)
+	{
+		Node->Time[0] = Props->Time[0];
+		Node->Time[1] = Props->Time[1];
+		Node->Attributes = Props->Attributes;
+		if(Props->HintsSize > 0)
+		{
+			Node->Hints = malloc(Props->HintsSize);
+			if(!Node->Hints)
+			{
+				free(Node->Name);
+				return -1;
+			}
+			memcpy(Node->Hints, Props->Hints, Props->HintsSize);
+			Node->HintsSize = Props->HintsSize;
+		}
+	}
+	else
+	{
+		ActWriter_GetCurrentTime(Node->Time);
+	}
+
+	Writer->NodeCount++;
+
+	if(Parent >= 0)
+	{
+		ActWriter_Node *ParentNode = &Writer->Nodes[Parent];
+
+		if(ParentNode->LastChild >= 0)
+			Writer->Nodes[ParentNode->LastChild].NextSibling = n;
+		else
+			ParentNode->FirstChild = n;
+		ParentNode->LastChild = n;
+	}
+
+	return n;
+}
+
+
+static ActWriter_Level *ActWriter_CurrentLevel(ActWriter *Writer)
+{
+	return &Writer->Levels[Writer->LevelCount - 1];
+}
+
+
+static int ActWriter_PushLevel(ActWriter *Writer, int File)
+{
+	ActWriter_Level *Level;
+	unsigned char Header[ACTINDEX_VFS_HEADER_SIZE];
+
+	if(Writer->LevelCount == ACTWRITER_MAX_LEVELS)
+		return 0;
+
+	Level = &Writer->Levels[Writer->LevelCount];
+	Level->Base = Writer->Position;
+	Level->File = File;
+	Level->Root = ActWriter_AddNode(Writer, -1, "", NULL);
+	if(Level->Root < 0)
+		return 0;
+	// the root carries no time so unchanged containers come out byte for byte
+	Writer->Nodes[Level->Root].Time[0] = 0;
+	Writer->Nodes[Level->Root].Time[1] = 0;
+	Writer->Nodes[Level->Root].Attributes = ACTINDEX_ATTRIB_DIRECTORY;
+	Level->Directory = Level->Root;
+	Writer->LevelCount++;
+
+	// placeholder, filled in when the container is closed
+	memset(Header, 0, sizeof(Header));
+	return ActWriter_Write(Writer, Header, sizeof(Header));
+}
+
+
+static int ActWriter_WriteTree(ActWriter *Writer, int Root)
+{
+	int *Stack;
+	int StackCount = 0;
+	int StackCapacity = 64;
+	int Result = 1;
+
+	Stack = (int*)malloc(StackCapacity * sizeof(int));
+	if(!Stack)
+		return 0;
+
+	// pre-order: node, its children list, then its siblings list
+	Stack[StackCount++] = Root;
+	while(Result && StackCount > 0)
+	{
+		int n = Stack[--StackCount];
+		const ActWriter_Node *Node;
+		uint32_t NameLength;
+
+		if(n < 0)
+		{
+			Result = ActWriter_WriteU32(Writer, ACTWRITER_LIST_TERMINATED);
+			continue;
+		}
+
+		Node = &Writer->Nodes[n];
+		NameLength = (uint32_t)strlen(Node->Name) + 1;
+
+		Result = ActWriter_WriteU32(Writer, 0) &&
+				 ActWriter_WriteU32(Writer, NameLength) &&
+				 ActWriter_Write(Writer, Node->Name, NameLength) &&
+				 ActWriter_WriteU32(Writer, Node->Time[0]) &&
+				 ActWriter_WriteU32(Writer, Node->Time[1]) &&
+				 ActWriter_WriteU32(Writer, Node->Attributes) &&
+				 ActWriter_WriteU32(Writer, Node->Size) &&
+				 ActWriter_WriteU32(Writer, Node->Offset) &&
+				 ActWriter_WriteU32(Writer, Node->HintsSize) &&
+				 (Node->HintsSize == 0 || ActWriter_Write(Writer, Node->Hints, Node->HintsSize));
+
+		if(StackCount + 2 > StackCapacity)
+		{
+			int *NewStack;
+			StackCapacity *= 2;
+			NewStack = (int*)realloc(Stack, StackCapacity * sizeof(int));
+			if(!NewStack)
+			{
+				Result = 0;
+				break;
+			}
+			Stack = NewStack;
+		}
+		Stack[StackCount++] = (n == Root) ? -1 : Node->NextSibling;
+		Stack[StackCount++] = Node->FirstChild;
+	}
+
+	free(Stack);
+	return Result;
+}
+
+
+static int ActWriter_PopLevel(ActWriter *Writer)
+{
+	ActWriter_Level *Level = ActWriter_CurrentLevel(Writer);
+	unsigned char Header[ACTINDEX_VFS_HEADER_SIZE];
+	uint64_t DirectoryPosition = Writer->Position;
+	uint32_t TreeSize;
+
+	if(Level->Directory != Level->Root)
+		return 0;
+
+	if(!ActWriter_WriteU32(Writer, ACTINDEX_DIRTREE_SIGNATURE) || !ActWriter_WriteU32(Writer, 0))
+		return 0;
+	if(!ActWriter_WriteTree(Writer, Level->Root))
+		return 0;
+	if(!ActWriter_Flush(Writer))
+		return 0;
+
+	TreeSize = (uint32_t)(Writer->Position - DirectoryPosition - 8);
+	ActWriter_PutU32(Header, TreeSize);
+	if(!ActWriter_Patch(Writer, DirectoryPosition + 4, Header, 4))
+		return 0;
+
+	memset(Header, 0, sizeof(Header));
+	ActWriter_PutU32(Header, ACTINDEX_VFS_SIGNATURE);
+	ActWriter_PutU32(Header + 12, (uint32_t)(DirectoryPosition - Level->Base));
+	ActWriter_PutU32(Header + 16, (uint32_t)(DirectoryPosition - Level->Base - ACTINDEX_VFS_HEADER_SIZE));
+	ActWriter_PutU32(Header + 20, (uint32_t)(Writer->Position - Level->Base));
+	if(!ActWriter_Patch(Writer, Level->Base, Header, sizeof(Header)))
+		return 0;
+
+	if(Level->File >= 0)
+	{
+		ActWriter_Node *File = &Writer->Nodes[Level->File];
+		File->Size = (uint32_t)(Writer->Position - Level->Base);
+	}
+
+	Writer->LevelCount--;
+	return 1;
+}
+
+
+// a temporary file next to the target that no other save, in this process
+// or another, can have open. It is given the target's permissions, so the
+// rename does not change them
+static int ActWriter_OpenTemp(ActWriter *Writer)
+{
+#ifdef _WIN32
+	static volatile LONG Counter = 0;
+#else
+	static unsigned long Counter = 0;
+	struct stat Stat;
+#endif
+	int fd = -1;
+	int i;
+
+	// a name left behind by a crashed process with the same id is skipped
+	for(i = 0; i < 100 && fd < 0; i++)
+	{
+		unsigned Length;
+
+#ifdef _WIN32
+		Length = (unsigned)snprintf(Writer->TempFileName, sizeof(Writer->TempFileName), "%s.%d.%ld.tmp",
+									Writer->FileName, (int)getpid(), (long)InterlockedIncrement(&Counter));
+		if(Length >= sizeof(Writer->TempFileName))
+			break;
+		fd = _open(Writer->TempFileName, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		Length = (unsigned)snprintf(Writer->TempFileName, sizeof(Writer->TempFileName), "%s.%d.%lu.tmp",
+									Writer->FileName, (int)getpid(), __atomic_add_fetch(&Counter, 1, __ATOMIC_RELAXED));
+		if(Length >= sizeof(Writer->TempFileName))
+			break;
+		fd = open(Writer->TempFileName, O_WRONLY | O_CREAT | O_EXCL, 0666);
+#endif
+		if(fd < 0 && errno != EEXIST)
+			break;
+	}
+
+#ifndef _WIN32
+	if(fd >= 0 && stat(Writer->FileName, &Stat) == 0)
+		fchmod(fd, Stat.st_mode & 07777);
+#endif
+
+	return fd;
+}
+
+
+ActWriter *ActWriter_Create(const char *FileName)
+{
+	ActWriter *Writer;
+
+	Writer = (ActWriter*)calloc(1, sizeof(ActWriter));
+	if(!Writer)
+		return NULL;
+
+	Writer->Buffer = (unsigned char*)malloc(ACTWRITER_BUFFER_SIZE);
+	if(!Writer->Buffer)
+	{
+		free(Writer);
+		return NULL;
+	}
+
+	strncpy(Writer->FileName, FileName, sizeof(Writer->FileName) - 1);
+
+	Writer->fd = ActWriter_OpenTemp(Writer);
+	if(Writer->fd < 0)
+	{
+		free(Writer->Buffer);
+		free(Writer);
+		return NULL;
+	}
+
+	if(!ActWriter_PushLevel(Writer, -1))
+	{
+		ActWriter_Abort(&Writer);
+		return NULL;
+	}
+
+	return Writer;
+}
+
+
+static void ActWriter_Free(ActWriter *Writer)
+{
+	int i;
+
+	if(Writer->fd >= 0)
+	{
+#ifdef _WIN32
+		_close(Writer->fd);
+#else
+		close(Writer->fd);
+#endif
+	}
+
+	for(i = 0; i < Writer->NodeCount; i++)
+	{
+		free(Writer->Nodes[i].Name);
+		free(Writer->Nodes[i].Hints);
+	}
+
+	free(Writer->Nodes);
+	free(Writer->Buffer);
+	free(Writer);
+}
+
+
+void ActWriter_Abort(ActWriter **pWriter)
+{
+	ActWriter *Writer = *pWriter;
+
+	if(!Writer)
+		return;
+
+#ifndef _WIN32
+	// the queue may still be writing to the file
+	if(Writer->Queue)
+		IoQueue_Wait(Writer->Queue);
+#endif
+
+	if(Writer->fd >= 0)
+	{
+#ifdef _WIN32
+		_close(Writer->fd);
+#else
+		close(Writer->fd);
+#endif
+		Writer->fd = -1;
+	}
+	remove(Writer->TempFileName);
+
+	ActWriter_Free(Writer);
+	*pWriter = NULL;
+}
+
+
+int ActWriter_Commit(ActWriter **pWriter, ActWriter_Stats *Stats)
+{
+	ActWriter *Writer = *pWriter;
+	int Result;
+
+	Result = !Writer->Failed && Writer->LevelCount == 1 && ActWriter_PopLevel(Writer);
+
+	Result = ActWriter_Drain(Writer) && Result;
+
+#ifndef _WIN32
+	if(Result)
+		Result = fsync(Writer->fd) == 0;
+	Result = (close(Writer->fd) == 0) && Result;
+#else
+	Result = (_close(Writer->fd) == 0) && Result;
+#endif
+	Writer->fd = -1;
+
+	if(Result)
+	{
+#ifdef _WIN32
+		Result = MoveFileExA(Writer->TempFileName, Writer->FileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		Result = rename(Writer->TempFileName, Writer->FileName) == 0;
+#endif
+	}
+
+	if(!Result)
+		remove(Writer->TempFileName);
+
+	if(Stats)
+		*Stats = Writer->Stats;
+
+	ActWriter_Free(Writer);
+	*pWriter = NULL;
+
+	return Result;
+}
+
+
+void ActWriter_SetIoQueue(ActWriter *Writer, IoQueue *Queue)
+{
+	Writer->Queue = Queue;
+}
+
+
+int ActWriter_Drain(ActWriter *Writer)
+{
+#ifndef _WIN32
+	TRACE_SPAN(Span)
+
+	if(!Writer->Queue || Writer->Queued == 0)
+		return !Writer->Failed;
+
+	TRACE_BEGIN(Span, TRACE_WRITE);
+	if(!IoQueue_Wait(Writer->Queue))
+		Writer->Failed = 1;
+	TRACE_END(Span, 1, Writer->Queued);
+
+	Writer->Queued = 0;
+#endif
+	return !Writer->Failed;
+}
+
+
+int ActWriter_BeginDirectory(ActWriter *Writer, const char *Name, const ActWriter_Props *Props)
+{
+	ActWriter_Level *Level = ActWriter_CurrentLevel(Writer);
+	int n;
+
+	n = ActWriter_AddNode(Writer, Level->Directory, Name, Props);
+	if(n < 0)
+		return 0;
+
+	Writer->Nodes[n].Attributes |= ACTINDEX_ATTRIB_DIRECTORY;
+	Level->Directory = n;
+	return 1;
+}
+
+
+int ActWriter_EndDirectory(ActWriter *Writer)
+{
+	ActWriter_Level *Level = ActWriter_CurrentLevel(Writer);
+
+	if(Level->Directory == Level->Root)
+		return 0;
+
+	Level->Directory = Writer->Nodes[Level->Directory].Parent;
+	return 1;
+}
+
+
+int ActWriter_BeginContainer(ActWriter *Writer, const char *Name, const ActWriter_Props *Props)
+{
+	ActWriter_Level *Level = ActWriter_CurrentLevel(Writer);
+	int n;
+
+	n = ActWriter_AddNode(Writer, Level->Directory, Name, Props);
+	if(n < 0)
+		return 0;
+
+	Writer->Nodes[n].Attributes &= ~ACTINDEX_ATTRIB_DIRECTORY;
+	Writer->Nodes[n].Offset = (uint32_t)(Writer->Position - Level->Base);
+
+	return ActWriter_PushLevel(Writer, n);
+}
+
+
+int ActWriter_EndContainer(ActWriter *Writer)
+{
+	if(Writer->LevelCount < 2)
+		return 0;
+
+	return ActWriter_PopLevel(Writer);
+}
+
+
+static int ActWriter_AddFileNode(ActWriter *Writer, const char *Name, uint32_t Size, const ActWriter_Props *Props)
+{
+	ActWriter_Level *Level = ActWriter_CurrentLevel(Writer);
+	int n;
+
+	n = ActWriter_AddNode(Writer, Level->Directory, Name, Props);
+	if(n < 0)
+		return 0;
+
+	Writer->Nodes[n].Attributes &= ~ACTINDEX_ATTRIB_DIRECTORY;
+	Writer->Nodes[n].Offset = (uint32_t)(Writer->Position - Level->Base);
+	Writer->Nodes[n].Size = Size;
+	return 1;
+}
+
+
+int ActWriter_AddData(ActWriter *Writer, const char *Name, const void *Data, uint32_t Size, const ActWriter_Props *Props)
+{
+	if(!ActWriter_AddFileNode(Writer, Name, Size, Props))
+		return 0;
+
+	Writer->Stats.EntriesWritten++;
+	return ActWriter_Write(Writer, Data, Size);
+}
+
+
+void ActWriter_GetProps(const ActIndex *Index, const ActIndex_Entry *Entry, ActWriter_Props *Props)
+{
+	Props->Time[0] = Entry->Time[0];
+	Props->Time[1] = Entry->Time[1];
+	Props->Attributes = Entry->Attributes;
+	Props->Hints = ActIndex_GetHints(Index, Entry);
+	Props->HintsSize = Entry->HintsSize;
+}
+
+
+int ActWriter_AddIndexedFile(ActWriter *Writer, const ActIndex *Index, const ActIndex_Entry *Entry)
+{
+	ActWriter_Props Props;
+
+	if(Entry->Flags & ACTINDEX_DIRECTORY)
+		return 0;
+
+	ActWriter_GetProps(Index, Entry, &Props);
+	if(!ActWriter_AddFileNode(Writer, Entry->Name, Entry->Size, &Props))
+		return 0;
+
+	Writer->Stats.EntriesSpliced++;
+	return ActWriter_Splice(Writer, ActIndex_GetFileDescriptor(Index), Entry->Offset, ActIndex_GetData(Index, Entry), Entry->Size);
+}
+
+
+int ActWriter_AddIndexedTree(ActWriter *Writer, const ActIndex *Index, const ActIndex_Entry *Entry)
+{
+	ActWriter_Props Props;
+	int e;
+
+	if(!(Entry->Flags & ACTINDEX_DIRECTORY))
+		return ActWriter_AddIndexedFile(Writer, Index, Entry);
+
+	ActWriter_GetProps(Index, Entry, &Props);
+	if(!ActWriter_BeginDirectory(Writer, Entry->Name, &Props))
+		return 0;
+
+	for(e = Entry->FirstChild; e >= 0; e = ActIndex_GetEntry(Index, e)->NextSibling)
+	{
+		if(!ActWriter_AddIndexedTree(Writer, Index, ActIndex_GetEntry(Index, e)))
+			return 0;
+	}
+
+	return ActWriter_EndDirectory(Writer);
+}
+
+
+void ActWriter_GetStats(const ActWriter *Writer, ActWriter_Stats *Stats)
+{
+	*Stats = Writer->Stats;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file actwriter.h
+ *
+ * Single-pass writer for Genesis virtual files (see actindex.h for the
+ * layout). Entries are streamed to a temporary file next to the target in
+ * the order they are added; nested containers such as an actor's Body are
+ * written inline and their headers patched when they are closed. Unchanged
+ * entries of an indexed source are spliced as raw byte ranges, with
+ * copy_file_range or sendfile where the platform has them, or on an
+ * IoQueue (ioqueue.h) that keeps several of them in flight while the rest
+ * of the file is written. Commit renames the finished file over the target.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef ACTWRITER_H
+#define ACTWRITER_H
+
+#include "platform.h"
+#include "actindex.h"
+#include "ioqueue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ActWriter ActWriter;
+
+/* directory attributes of a new entry, NULL means "now, no attributes, no hints" */
+typedef struct	ActWriter_Props
+{
+	uint32_t		Time[2];
+	uint32_t		Attributes;
+	const void		*Hints;
+	uint32_t		HintsSize;
+}	ActWriter_Props;
+
+typedef struct	ActWriter_Stats
+{
+	uint64_t		BytesWritten;	/* everything that went to the output file */
+	uint64_t		BytesSpliced;	/* part of BytesWritten copied raw from a source */
+	int				EntriesWritten;	/* files written from memory */
+	int				EntriesSpliced;	/* files copied raw from a source */
+}	ActWriter_Stats;
+
+ActWriter *ActWriter_Create(const char *FileName);
+/* finish the file and atomically replace the target with it, Stats may be NULL */
+int ActWriter_Commit(ActWriter **pWriter, ActWriter_Stats *Stats);
+/* throw the temporary file away, the target is left untouched */
+void ActWriter_Abort(ActWriter **pWriter);
+
+/* splice through Queue from now on, NULL for the synchronous copies; the
+   queue is waited for by Commit and Abort, and must outlive the writer */
+void ActWriter_SetIoQueue(ActWriter *Writer, IoQueue *Queue);
+/* waits for the splices queued so far, after which their sources may be
+   closed; 0 if one of them failed */
+int ActWriter_Drain(ActWriter *Writer);
+
+int ActWriter_BeginDirectory(ActWriter *Writer, const char *Name, const ActWriter_Props *Props);
+int ActWriter_EndDirectory(ActWriter *Writer);
+int ActWriter_BeginContainer(ActWriter *Writer, const char *Name, const ActWriter_Props *Props);
+int ActWriter_EndContainer(ActWriter *Writer);
+
+int ActWriter_AddData(ActWriter *Writer, const char *Name, const void *Data, uint32_t Size, const ActWriter_Props *Props);
+/* raw copy of an indexed file entry, keeping its name and attributes */
+int ActWriter_AddIndexedFile(ActWriter *Writer, const ActIndex *Index, const ActIndex_Entry *Entry);
+/* raw copy of an indexed entry and everything below it */
+int ActWriter_AddIndexedTree(ActWriter *Writer, const ActIndex *Index, const ActIndex_Entry *Entry);
+
+/* the current time as a FILETIME, for entries that were changed */
+void ActWriter_GetCurrentTime(uint32_t Time[2]);
+void ActWriter_GetProps(const ActIndex *Index, const ActIndex_Entry *Entry, ActWriter_Props *Props);
+void ActWriter_GetStats(const ActWriter *Writer, ActWriter_Stats *Stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,514 @@
+/**
+ * @file convcache.c
+ *
+ * On-disk conversion cache, see convcache.h.
+ */
+#include <stdio.h>
+#include "convcache.h"
+#include "fasthash.h"
+#include "threadpool.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <direct.h>
+	#include <process.h>
+	#include <sys/types.h>
+	#include <sys/utime.h>
+	#define getpid			_getpid
+	#define utime			_utime
+	#define mkdir(d, m)		_mkdir(d)
+#else
+	#include <dirent.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <utime.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+#endif
+
+#define CONVCACHE_MAGIC				0x31434754	/* 'TGC1' */
+#define CONVCACHE_HEADER_SIZE		40
+#define CONVCACHE_EXT				".gbm"
+#define CONVCACHE_KEY_CHARS			32
+#define CONVCACHE_CHUNK_SIZE		(1 << 20)	/* read at a time by ConvCache_MakeFileKey */
+/* temporary files this old were left by a process that died while storing */
+#define CONVCACHE_STALE_SECONDS		3600
+
+typedef struct	ConvCache_File
+{
+	char		Name[CONVCACHE_KEY_CHARS + 16];
+	uint64_t	Size;
+	uint64_t	Time;			/* last write, only compared with each other */
+}	ConvCache_File;
+
+struct ConvCache
+{
+	char			Dir[_MAX_PATH];
+	ThreadPool_Gate	*Lock;			/* a gate of one, guards the fields below */
+	ConvCache_Stats	Stats;
+	unsigned		TempCount;
+	int				Evicting;
+};
+
+
+static void ConvCache_Put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+
+static void ConvCache_Put64(uint8_t *p, uint64_t v)
+{
+	ConvCache_Put32(p, (uint32_t)v);
+	ConvCache_Put32(p + 4, (uint32_t)(v >> 32));
+}
+
+
+static uint32_t ConvCache_Get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static uint64_t ConvCache_Get64(const uint8_t *p)
+{
+	return (uint64_t)ConvCache_Get32(p) | ((uint64_t)ConvCache_Get32(p + 4) << 32);
+}
+
+
+// Path holds _MAX_PATH characters; 0 if the name does not fit
+static int ConvCache_GetPath(const ConvCache *Cache, const ConvCache_Key *Key, char *Path)
+{
+	static const char Hex[] = "0123456789abcdef";
+	char Name[CONVCACHE_KEY_CHARS + 1];
+	int i;
+
+	for(i = 0; i < CONVCACHE_KEY_CHARS; i++)
+		Name[i] = Hex[(Key->Hash[i / 16] >> (60 - (i % 16) * 4)) & 15];
+	Name[CONVCACHE_KEY_CHARS] = '\0';
+
+	return (unsigned)snprintf(Path, _MAX_PATH, "%s" TGA2GEBMP_DIRSEP "%s" CONVCACHE_EXT, Cache->Dir, Name) < _MAX_PATH;
+}
+
+
+static int ConvCache_HasSuffix(const char *Name, const char *Suffix)
+{
+	size_t Length = strlen(Name);
+	size_t SuffixLength = strlen(Suffix);
+
+	return Length > SuffixLength && tga2gebmp_stricmp(Name + Length - SuffixLength, Suffix) == 0;
+}
+
+
+// every entry in the directory, stale temporary files are deleted on the way
+static int ConvCache_Scan(const ConvCache *Cache, ConvCache_File **pFiles, int *pCount)
+{
+	ConvCache_File *Files = NULL;
+	int Count = 0;
+	int Capacity = 0;
+	char Path[_MAX_PATH];
+	const char *Name;
+	uint64_t Size, Time;
+	int IsStaleTemp;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA Find;
+	HANDLE FindHandle;
+	FILETIME Now;
+
+	GetSystemTimeAsFileTime(&Now);
+
+	if((unsigned)snprintf(Path, sizeof(Path), "%s\\*", Cache->Dir) >= sizeof(Path))
+		return 0;
+	FindHandle = FindFirstFileA(Path, &Find);
+	if(FindHandle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	do
+	{
+		if(Find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		Name = Find.cFileName;
+		Size = ((uint64_t)Find.nFileSizeHigh << 32) | Find.nFileSizeLow;
+		Time = ((uint64_t)Find.ftLastWriteTime.dwHighDateTime << 32) | Find.ftLastWriteTime.dwLowDateTime;
+		IsStaleTemp = ((((uint64_t)Now.dwHighDateTime << 32) | Now.dwLowDateTime) - Time) / 10000000 > CONVCACHE_STALE_SECONDS;
+#else
+	DIR *DirHandle;
+	struct dirent *Ent;
+	struct stat Stat;
+
+	DirHandle = opendir(Cache->Dir);
+	if(!DirHandle)
+		return 0;
+
+	while((Ent = readdir(DirHandle)) != NULL)
+	{
+		Name = Ent->d_name;
+		if((unsigned)snprintf(Path, sizeof(Path), "%s/%s", Cache->Dir, Name) >= sizeof(Path))
+			continue;
+
+		if(stat(Path, &Stat) != 0 || !S_ISREG(Stat.st_mode))
+			continue;
+
+		Size = (uint64_t)Stat.st_size;
+		Time = (uint64_t)Stat.st_mtime;
+		IsStaleTemp = time(NULL) - Stat.st_mtime > CONVCACHE_STALE_SECONDS;
+#endif
+
+		if(ConvCache_HasSuffix(Name, ".tmp"))
+		{
+			if(IsStaleTemp && (unsigned)snprintf(Path, sizeof(Path), "%s" TGA2GEBMP_DIRSEP "%s", Cache->Dir, Name) < sizeof(Path))
+				remove(Path);
+			continue;
+		}
+
+		if(!ConvCache_HasSuffix(Name, CONVCACHE_EXT) || strlen(Name) >= sizeof(Files->Name))
+			continue;
+
+		if(Count == Capacity)
+		{
+			ConvCache_File *NewFiles;
+
+			Capacity = Capacity ? Capacity * 2 : 256;
+			NewFiles = (ConvCache_File*)realloc(Files, Capacity * sizeof(ConvCache_File));
+			if(!NewFiles)
+				break;
+			Files = NewFiles;
+		}
+
+		strcpy(Files[Count].Name, Name);
+		Files[Count].Size = Size;
+		Files[Count].Time = Time;
+		Count++;
+
+#ifdef _WIN32
+	}
+	while(FindNextFileA(FindHandle, &Find));
+
+	FindClose(FindHandle);
+#else
+	}
+
+	closedir(DirHandle);
+#endif
+
+	*pFiles = Files;
+	*pCount = Count;
+	return 1;
+}
+
+
+static int ConvCache_CompareTime(const void *a, const void *b)
+{
+	const ConvCache_File *FileA = (const ConvCache_File*)a;
+	const ConvCache_File *FileB = (const ConvCache_File*)b;
+
+	if(FileA->Time != FileB->Time)
+		return FileA->Time < FileB->Time ? -1 : 1;
+
+	return strcmp(FileA->Name, FileB->Name);
+}
+
+
+// rescan the directory, which other processes may have changed too, and
+// delete the oldest entries until it is under the low-water mark
+static void ConvCache_Evict(ConvCache *Cache)
+{
+	ConvCache_File *Files = NULL;
+	int Count = 0;
+	uint64_t Size = 0;
+	uint64_t Target;
+	uint64_t Evictions = 0;
+	char Path[_MAX_PATH];
+	int i;
+
+	if(!ConvCache_Scan(Cache, &Files, &Count))
+		return;
+
+	for(i = 0; i < Count; i++)
+		Size += Files[i].Size;
+
+	Target = Cache->Stats.MaxSize - Cache->Stats.MaxSize / 10;
+	if(Size > Cache->Stats.MaxSize)
+	{
+		qsort(Files, Count, sizeof(ConvCache_File), ConvCache_CompareTime);
+
+		for(i = 0; i < Count && Size > Target; i++)
+		{
+			// a file another process has open may refuse to go on Windows
+			if((unsigned)snprintf(Path, sizeof(Path), "%s" TGA2GEBMP_DIRSEP "%s", Cache->Dir, Files[i].Name) < sizeof(Path) &&
+			   remove(Path) == 0)
+			{
+				Size -= Files[i].Size;
+				Evictions++;
+			}
+		}
+	}
+
+	free(Files);
+
+	ThreadPool_EnterGate(Cache->Lock);
+	Cache->Stats.Size = Size;
+	Cache->Stats.Evictions += Evictions;
+	ThreadPool_LeaveGate(Cache->Lock);
+}
+
+
+ConvCache *ConvCache_Open(const char *Dir, uint64_t MaxSize)
+{
+	ConvCache *Cache;
+	ConvCache_File *Files = NULL;
+	int Count = 0;
+	int i;
+
+	if(strlen(Dir) + CONVCACHE_KEY_CHARS + 32 >= _MAX_PATH)
+		return NULL;
+
+	// an existing directory is fine, a missing one shows up in the scan
+	mkdir(Dir, 0777);
+
+	Cache = (ConvCache*)calloc(1, sizeof(ConvCache));
+	if(!Cache)
+		return NULL;
+
+	strcpy(Cache->Dir, Dir);
+	Cache->Stats.MaxSize = MaxSize ? MaxSize : CONVCACHE_DEFAULT_SIZE;
+
+	Cache->Lock = ThreadPool_CreateGate(1);
+	if(!Cache->Lock || !ConvCache_Scan(Cache, &Files, &Count))
+	{
+		ConvCache_Close(&Cache);
+		return NULL;
+	}
+
+	for(i = 0; i < Count; i++)
+		Cache->Stats.Size += Files[i].Size;
+	free(Files);
+
+	if(Cache->Stats.Size > Cache->Stats.MaxSize)
+		ConvCache_Evict(Cache);
+
+	return Cache;
+}
+
+
+void ConvCache_Close(ConvCache **pCache)
+{
+	ConvCache *Cache = *pCache;
+
+	if(!Cache)
+		return;
+
+	ThreadPool_DestroyGate(&Cache->Lock);
+	free(Cache);
+
+	*pCache = NULL;
+}
+
+
+void ConvCache_MakeKey(ConvCache_Key *Key, const void *Source, size_t SourceSize, const void *Params, size_t ParamsSize)
+{
+	uint64_t Seed = FastHash_64(Params, ParamsSize, 0);
+
+	// two independent 64-bit hashes, a collision would hand out the wrong skin
+	Key->Hash[0] = FastHash_64(Source, SourceSize, Seed);
+	Key->Hash[1] = FastHash_64(Source, SourceSize, ~Seed);
+}
+
+
+int ConvCache_MakeFileKey(ConvCache_Key *Key, const char *FileName, const void *Params, size_t ParamsSize)
+{
+	uint64_t Seed = FastHash_64(Params, ParamsSize, 0);
+	uint64_t Hash[2];
+	uint64_t Size = 0;
+	uint8_t *Chunk;
+	size_t Read;
+	FILE *File;
+	int Result;
+
+	File = fopen(FileName, "rb");
+	if(!File)
+		return 0;
+
+	Chunk = (uint8_t *)malloc(CONVCACHE_CHUNK_SIZE);
+	if(!Chunk)
+	{
+		fclose(File);
+		return 0;
+	}
+
+	// each chunk's hash seeds the next one's
+	Hash[0] = Seed;
+	Hash[1] = ~Seed;
+	while((Read = fread(Chunk, 1, CONVCACHE_CHUNK_SIZE, File)) > 0)
+	{
+		Hash[0] = FastHash_64(Chunk, Read, Hash[0]);
+		Hash[1] = FastHash_64(Chunk, Read, Hash[1]);
+		Size += Read;
+	}
+
+	Result = !ferror(File);
+	fclose(File);
+	free(Chunk);
+
+	Key->Hash[0] = FastHash_64(&Size, sizeof(Size), Hash[0]);
+	Key->Hash[1] = FastHash_64(&Size, sizeof(Size), Hash[1]);
+	return Result;
+}
+
+
+int ConvCache_Load(ConvCache *Cache, const ConvCache_Key *Key, ConvCache_AllocFunc Alloc, ConvCache_FreeFunc Free,
+				   void **pData, size_t *pSize)
+{
+	char Path[_MAX_PATH];
+	uint8_t Header[CONVCACHE_HEADER_SIZE];
+	FILE *File;
+	void *Data = NULL;
+	uint64_t Size = 0;
+	int Hit = 0;
+	int OutOfMemory = 0;
+
+	File = ConvCache_GetPath(Cache, Key, Path) ? fopen(Path, "rb") : NULL;
+	if(File)
+	{
+		if(fread(Header, 1, sizeof(Header), File) == sizeof(Header) &&
+		   ConvCache_Get32(Header) == CONVCACHE_MAGIC &&
+		   ConvCache_Get64(Header + 8) == Key->Hash[0] &&
+		   ConvCache_Get64(Header + 16) == Key->Hash[1])
+		{
+			Size = ConvCache_Get64(Header + 24);
+			if(Size > 0 && Size == (size_t)Size)
+			{
+				Data = Alloc ? Alloc((size_t)Size) : malloc((size_t)Size);
+				OutOfMemory = !Data;
+			}
+
+			if(Data && fread(Data, 1, (size_t)Size, File) == (size_t)Size &&
+			   FastHash_64(Data, (size_t)Size, 0) == ConvCache_Get64(Header + 32))
+				Hit = 1;
+		}
+
+		fclose(File);
+
+		if(Hit)
+		{
+			// the modification time is the LRU clock
+			utime(Path, NULL);
+		}
+		else if(!OutOfMemory)
+		{
+			// truncated or corrupt, don't trip over it again; running out of
+			// memory says nothing about the entry
+			remove(Path);
+		}
+	}
+
+	ThreadPool_EnterGate(Cache->Lock);
+	if(Hit)
+	{
+		Cache->Stats.Hits++;
+		Cache->Stats.BytesRead += Size;
+	}
+	else
+	{
+		Cache->Stats.Misses++;
+	}
+	ThreadPool_LeaveGate(Cache->Lock);
+
+	if(!Hit)
+	{
+		if(Data)
+		{
+			if(Free)
+				Free(Data);
+			else
+				free(Data);
+		}
+		return 0;
+	}
+
+	*pData = Data;
+	*pSize = (size_t)Size;
+	return 1;
+}
+
+
+int ConvCache_Store(ConvCache *Cache, const ConvCache_Key *Key, const void *Data, size_t Size)
+{
+	char Path[_MAX_PATH];
+	char TempPath[_MAX_PATH];
+	uint8_t Header[CONVCACHE_HEADER_SIZE];
+	FILE *File;
+	unsigned TempCount;
+	int Ok, Evict;
+
+	if(!ConvCache_GetPath(Cache, Key, Path))
+		return 0;
+
+	ThreadPool_EnterGate(Cache->Lock);
+	TempCount = Cache->TempCount++;
+	ThreadPool_LeaveGate(Cache->Lock);
+
+	if((unsigned)snprintf(TempPath, sizeof(TempPath), "%s.%d.%u.tmp", Path, (int)getpid(), TempCount) >= sizeof(TempPath))
+		return 0;
+
+	memset(Header, 0, sizeof(Header));
+	ConvCache_Put32(Header, CONVCACHE_MAGIC);
+	ConvCache_Put64(Header + 8, Key->Hash[0]);
+	ConvCache_Put64(Header + 16, Key->Hash[1]);
+	ConvCache_Put64(Header + 24, (uint64_t)Size);
+	ConvCache_Put64(Header + 32, FastHash_64(Data, Size, 0));
+
+	File = fopen(TempPath, "wb");
+	if(!File)
+		return 0;
+
+	Ok = fwrite(Header, 1, sizeof(Header), File) == sizeof(Header) &&
+		 fwrite(Data, 1, Size, File) == Size;
+	Ok = fclose(File) == 0 && Ok;
+
+	// readers only ever see complete entries
+#ifdef _WIN32
+	Ok = Ok && MoveFileExA(TempPath, Path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	Ok = Ok && rename(TempPath, Path) == 0;
+#endif
+
+	if(!Ok)
+	{
+		remove(TempPath);
+		return 0;
+	}
+
+	ThreadPool_EnterGate(Cache->Lock);
+	Cache->Stats.Stores++;
+	Cache->Stats.BytesStored += Size;
+	Cache->Stats.Size += CONVCACHE_HEADER_SIZE + Size;
+	Evict = Cache->Stats.Size > Cache->Stats.MaxSize && !Cache->Evicting;
+	if(Evict)
+		Cache->Evicting = 1;
+	ThreadPool_LeaveGate(Cache->Lock);
+
+	if(Evict)
+	{
+		ConvCache_Evict(Cache);
+
+		ThreadPool_EnterGate(Cache->Lock);
+		Cache->Evicting = 0;
+		ThreadPool_LeaveGate(Cache->Lock);
+	}
+
+	return 1;
+}
+
+
+void ConvCache_GetStats(ConvCache *Cache, ConvCache_Stats *Stats)
+{
+	ThreadPool_EnterGate(Cache->Lock);
+	*Stats = Cache->Stats;
+	ThreadPool_LeaveGate(Cache->Lock);
+}
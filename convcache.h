@@ -0,0 +1,77 @@
+/**
+ * @file convcache.h
+ *
+ * Persistent, content-addressed cache of converted skins. An entry maps a
+ * 128-bit key, made from the bytes of a source image and the parameters it
+ * was encoded with, to the encoded geBitmap file, so an image that has been
+ * converted once is never decoded or encoded again by any build.
+ *
+ * Entries are files "<key>.gbm" in one directory, each with a small header
+ * holding the key and a hash of the payload. They are written to a temporary
+ * file and renamed into place, and a file that fails its checks reads as a
+ * miss, so any number of processes can share a directory. Hits refresh the
+ * file's modification time; once the directory grows past its limit the
+ * least recently used files are deleted until it is 10% under it again.
+ *
+ * A cache may be used from several threads at once.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef CONVCACHE_H
+#define CONVCACHE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONVCACHE_DEFAULT_SIZE		((uint64_t)1024 * 1024 * 1024)
+
+typedef struct ConvCache ConvCache;
+
+typedef struct	ConvCache_Key
+{
+	uint64_t	Hash[2];
+}	ConvCache_Key;
+
+typedef struct	ConvCache_Stats
+{
+	uint64_t	Hits;
+	uint64_t	Misses;
+	uint64_t	Stores;
+	uint64_t	Evictions;		/* files this process deleted to stay under the limit */
+	uint64_t	BytesRead;		/* payload bytes served from the cache */
+	uint64_t	BytesStored;
+	uint64_t	Size;			/* of the directory, as of the last scan plus stores since */
+	uint64_t	MaxSize;
+}	ConvCache_Stats;
+
+typedef void *(*ConvCache_AllocFunc)(size_t Size);
+typedef void (*ConvCache_FreeFunc)(void *Data);
+
+/* creates Dir if needed; MaxSize 0 uses CONVCACHE_DEFAULT_SIZE */
+ConvCache *ConvCache_Open(const char *Dir, uint64_t MaxSize);
+void ConvCache_Close(ConvCache **pCache);
+
+void ConvCache_MakeKey(ConvCache_Key *Key, const void *Source, size_t SourceSize, const void *Params, size_t ParamsSize);
+/* the key of a source image too large to hold in memory, read a megabyte at a
+   time; not the same key as ConvCache_MakeKey gives for the same bytes.
+   Returns 0 if the file cannot be read */
+int ConvCache_MakeFileKey(ConvCache_Key *Key, const char *FileName, const void *Params, size_t ParamsSize);
+
+/* on a hit the payload is read into a buffer from Alloc, which then belongs
+   to the caller; Alloc and Free may be NULL for malloc and free */
+int ConvCache_Load(ConvCache *Cache, const ConvCache_Key *Key, ConvCache_AllocFunc Alloc, ConvCache_FreeFunc Free,
+				   void **pData, size_t *pSize);
+/* 0 if the entry could not be written, which only costs a later miss */
+int ConvCache_Store(ConvCache *Cache, const ConvCache_Key *Key, const void *Data, size_t Size);
+
+void ConvCache_GetStats(ConvCache *Cache, ConvCache_Stats *Stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
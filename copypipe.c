@@ -0,0 +1,257 @@
+/**
+ * @file copypipe.c
+ *
+ * Reader/writer ring behind copypipe.h. Buffers are handed over in ring
+ * order: the reader fills slot Head % Depth once it has entered the free
+ * gate, the writer drains slot Tail % Depth once it has entered the full
+ * gate, and the gates' locks order every buffer's bytes and length between
+ * the two threads.
+ */
+#include "copypipe.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#define COPYPIPE_ALIGNMENT			4096
+
+
+typedef struct	CopyPipe_Slot
+{
+	uint8_t		*Data;
+	size_t		Length;
+	int			Failed;			/* the read into it failed, nothing follows */
+}	CopyPipe_Slot;
+
+struct CopyPipe
+{
+	size_t			BufferSize;
+	int				Depth;
+	void			*Memory;		/* the buffers, before alignment */
+	CopyPipe_Slot	*Slots;
+
+	ThreadPool		*Pool;			/* the reader, created by the first pipelined copy */
+	ThreadPool_Group *Group;
+	ThreadPool_Gate	*Free;			/* buffers the reader may fill */
+	ThreadPool_Gate	*Full;			/* buffers the writer may drain */
+	ThreadPool_Gate	*Lock;			/* a gate of one, guards Abort */
+
+	/* the copy being run */
+	uint64_t		Size;
+	CopyPipe_ReadFunc Read;
+	void			*ReadContext;
+	uint64_t		Head;			/* buffers filled, written by the reader */
+	int				Abort;			/* the writer gave up */
+};
+
+
+CopyPipe *CopyPipe_Create(size_t BufferSize, int Depth)
+{
+	CopyPipe *Pipe;
+	uint8_t *Aligned;
+	int i;
+
+	if(BufferSize == 0)
+		BufferSize = COPYPIPE_DEFAULT_BUFFER;
+	if(Depth <= 0)
+		Depth = COPYPIPE_DEFAULT_DEPTH;
+
+	BufferSize = (TGA2GEBMP_MIN(BufferSize, (size_t)1 << 30) + COPYPIPE_ALIGNMENT - 1) & ~(size_t)(COPYPIPE_ALIGNMENT - 1);
+
+	Pipe = (CopyPipe*)calloc(1, sizeof(CopyPipe));
+	if(!Pipe)
+		return NULL;
+
+	Pipe->BufferSize = BufferSize;
+	Pipe->Depth = Depth;
+	Pipe->Slots = (CopyPipe_Slot*)calloc(Depth, sizeof(CopyPipe_Slot));
+	Pipe->Memory = malloc((size_t)Depth * BufferSize + COPYPIPE_ALIGNMENT);
+	if(!Pipe->Slots || !Pipe->Memory)
+	{
+		CopyPipe_Destroy(&Pipe);
+		return NULL;
+	}
+
+	// large blocks come straight from the system, so buffers a copy never
+	// reaches cost no memory
+	Aligned = (uint8_t*)(((uintptr_t)Pipe->Memory + COPYPIPE_ALIGNMENT - 1) & ~(uintptr_t)(COPYPIPE_ALIGNMENT - 1));
+	for(i = 0; i < Depth; i++)
+		Pipe->Slots[i].Data = Aligned + (size_t)i * BufferSize;
+
+	return Pipe;
+}
+
+
+void CopyPipe_Destroy(CopyPipe **pPipe)
+{
+	CopyPipe *Pipe = *pPipe;
+
+	if(!Pipe)
+		return;
+
+	ThreadPool_Destroy(&Pipe->Pool);
+	ThreadPool_DestroyGroup(&Pipe->Group);
+	ThreadPool_DestroyGate(&Pipe->Free);
+	ThreadPool_DestroyGate(&Pipe->Full);
+	ThreadPool_DestroyGate(&Pipe->Lock);
+
+	free(Pipe->Memory);
+	free(Pipe->Slots);
+	free(Pipe);
+	*pPipe = NULL;
+}
+
+
+static int CopyPipe_Start(CopyPipe *Pipe)
+{
+	if(Pipe->Pool)
+		return 1;
+
+	Pipe->Pool = ThreadPool_Create(1);
+	Pipe->Group = ThreadPool_CreateGroup();
+	Pipe->Free = ThreadPool_CreateGate(Pipe->Depth);
+	Pipe->Full = ThreadPool_CreateGate(1);
+	Pipe->Lock = ThreadPool_CreateGate(1);
+	if(!Pipe->Pool || !Pipe->Group || !Pipe->Free || !Pipe->Full || !Pipe->Lock)
+	{
+		ThreadPool_Destroy(&Pipe->Pool);
+		ThreadPool_DestroyGroup(&Pipe->Group);
+		ThreadPool_DestroyGate(&Pipe->Free);
+		ThreadPool_DestroyGate(&Pipe->Full);
+		ThreadPool_DestroyGate(&Pipe->Lock);
+		return 0;
+	}
+
+	// gates start with at least one, the full one has to start empty
+	ThreadPool_EnterGate(Pipe->Full);
+	return 1;
+}
+
+
+static void CopyPipe_Reader(void *Context, int Worker)
+{
+	CopyPipe *Pipe = (CopyPipe*)Context;
+	uint64_t Offset;
+	TRACE_SPAN(Span)
+
+	(void)Worker;
+
+	for(Offset = 0; Offset < Pipe->Size; )
+	{
+		CopyPipe_Slot *Slot = &Pipe->Slots[Pipe->Head % Pipe->Depth];
+		int Abort;
+
+		ThreadPool_EnterGate(Pipe->Free);
+		ThreadPool_EnterGate(Pipe->Lock);
+		Abort = Pipe->Abort;
+		ThreadPool_LeaveGate(Pipe->Lock);
+		if(Abort)
+		{
+			ThreadPool_LeaveGate(Pipe->Free);
+			return;
+		}
+
+		Slot->Length = (size_t)TGA2GEBMP_MIN(Pipe->Size - Offset, (uint64_t)Pipe->BufferSize);
+
+		TRACE_BEGIN(Span, TRACE_READ);
+		Slot->Failed = !Pipe->Read(Pipe->ReadContext, Slot->Data, Slot->Length);
+		TRACE_END(Span, 1, Slot->Length);
+
+		Pipe->Head++;
+		ThreadPool_LeaveGate(Pipe->Full);
+
+		if(Slot->Failed)
+			return;
+		Offset += Slot->Length;
+	}
+}
+
+
+int CopyPipe_Run(CopyPipe *Pipe, uint64_t Size, CopyPipe_ReadFunc Read, void *ReadContext,
+				 CopyPipe_WriteFunc Write, void *WriteContext)
+{
+	uint64_t Tail;
+	uint64_t Offset;
+	int Result = 1;
+	TRACE_SPAN(Span)
+
+	if(Size == 0)
+		return 1;
+
+	// one buffer's worth gains nothing from a second thread
+	if(Size <= Pipe->BufferSize || Pipe->Depth < 2 || !CopyPipe_Start(Pipe))
+	{
+		for(Offset = 0; Result && Offset < Size; )
+		{
+			size_t Length = (size_t)TGA2GEBMP_MIN(Size - Offset, (uint64_t)Pipe->BufferSize);
+
+			TRACE_BEGIN(Span, TRACE_READ);
+			Result = Read(ReadContext, Pipe->Slots[0].Data, Length);
+			TRACE_END(Span, 1, Length);
+
+			if(Result)
+			{
+				TRACE_BEGIN(Span, TRACE_WRITE);
+				Result = Write(WriteContext, Pipe->Slots[0].Data, Length);
+				TRACE_END(Span, 1, Length);
+			}
+			Offset += Length;
+		}
+		return Result;
+	}
+
+	Pipe->Size = Size;
+	Pipe->Read = Read;
+	Pipe->ReadContext = ReadContext;
+	Pipe->Head = 0;
+	Pipe->Abort = 0;
+
+	if(!ThreadPool_Submit(Pipe->Pool, Pipe->Group, CopyPipe_Reader, Pipe))
+		return 0;
+
+	for(Tail = 0, Offset = 0; Offset < Size; Tail++)
+	{
+		CopyPipe_Slot *Slot = &Pipe->Slots[Tail % Pipe->Depth];
+
+		ThreadPool_EnterGate(Pipe->Full);
+		if(Slot->Failed)
+		{
+			ThreadPool_LeaveGate(Pipe->Free);
+			Tail++;
+			Result = 0;
+			break;
+		}
+
+		TRACE_BEGIN(Span, TRACE_WRITE);
+		Result = Write(WriteContext, Slot->Data, Slot->Length);
+		TRACE_END(Span, 1, Slot->Length);
+
+		Offset += Slot->Length;
+
+		// the reader may be waiting for this buffer, so it has to find the
+		// flag set once it gets it
+		if(!Result)
+		{
+			ThreadPool_EnterGate(Pipe->Lock);
+			Pipe->Abort = 1;
+			ThreadPool_LeaveGate(Pipe->Lock);
+		}
+		ThreadPool_LeaveGate(Pipe->Free);
+
+		if(!Result)
+		{
+			Tail++;
+			break;
+		}
+	}
+
+	ThreadPool_Wait(Pipe->Pool, Pipe->Group);
+
+	// buffers the reader filled after a failed write go back unwritten, so
+	// the gates are as they started for the next copy
+	for(; Tail < Pipe->Head; Tail++)
+	{
+		ThreadPool_EnterGate(Pipe->Full);
+		ThreadPool_LeaveGate(Pipe->Free);
+	}
+
+	return Result;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file copypipe.h
+ *
+ * Double-buffered copies between two streams that can only be read and
+ * written in order, such as geVFile handles. A reader thread fills a ring
+ * of large buffers while the calling thread writes out the ones already
+ * full, so the source and the destination are busy at the same time
+ * instead of taking turns.
+ *
+ * The ring is two counting gates from threadpool.h, one of free and one of
+ * full buffers, and the reader is the single worker of a pool of its own,
+ * started by the first copy larger than one buffer. Copies that fit in one
+ * buffer, and every copy of a pipe with a depth of 1, are read and written
+ * on the calling thread; that is for streams that must not be used from
+ * two threads at once, such as two files of the same geVFile system.
+ *
+ * A pipe runs one copy at a time.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef COPYPIPE_H
+#define COPYPIPE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COPYPIPE_DEFAULT_BUFFER		(1 << 20)
+#define COPYPIPE_DEFAULT_DEPTH		4
+
+typedef struct CopyPipe CopyPipe;
+
+/* both return 1 once exactly Size bytes have been moved, 0 on failure */
+typedef int (*CopyPipe_ReadFunc)(void *Context, void *Buffer, size_t Size);
+typedef int (*CopyPipe_WriteFunc)(void *Context, const void *Buffer, size_t Size);
+
+/* Depth buffers of BufferSize bytes, 4 KB aligned; 0 takes the defaults.
+   NULL if out of memory */
+CopyPipe *CopyPipe_Create(size_t BufferSize, int Depth);
+void CopyPipe_Destroy(CopyPipe **pPipe);
+
+/* copies Size bytes, Read on the pipe's thread and Write on the caller's.
+   Returns 0 if a read or write failed, after which the rest of the copy is
+   not attempted */
+int CopyPipe_Run(CopyPipe *Pipe, uint64_t Size, CopyPipe_ReadFunc Read, void *ReadContext,
+				 CopyPipe_WriteFunc Write, void *WriteContext);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file dirwalk.c
+ *
+ * Directory tree search, see dirwalk.h. Each directory is read completely
+ * and sorted before anything in it is visited, so at most one directory
+ * handle is open at a time however deep the tree is.
+ */
+#include <stdio.h>
+#include "dirwalk.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <dirent.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+#endif
+
+typedef struct	DirWalk_Entry
+{
+	char	*Name;
+	int		IsDirectory;
+}	DirWalk_Entry;
+
+typedef struct	DirWalk_List
+{
+	DirWalk_Entry	*Entries;
+	int				Count;
+	int				Capacity;
+}	DirWalk_List;
+
+
+static int DirWalk_HasExtension(const char *Name, const char *Extension)
+{
+	size_t Length = strlen(Name);
+	size_t ExtLength;
+
+	if(!Extension)
+		return 1;
+
+	ExtLength = strlen(Extension);
+	return Length > ExtLength && tga2gebmp_stricmp(Name + Length - ExtLength, Extension) == 0;
+}
+
+
+static int DirWalk_Add(DirWalk_List *List, const char *Name, int IsDirectory)
+{
+	if(List->Count == List->Capacity)
+	{
+		DirWalk_Entry *NewEntries;
+		int NewCapacity = List->Capacity ? List->Capacity * 2 : 64;
+
+		NewEntries = (DirWalk_Entry*)realloc(List->Entries, NewCapacity * sizeof(DirWalk_Entry));
+		if(!NewEntries)
+			return 0;
+
+		List->Entries = NewEntries;
+		List->Capacity = NewCapacity;
+	}
+
+	List->Entries[List->Count].Name = (char*)malloc(strlen(Name) + 1);
+	if(!List->Entries[List->Count].Name)
+		return 0;
+
+	strcpy(List->Entries[List->Count].Name, Name);
+	List->Entries[List->Count].IsDirectory = IsDirectory;
+	List->Count++;
+	return 1;
+}
+
+
+static void DirWalk_FreeList(DirWalk_List *List)
+{
+	int i;
+
+	for(i = 0; i < List->Count; i++)
+		free(List->Entries[i].Name);
+	free(List->Entries);
+}
+
+
+static int DirWalk_CompareEntries(const void *a, const void *b)
+{
+	return strcmp(((const DirWalk_Entry*)a)->Name, ((const DirWalk_Entry*)b)->Name);
+}
+
+
+// the subdirectories of Dir and the files in it that match Extension
+static int DirWalk_Read(const char *Dir, const char *Extension, DirWalk_List *List)
+{
+	char Path[_MAX_PATH];
+	const char *Name;
+	int IsDirectory;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA Find;
+	HANDLE FindHandle;
+
+	if((unsigned)snprintf(Path, sizeof(Path), "%s\\*", Dir) >= sizeof(Path))
+		return 0;
+
+	FindHandle = FindFirstFileA(Path, &Find);
+	if(FindHandle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	do
+	{
+		Name = Find.cFileName;
+
+		// junctions and directory links could lead back up the tree
+		if((Find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (Find.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+			continue;
+
+		IsDirectory = (Find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	DIR *DirHandle;
+	struct dirent *Ent;
+	struct stat Stat;
+
+	DirHandle = opendir(Dir);
+	if(!DirHandle)
+		return 0;
+
+	while((Ent = readdir(DirHandle)) != NULL)
+	{
+		Name = Ent->d_name;
+		if((unsigned)snprintf(Path, sizeof(Path), "%s/%s", Dir, Name) >= sizeof(Path))
+			continue;
+
+		if(lstat(Path, &Stat) != 0)
+			continue;
+
+		// a link to a file is followed, a link to a directory could lead back up the tree
+		if(S_ISLNK(Stat.st_mode) && (stat(Path, &Stat) != 0 || S_ISDIR(Stat.st_mode)))
+			continue;
+
+		if(!S_ISDIR(Stat.st_mode) && !S_ISREG(Stat.st_mode))
+			continue;
+
+		IsDirectory = S_ISDIR(Stat.st_mode);
+#endif
+
+		if(IsDirectory && (strcmp(Name, ".") == 0 || strcmp(Name, "..") == 0))
+			continue;
+
+		if((IsDirectory || DirWalk_HasExtension(Name, Extension)) && !DirWalk_Add(List, Name, IsDirectory))
+			break;
+
+#ifdef _WIN32
+	}
+	while(FindNextFileA(FindHandle, &Find));
+
+	FindClose(FindHandle);
+#else
+	}
+
+	closedir(DirHandle);
+#endif
+
+	qsort(List->Entries, List->Count, sizeof(DirWalk_Entry), DirWalk_CompareEntries);
+	return 1;
+}
+
+
+// 0 only if Func asked to stop
+static int DirWalk_Recurse(const char *Dir, const char *Extension, DirWalk_Func Func, void *Context, int *pReadable)
+{
+	DirWalk_List List;
+	char Path[_MAX_PATH];
+	int Continue = 1;
+	int i;
+
+	memset(&List, 0, sizeof(List));
+
+	*pReadable = DirWalk_Read(Dir, Extension, &List);
+
+	for(i = 0; Continue && i < List.Count; i++)
+	{
+		const DirWalk_Entry *Entry = &List.Entries[i];
+		int Readable;
+		int Length;
+
+		// a root given with a trailing separator does not get a second one
+		if(Dir[0] && (Dir[strlen(Dir) - 1] == '/' || Dir[strlen(Dir) - 1] == TGA2GEBMP_DIRSEP[0]))
+			Length = snprintf(Path, sizeof(Path), "%s%s", Dir, Entry->Name);
+		else
+			Length = snprintf(Path, sizeof(Path), "%s" TGA2GEBMP_DIRSEP "%s", Dir, Entry->Name);
+
+		// a truncated path would name some other file
+		if((unsigned)Length >= sizeof(Path))
+			continue;
+
+		if(Entry->IsDirectory)
+			Continue = DirWalk_Recurse(Path, Extension, Func, Context, &Readable);
+		else
+			Continue = Func(Path, Context);
+	}
+
+	DirWalk_FreeList(&List);
+	return Continue;
+}
+
+
+int DirWalk_IsDirectory(const char *Path)
+{
+#ifdef _WIN32
+	DWORD Attributes = GetFileAttributesA(Path);
+
+	return Attributes != INVALID_FILE_ATTRIBUTES && (Attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat Stat;
+
+	return stat(Path, &Stat) == 0 && S_ISDIR(Stat.st_mode);
+#endif
+}
+
+
+int DirWalk_Run(const char *Root, const char *Extension, DirWalk_Func Func, void *Context)
+{
+	int Readable;
+
+	if(!DirWalk_Recurse(Root, Extension, Func, Context, &Readable))
+		return 0;
+
+	return Readable;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file dirwalk.h
+ *
+ * Recursive search of a directory tree for files with a given extension.
+ * Entries are visited in name order, so two walks of the same tree report
+ * files in the same order. Linked or junctioned directories are not
+ * followed.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef DIRWALK_H
+#define DIRWALK_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* return 0 to stop the walk */
+typedef int (*DirWalk_Func)(const char *Path, void *Context);
+
+int DirWalk_IsDirectory(const char *Path);
+
+/* calls Func for every file under Root whose name ends in Extension (case
+   insensitive, NULL for all files); returns 0 if Root could not be read or
+   Func stopped the walk, subdirectories that cannot be read are skipped */
+int DirWalk_Run(const char *Root, const char *Extension, DirWalk_Func Func, void *Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
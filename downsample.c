@@ -0,0 +1,400 @@
+/**
+ * @file downsample.c
+ *
+ * Mip-chain halving plus a final box filter, see downsample.h.
+ */
+#include "downsample.h"
+#include <stdlib.h>
+#include <string.h>
+
+// SSE2 is part of every x64 target; 32-bit builds only use it when the
+// compiler was told it may
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define DOWNSAMPLE_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+// fixed point of the final pass: weights sum to 1 << WEIGHT_BITS, the
+// horizontal pass keeps ROW_BITS of fraction in 16-bit intermediates
+#define DOWNSAMPLE_WEIGHT_BITS		14
+#define DOWNSAMPLE_ROW_BITS			8
+
+typedef struct	Downsample_Taps
+{
+	int			*First;			// first source pixel of each output pixel
+	int			*Count;			// number of source pixels it covers
+	int			*Offset;		// into Weights
+	uint16_t	*Weights;
+	int			MaxCount;
+}	Downsample_Taps;
+
+
+void Downsample_FitSize(int Width, int Height, int MaxWidth, int MaxHeight, int *pWidth, int *pHeight)
+{
+	int w = Width;
+	int h = Height;
+
+	if(w > MaxWidth)
+	{
+		h = (int)(((int64_t)h * MaxWidth + w / 2) / w);
+		w = MaxWidth;
+	}
+	if(h > MaxHeight)
+	{
+		w = (int)(((int64_t)w * MaxHeight + h / 2) / h);
+		h = MaxHeight;
+	}
+
+	*pWidth = TGA2GEBMP_MAX(w, 1);
+	*pHeight = TGA2GEBMP_MAX(h, 1);
+}
+
+
+int Downsample_GetDibStride(int Width, int BitsPerPixel)
+{
+	return ((Width * BitsPerPixel + 31) / 32) * 4;
+}
+
+
+/*
+ * halving, every output byte is the rounded mean of the 2x2, 2x1 or 1x2
+ * source bytes it covers; an odd last row or column is dropped. Dest may
+ * equal Src since each output is written at or before the data it came from.
+ */
+
+static void Downsample_HalveRow_Scalar(uint8_t *Dest, const uint8_t *Row0, const uint8_t *Row1, int Width, int HalveX)
+{
+	int x, c;
+
+	if(!HalveX)
+	{
+		for(x = 0; x < Width * 4; x++)
+			Dest[x] = (uint8_t)((Row0[x] + Row1[x] + 1) >> 1);
+		return;
+	}
+
+	for(x = 0; x < Width; x++)
+	{
+		for(c = 0; c < 4; c++)
+		{
+			if(Row1)
+				Dest[c] = (uint8_t)((Row0[c] + Row0[c + 4] + Row1[c] + Row1[c + 4] + 2) >> 2);
+			else
+				Dest[c] = (uint8_t)((Row0[c] + Row0[c + 4] + 1) >> 1);
+		}
+		Dest += 4;
+		Row0 += 8;
+		if(Row1)
+			Row1 += 8;
+	}
+}
+
+#ifdef DOWNSAMPLE_HAVE_SSE2
+
+// sums of pixels 0+1 and 2+3 of four 16-bit pixels in Lo (0, 1) and Hi (2, 3)
+static __m128i Downsample_PairSums_SSE2(__m128i Lo, __m128i Hi)
+{
+	return _mm_add_epi16(_mm_unpacklo_epi64(Lo, Hi), _mm_unpackhi_epi64(Lo, Hi));
+}
+
+static void Downsample_HalveRow_SSE2(uint8_t *Dest, const uint8_t *Row0, const uint8_t *Row1, int Width, int HalveX)
+{
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i Two = _mm_set1_epi16(2);
+	const __m128i One = _mm_set1_epi16(1);
+	__m128i a0, a1, b0, b1, s0, s1;
+	int x = 0;
+
+	if(!HalveX)
+	{
+		// output row is as wide as the input, pavgb rounds the same way
+		for(; x + 4 <= Width; x += 4)
+		{
+			a0 = _mm_loadu_si128((const __m128i*)(Row0 + x * 4));
+			b0 = _mm_loadu_si128((const __m128i*)(Row1 + x * 4));
+			_mm_storeu_si128((__m128i*)(Dest + x * 4), _mm_avg_epu8(a0, b0));
+		}
+		Downsample_HalveRow_Scalar(Dest + x * 4, Row0 + x * 4, Row1 + x * 4, Width - x, 0);
+		return;
+	}
+
+	// eight source pixels make four output pixels
+	for(; x + 4 <= Width; x += 4)
+	{
+		a0 = _mm_loadu_si128((const __m128i*)(Row0 + x * 8));
+		a1 = _mm_loadu_si128((const __m128i*)(Row0 + x * 8 + 16));
+
+		if(Row1)
+		{
+			b0 = _mm_loadu_si128((const __m128i*)(Row1 + x * 8));
+			b1 = _mm_loadu_si128((const __m128i*)(Row1 + x * 8 + 16));
+
+			s0 = Downsample_PairSums_SSE2(_mm_add_epi16(_mm_unpacklo_epi8(a0, Zero), _mm_unpacklo_epi8(b0, Zero)),
+										  _mm_add_epi16(_mm_unpackhi_epi8(a0, Zero), _mm_unpackhi_epi8(b0, Zero)));
+			s1 = Downsample_PairSums_SSE2(_mm_add_epi16(_mm_unpacklo_epi8(a1, Zero), _mm_unpacklo_epi8(b1, Zero)),
+										  _mm_add_epi16(_mm_unpackhi_epi8(a1, Zero), _mm_unpackhi_epi8(b1, Zero)));
+			s0 = _mm_srli_epi16(_mm_add_epi16(s0, Two), 2);
+			s1 = _mm_srli_epi16(_mm_add_epi16(s1, Two), 2);
+		}
+		else
+		{
+			s0 = Downsample_PairSums_SSE2(_mm_unpacklo_epi8(a0, Zero), _mm_unpackhi_epi8(a0, Zero));
+			s1 = Downsample_PairSums_SSE2(_mm_unpacklo_epi8(a1, Zero), _mm_unpackhi_epi8(a1, Zero));
+			s0 = _mm_srli_epi16(_mm_add_epi16(s0, One), 1);
+			s1 = _mm_srli_epi16(_mm_add_epi16(s1, One), 1);
+		}
+
+		_mm_storeu_si128((__m128i*)(Dest + x * 4), _mm_packus_epi16(s0, s1));
+	}
+
+	Downsample_HalveRow_Scalar(Dest + x * 4, Row0 + x * 8, Row1 ? Row1 + x * 8 : NULL, Width - x, 1);
+}
+
+#define Downsample_HalveRow		Downsample_HalveRow_SSE2
+
+#else
+
+#define Downsample_HalveRow		Downsample_HalveRow_Scalar
+
+#endif
+
+static void Downsample_Halve(const uint8_t *Src, int Width, int Height, ptrdiff_t SrcStride,
+							 uint8_t *Dest, ptrdiff_t DestStride, int HalveX, int HalveY)
+{
+	int OutWidth = HalveX ? Width / 2 : Width;
+	int OutHeight = HalveY ? Height / 2 : Height;
+	const uint8_t *Row0;
+	int y;
+
+	for(y = 0; y < OutHeight; y++)
+	{
+		if(HalveY)
+		{
+			Row0 = Src + (ptrdiff_t)y * 2 * SrcStride;
+			Downsample_HalveRow(Dest + y * DestStride, Row0, Row0 + SrcStride, OutWidth, HalveX);
+		}
+		else
+		{
+			Downsample_HalveRow(Dest + y * DestStride, Src + y * SrcStride, NULL, OutWidth, HalveX);
+		}
+	}
+}
+
+
+/*
+ * final pass, separable box filter: output pixel x covers source pixels
+ * [x * Src / Dest, (x + 1) * Src / Dest) and each of them is weighted by how
+ * much of it lies inside
+ */
+
+static void Downsample_DestroyTaps(Downsample_Taps *Taps)
+{
+	free(Taps->First);
+	free(Taps->Count);
+	free(Taps->Offset);
+	free(Taps->Weights);
+}
+
+static int Downsample_CreateTaps(Downsample_Taps *Taps, int SrcSize, int DestSize)
+{
+	int MaxCount = (SrcSize + DestSize - 1) / DestSize + 1;
+	int64_t Start, End, Lo, Hi;
+	int i, x, Used, Total, Largest;
+	uint16_t w;
+
+	memset(Taps, 0, sizeof(*Taps));
+	Taps->First = (int*)malloc(DestSize * sizeof(int));
+	Taps->Count = (int*)malloc(DestSize * sizeof(int));
+	Taps->Offset = (int*)malloc(DestSize * sizeof(int));
+	Taps->Weights = (uint16_t*)malloc((size_t)DestSize * MaxCount * sizeof(uint16_t));
+	if(!Taps->First || !Taps->Count || !Taps->Offset || !Taps->Weights)
+	{
+		Downsample_DestroyTaps(Taps);
+		return 0;
+	}
+
+	Used = 0;
+	for(x = 0; x < DestSize; x++)
+	{
+		// in units of 1 / DestSize source pixels
+		Start = (int64_t)x * SrcSize;
+		End = Start + SrcSize;
+
+		Taps->First[x] = (int)(Start / DestSize);
+		Taps->Count[x] = (int)((End + DestSize - 1) / DestSize) - Taps->First[x];
+		Taps->Offset[x] = Used;
+
+		Total = 0;
+		Largest = 0;
+		for(i = 0; i < Taps->Count[x]; i++)
+		{
+			Lo = TGA2GEBMP_MAX(Start, (int64_t)(Taps->First[x] + i) * DestSize);
+			Hi = TGA2GEBMP_MIN(End, (int64_t)(Taps->First[x] + i + 1) * DestSize);
+			w = (uint16_t)((((Hi - Lo) << DOWNSAMPLE_WEIGHT_BITS) + SrcSize / 2) / SrcSize);
+			Taps->Weights[Used + i] = w;
+			Total += w;
+			if(w > Taps->Weights[Used + Largest])
+				Largest = i;
+		}
+
+		// rounding must not make the output brighter or darker
+		Taps->Weights[Used + Largest] = (uint16_t)(Taps->Weights[Used + Largest] + (1 << DOWNSAMPLE_WEIGHT_BITS) - Total);
+
+		Used += Taps->Count[x];
+		Taps->MaxCount = TGA2GEBMP_MAX(Taps->MaxCount, Taps->Count[x]);
+	}
+
+	return 1;
+}
+
+static void Downsample_FilterRow(uint16_t *Dest, const uint8_t *Src, const Downsample_Taps *Taps, int DestWidth)
+{
+	const uint8_t *p;
+	const uint16_t *w;
+	uint32_t b, g, r, a;
+	int x, i;
+
+	for(x = 0; x < DestWidth; x++)
+	{
+		p = Src + Taps->First[x] * 4;
+		w = Taps->Weights + Taps->Offset[x];
+		b = g = r = a = 0;
+
+		for(i = 0; i < Taps->Count[x]; i++, p += 4)
+		{
+			b += w[i] * p[0];
+			g += w[i] * p[1];
+			r += w[i] * p[2];
+			a += w[i] * p[3];
+		}
+
+		Dest[0] = (uint16_t)((b + (1 << (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS - 1))) >> (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS));
+		Dest[1] = (uint16_t)((g + (1 << (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS - 1))) >> (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS));
+		Dest[2] = (uint16_t)((r + (1 << (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS - 1))) >> (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS));
+		Dest[3] = (uint16_t)((a + (1 << (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS - 1))) >> (DOWNSAMPLE_WEIGHT_BITS - DOWNSAMPLE_ROW_BITS));
+		Dest += 4;
+	}
+}
+
+static int Downsample_Filter(const uint8_t *Src, int SrcWidth, int SrcHeight, ptrdiff_t SrcStride,
+							 uint8_t *Dest, int DestWidth, int DestHeight, ptrdiff_t DestStride)
+{
+	const int Shift = DOWNSAMPLE_WEIGHT_BITS + DOWNSAMPLE_ROW_BITS;
+	Downsample_Taps XTaps, YTaps;
+	uint16_t *Rows = NULL;
+	int *RowIndex = NULL;
+	uint32_t *Sums = NULL;
+	const uint16_t *Row, *w;
+	uint8_t *Out;
+	int x, y, i, Slot, SrcY, Ok = 0;
+
+	if(!Downsample_CreateTaps(&XTaps, SrcWidth, DestWidth))
+		return 0;
+	if(!Downsample_CreateTaps(&YTaps, SrcHeight, DestHeight))
+	{
+		Downsample_DestroyTaps(&XTaps);
+		return 0;
+	}
+
+	// output rows need consecutive, increasing source rows, so a ring of
+	// YTaps.MaxCount filtered rows never throws away one that is still needed
+	Rows = (uint16_t*)malloc((size_t)YTaps.MaxCount * DestWidth * 4 * sizeof(uint16_t));
+	RowIndex = (int*)malloc(YTaps.MaxCount * sizeof(int));
+	Sums = (uint32_t*)malloc((size_t)DestWidth * 4 * sizeof(uint32_t));
+	if(!Rows || !RowIndex || !Sums)
+		goto ExitWithError;
+
+	for(i = 0; i < YTaps.MaxCount; i++)
+		RowIndex[i] = -1;
+
+	for(y = 0; y < DestHeight; y++)
+	{
+		memset(Sums, 0, (size_t)DestWidth * 4 * sizeof(uint32_t));
+		w = YTaps.Weights + YTaps.Offset[y];
+
+		for(i = 0; i < YTaps.Count[y]; i++)
+		{
+			SrcY = YTaps.First[y] + i;
+			Slot = SrcY % YTaps.MaxCount;
+			Row = Rows + (size_t)Slot * DestWidth * 4;
+
+			if(RowIndex[Slot] != SrcY)
+			{
+				Downsample_FilterRow((uint16_t*)Row, Src + SrcY * SrcStride, &XTaps, DestWidth);
+				RowIndex[Slot] = SrcY;
+			}
+
+			for(x = 0; x < DestWidth * 4; x++)
+				Sums[x] += w[i] * Row[x];
+		}
+
+		Out = Dest + y * DestStride;
+		for(x = 0; x < DestWidth * 4; x++)
+			Out[x] = (uint8_t)((Sums[x] + (1u << (Shift - 1))) >> Shift);
+	}
+
+	Ok = 1;
+
+ExitWithError:
+	free(Rows);
+	free(RowIndex);
+	free(Sums);
+	Downsample_DestroyTaps(&XTaps);
+	Downsample_DestroyTaps(&YTaps);
+	return Ok;
+}
+
+
+int Downsample_Resize32(const void *Src, int SrcWidth, int SrcHeight, ptrdiff_t SrcStride,
+						void *Dest, int DestWidth, int DestHeight, ptrdiff_t DestStride)
+{
+	const uint8_t *Cur = (const uint8_t*)Src;
+	uint8_t *Temp = NULL;
+	ptrdiff_t CurStride = SrcStride;
+	int Width = SrcWidth;
+	int Height = SrcHeight;
+	int HalveX, HalveY, Ok, y;
+
+	if(SrcWidth <= 0 || SrcHeight <= 0 || DestWidth <= 0 || DestHeight <= 0)
+		return 0;
+
+	for(;;)
+	{
+		HalveX = Width >= DestWidth * 2;
+		HalveY = Height >= DestHeight * 2;
+		if(!HalveX && !HalveY)
+			break;
+
+		// the first level goes to a buffer of its own, the rest in place
+		if(!Temp)
+		{
+			Temp = (uint8_t*)malloc((size_t)(HalveX ? Width / 2 : Width) * (HalveY ? Height / 2 : Height) * 4);
+			if(!Temp)
+				return 0;
+		}
+
+		if(HalveX)
+			Width /= 2;
+		if(HalveY)
+			Height /= 2;
+
+		Downsample_Halve(Cur, HalveX ? Width * 2 : Width, HalveY ? Height * 2 : Height, CurStride,
+						 Temp, (ptrdiff_t)Width * 4, HalveX, HalveY);
+		Cur = Temp;
+		CurStride = (ptrdiff_t)Width * 4;
+	}
+
+	if(Width == DestWidth && Height == DestHeight)
+	{
+		for(y = 0; y < Height; y++)
+			memcpy((uint8_t*)Dest + y * DestStride, Cur + y * CurStride, (size_t)Width * 4);
+		Ok = 1;
+	}
+	else
+	{
+		Ok = Downsample_Filter(Cur, Width, Height, CurStride, (uint8_t*)Dest, DestWidth, DestHeight, DestStride);
+	}
+
+	free(Temp);
+	return Ok;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file downsample.h
+ *
+ * Area-averaging resize of 32-bit pixels (B, G, R, X bytes, the layout of a
+ * 32-bit DIB and of GE_PIXELFORMAT_32BIT_XRGB) for skin previews.
+ *
+ * Large reductions first halve the image with exact 2x2 (or 2x1, 1x2) box
+ * averages, SSE2 where available, until it is less than twice the target
+ * size on each axis; a final separable box filter with fractional coverage
+ * then produces the exact output size. Width and height are scaled
+ * independently, so any aspect ratio works.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* largest size with the image's aspect ratio that fits MaxWidth x MaxHeight,
+   images that already fit are left alone */
+void Downsample_FitSize(int Width, int Height, int MaxWidth, int MaxHeight, int *pWidth, int *pHeight);
+
+/* bytes per row of a DIB, rows are padded to 4 bytes */
+int Downsample_GetDibStride(int Width, int BitsPerPixel);
+
+/* resample Src into Dest, strides in bytes; 0 if out of memory */
+int Downsample_Resize32(const void *Src, int SrcWidth, int SrcHeight, ptrdiff_t SrcStride,
+						void *Dest, int DestWidth, int DestHeight, ptrdiff_t DestStride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
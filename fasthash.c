@@ -0,0 +1,115 @@
+/**
+ * @file fasthash.c
+ *
+ * XXH64, see fasthash.h. Reads are done bytewise into little-endian words so
+ * unaligned input and big-endian hosts give the same hashes.
+ */
+#include "fasthash.h"
+
+#define FASTHASH_PRIME1		0x9E3779B185EBCA87ULL
+#define FASTHASH_PRIME2		0xC2B2AE3D27D4EB4FULL
+#define FASTHASH_PRIME3		0x165667B19E3779F9ULL
+#define FASTHASH_PRIME4		0x85EBCA77C2B2AE63ULL
+#define FASTHASH_PRIME5		0x27D4EB2F165667C5ULL
+
+#define FASTHASH_ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+
+static uint64_t FastHash_Read64(const uint8_t *p)
+{
+	uint64_t v;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+#else
+	memcpy(&v, p, 8);
+#endif
+	return v;
+}
+
+
+static uint32_t FastHash_Read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static uint64_t FastHash_Round(uint64_t Acc, uint64_t Input)
+{
+	Acc += Input * FASTHASH_PRIME2;
+	Acc = FASTHASH_ROTL(Acc, 31);
+	return Acc * FASTHASH_PRIME1;
+}
+
+
+static uint64_t FastHash_Merge(uint64_t Acc, uint64_t Value)
+{
+	Acc ^= FastHash_Round(0, Value);
+	return Acc * FASTHASH_PRIME1 + FASTHASH_PRIME4;
+}
+
+
+uint64_t FastHash_64(const void *Data, size_t Size, uint64_t Seed)
+{
+	const uint8_t *p = (const uint8_t*)Data;
+	const uint8_t *End = p + Size;
+	uint64_t v1, v2, v3, v4, h;
+
+	if(Size >= 32)
+	{
+		v1 = Seed + FASTHASH_PRIME1 + FASTHASH_PRIME2;
+		v2 = Seed + FASTHASH_PRIME2;
+		v3 = Seed;
+		v4 = Seed - FASTHASH_PRIME1;
+
+		do
+		{
+			v1 = FastHash_Round(v1, FastHash_Read64(p));
+			v2 = FastHash_Round(v2, FastHash_Read64(p + 8));
+			v3 = FastHash_Round(v3, FastHash_Read64(p + 16));
+			v4 = FastHash_Round(v4, FastHash_Read64(p + 24));
+			p += 32;
+		}
+		while(End - p >= 32);
+
+		h = FASTHASH_ROTL(v1, 1) + FASTHASH_ROTL(v2, 7) + FASTHASH_ROTL(v3, 12) + FASTHASH_ROTL(v4, 18);
+		h = FastHash_Merge(h, v1);
+		h = FastHash_Merge(h, v2);
+		h = FastHash_Merge(h, v3);
+		h = FastHash_Merge(h, v4);
+	}
+	else
+	{
+		h = Seed + FASTHASH_PRIME5;
+	}
+
+	h += (uint64_t)Size;
+
+	for(; End - p >= 8; p += 8)
+	{
+		h ^= FastHash_Round(0, FastHash_Read64(p));
+		h = FASTHASH_ROTL(h, 27) * FASTHASH_PRIME1 + FASTHASH_PRIME4;
+	}
+
+	if(End - p >= 4)
+	{
+		h ^= (uint64_t)FastHash_Read32(p) * FASTHASH_PRIME1;
+		h = FASTHASH_ROTL(h, 23) * FASTHASH_PRIME2 + FASTHASH_PRIME3;
+		p += 4;
+	}
+
+	for(; p < End; p++)
+	{
+		h ^= (uint64_t)*p * FASTHASH_PRIME5;
+		h = FASTHASH_ROTL(h, 11) * FASTHASH_PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= FASTHASH_PRIME2;
+	h ^= h >> 29;
+	h *= FASTHASH_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file fasthash.h
+ *
+ * 64-bit non-cryptographic hash (the XXH64 algorithm), several GB/s per
+ * core. Used to recognise skins and source images by content.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t FastHash_64(const void *Data, size_t Size, uint64_t Seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
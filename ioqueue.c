@@ -0,0 +1,534 @@
+/**
+ * @file ioqueue.c
+ *
+ * Chunked asynchronous copies behind ioqueue.h: io_uring through the raw
+ * system calls, so nothing beyond the kernel headers is needed, and a
+ * pread/pwrite loop.
+ */
+#include "ioqueue.h"
+
+#ifndef _WIN32
+	#include <errno.h>
+	#include <unistd.h>
+	#include <sys/types.h>
+	#ifdef __linux__
+		#if defined(__has_include)
+			#if __has_include(<linux/io_uring.h>)
+				#define IOQUEUE_URING
+			#endif
+		#endif
+	#endif
+#endif
+
+#ifdef IOQUEUE_URING
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <linux/io_uring.h>
+#endif
+
+#define IOQUEUE_MAX_DEPTH			256
+#define IOQUEUE_ALIGNMENT			4096
+
+
+/* a buffer of the pool and the piece of a copy it is moving */
+typedef struct	IoQueue_Chunk
+{
+	int			Busy;
+	int			Writing;		/* read is done, the buffer is being written out */
+	int			SrcFd;
+	int			DestFd;
+	uint64_t	SrcOffset;
+	uint64_t	DestOffset;
+	uint32_t	Size;
+	uint32_t	Done;			/* of the current read or write */
+}	IoQueue_Chunk;
+
+struct IoQueue
+{
+	int				Backend;
+	int				Depth;
+	size_t			BufferSize;
+	uint8_t			*Buffers;
+	IoQueue_Chunk	*Chunks;
+	int				InFlight;
+	int				Failed;
+	IoQueue_Stats	Stats;
+
+#ifdef IOQUEUE_URING
+	int				RingFd;
+	int				Fixed;			/* buffers are registered */
+	unsigned		ToSubmit;
+	void			*SqRing;
+	void			*CqRing;
+	size_t			SqRingSize;
+	size_t			CqRingSize;
+	struct io_uring_sqe	*Sqes;
+	size_t			SqesSize;
+	unsigned		*SqHead;
+	unsigned		*SqTail;
+	unsigned		*SqMask;
+	unsigned		*SqArray;
+	unsigned		*CqHead;
+	unsigned		*CqTail;
+	unsigned		*CqMask;
+	struct io_uring_cqe	*Cqes;
+#endif
+};
+
+
+const char *IoQueue_GetBackendName(int Backend)
+{
+	switch(Backend)
+	{
+		case IOQUEUE_BACKEND_URING:	return "io_uring";
+		case IOQUEUE_BACKEND_PREAD:	return "pread";
+		default:					return "auto";
+	}
+}
+
+
+#ifndef _WIN32
+
+/* the whole chunk, restarting after signals and short transfers */
+static int IoQueue_CopyChunk(IoQueue *Queue, IoQueue_Chunk *Chunk)
+{
+	uint8_t *Buffer = Queue->Buffers;
+	uint32_t Done;
+
+	for(Done = 0; Done < Chunk->Size; )
+	{
+		ssize_t Read = pread(Chunk->SrcFd, Buffer + Done, Chunk->Size - Done, (off_t)(Chunk->SrcOffset + Done));
+		Queue->Stats.Requests++;
+		if(Read < 0 && errno == EINTR)
+			continue;
+		if(Read <= 0)
+			return 0;
+		Done += (uint32_t)Read;
+	}
+
+	for(Done = 0; Done < Chunk->Size; )
+	{
+		ssize_t Written = pwrite(Chunk->DestFd, Buffer + Done, Chunk->Size - Done, (off_t)(Chunk->DestOffset + Done));
+		Queue->Stats.Requests++;
+		if(Written < 0 && errno == EINTR)
+			continue;
+		if(Written <= 0)
+			return 0;
+		Done += (uint32_t)Written;
+	}
+
+	return 1;
+}
+
+#endif
+
+
+#ifdef IOQUEUE_URING
+
+static int IoQueue_SetupRing(IoQueue *Queue)
+{
+	struct io_uring_params Params;
+	struct iovec *Buffers;
+	uint8_t *Sq, *Cq;
+	int i;
+
+	memset(&Params, 0, sizeof(Params));
+	Queue->RingFd = (int)syscall(__NR_io_uring_setup, (unsigned)Queue->Depth, &Params);
+	if(Queue->RingFd < 0)
+		return 0;
+
+	Queue->SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+	Queue->CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+	if(Params.features & IORING_FEAT_SINGLE_MMAP)
+		Queue->SqRingSize = Queue->CqRingSize = TGA2GEBMP_MAX(Queue->SqRingSize, Queue->CqRingSize);
+
+	Queue->SqRing = mmap(NULL, Queue->SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 Queue->RingFd, IORING_OFF_SQ_RING);
+	if(Queue->SqRing == MAP_FAILED)
+	{
+		Queue->SqRing = NULL;
+		return 0;
+	}
+
+	if(Params.features & IORING_FEAT_SINGLE_MMAP)
+		Queue->CqRing = Queue->SqRing;
+	else
+	{
+		Queue->CqRing = mmap(NULL, Queue->CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+							 Queue->RingFd, IORING_OFF_CQ_RING);
+		if(Queue->CqRing == MAP_FAILED)
+		{
+			Queue->CqRing = NULL;
+			return 0;
+		}
+	}
+
+	Queue->SqesSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+	Queue->Sqes = (struct io_uring_sqe*)mmap(NULL, Queue->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+											  Queue->RingFd, IORING_OFF_SQES);
+	if(Queue->Sqes == MAP_FAILED)
+	{
+		Queue->Sqes = NULL;
+		return 0;
+	}
+
+	Sq = (uint8_t*)Queue->SqRing;
+	Cq = (uint8_t*)Queue->CqRing;
+	Queue->SqHead = (unsigned*)(Sq + Params.sq_off.head);
+	Queue->SqTail = (unsigned*)(Sq + Params.sq_off.tail);
+	Queue->SqMask = (unsigned*)(Sq + Params.sq_off.ring_mask);
+	Queue->SqArray = (unsigned*)(Sq + Params.sq_off.array);
+	Queue->CqHead = (unsigned*)(Cq + Params.cq_off.head);
+	Queue->CqTail = (unsigned*)(Cq + Params.cq_off.tail);
+	Queue->CqMask = (unsigned*)(Cq + Params.cq_off.ring_mask);
+	Queue->Cqes = (struct io_uring_cqe*)(Cq + Params.cq_off.cqes);
+
+	// registering pins the pool for good; if RLIMIT_MEMLOCK does not allow
+	// it, plain requests pin each transfer instead
+	Buffers = (struct iovec*)malloc(Queue->Depth * sizeof(struct iovec));
+	if(Buffers)
+	{
+		for(i = 0; i < Queue->Depth; i++)
+		{
+			Buffers[i].iov_base = Queue->Buffers + (size_t)i * Queue->BufferSize;
+			Buffers[i].iov_len = Queue->BufferSize;
+		}
+		Queue->Fixed = syscall(__NR_io_uring_register, Queue->RingFd, IORING_REGISTER_BUFFERS, Buffers, (unsigned)Queue->Depth) == 0;
+		free(Buffers);
+	}
+
+	return 1;
+}
+
+
+static void IoQueue_CloseRing(IoQueue *Queue)
+{
+	// closing the ring waits for what the kernel still has in flight
+	if(Queue->RingFd >= 0)
+		close(Queue->RingFd);
+	if(Queue->Sqes)
+		munmap(Queue->Sqes, Queue->SqesSize);
+	if(Queue->CqRing && Queue->CqRing != Queue->SqRing)
+		munmap(Queue->CqRing, Queue->CqRingSize);
+	if(Queue->SqRing)
+		munmap(Queue->SqRing, Queue->SqRingSize);
+
+	Queue->RingFd = -1;
+	Queue->Sqes = NULL;
+	Queue->SqRing = Queue->CqRing = NULL;
+}
+
+
+/* the next read or write of a chunk; there is room, as every chunk has at
+   most one request queued and the ring holds Depth */
+static void IoQueue_Prepare(IoQueue *Queue, int Index)
+{
+	IoQueue_Chunk *Chunk = &Queue->Chunks[Index];
+	unsigned Tail = *Queue->SqTail;
+	unsigned Slot = Tail & *Queue->SqMask;
+	struct io_uring_sqe *Sqe = &Queue->Sqes[Slot];
+
+	memset(Sqe, 0, sizeof(*Sqe));
+	if(Chunk->Writing)
+	{
+		Sqe->opcode = Queue->Fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		Sqe->fd = Chunk->DestFd;
+		Sqe->off = Chunk->DestOffset + Chunk->Done;
+	}
+	else
+	{
+		Sqe->opcode = Queue->Fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		Sqe->fd = Chunk->SrcFd;
+		Sqe->off = Chunk->SrcOffset + Chunk->Done;
+	}
+	Sqe->addr = (uint64_t)(uintptr_t)(Queue->Buffers + (size_t)Index * Queue->BufferSize + Chunk->Done);
+	Sqe->len = Chunk->Size - Chunk->Done;
+	if(Queue->Fixed)
+		Sqe->buf_index = (uint16_t)Index;
+	Sqe->user_data = (uint64_t)Index;
+
+	Queue->SqArray[Slot] = Slot;
+	__atomic_store_n(Queue->SqTail, Tail + 1, __ATOMIC_RELEASE);
+	Queue->ToSubmit++;
+	Queue->Stats.Requests++;
+}
+
+
+/* submits what is queued and, with MinComplete, sleeps until that many
+   requests have finished */
+static int IoQueue_Enter(IoQueue *Queue, unsigned MinComplete)
+{
+	for(;;)
+	{
+		long Submitted = syscall(__NR_io_uring_enter, Queue->RingFd, Queue->ToSubmit, MinComplete,
+								 MinComplete ? IORING_ENTER_GETEVENTS : 0u, NULL, 0);
+		if(Submitted >= 0)
+		{
+			Queue->ToSubmit -= (unsigned)Submitted;
+			Queue->Stats.Submits++;
+			return 1;
+		}
+		if(errno != EINTR)
+			return 0;
+	}
+}
+
+
+static void IoQueue_Release(IoQueue *Queue, IoQueue_Chunk *Chunk, int Succeeded)
+{
+	if(Succeeded)
+		Queue->Stats.BytesCopied += Chunk->Size;
+	else
+		Queue->Failed = 1;
+
+	Chunk->Busy = 0;
+	Queue->InFlight--;
+}
+
+
+/* moves every finished request's chunk on: the rest of a short transfer,
+   the write after the read, or back to the pool */
+static void IoQueue_Reap(IoQueue *Queue)
+{
+	unsigned Head = *Queue->CqHead;
+	unsigned Tail = __atomic_load_n(Queue->CqTail, __ATOMIC_ACQUIRE);
+
+	while(Head != Tail)
+	{
+		const struct io_uring_cqe *Cqe = &Queue->Cqes[Head & *Queue->CqMask];
+		int Index = (int)Cqe->user_data;
+		int Result = Cqe->res;
+		IoQueue_Chunk *Chunk = &Queue->Chunks[Index];
+
+		Head++;
+
+		if(Result == -EINTR || Result == -EAGAIN)
+			IoQueue_Prepare(Queue, Index);
+		else if(Result <= 0)
+			IoQueue_Release(Queue, Chunk, 0);
+		else if((Chunk->Done += (uint32_t)Result) < Chunk->Size)
+			IoQueue_Prepare(Queue, Index);
+		else if(!Chunk->Writing)
+		{
+			Chunk->Writing = 1;
+			Chunk->Done = 0;
+			IoQueue_Prepare(Queue, Index);
+		}
+		else
+			IoQueue_Release(Queue, Chunk, 1);
+	}
+
+	__atomic_store_n(Queue->CqHead, Head, __ATOMIC_RELEASE);
+}
+
+
+/* sleeps until at least one request finishes; a ring that stops working
+   fails the queue */
+static int IoQueue_WaitOne(IoQueue *Queue)
+{
+	if(!IoQueue_Enter(Queue, 1))
+	{
+		Queue->Failed = 1;
+		return 0;
+	}
+
+	IoQueue_Reap(Queue);
+	return 1;
+}
+
+#endif
+
+
+IoQueue *IoQueue_Create(int Depth, size_t BufferSize, int Backend)
+{
+#ifdef _WIN32
+	(void)Depth;
+	(void)BufferSize;
+	(void)Backend;
+	return NULL;
+#else
+	IoQueue *Queue;
+	void *Buffers;
+
+	if(Depth <= 0)
+		Depth = IOQUEUE_DEFAULT_DEPTH;
+	if(BufferSize == 0)
+		BufferSize = IOQUEUE_DEFAULT_BUFFER;
+
+	Depth = TGA2GEBMP_MIN(Depth, IOQUEUE_MAX_DEPTH);
+	BufferSize = (TGA2GEBMP_MIN(BufferSize, (size_t)1 << 30) + IOQUEUE_ALIGNMENT - 1) & ~(size_t)(IOQUEUE_ALIGNMENT - 1);
+
+	#ifndef IOQUEUE_URING
+	if(Backend == IOQUEUE_BACKEND_URING)
+		return NULL;
+	Backend = IOQUEUE_BACKEND_PREAD;
+	#endif
+
+	Queue = (IoQueue*)calloc(1, sizeof(IoQueue));
+	if(!Queue)
+		return NULL;
+
+	// pread copies one chunk at a time and needs one buffer
+	Queue->Depth = Backend == IOQUEUE_BACKEND_PREAD ? 1 : Depth;
+	Queue->BufferSize = BufferSize;
+	Queue->Chunks = (IoQueue_Chunk*)calloc(Queue->Depth, sizeof(IoQueue_Chunk));
+	if(!Queue->Chunks || posix_memalign(&Buffers, IOQUEUE_ALIGNMENT, (size_t)Queue->Depth * BufferSize) != 0)
+	{
+		free(Queue->Chunks);
+		free(Queue);
+		return NULL;
+	}
+	Queue->Buffers = (uint8_t*)Buffers;
+
+	#ifdef IOQUEUE_URING
+	Queue->RingFd = -1;
+	if(Backend != IOQUEUE_BACKEND_PREAD && IoQueue_SetupRing(Queue))
+		Queue->Backend = IOQUEUE_BACKEND_URING;
+	else
+	{
+		IoQueue_CloseRing(Queue);
+		if(Backend == IOQUEUE_BACKEND_URING)
+		{
+			IoQueue_Destroy(&Queue);
+			return NULL;
+		}
+		Queue->Backend = IOQUEUE_BACKEND_PREAD;
+		Queue->Depth = 1;
+	}
+	#else
+	Queue->Backend = IOQUEUE_BACKEND_PREAD;
+	#endif
+
+	return Queue;
+#endif
+}
+
+
+void IoQueue_Destroy(IoQueue **pQueue)
+{
+	IoQueue *Queue = *pQueue;
+
+	if(!Queue)
+		return;
+
+	IoQueue_Wait(Queue);
+
+#ifdef IOQUEUE_URING
+	IoQueue_CloseRing(Queue);
+#endif
+
+	free(Queue->Buffers);
+	free(Queue->Chunks);
+	free(Queue);
+	*pQueue = NULL;
+}
+
+
+int IoQueue_GetBackend(const IoQueue *Queue)
+{
+	return Queue->Backend;
+}
+
+
+int IoQueue_Copy(IoQueue *Queue, int SrcFd, uint64_t SrcOffset, int DestFd, uint64_t DestOffset, uint64_t Size)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	IoQueue_Chunk *Chunk;
+	uint64_t Done;
+	int i = 0;
+
+	if(Queue->Failed)
+		return 0;
+
+	Queue->Stats.Copies++;
+
+	for(Done = 0; Done < Size; Done += Chunk->Size)
+	{
+	#ifdef IOQUEUE_URING
+		if(Queue->Backend == IOQUEUE_BACKEND_URING)
+		{
+			while(Queue->InFlight == Queue->Depth)
+			{
+				if(!IoQueue_WaitOne(Queue))
+					return 0;
+			}
+			if(Queue->Failed)
+				return 0;
+
+			for(i = 0; Queue->Chunks[i].Busy; i++)
+				;
+		}
+	#endif
+
+		Chunk = &Queue->Chunks[i];
+		Chunk->Writing = 0;
+		Chunk->SrcFd = SrcFd;
+		Chunk->DestFd = DestFd;
+		Chunk->SrcOffset = SrcOffset + Done;
+		Chunk->DestOffset = DestOffset + Done;
+		Chunk->Size = (uint32_t)TGA2GEBMP_MIN(Size - Done, (uint64_t)Queue->BufferSize);
+		Chunk->Done = 0;
+
+	#ifdef IOQUEUE_URING
+		if(Queue->Backend == IOQUEUE_BACKEND_URING)
+		{
+			Chunk->Busy = 1;
+			Queue->InFlight++;
+			Queue->Stats.MaxInFlight = TGA2GEBMP_MAX(Queue->Stats.MaxInFlight, Queue->InFlight);
+			IoQueue_Prepare(Queue, i);
+			continue;
+		}
+	#endif
+
+		Queue->Stats.MaxInFlight = 1;
+		if(!IoQueue_CopyChunk(Queue, Chunk))
+		{
+			Queue->Failed = 1;
+			return 0;
+		}
+		Queue->Stats.BytesCopied += Chunk->Size;
+	}
+
+	#ifdef IOQUEUE_URING
+	// start on the copy now, collecting whatever has finished meanwhile
+	if(Queue->Backend == IOQUEUE_BACKEND_URING && Queue->ToSubmit > 0)
+	{
+		if(!IoQueue_Enter(Queue, 0))
+		{
+			Queue->Failed = 1;
+			return 0;
+		}
+		IoQueue_Reap(Queue);
+	}
+	#endif
+
+	return !Queue->Failed;
+#endif
+}
+
+
+int IoQueue_Wait(IoQueue *Queue)
+{
+	int Result;
+
+#ifdef IOQUEUE_URING
+	while(Queue->InFlight > 0)
+	{
+		if(!IoQueue_WaitOne(Queue))
+			break;
+	}
+#endif
+
+	Result = !Queue->Failed;
+	Queue->Failed = 0;
+	return Result;
+}
+
+
+void IoQueue_GetStats(const IoQueue *Queue, IoQueue_Stats *Stats)
+{
+	*Stats = Queue->Stats;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file ioqueue.h
+ *
+ * Asynchronous copies of byte ranges between file descriptors, for moving
+ * the unchanged entries of actors. A copy is cut into chunks that each take
+ * one buffer of a fixed pool; a chunk is read into its buffer and written
+ * out from it, and up to Depth chunks of any number of copies, on any
+ * number of files, are in flight at once.
+ *
+ * On Linux the requests go through io_uring, with the buffers registered
+ * with the kernel once so reads and writes skip the per-request page
+ * pinning (plain requests if the memory lock limit is too low for that).
+ * Where io_uring is unavailable, too old or blocked, chunks are copied one
+ * after another with pread and pwrite. Windows has neither, and
+ * IoQueue_Create returns NULL there.
+ *
+ * A queue is used by one thread at a time. The destination ranges of
+ * pending copies must not be written by anything else until IoQueue_Wait.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef IOQUEUE_H
+#define IOQUEUE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOQUEUE_BACKEND_AUTO		0	/* io_uring if the kernel allows it */
+#define IOQUEUE_BACKEND_URING		1
+#define IOQUEUE_BACKEND_PREAD		2
+
+#define IOQUEUE_DEFAULT_DEPTH		8
+#define IOQUEUE_DEFAULT_BUFFER		(256 * 1024)
+
+typedef struct IoQueue IoQueue;
+
+typedef struct	IoQueue_Stats
+{
+	uint64_t	Copies;
+	uint64_t	BytesCopied;
+	uint64_t	Requests;		/* reads and writes, short ones resubmitted count again */
+	uint64_t	Submits;		/* io_uring_enter calls */
+	int			MaxInFlight;	/* most chunks in flight at once */
+}	IoQueue_Stats;
+
+/* Depth 0 and BufferSize 0 take the defaults. NULL if out of memory, on
+   Windows, or if Backend is IOQUEUE_BACKEND_URING and io_uring cannot be
+   used */
+IoQueue *IoQueue_Create(int Depth, size_t BufferSize, int Backend);
+/* waits for the pending copies first */
+void IoQueue_Destroy(IoQueue **pQueue);
+/* IOQUEUE_BACKEND_URING or IOQUEUE_BACKEND_PREAD */
+int IoQueue_GetBackend(const IoQueue *Queue);
+const char *IoQueue_GetBackendName(int Backend);
+
+/* queues a copy of Size bytes; may wait for earlier chunks to free a
+   buffer. Returns 0 once a copy since the last IoQueue_Wait has failed */
+int IoQueue_Copy(IoQueue *Queue, int SrcFd, uint64_t SrcOffset, int DestFd, uint64_t DestOffset, uint64_t Size);
+/* waits for every pending copy; 1 if all of them since the last wait
+   succeeded */
+int IoQueue_Wait(IoQueue *Queue);
+
+void IoQueue_GetStats(const IoQueue *Queue, IoQueue_Stats *Stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,409 @@
+/**
+ * @file json.c
+ *
+ * Recursive-descent parser behind json.h. Arrays and objects collect their
+ * values in a growing array, which is trimmed to its final size once the
+ * closing bracket is read.
+ */
+#include "json.h"
+
+typedef struct	Json_Parser
+{
+	const char	*Pos;
+	const char	*End;
+	int			Depth;
+}	Json_Parser;
+
+
+static int Json_ParseValue(Json_Parser *Parser, Json_Value *Value);
+
+
+static void Json_FreeValue(Json_Value *Value)
+{
+	int i;
+
+	for(i = 0; i < Value->Count; i++)
+		Json_FreeValue(&Value->Items[i]);
+
+	free(Value->Items);
+	free(Value->Key);
+	free(Value->String);
+}
+
+
+static void Json_SkipSpace(Json_Parser *Parser)
+{
+	while(Parser->Pos < Parser->End &&
+		  (*Parser->Pos == ' ' || *Parser->Pos == '\t' || *Parser->Pos == '\n' || *Parser->Pos == '\r'))
+		Parser->Pos++;
+}
+
+
+static int Json_Expect(Json_Parser *Parser, const char *Word)
+{
+	size_t Length = strlen(Word);
+
+	if((size_t)(Parser->End - Parser->Pos) < Length || memcmp(Parser->Pos, Word, Length) != 0)
+		return 0;
+
+	Parser->Pos += Length;
+	return 1;
+}
+
+
+static int Json_ParseHex(Json_Parser *Parser, unsigned *pCode)
+{
+	unsigned Code = 0;
+	int i;
+
+	if(Parser->End - Parser->Pos < 4)
+		return 0;
+
+	for(i = 0; i < 4; i++)
+	{
+		char c = *Parser->Pos++;
+
+		Code <<= 4;
+		if(c >= '0' && c <= '9')
+			Code |= c - '0';
+		else if(c >= 'a' && c <= 'f')
+			Code |= c - 'a' + 10;
+		else if(c >= 'A' && c <= 'F')
+			Code |= c - 'A' + 10;
+		else
+			return 0;
+	}
+
+	*pCode = Code;
+	return 1;
+}
+
+
+static char *Json_PutUtf8(char *Out, unsigned Code)
+{
+	if(Code < 0x80)
+		*Out++ = (char)Code;
+	else if(Code < 0x800)
+	{
+		*Out++ = (char)(0xc0 | (Code >> 6));
+		*Out++ = (char)(0x80 | (Code & 0x3f));
+	}
+	else if(Code < 0x10000)
+	{
+		*Out++ = (char)(0xe0 | (Code >> 12));
+		*Out++ = (char)(0x80 | ((Code >> 6) & 0x3f));
+		*Out++ = (char)(0x80 | (Code & 0x3f));
+	}
+	else
+	{
+		*Out++ = (char)(0xf0 | (Code >> 18));
+		*Out++ = (char)(0x80 | ((Code >> 12) & 0x3f));
+		*Out++ = (char)(0x80 | ((Code >> 6) & 0x3f));
+		*Out++ = (char)(0x80 | (Code & 0x3f));
+	}
+
+	return Out;
+}
+
+
+// the string at Pos, past its opening quote; escapes never grow the text,
+// so the string is at most as long as what is left of the document
+static char *Json_ParseString(Json_Parser *Parser)
+{
+	char *String;
+	char *Out;
+
+	String = (char*)malloc(Parser->End - Parser->Pos + 1);
+	if(!String)
+		return NULL;
+
+	for(Out = String; Parser->Pos < Parser->End; )
+	{
+		char c = *Parser->Pos++;
+		unsigned Code, Low;
+
+		if(c == '"')
+		{
+			*Out = '\0';
+			return String;
+		}
+
+		if((unsigned char)c < 0x20)
+			break;
+
+		if(c != '\\')
+		{
+			*Out++ = c;
+			continue;
+		}
+
+		if(Parser->Pos == Parser->End)
+			break;
+
+		switch(*Parser->Pos++)
+		{
+			case '"':	*Out++ = '"';	continue;
+			case '\\':	*Out++ = '\\';	continue;
+			case '/':	*Out++ = '/';	continue;
+			case 'b':	*Out++ = '\b';	continue;
+			case 'f':	*Out++ = '\f';	continue;
+			case 'n':	*Out++ = '\n';	continue;
+			case 'r':	*Out++ = '\r';	continue;
+			case 't':	*Out++ = '\t';	continue;
+			case 'u':	break;
+			default:	free(String);	return NULL;
+		}
+
+		if(!Json_ParseHex(Parser, &Code) || Code == 0)
+			break;
+
+		// characters past the first plane come as a surrogate pair
+		if(Code >= 0xd800 && Code < 0xdc00)
+		{
+			if(!Json_Expect(Parser, "\\u") || !Json_ParseHex(Parser, &Low) || Low < 0xdc00 || Low >= 0xe000)
+				break;
+			Code = 0x10000 + ((Code - 0xd800) << 10) + (Low - 0xdc00);
+		}
+		else if(Code >= 0xdc00 && Code < 0xe000)
+			break;
+
+		Out = Json_PutUtf8(Out, Code);
+	}
+
+	free(String);
+	return NULL;
+}
+
+
+static int Json_ParseNumber(Json_Parser *Parser, double *pNumber)
+{
+	const char *Start = Parser->Pos;
+	char Buffer[64];
+	char *End;
+
+	if(Parser->Pos < Parser->End && *Parser->Pos == '-')
+		Parser->Pos++;
+	while(Parser->Pos < Parser->End && strchr("0123456789.eE+-", *Parser->Pos))
+		Parser->Pos++;
+
+	if(Parser->Pos == Start || Parser->Pos - Start >= (ptrdiff_t)sizeof(Buffer))
+		return 0;
+
+	// the document need not end after the number, strtod wants it to
+	memcpy(Buffer, Start, Parser->Pos - Start);
+	Buffer[Parser->Pos - Start] = '\0';
+	*pNumber = strtod(Buffer, &End);
+	return *End == '\0';
+}
+
+
+// the values of an array or object up to Close, past the opening bracket
+static int Json_ParseItems(Json_Parser *Parser, Json_Value *Value, char Close)
+{
+	int Capacity = 0;
+
+	Json_SkipSpace(Parser);
+	if(Parser->Pos < Parser->End && *Parser->Pos == Close)
+	{
+		Parser->Pos++;
+		return 1;
+	}
+
+	for(;;)
+	{
+		Json_Value *Item;
+
+		if(Value->Count == Capacity)
+		{
+			Json_Value *NewItems;
+			int NewCapacity = Capacity ? Capacity * 2 : 8;
+
+			NewItems = (Json_Value*)realloc(Value->Items, NewCapacity * sizeof(Json_Value));
+			if(!NewItems)
+				return 0;
+
+			Value->Items = NewItems;
+			Capacity = NewCapacity;
+		}
+
+		Item = &Value->Items[Value->Count];
+		memset(Item, 0, sizeof(*Item));
+		Value->Count++;
+
+		Json_SkipSpace(Parser);
+		if(Close == '}')
+		{
+			if(Parser->Pos == Parser->End || *Parser->Pos != '"')
+				return 0;
+			Parser->Pos++;
+			Item->Key = Json_ParseString(Parser);
+			if(!Item->Key)
+				return 0;
+
+			Json_SkipSpace(Parser);
+			if(!Json_Expect(Parser, ":"))
+				return 0;
+		}
+
+		if(!Json_ParseValue(Parser, Item))
+			return 0;
+
+		Json_SkipSpace(Parser);
+		if(Json_Expect(Parser, ","))
+			continue;
+		if(Parser->Pos < Parser->End && *Parser->Pos == Close)
+		{
+			Parser->Pos++;
+			break;
+		}
+		return 0;
+	}
+
+	// a smaller block, so failing to get it only keeps the larger one
+	if(Value->Count < Capacity)
+	{
+		Json_Value *Items = (Json_Value*)realloc(Value->Items, Value->Count * sizeof(Json_Value));
+
+		if(Items)
+			Value->Items = Items;
+	}
+
+	return 1;
+}
+
+
+static int Json_ParseValue(Json_Parser *Parser, Json_Value *Value)
+{
+	int Result;
+
+	Json_SkipSpace(Parser);
+	if(Parser->Pos == Parser->End)
+		return 0;
+
+	switch(*Parser->Pos)
+	{
+		case '{':
+		case '[':
+			if(++Parser->Depth > JSON_MAX_DEPTH)
+				return 0;
+			Value->Type = *Parser->Pos == '{' ? JSON_OBJECT : JSON_ARRAY;
+			Parser->Pos++;
+			Result = Json_ParseItems(Parser, Value, Value->Type == JSON_OBJECT ? '}' : ']');
+			Parser->Depth--;
+			return Result;
+
+		case '"':
+			Parser->Pos++;
+			Value->Type = JSON_STRING;
+			Value->String = Json_ParseString(Parser);
+			return Value->String != NULL;
+
+		case 't':
+			Value->Type = JSON_TRUE;
+			return Json_Expect(Parser, "true");
+
+		case 'f':
+			Value->Type = JSON_FALSE;
+			return Json_Expect(Parser, "false");
+
+		case 'n':
+			Value->Type = JSON_NULL;
+			return Json_Expect(Parser, "null");
+
+		default:
+			Value->Type = JSON_NUMBER;
+			return Json_ParseNumber(Parser, &Value->Number);
+	}
+}
+
+
+Json_Value *Json_Parse(const char *Text, size_t Length)
+{
+	Json_Parser Parser;
+	Json_Value *Value;
+
+	Value = (Json_Value*)calloc(1, sizeof(Json_Value));
+	if(!Value)
+		return NULL;
+
+	Parser.Pos = Text;
+	Parser.End = Text + Length;
+	Parser.Depth = 0;
+
+	if(!Json_ParseValue(&Parser, Value))
+	{
+		Json_Free(&Value);
+		return NULL;
+	}
+
+	Json_SkipSpace(&Parser);
+	if(Parser.Pos != Parser.End)
+		Json_Free(&Value);
+
+	return Value;
+}
+
+
+void Json_Free(Json_Value **pValue)
+{
+	Json_Value *Value = *pValue;
+
+	if(!Value)
+		return;
+
+	Json_FreeValue(Value);
+	free(Value);
+	*pValue = NULL;
+}
+
+
+const Json_Value *Json_Find(const Json_Value *Object, const char *Key)
+{
+	int i;
+
+	if(!Object || Object->Type != JSON_OBJECT)
+		return NULL;
+
+	for(i = 0; i < Object->Count; i++)
+	{
+		if(strcmp(Object->Items[i].Key, Key) == 0)
+			return &Object->Items[i];
+	}
+
+	return NULL;
+}
+
+
+const char *Json_GetString(const Json_Value *Object, const char *Key)
+{
+	const Json_Value *Value = Json_Find(Object, Key);
+
+	return Value && Value->Type == JSON_STRING ? Value->String : NULL;
+}
+
+
+void Json_WriteString(FILE *File, const char *Str)
+{
+	const unsigned char *c;
+
+	fputc('"', File);
+
+	for(c = (const unsigned char*)Str; *c; c++)
+	{
+		switch(*c)
+		{
+			case '"':	fputs("\\\"", File);	break;
+			case '\\':	fputs("\\\\", File);	break;
+			case '\n':	fputs("\\n", File);		break;
+			case '\r':	fputs("\\r", File);		break;
+			case '\t':	fputs("\\t", File);		break;
+			default:
+				if(*c < 0x20)
+					fprintf(File, "\\u%04x", *c);
+				else
+					fputc(*c, File);
+		}
+	}
+
+	fputc('"', File);
+}
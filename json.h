@@ -0,0 +1,61 @@
+/**
+ * @file json.h
+ *
+ * A small JSON reader for the requests of tga2gebmp_server, and a string
+ * writer for its replies. A document is parsed into a tree of values;
+ * strings are unescaped to UTF-8, numbers are doubles, and objects keep
+ * their members in document order.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_NULL			0
+#define JSON_FALSE			1
+#define JSON_TRUE			2
+#define JSON_NUMBER			3
+#define JSON_STRING			4
+#define JSON_ARRAY			5
+#define JSON_OBJECT			6
+
+#define JSON_MAX_DEPTH		64
+
+typedef struct Json_Value Json_Value;
+
+struct Json_Value
+{
+	int			Type;
+	char		*Key;			/* name in the parent object, NULL elsewhere */
+	char		*String;		/* JSON_STRING */
+	double		Number;			/* JSON_NUMBER */
+	Json_Value	*Items;			/* elements of an array, members of an object */
+	int			Count;
+};
+
+/* one value, with nothing but white space around it. NULL on a syntax
+   error, nesting deeper than JSON_MAX_DEPTH or out of memory */
+Json_Value *Json_Parse(const char *Text, size_t Length);
+void Json_Free(Json_Value **pValue);
+
+/* member of an object, NULL if there is none or Object is not an object */
+const Json_Value *Json_Find(const Json_Value *Object, const char *Key);
+/* NULL if the member is missing or not a string */
+const char *Json_GetString(const Json_Value *Object, const char *Key);
+
+/* Str as a quoted JSON string */
+void Json_WriteString(FILE *File, const char *Str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
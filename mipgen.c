@@ -0,0 +1,790 @@
+/**
+ * @file mipgen.c
+ *
+ * Mip chain generation, see mipgen.h. A level is made in two passes over
+ * bands of rows: a horizontal pass from the level above into a temporary
+ * image, then a vertical pass into the new level. Pixels are kept as four
+ * signed 16-bit channels (B, G, R, A, 0 .. 32767) and filter weights in
+ * 14-bit fixed point, which is what SSE2's multiply-add works on; the plain
+ * C kernels compute exactly the same sums.
+ */
+#include <math.h>
+#include "mipgen.h"
+
+// SSE2 is part of every x64 target; 32-bit builds only use it when the
+// compiler is allowed to
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MIPGEN_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#define MIPGEN_WEIGHT_BITS		14
+#define MIPGEN_WEIGHT_ONE		(1 << MIPGEN_WEIGHT_BITS)
+#define MIPGEN_LINEAR_MAX		32767
+#define MIPGEN_KAISER_RADIUS	2.0			// in pixels of the smaller level
+#define MIPGEN_KAISER_BETA		4.0
+#define MIPGEN_BAND_ROWS		16
+#define MIPGEN_BAND_PIXELS		32768		// at least this much work per task
+#define MIPGEN_MAX_ALPHA_SCALE	(16 * 256)	// alpha is scaled by at most 16 (8.8 fixed point)
+#define MIPGEN_CUTOUT_PARTIAL	20			// cut-outs have at most 1 in 20 partly transparent pixels
+#define MIPGEN_PI				3.14159265358979323846
+
+typedef struct	MipGen_Taps
+{
+	int			Count;			// per output pixel, even
+	int			*Index;			// source pixel or row of every tap
+	int32_t		*Pairs;			// weights of taps 2k and 2k + 1 in the low and high halves
+}	MipGen_Taps;
+
+typedef struct	MipGen_Tables
+{
+	int16_t		FromSrgb[256];
+	int16_t		FromByte[256];
+	uint8_t		ToSrgb[MIPGEN_LINEAR_MAX + 1];
+	uint8_t		ToByte[MIPGEN_LINEAR_MAX + 1];
+}	MipGen_Tables;
+
+// one level being made; linear images are rows of Width * 4 channels
+typedef struct	MipGen_Context
+{
+	const MipGen_Params	*Params;
+	const MipGen_Tables	*Tables;
+	const MipGen_Image	*Source;	// for the pass that reads the full-size image
+	const int16_t		*Above;		// the level being reduced
+	int					AboveWidth;
+	int16_t				*Temp;		// Above filtered horizontally, Level->Width x Above's height
+	int16_t				*Linear;	// the new level
+	const MipGen_Image	*Level;		// the new level in 8 bits per channel
+	MipGen_Taps			TapsX;
+	MipGen_Taps			TapsY;
+}	MipGen_Context;
+
+typedef void (*MipGen_PassFunc)(const MipGen_Context *Context, int First, int End);
+
+typedef struct	MipGen_Band
+{
+	const MipGen_Context	*Context;
+	MipGen_PassFunc			Func;
+	int						First;
+	int						End;
+}	MipGen_Band;
+
+
+void MipGen_SetDefaults(MipGen_Params *Params)
+{
+	Params->Filter = MIPGEN_FILTER_KAISER;
+	Params->SRGB = 1;
+	Params->AlphaCoverage = 0;
+	Params->AlphaRef = 128;
+}
+
+
+int MipGen_GetMaxLevels(int Width, int Height)
+{
+	int Size = TGA2GEBMP_MAX(Width, Height);
+	int Levels = 1;
+
+	while(Size > 1)
+	{
+		Size >>= 1;
+		Levels++;
+	}
+
+	return Levels;
+}
+
+
+int MipGen_IsCutout(const MipGen_Image *Image)
+{
+	uint64_t Transparent = 0;
+	uint64_t Partial = 0;
+	const uint8_t *Row;
+	int x, y;
+
+	if(Image->BytesPerPixel != 4)
+		return 0;
+
+	for(y = 0; y < Image->Height; y++)
+	{
+		Row = (const uint8_t*)Image->Pixels + y * Image->Stride;
+		for(x = 0; x < Image->Width; x++)
+		{
+			if(Row[x * 4 + 3] == 0)
+				Transparent++;
+			else if(Row[x * 4 + 3] != 255)
+				Partial++;
+		}
+	}
+
+	return Transparent > 0 && Partial * MIPGEN_CUTOUT_PARTIAL <= (uint64_t)Image->Width * Image->Height;
+}
+
+
+static double MipGen_SrgbToLinear(double v)
+{
+	return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+
+static void MipGen_InitTables(MipGen_Tables *Tables)
+{
+	double Threshold;
+	int i, v;
+
+	for(i = 0; i < 256; i++)
+	{
+		Tables->FromSrgb[i] = (int16_t)floor(MipGen_SrgbToLinear(i / 255.0) * MIPGEN_LINEAR_MAX + 0.5);
+		Tables->FromByte[i] = (int16_t)((i * MIPGEN_LINEAR_MAX + 127) / 255);
+	}
+
+	// a linear value encodes to the byte whose sRGB interval it falls in,
+	// so bytes survive the round trip unchanged
+	i = 0;
+	Threshold = MipGen_SrgbToLinear(0.5 / 255.0) * MIPGEN_LINEAR_MAX;
+	for(v = 0; v <= MIPGEN_LINEAR_MAX; v++)
+	{
+		while(i < 255 && v >= Threshold)
+		{
+			i++;
+			Threshold = i < 255 ? MipGen_SrgbToLinear((i + 0.5) / 255.0) * MIPGEN_LINEAR_MAX : MIPGEN_LINEAR_MAX + 1.0;
+		}
+
+		Tables->ToSrgb[v] = (uint8_t)i;
+		Tables->ToByte[v] = (uint8_t)((v * 255 + MIPGEN_LINEAR_MAX / 2) / MIPGEN_LINEAR_MAX);
+	}
+}
+
+
+static double MipGen_BesselI0(double x)
+{
+	double Sum = 1.0;
+	double Term = 1.0;
+	int k;
+
+	for(k = 1; k < 50 && Term > Sum * 1e-12; k++)
+	{
+		Term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		Sum += Term;
+	}
+
+	return Sum;
+}
+
+
+// x in pixels of the smaller level
+static double MipGen_Kaiser(double x)
+{
+	double t, Sinc;
+
+	if(fabs(x) >= MIPGEN_KAISER_RADIUS)
+		return 0.0;
+
+	t = x / MIPGEN_KAISER_RADIUS;
+	Sinc = x == 0.0 ? 1.0 : sin(MIPGEN_PI * x) / (MIPGEN_PI * x);
+
+	return Sinc * MipGen_BesselI0(MIPGEN_KAISER_BETA * sqrt(1.0 - t * t)) / MipGen_BesselI0(MIPGEN_KAISER_BETA);
+}
+
+
+static void MipGen_FreeTaps(MipGen_Taps *Taps)
+{
+	free(Taps->Index);
+	free(Taps->Pairs);
+	Taps->Index = NULL;
+	Taps->Pairs = NULL;
+}
+
+
+// weights of the source pixels that make up each of DestSize pixels; taps
+// past the edges are folded onto the edge pixel
+static int MipGen_InitTaps(MipGen_Taps *Taps, int SrcSize, int DestSize, int Filter)
+{
+	double Scale = (double)SrcSize / DestSize;
+	double Radius = Filter == MIPGEN_FILTER_BOX ? Scale * 0.5 : MIPGEN_KAISER_RADIUS * Scale;
+	int Bound = (int)ceil(2.0 * Radius) + 2;
+	double *Weights;
+	int16_t *Fixed;
+	int *Counts;
+	int i, j, k;
+
+	Taps->Index = (int*)malloc((size_t)DestSize * Bound * sizeof(int));
+	Taps->Pairs = NULL;
+	Weights = (double*)malloc(Bound * sizeof(double));
+	Fixed = (int16_t*)malloc((size_t)DestSize * Bound * sizeof(int16_t));
+	Counts = (int*)malloc(DestSize * sizeof(int));
+	if(!Taps->Index || !Weights || !Fixed || !Counts)
+	{
+		free(Weights);
+		free(Fixed);
+		free(Counts);
+		MipGen_FreeTaps(Taps);
+		return 0;
+	}
+
+	Taps->Count = 2;
+
+	for(i = 0; i < DestSize; i++)
+	{
+		double Center = (i + 0.5) * Scale;
+		int *Index = Taps->Index + (size_t)i * Bound;
+		int16_t *Weight = Fixed + (size_t)i * Bound;
+		double Total = 0.0;
+		int Sum = 0, Largest = 0, n = 0;
+
+		for(j = (int)floor(Center - Radius); j < (int)ceil(Center + Radius); j++)
+		{
+			double w;
+			int Src = TGA2GEBMP_MIN(TGA2GEBMP_MAX(j, 0), SrcSize - 1);
+
+			if(Filter == MIPGEN_FILTER_BOX)
+				w = TGA2GEBMP_MIN(j + 1.0, Center + Radius) - TGA2GEBMP_MAX((double)j, Center - Radius);
+			else
+				w = MipGen_Kaiser((j + 0.5 - Center) / Scale);
+
+			if(w == 0.0)
+				continue;
+
+			if(n > 0 && Index[n - 1] == Src)
+			{
+				Weights[n - 1] += w;
+			}
+			else
+			{
+				Index[n] = Src;
+				Weights[n] = w;
+				n++;
+			}
+			Total += w;
+		}
+
+		// round to fixed point and give the rounding error to the largest tap,
+		// so every output pixel's weights add up to exactly one
+		for(k = 0; k < n; k++)
+		{
+			Weight[k] = (int16_t)floor(Weights[k] / Total * MIPGEN_WEIGHT_ONE + 0.5);
+			Sum += Weight[k];
+			if(Weights[k] > Weights[Largest])
+				Largest = k;
+		}
+		Weight[Largest] = (int16_t)(Weight[Largest] + MIPGEN_WEIGHT_ONE - Sum);
+
+		Counts[i] = n;
+		Taps->Count = TGA2GEBMP_MAX(Taps->Count, (n + 1) & ~1);
+	}
+
+	free(Weights);
+
+	Taps->Pairs = (int32_t*)malloc((size_t)DestSize * (Taps->Count / 2) * sizeof(int32_t));
+	if(!Taps->Pairs)
+	{
+		free(Fixed);
+		free(Counts);
+		MipGen_FreeTaps(Taps);
+		return 0;
+	}
+
+	// pack to Count taps per pixel, padding with zero weights on the last pixel
+	for(i = 0; i < DestSize; i++)
+	{
+		const int *SrcIndex = Taps->Index + (size_t)i * Bound;
+		const int16_t *SrcWeight = Fixed + (size_t)i * Bound;
+		int *Index = Taps->Index + (size_t)i * Taps->Count;
+		int32_t *Pairs = Taps->Pairs + (size_t)i * (Taps->Count / 2);
+		int Last = SrcIndex[Counts[i] - 1];
+		int16_t w[2];
+
+		for(k = 0; k < Taps->Count; k++)
+		{
+			w[k & 1] = k < Counts[i] ? SrcWeight[k] : 0;
+			Index[k] = k < Counts[i] ? SrcIndex[k] : Last;
+
+			if(k & 1)
+				Pairs[k / 2] = (int32_t)((uint32_t)(uint16_t)w[0] | ((uint32_t)(uint16_t)w[1] << 16));
+		}
+	}
+
+	free(Fixed);
+	free(Counts);
+	return 1;
+}
+
+
+static int16_t MipGen_Round(int32_t Sum)
+{
+	if(Sum < 0)
+		return 0;
+
+	Sum = (Sum + MIPGEN_WEIGHT_ONE / 2) >> MIPGEN_WEIGHT_BITS;
+	return (int16_t)(Sum > MIPGEN_LINEAR_MAX ? MIPGEN_LINEAR_MAX : Sum);
+}
+
+
+static int16_t MipGen_PairLow(int32_t Pair)
+{
+	return (int16_t)(uint16_t)((uint32_t)Pair & 0xffff);
+}
+
+
+static int16_t MipGen_PairHigh(int32_t Pair)
+{
+	return (int16_t)(uint16_t)((uint32_t)Pair >> 16);
+}
+
+
+// the full-size image to linear pixels
+static void MipGen_Import(const MipGen_Context *Context, int First, int End)
+{
+	const MipGen_Image *Source = Context->Source;
+	const MipGen_Tables *Tables = Context->Tables;
+	const int16_t *Colour = Context->Params->SRGB ? Tables->FromSrgb : Tables->FromByte;
+	int Bpp = Source->BytesPerPixel;
+	int x, y;
+
+	for(y = First; y < End; y++)
+	{
+		const uint8_t *Src = (const uint8_t*)Source->Pixels + y * Source->Stride;
+		int16_t *Dest = Context->Linear + (size_t)y * Source->Width * 4;
+
+		for(x = 0; x < Source->Width; x++, Src += Bpp, Dest += 4)
+		{
+			Dest[0] = Colour[Src[0]];
+			Dest[1] = Colour[Src[1]];
+			Dest[2] = Colour[Src[2]];
+			Dest[3] = Bpp == 4 ? Tables->FromByte[Src[3]] : MIPGEN_LINEAR_MAX;
+		}
+	}
+}
+
+
+static void MipGen_Export(const MipGen_Context *Context, int y)
+{
+	const MipGen_Image *Level = Context->Level;
+	const MipGen_Tables *Tables = Context->Tables;
+	const uint8_t *Colour = Context->Params->SRGB ? Tables->ToSrgb : Tables->ToByte;
+	const int16_t *Src = Context->Linear + (size_t)y * Level->Width * 4;
+	uint8_t *Dest = (uint8_t*)Level->Pixels + y * Level->Stride;
+	int x;
+
+	if(Level->BytesPerPixel == 4)
+	{
+		for(x = 0; x < Level->Width; x++, Src += 4, Dest += 4)
+		{
+			Dest[0] = Colour[Src[0]];
+			Dest[1] = Colour[Src[1]];
+			Dest[2] = Colour[Src[2]];
+			Dest[3] = Tables->ToByte[Src[3]];
+		}
+	}
+	else
+	{
+		for(x = 0; x < Level->Width; x++, Src += 4, Dest += 3)
+		{
+			Dest[0] = Colour[Src[0]];
+			Dest[1] = Colour[Src[1]];
+			Dest[2] = Colour[Src[2]];
+		}
+	}
+}
+
+
+// the plain kernels are only built where there is no SSE2 to use instead
+#ifndef MIPGEN_HAVE_SSE2
+
+static void MipGen_FilterRows_C(const MipGen_Context *Context, int First, int End)
+{
+	const MipGen_Taps *Taps = &Context->TapsX;
+	int Width = Context->Level->Width;
+	int x, y, k, c;
+
+	for(y = First; y < End; y++)
+	{
+		const int16_t *Row = Context->Above + (size_t)y * Context->AboveWidth * 4;
+		int16_t *Dest = Context->Temp + (size_t)y * Width * 4;
+
+		for(x = 0; x < Width; x++)
+		{
+			const int *Index = Taps->Index + (size_t)x * Taps->Count;
+			const int32_t *Pairs = Taps->Pairs + (size_t)x * (Taps->Count / 2);
+			int32_t Sum[4] = { 0, 0, 0, 0 };
+
+			for(k = 0; k < Taps->Count; k += 2)
+			{
+				const int16_t *a = Row + Index[k] * 4;
+				const int16_t *b = Row + Index[k + 1] * 4;
+				int32_t wa = MipGen_PairLow(Pairs[k / 2]);
+				int32_t wb = MipGen_PairHigh(Pairs[k / 2]);
+
+				for(c = 0; c < 4; c++)
+					Sum[c] += a[c] * wa + b[c] * wb;
+			}
+
+			for(c = 0; c < 4; c++)
+				Dest[x * 4 + c] = MipGen_Round(Sum[c]);
+		}
+	}
+}
+
+
+static void MipGen_FilterColumns_C(const MipGen_Context *Context, int First, int End)
+{
+	const MipGen_Taps *Taps = &Context->TapsY;
+	int Count = Context->Level->Width * 4;
+	int i, y, k;
+
+	for(y = First; y < End; y++)
+	{
+		const int *Index = Taps->Index + (size_t)y * Taps->Count;
+		const int32_t *Pairs = Taps->Pairs + (size_t)y * (Taps->Count / 2);
+		int16_t *Dest = Context->Linear + (size_t)y * Count;
+
+		for(i = 0; i < Count; i++)
+		{
+			int32_t Sum = 0;
+
+			for(k = 0; k < Taps->Count; k += 2)
+			{
+				Sum += Context->Temp[(size_t)Index[k] * Count + i] * MipGen_PairLow(Pairs[k / 2]) +
+					   Context->Temp[(size_t)Index[k + 1] * Count + i] * MipGen_PairHigh(Pairs[k / 2]);
+			}
+
+			Dest[i] = MipGen_Round(Sum);
+		}
+
+		MipGen_Export(Context, y);
+	}
+}
+
+#endif
+
+
+#ifdef MIPGEN_HAVE_SSE2
+
+// four 32-bit sums to 16 bits the way MipGen_Round does it: packs saturates
+// above, anything negative ends up at zero
+static __m128i MipGen_Round_SSE2(__m128i Lo, __m128i Hi)
+{
+	const __m128i Half = _mm_set1_epi32(MIPGEN_WEIGHT_ONE / 2);
+
+	Lo = _mm_srai_epi32(_mm_add_epi32(Lo, Half), MIPGEN_WEIGHT_BITS);
+	Hi = _mm_srai_epi32(_mm_add_epi32(Hi, Half), MIPGEN_WEIGHT_BITS);
+	return _mm_max_epi16(_mm_packs_epi32(Lo, Hi), _mm_setzero_si128());
+}
+
+
+static void MipGen_FilterRows_SSE2(const MipGen_Context *Context, int First, int End)
+{
+	const MipGen_Taps *Taps = &Context->TapsX;
+	int Width = Context->Level->Width;
+	int x, y, k;
+
+	for(y = First; y < End; y++)
+	{
+		const int16_t *Row = Context->Above + (size_t)y * Context->AboveWidth * 4;
+		int16_t *Dest = Context->Temp + (size_t)y * Width * 4;
+
+		for(x = 0; x < Width; x++)
+		{
+			const int *Index = Taps->Index + (size_t)x * Taps->Count;
+			const int32_t *Pairs = Taps->Pairs + (size_t)x * (Taps->Count / 2);
+			__m128i Sum = _mm_setzero_si128();
+
+			// a pixel from each of two taps, channels interleaved, times both weights
+			for(k = 0; k < Taps->Count; k += 2)
+			{
+				__m128i a = _mm_loadl_epi64((const __m128i*)(Row + Index[k] * 4));
+				__m128i b = _mm_loadl_epi64((const __m128i*)(Row + Index[k + 1] * 4));
+
+				Sum = _mm_add_epi32(Sum, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_set1_epi32(Pairs[k / 2])));
+			}
+
+			_mm_storel_epi64((__m128i*)(Dest + x * 4), MipGen_Round_SSE2(Sum, Sum));
+		}
+	}
+}
+
+
+static void MipGen_FilterColumns_SSE2(const MipGen_Context *Context, int First, int End)
+{
+	const MipGen_Taps *Taps = &Context->TapsY;
+	int Count = Context->Level->Width * 4;
+	int i, y, k;
+
+	for(y = First; y < End; y++)
+	{
+		const int *Index = Taps->Index + (size_t)y * Taps->Count;
+		const int32_t *Pairs = Taps->Pairs + (size_t)y * (Taps->Count / 2);
+		int16_t *Dest = Context->Linear + (size_t)y * Count;
+
+		for(i = 0; i + 8 <= Count; i += 8)
+		{
+			__m128i Lo = _mm_setzero_si128();
+			__m128i Hi = _mm_setzero_si128();
+
+			for(k = 0; k < Taps->Count; k += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(Context->Temp + (size_t)Index[k] * Count + i));
+				__m128i b = _mm_loadu_si128((const __m128i*)(Context->Temp + (size_t)Index[k + 1] * Count + i));
+				__m128i w = _mm_set1_epi32(Pairs[k / 2]);
+
+				Lo = _mm_add_epi32(Lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+				Hi = _mm_add_epi32(Hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+			}
+
+			_mm_storeu_si128((__m128i*)(Dest + i), MipGen_Round_SSE2(Lo, Hi));
+		}
+
+		// an odd width leaves one pixel
+		for(; i < Count; i++)
+		{
+			int32_t Sum = 0;
+
+			for(k = 0; k < Taps->Count; k += 2)
+			{
+				Sum += Context->Temp[(size_t)Index[k] * Count + i] * MipGen_PairLow(Pairs[k / 2]) +
+					   Context->Temp[(size_t)Index[k + 1] * Count + i] * MipGen_PairHigh(Pairs[k / 2]);
+			}
+
+			Dest[i] = MipGen_Round(Sum);
+		}
+
+		MipGen_Export(Context, y);
+	}
+}
+
+#define MipGen_FilterRows		MipGen_FilterRows_SSE2
+#define MipGen_FilterColumns	MipGen_FilterColumns_SSE2
+
+#else
+
+#define MipGen_FilterRows		MipGen_FilterRows_C
+#define MipGen_FilterColumns	MipGen_FilterColumns_C
+
+#endif
+
+
+static void MipGen_RunBand(void *Context, int Worker)
+{
+	const MipGen_Band *Band = (const MipGen_Band*)Context;
+
+	(void)Worker;
+
+	Band->Func(Band->Context, Band->First, Band->End);
+}
+
+
+// runs Func over Rows rows, in bands on Pool if there is enough work
+static void MipGen_RunPass(const MipGen_Context *Context, MipGen_PassFunc Func, int Rows, int Width, ThreadPool *Pool)
+{
+	int BandRows = TGA2GEBMP_MAX(MIPGEN_BAND_ROWS, MIPGEN_BAND_PIXELS / TGA2GEBMP_MAX(Width, 1));
+	int BandCount = (Rows + BandRows - 1) / BandRows;
+	ThreadPool_Group *Group = NULL;
+	MipGen_Band *Bands = NULL;
+	int i;
+
+	if(Pool && BandCount > 1)
+	{
+		Bands = (MipGen_Band*)malloc(BandCount * sizeof(MipGen_Band));
+		Group = ThreadPool_CreateGroup();
+	}
+
+	if(!Bands || !Group)
+	{
+		free(Bands);
+		ThreadPool_DestroyGroup(&Group);
+		Func(Context, 0, Rows);
+		return;
+	}
+
+	for(i = 0; i < BandCount; i++)
+	{
+		Bands[i].Context = Context;
+		Bands[i].Func = Func;
+		Bands[i].First = i * BandRows;
+		Bands[i].End = TGA2GEBMP_MIN(Rows, (i + 1) * BandRows);
+
+		if(!ThreadPool_Submit(Pool, Group, MipGen_RunBand, &Bands[i]))
+			MipGen_RunBand(&Bands[i], -1);
+	}
+
+	ThreadPool_Wait(Pool, Group);
+	ThreadPool_DestroyGroup(&Group);
+	free(Bands);
+}
+
+
+static void MipGen_GetAlphaHistogram(const MipGen_Image *Image, uint64_t *Histogram)
+{
+	const uint8_t *Row;
+	int x, y;
+
+	memset(Histogram, 0, 256 * sizeof(uint64_t));
+
+	for(y = 0; y < Image->Height; y++)
+	{
+		Row = (const uint8_t*)Image->Pixels + y * Image->Stride;
+		for(x = 0; x < Image->Width; x++)
+			Histogram[Row[x * 4 + 3]]++;
+	}
+}
+
+
+static int MipGen_ScaleAlpha(int Alpha, int Scale)
+{
+	Alpha = (Alpha * Scale + 128) >> 8;
+	return Alpha > 255 ? 255 : Alpha;
+}
+
+
+static uint64_t MipGen_CountCovered(const uint64_t *Histogram, int Scale, int AlphaRef)
+{
+	uint64_t Covered = 0;
+	int a;
+
+	for(a = 0; a < 256; a++)
+	{
+		if(MipGen_ScaleAlpha(a, Scale) >= AlphaRef)
+			Covered += Histogram[a];
+	}
+
+	return Covered;
+}
+
+
+// scale the level's alpha so Covered / Pixels of it passes AlphaRef
+static void MipGen_KeepCoverage(const MipGen_Image *Level, uint64_t Covered, uint64_t Pixels, int AlphaRef)
+{
+	uint64_t Histogram[256];
+	uint64_t LevelPixels = (uint64_t)Level->Width * Level->Height;
+	uint64_t Target = (Covered * LevelPixels + Pixels / 2) / Pixels;
+	int Low = 0, High = MIPGEN_MAX_ALPHA_SCALE;
+	int Scale, x, y;
+	uint8_t *Row;
+
+	MipGen_GetAlphaHistogram(Level, Histogram);
+
+	// coverage only grows with the scale: find the smallest that reaches the
+	// target, then take whichever of it and the one below is closer
+	while(Low < High)
+	{
+		int Mid = (Low + High) / 2;
+
+		if(MipGen_CountCovered(Histogram, Mid, AlphaRef) >= Target)
+			High = Mid;
+		else
+			Low = Mid + 1;
+	}
+
+	Scale = Low;
+	if(Scale > 0 && MipGen_CountCovered(Histogram, Scale, AlphaRef) >= Target &&
+	   Target - MipGen_CountCovered(Histogram, Scale - 1, AlphaRef) <
+					MipGen_CountCovered(Histogram, Scale, AlphaRef) - Target)
+		Scale--;
+
+	if(Scale == 256)
+		return;
+
+	for(y = 0; y < Level->Height; y++)
+	{
+		Row = (uint8_t*)Level->Pixels + y * Level->Stride;
+		for(x = 0; x < Level->Width; x++)
+			Row[x * 4 + 3] = (uint8_t)MipGen_ScaleAlpha(Row[x * 4 + 3], Scale);
+	}
+}
+
+
+int MipGen_Build(const MipGen_Params *Params, const MipGen_Image *Source, MipGen_Image *Levels, int Count, ThreadPool *Pool)
+{
+	MipGen_Context Context;
+	MipGen_Tables *Tables;
+	int16_t *Buffers[2];
+	size_t BufferSize[2], TempSize;
+	uint64_t Histogram[256];
+	uint64_t Covered = 0;
+	int AboveWidth, AboveHeight;
+	int Coverage;
+	int Result = 1;
+	int i;
+
+	if(Count <= 0)
+		return 1;
+
+	Coverage = Params->AlphaCoverage && Source->BytesPerPixel == 4;
+	if(Coverage)
+	{
+		MipGen_GetAlphaHistogram(Source, Histogram);
+		Covered = MipGen_CountCovered(Histogram, 256, Params->AlphaRef);
+	}
+
+	// levels alternate between two buffers, the full-size image in the first
+	BufferSize[0] = (size_t)Source->Width * Source->Height;
+	BufferSize[1] = 0;
+	TempSize = 0;
+	AboveHeight = Source->Height;
+	for(i = 0; i < Count; i++)
+	{
+		BufferSize[(i + 1) & 1] = TGA2GEBMP_MAX(BufferSize[(i + 1) & 1], (size_t)Levels[i].Width * Levels[i].Height);
+		TempSize = TGA2GEBMP_MAX(TempSize, (size_t)Levels[i].Width * AboveHeight);
+		AboveHeight = Levels[i].Height;
+	}
+
+	Tables = (MipGen_Tables*)malloc(sizeof(MipGen_Tables));
+	Buffers[0] = (int16_t*)malloc(BufferSize[0] * 4 * sizeof(int16_t));
+	Buffers[1] = (int16_t*)malloc(BufferSize[1] * 4 * sizeof(int16_t));
+	memset(&Context, 0, sizeof(Context));
+	Context.Temp = (int16_t*)malloc(TempSize * 4 * sizeof(int16_t));
+	if(!Tables || !Buffers[0] || !Buffers[1] || !Context.Temp)
+	{
+		free(Tables);
+		free(Buffers[0]);
+		free(Buffers[1]);
+		free(Context.Temp);
+		return 0;
+	}
+
+	MipGen_InitTables(Tables);
+	Context.Params = Params;
+	Context.Tables = Tables;
+
+	Context.Source = Source;
+	Context.Linear = Buffers[0];
+	MipGen_RunPass(&Context, MipGen_Import, Source->Height, Source->Width, Pool);
+
+	AboveWidth = Source->Width;
+	AboveHeight = Source->Height;
+
+	for(i = 0; i < Count && Result; i++)
+	{
+		Context.Above = Buffers[i & 1];
+		Context.AboveWidth = AboveWidth;
+		Context.Linear = Buffers[(i + 1) & 1];
+		Context.Level = &Levels[i];
+
+		if(!MipGen_InitTaps(&Context.TapsX, AboveWidth, Levels[i].Width, Params->Filter) ||
+		   !MipGen_InitTaps(&Context.TapsY, AboveHeight, Levels[i].Height, Params->Filter))
+		{
+			MipGen_FreeTaps(&Context.TapsX);
+			Result = 0;
+			break;
+		}
+
+		MipGen_RunPass(&Context, MipGen_FilterRows, AboveHeight, AboveWidth, Pool);
+		MipGen_RunPass(&Context, MipGen_FilterColumns, Levels[i].Height, Levels[i].Width * Context.TapsY.Count, Pool);
+
+		MipGen_FreeTaps(&Context.TapsX);
+		MipGen_FreeTaps(&Context.TapsY);
+
+		// only the 8-bit level is scaled, the next one is made from unscaled alpha
+		if(Coverage && Levels[i].BytesPerPixel == 4)
+			MipGen_KeepCoverage(&Levels[i], Covered, (uint64_t)Source->Width * Source->Height, Params->AlphaRef);
+
+		AboveWidth = Levels[i].Width;
+		AboveHeight = Levels[i].Height;
+	}
+
+	free(Tables);
+	free(Buffers[0]);
+	free(Buffers[1]);
+	free(Context.Temp);
+
+	return Result;
+}
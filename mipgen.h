@@ -0,0 +1,72 @@
+/**
+ * @file mipgen.h
+ *
+ * Mip chain generation for skins. Every level is filtered from the one above
+ * it with a separable box or Kaiser-windowed sinc filter. Colour channels
+ * are filtered in linear light (sRGB is decoded and re-encoded through
+ * lookup tables) and the chain is carried at 15 bits per channel, so
+ * rounding does not build up from level to level. For cut-out textures the
+ * alpha of every level can be scaled so the same share of pixels passes the
+ * alpha test as in the full-size image, which keeps foliage and fences from
+ * thinning out in the distance.
+ *
+ * Levels are split into bands of rows that run in parallel on a thread
+ * pool. All arithmetic is in integers and the SSE2 and plain C kernels give
+ * identical results, so the output does not depend on the thread count or
+ * the processor.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "threadpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIPGEN_FILTER_BOX			0
+#define MIPGEN_FILTER_KAISER		1
+
+typedef struct	MipGen_Params
+{
+	int			Filter;			/* MIPGEN_FILTER_ */
+	int			SRGB;			/* colour is sRGB encoded and filtered in linear light */
+	int			AlphaCoverage;	/* keep the share of pixels with alpha >= AlphaRef */
+	int			AlphaRef;		/* 1 .. 255 */
+}	MipGen_Params;
+
+/* rows of B, G, R (3 bytes per pixel) or B, G, R, A (4 bytes per pixel),
+   the layouts of GE_PIXELFORMAT_24BIT_BGR and GE_PIXELFORMAT_32BIT_ARGB */
+typedef struct	MipGen_Image
+{
+	int			Width;
+	int			Height;
+	int			BytesPerPixel;
+	ptrdiff_t	Stride;			/* in bytes */
+	void		*Pixels;
+}	MipGen_Image;
+
+void MipGen_SetDefaults(MipGen_Params *Params);
+
+/* levels down to 1x1, including the full-size image */
+int MipGen_GetMaxLevels(int Width, int Height);
+
+/* whether Image looks like a cut-out: some pixels are transparent and
+   nearly all of them are either fully transparent or fully opaque */
+int MipGen_IsCutout(const MipGen_Image *Image);
+
+/* fills Levels[0 .. Count - 1] with mips 1 .. Count of Source; the caller
+   sets up every level's size, layout and pixels, each level is reduced from
+   the one before it whatever the sizes are. Pool may be NULL. Returns 0 if
+   out of memory */
+int MipGen_Build(const MipGen_Params *Params, const MipGen_Image *Source, MipGen_Image *Levels, int Count, ThreadPool *Pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,373 @@
+/**
+ * @file pack16.c
+ *
+ * 32-bit to 16-bit conversion, see pack16.h.
+ */
+#include "pack16.h"
+
+// SSE2 is part of every x64 target; 32-bit builds only use it when the
+// compiler is allowed to
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PACK16_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#define PACK16_BAND_ROWS		64			// error diffusion restarts every this many rows
+#define PACK16_ALPHA_REF		128
+
+// per channel B, G, R, A: bits kept (0 for none) and where they go
+typedef struct	Pack16_Layout
+{
+	int			Bits[4];
+	int			Shift[4];
+}	Pack16_Layout;
+
+typedef struct	Pack16_Context
+{
+	const Pack16_Image	*Source;
+	uint16_t			*Dest;
+	ptrdiff_t			DestStride;
+	int					Dither;
+	int					Key;			// transparent pixels become PACK16_KEY
+	Pack16_Layout		Layout;
+	uint8_t				Offsets[4][16];	// added before truncating, per row mod 4 for four pixels
+	// error diffusion: per channel and value the nearest level, in the top
+	// bits, and what the engine expands that level back to; channels that
+	// are dropped or 1 bit have no error
+	uint8_t				Rounded[4][256];
+	uint8_t				Expanded[4][256];
+}	Pack16_Context;
+
+typedef struct	Pack16_Band
+{
+	const Pack16_Context	*Context;
+	int						First;
+	int						End;
+	int						Failed;
+}	Pack16_Band;
+
+static const Pack16_Layout Pack16_Layouts[4] =
+{
+	{ { 5, 6, 5, 0 }, { 0, 5, 11, 0 } },	// PACK16_565
+	{ { 5, 5, 5, 0 }, { 0, 5, 10, 0 } },	// PACK16_555
+	{ { 5, 5, 5, 1 }, { 0, 5, 10, 15 } },	// PACK16_1555
+	{ { 4, 4, 4, 4 }, { 0, 4, 8, 12 } },	// PACK16_4444
+};
+
+static const uint8_t Pack16_Bayer[4][4] =
+{
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+
+int Pack16_HasAlpha(int Layout)
+{
+	return Layout == PACK16_1555 || Layout == PACK16_4444;
+}
+
+
+// a pixel whose channels already carry their offsets
+static uint16_t Pack16_PackPixel(const Pack16_Context *Context, const uint8_t *p, int Alpha)
+{
+	const Pack16_Layout *Layout = &Context->Layout;
+	uint32_t Packed = 0;
+	int c;
+
+	if(Context->Key && Alpha < PACK16_ALPHA_REF)
+		return PACK16_KEY;
+
+	for(c = 0; c < 4; c++)
+	{
+		if(Layout->Bits[c])
+			Packed |= (uint32_t)(p[c] >> (8 - Layout->Bits[c])) << Layout->Shift[c];
+	}
+
+	// the key is kept for transparent pixels, black is as good
+	if(Context->Key && Packed == PACK16_KEY)
+		Packed = 0;
+
+	return (uint16_t)Packed;
+}
+
+
+static void Pack16_PackRow_C(const Pack16_Context *Context, const uint8_t *Source, uint16_t *Dest, int First, int Width, const uint8_t *Offsets)
+{
+	uint8_t Biased[4];
+	int x, c;
+
+	for(x = First; x < Width; x++, Source += 4)
+	{
+		for(c = 0; c < 4; c++)
+			Biased[c] = (uint8_t)TGA2GEBMP_MIN(Source[c] + Offsets[(x & 3) * 4 + c], 255);
+
+		Dest[x] = Pack16_PackPixel(Context, Biased, Source[3]);
+	}
+}
+
+
+#ifdef PACK16_HAVE_SSE2
+
+// four pixels at a time: saturating add of the offsets, then every channel
+// moved into place in 32-bit lanes and the lanes narrowed to 16 bits
+static void Pack16_PackRow_SSE2(const Pack16_Context *Context, const uint8_t *Source, uint16_t *Dest, int Width, const uint8_t *Offsets)
+{
+	const Pack16_Layout *Layout = &Context->Layout;
+	const __m128i Bias = _mm_loadu_si128((const __m128i*)Offsets);
+	const __m128i Half = _mm_set1_epi32(0x8000);
+	const __m128i Key = _mm_set1_epi32(PACK16_KEY);
+	const __m128i AlphaRef = _mm_set1_epi32(PACK16_ALPHA_REF);
+	__m128i Down[4], Up[4], Mask[4];
+	int Channels = 0;
+	int x, c;
+
+	for(c = 0; c < 4; c++)
+	{
+		if(!Layout->Bits[c])
+			continue;
+
+		Down[Channels] = _mm_cvtsi32_si128(c * 8 + 8 - Layout->Bits[c]);
+		Up[Channels] = _mm_cvtsi32_si128(Layout->Shift[c]);
+		Mask[Channels] = _mm_set1_epi32((1 << Layout->Bits[c]) - 1);
+		Channels++;
+	}
+
+	for(x = 0; x + 4 <= Width; x += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(Source + x * 4));
+		__m128i Biased = _mm_adds_epu8(p, Bias);
+		__m128i Packed = _mm_setzero_si128();
+
+		for(c = 0; c < Channels; c++)
+			Packed = _mm_or_si128(Packed, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(Biased, Down[c]), Mask[c]), Up[c]));
+
+		if(Context->Key)
+		{
+			__m128i Transparent = _mm_cmplt_epi32(_mm_srli_epi32(p, 24), AlphaRef);
+
+			Packed = _mm_andnot_si128(_mm_cmpeq_epi32(Packed, Key), Packed);
+			Packed = _mm_or_si128(_mm_andnot_si128(Transparent, Packed), _mm_and_si128(Transparent, Key));
+		}
+
+		// packs_epi32 saturates as signed, so go through -32768 .. 32767
+		Packed = _mm_packs_epi32(_mm_sub_epi32(Packed, Half), Half);
+		Packed = _mm_xor_si128(Packed, _mm_set1_epi16((short)0x8000));
+		_mm_storel_epi64((__m128i*)(Dest + x), Packed);
+	}
+
+	Pack16_PackRow_C(Context, Source + x * 4, Dest, x, Width, Offsets);
+}
+
+#define Pack16_PackRow(Context, Source, Dest, Width, Offsets)	Pack16_PackRow_SSE2(Context, Source, Dest, Width, Offsets)
+
+#else
+
+#define Pack16_PackRow(Context, Source, Dest, Width, Offsets)	Pack16_PackRow_C(Context, Source, Dest, 0, Width, Offsets)
+
+#endif
+
+
+static void Pack16_ConvertPlain(const Pack16_Context *Context, int First, int End)
+{
+	const Pack16_Image *Source = Context->Source;
+	int y;
+
+	for(y = First; y < End; y++)
+	{
+		Pack16_PackRow(Context, (const uint8_t*)Source->Pixels + y * Source->Stride,
+					   (uint16_t*)((uint8_t*)Context->Dest + y * Context->DestStride), Source->Width, Context->Offsets[y & 3]);
+	}
+}
+
+
+// Floyd-Steinberg, every other row right to left, errors kept in sixteenths.
+// A 1-bit alpha is only thresholded, and no error crosses a transparent
+// pixel that becomes the colour key. What goes to the next pixel and the
+// row below is carried in locals, each entry of the next row is written once
+static int Pack16_ConvertDiffuse(const Pack16_Context *Context, int First, int End)
+{
+	const Pack16_Image *Source = Context->Source;
+	int Width = Source->Width;
+	int *Errors, *Cur, *Next, *Swap;
+	int x, y, c;
+
+	// two rows of four channels with a pixel of slack at either end
+	Errors = (int*)calloc((size_t)(Width + 2) * 4 * 2, sizeof(int));
+	if(!Errors)
+		return 0;
+
+	Cur = Errors;
+	Next = Errors + (Width + 2) * 4;
+
+	for(y = First; y < End; y++)
+	{
+		const uint8_t *Row = (const uint8_t*)Source->Pixels + y * Source->Stride;
+		uint16_t *Out = (uint16_t*)((uint8_t*)Context->Dest + y * Context->DestStride);
+		int Step = (y & 1) ? -1 : 1;
+		int Right[4] = { 0, 0, 0, 0 };		// to the next pixel
+		int Behind[4] = { 0, 0, 0, 0 };		// below the previous pixel
+		int Below[4] = { 0, 0, 0, 0 };		// below this pixel
+		int *d;
+
+		x = (y & 1) ? Width - 1 : 0;
+		d = Next + (x + 1) * 4;
+
+		for(; x >= 0 && x < Width; x += Step, d += Step * 4)
+		{
+			const uint8_t *p = Row + x * 4;
+			const int *e = Cur + (x + 1) * 4;
+			uint8_t Rounded[4];
+
+			if(Context->Key && p[3] < PACK16_ALPHA_REF)
+			{
+				Out[x] = PACK16_KEY;
+				for(c = 0; c < 4; c++)
+				{
+					d[-Step * 4 + c] = Behind[c];
+					Behind[c] = Below[c];
+					Below[c] = Right[c] = 0;
+				}
+				continue;
+			}
+
+			for(c = 0; c < 4; c++)
+			{
+				int Value = p[c] + ((e[c] + Right[c] + 8) >> 4);
+				int Error;
+
+				Value = Value < 0 ? 0 : Value > 255 ? 255 : Value;
+				Rounded[c] = Context->Rounded[c][Value];
+				Error = Value - Context->Expanded[c][Value];
+
+				d[-Step * 4 + c] = Behind[c] + Error * 3;
+				Behind[c] = Below[c] + Error * 5;
+				Below[c] = Error;
+				Right[c] = Error * 7;
+			}
+
+			Out[x] = Pack16_PackPixel(Context, Rounded, p[3]);
+		}
+
+		// this row's last pixel and the slack entry past it
+		for(c = 0; c < 4; c++)
+		{
+			d[-Step * 4 + c] = Behind[c];
+			d[c] = Below[c];
+		}
+
+		Swap = Cur;
+		Cur = Next;
+		Next = Swap;
+	}
+
+	free(Errors);
+	return 1;
+}
+
+
+static void Pack16_RunBand(void *Context, int Worker)
+{
+	Pack16_Band *Band = (Pack16_Band*)Context;
+
+	(void)Worker;
+
+	if(Band->Context->Dither == PACK16_DITHER_DIFFUSE)
+		Band->Failed = !Pack16_ConvertDiffuse(Band->Context, Band->First, Band->End);
+	else
+		Pack16_ConvertPlain(Band->Context, Band->First, Band->End);
+}
+
+
+int Pack16_Convert(const Pack16_Params *Params, const Pack16_Image *Source, uint16_t *Dest, ptrdiff_t DestStride, ThreadPool *Pool)
+{
+	Pack16_Context Context;
+	Pack16_Band *Bands;
+	ThreadPool_Group *Group = NULL;
+	int BandCount = (Source->Height + PACK16_BAND_ROWS - 1) / PACK16_BAND_ROWS;
+	int Failed = 0;
+	int i, x, y, c, Step;
+
+	Context.Source = Source;
+	Context.Dest = Dest;
+	Context.DestStride = DestStride;
+	Context.Dither = Params->Dither;
+	Context.Key = Params->ColorKey && !Pack16_HasAlpha(Params->Layout);
+	Context.Layout = Pack16_Layouts[Params->Layout & 3];
+
+	if(Params->SwapRB)
+	{
+		Context.Layout.Shift[0] = Pack16_Layouts[Params->Layout & 3].Shift[2];
+		Context.Layout.Shift[2] = Pack16_Layouts[Params->Layout & 3].Shift[0];
+	}
+
+	// rounding to the nearest level, or thresholds spread over a 4x4 tile;
+	// a 1-bit alpha is cut at 128
+	for(y = 0; y < 4; y++)
+	{
+		for(x = 0; x < 4; x++)
+		{
+			for(c = 0; c < 4; c++)
+			{
+				Step = 1 << (8 - Context.Layout.Bits[c]);
+				if(Context.Layout.Bits[c] <= 1)
+					Context.Offsets[y][x * 4 + c] = 0;
+				else if(Params->Dither == PACK16_DITHER_ORDERED)
+					Context.Offsets[y][x * 4 + c] = (uint8_t)((Pack16_Bayer[y][x] * Step + Step / 2) / 16);
+				else
+					Context.Offsets[y][x * 4 + c] = (uint8_t)(Step / 2);
+			}
+		}
+	}
+
+	for(c = 0; c < 4; c++)
+	{
+		int Bits = Context.Layout.Bits[c];
+
+		for(i = 0; i < 256; i++)
+		{
+			int Level = TGA2GEBMP_MIN(i + (1 << (7 - Bits)), 255) >> (8 - Bits);
+
+			if(Bits <= 1)
+			{
+				Context.Rounded[c][i] = Context.Expanded[c][i] = (uint8_t)i;
+				continue;
+			}
+
+			// levels are widened by repeating their bits
+			Context.Rounded[c][i] = (uint8_t)(Level << (8 - Bits));
+			Context.Expanded[c][i] = (uint8_t)(Context.Rounded[c][i] | (Context.Rounded[c][i] >> Bits) | (Context.Rounded[c][i] >> (2 * Bits)));
+		}
+	}
+
+	Bands = (Pack16_Band*)malloc(TGA2GEBMP_MAX(BandCount, 1) * sizeof(Pack16_Band));
+	if(!Bands)
+		return 0;
+
+	if(Pool && BandCount > 1)
+		Group = ThreadPool_CreateGroup();
+
+	for(i = 0; i < BandCount; i++)
+	{
+		Bands[i].Context = &Context;
+		Bands[i].First = i * PACK16_BAND_ROWS;
+		Bands[i].End = TGA2GEBMP_MIN(Source->Height, (i + 1) * PACK16_BAND_ROWS);
+		Bands[i].Failed = 0;
+
+		if(!Group || !ThreadPool_Submit(Pool, Group, Pack16_RunBand, &Bands[i]))
+			Pack16_RunBand(&Bands[i], -1);
+	}
+
+	if(Group)
+	{
+		ThreadPool_Wait(Pool, Group);
+		ThreadPool_DestroyGroup(&Group);
+	}
+
+	for(i = 0; i < BandCount; i++)
+		Failed |= Bands[i].Failed;
+
+	free(Bands);
+	return !Failed;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file pack16.h
+ *
+ * Conversion of 32-bit skins to the engine's 16-bit layouts (565, 555, 1555
+ * and 4444) with plain rounding, 4x4 ordered dithering or Floyd-Steinberg
+ * error diffusion. Rounding and ordered dithering work on four pixels at a
+ * time with SSE2; error diffusion is scalar. Rows are converted in bands on
+ * a thread pool, error diffusion starts afresh in every band and the bands
+ * do not depend on the thread count, so neither does the output.
+ *
+ * Layouts without alpha can keep cut-outs with a colour key: pixels with
+ * alpha below 128 become PACK16_KEY, which no opaque pixel is given.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef PACK16_H
+#define PACK16_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "threadpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* channels from the low bits up, blue first unless swapped */
+#define PACK16_565				0
+#define PACK16_555				1
+#define PACK16_1555				2		/* alpha in the top bit */
+#define PACK16_4444				3		/* alpha in the top four bits */
+
+#define PACK16_DITHER_NONE		0
+#define PACK16_DITHER_DIFFUSE	1
+#define PACK16_DITHER_ORDERED	2
+
+/* the colour key of PACK16_565 and PACK16_555 cut-outs, the dimmest blue */
+#define PACK16_KEY				0x0001
+
+typedef struct	Pack16_Params
+{
+	int			Layout;			/* PACK16_ */
+	int			SwapRB;			/* red in the low bits */
+	int			Dither;			/* PACK16_DITHER_ */
+	int			ColorKey;		/* transparent pixels become PACK16_KEY */
+}	Pack16_Params;
+
+/* rows of B, G, R, A bytes, the layout of GE_PIXELFORMAT_32BIT_ARGB */
+typedef struct	Pack16_Image
+{
+	int			Width;
+	int			Height;
+	ptrdiff_t	Stride;			/* in bytes */
+	const void	*Pixels;
+}	Pack16_Image;
+
+/* whether the layout has an alpha channel */
+int Pack16_HasAlpha(int Layout);
+
+/* writes Source to Dest, rows DestStride bytes apart; Pool may be NULL.
+   Returns 0 if out of memory */
+int Pack16_Convert(const Pack16_Params *Params, const Pack16_Image *Source, uint16_t *Dest, ptrdiff_t DestStride, ThreadPool *Pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
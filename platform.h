@@ -0,0 +1,51 @@
+/**
+ * @file platform.h
+ *
+ * Small portability layer shared by the dialog, the core and the
+ * command-line driver so the UI-free parts build on Windows and Linux.
+ */
+#ifndef TGA2GEBMP_PLATFORM_H
+#define TGA2GEBMP_PLATFORM_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1600
+	typedef signed __int8			int8_t;
+	typedef unsigned __int8			uint8_t;
+	typedef signed __int16			int16_t;
+	typedef unsigned __int16		uint16_t;
+	typedef signed __int32			int32_t;
+	typedef unsigned __int32		uint32_t;
+	typedef signed __int64			int64_t;
+	typedef unsigned __int64		uint64_t;
+#else
+	#include <stdint.h>
+#endif
+
+#ifdef _WIN32
+	#define TGA2GEBMP_DIRSEP		"\\"
+	#define tga2gebmp_stricmp		_stricmp
+	/* returns -1 on truncation, so compare results as unsigned */
+	#if defined(_MSC_VER) && _MSC_VER < 1900
+		#define snprintf			_snprintf
+	#endif
+#else
+	#include <limits.h>
+	#include <strings.h>
+	#define TGA2GEBMP_DIRSEP		"/"
+	#define tga2gebmp_stricmp		strcasecmp
+#endif
+
+#ifndef _MAX_PATH
+	#ifdef PATH_MAX
+		#define _MAX_PATH			PATH_MAX
+	#else
+		#define _MAX_PATH			260
+	#endif
+#endif
+
+#define TGA2GEBMP_MIN(a, b)			((a) < (b) ? (a) : (b))
+#define TGA2GEBMP_MAX(a, b)			((a) > (b) ? (a) : (b))
+
+#endif
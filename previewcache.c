@@ -0,0 +1,205 @@
+/**
+ * @file previewcache.c
+ *
+ * LRU list of preview images, most recently used first. An actor has tens of
+ * skins, so lookups walk the list.
+ */
+#include "previewcache.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct	PreviewCache_Entry
+{
+	struct PreviewCache_Entry	*Prev;
+	struct PreviewCache_Entry	*Next;
+	char						*Name;
+	uint64_t					Hash;
+	size_t						Bytes;
+	PreviewCache_Image			Image;
+}	PreviewCache_Entry;
+
+struct PreviewCache
+{
+	PreviewCache_Entry	*Head;		// most recently used
+	PreviewCache_Entry	*Tail;		// next to be evicted
+	PreviewCache_Stats	Stats;
+};
+
+
+static void PreviewCache_Unlink(PreviewCache *Cache, PreviewCache_Entry *Entry)
+{
+	if(Entry->Prev)
+		Entry->Prev->Next = Entry->Next;
+	else
+		Cache->Head = Entry->Next;
+
+	if(Entry->Next)
+		Entry->Next->Prev = Entry->Prev;
+	else
+		Cache->Tail = Entry->Prev;
+
+	Entry->Prev = Entry->Next = NULL;
+}
+
+
+static void PreviewCache_PushFront(PreviewCache *Cache, PreviewCache_Entry *Entry)
+{
+	Entry->Prev = NULL;
+	Entry->Next = Cache->Head;
+
+	if(Cache->Head)
+		Cache->Head->Prev = Entry;
+	else
+		Cache->Tail = Entry;
+
+	Cache->Head = Entry;
+}
+
+
+static void PreviewCache_Remove(PreviewCache *Cache, PreviewCache_Entry *Entry)
+{
+	PreviewCache_Unlink(Cache, Entry);
+
+	Cache->Stats.Entries--;
+	Cache->Stats.Bytes -= Entry->Bytes;
+
+	free(Entry->Image.Pixels);
+	free(Entry->Name);
+	free(Entry);
+}
+
+
+static PreviewCache_Entry *PreviewCache_Lookup(const PreviewCache *Cache, const char *Name, uint64_t Hash)
+{
+	PreviewCache_Entry *Entry;
+
+	for(Entry = Cache->Head; Entry; Entry = Entry->Next)
+	{
+		if(Entry->Hash == Hash && tga2gebmp_stricmp(Entry->Name, Name) == 0)
+			return Entry;
+	}
+
+	return NULL;
+}
+
+
+PreviewCache *PreviewCache_Create(size_t MaxBytes)
+{
+	PreviewCache *Cache;
+
+	Cache = (PreviewCache*)calloc(1, sizeof(PreviewCache));
+	if(!Cache)
+		return NULL;
+
+	Cache->Stats.MaxBytes = MaxBytes;
+	return Cache;
+}
+
+
+void PreviewCache_Destroy(PreviewCache **pCache)
+{
+	PreviewCache *Cache = *pCache;
+
+	if(!Cache)
+		return;
+
+	PreviewCache_Clear(Cache);
+	free(Cache);
+	*pCache = NULL;
+}
+
+
+const PreviewCache_Image *PreviewCache_Find(PreviewCache *Cache, const char *Name, uint64_t Hash)
+{
+	PreviewCache_Entry *Entry;
+
+	Entry = PreviewCache_Lookup(Cache, Name, Hash);
+	if(!Entry)
+	{
+		Cache->Stats.Misses++;
+		return NULL;
+	}
+
+	Cache->Stats.Hits++;
+
+	if(Entry != Cache->Head)
+	{
+		PreviewCache_Unlink(Cache, Entry);
+		PreviewCache_PushFront(Cache, Entry);
+	}
+
+	return &Entry->Image;
+}
+
+
+int PreviewCache_Contains(const PreviewCache *Cache, const char *Name, uint64_t Hash)
+{
+	return PreviewCache_Lookup(Cache, Name, Hash) != NULL;
+}
+
+
+const PreviewCache_Image *PreviewCache_Insert(PreviewCache *Cache, const char *Name, uint64_t Hash,
+											  int Width, int Height, ptrdiff_t Stride, void *Pixels)
+{
+	PreviewCache_Entry *Entry;
+
+	Entry = PreviewCache_Lookup(Cache, Name, Hash);
+	if(Entry)
+		PreviewCache_Remove(Cache, Entry);
+
+	Entry = (PreviewCache_Entry*)calloc(1, sizeof(PreviewCache_Entry));
+	if(Entry)
+		Entry->Name = (char*)malloc(strlen(Name) + 1);
+	if(!Entry || !Entry->Name)
+	{
+		free(Entry);
+		free(Pixels);
+		return NULL;
+	}
+
+	strcpy(Entry->Name, Name);
+	Entry->Hash = Hash;
+	Entry->Bytes = (size_t)Stride * Height;
+	Entry->Image.Width = Width;
+	Entry->Image.Height = Height;
+	Entry->Image.Stride = Stride;
+	Entry->Image.Pixels = Pixels;
+
+	while(Cache->Tail && Cache->Stats.Bytes + Entry->Bytes > Cache->Stats.MaxBytes)
+	{
+		PreviewCache_Remove(Cache, Cache->Tail);
+		Cache->Stats.Evictions++;
+	}
+
+	PreviewCache_PushFront(Cache, Entry);
+	Cache->Stats.Entries++;
+	Cache->Stats.Bytes += Entry->Bytes;
+
+	return &Entry->Image;
+}
+
+
+void PreviewCache_Invalidate(PreviewCache *Cache, const char *Name)
+{
+	PreviewCache_Entry *Entry, *Next;
+
+	for(Entry = Cache->Head; Entry; Entry = Next)
+	{
+		Next = Entry->Next;
+		if(tga2gebmp_stricmp(Entry->Name, Name) == 0)
+			PreviewCache_Remove(Cache, Entry);
+	}
+}
+
+
+void PreviewCache_Clear(PreviewCache *Cache)
+{
+	while(Cache->Head)
+		PreviewCache_Remove(Cache, Cache->Head);
+}
+
+
+void PreviewCache_GetStats(const PreviewCache *Cache, PreviewCache_Stats *Stats)
+{
+	*Stats = Cache->Stats;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file previewcache.h
+ *
+ * Size-bounded LRU cache of decoded, already reduced skin previews (32-bit
+ * B, G, R, X pixels in DIB row layout, see downsample.h). Entries are keyed
+ * by skin name and a hash of the skin's encoded bytes, so a replaced skin
+ * never hits a stale preview; PreviewCache_Invalidate frees the old one right
+ * away. Not thread-safe, the dialog only uses it from its own thread.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef PREVIEWCACHE_H
+#define PREVIEWCACHE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PreviewCache PreviewCache;
+
+typedef struct	PreviewCache_Image
+{
+	int			Width;
+	int			Height;
+	ptrdiff_t	Stride;			/* bytes per row */
+	void		*Pixels;
+}	PreviewCache_Image;
+
+typedef struct	PreviewCache_Stats
+{
+	uint64_t	Hits;
+	uint64_t	Misses;
+	uint64_t	Evictions;		/* entries dropped to stay under the limit */
+	int			Entries;
+	size_t		Bytes;			/* pixel bytes held */
+	size_t		MaxBytes;
+}	PreviewCache_Stats;
+
+PreviewCache *PreviewCache_Create(size_t MaxBytes);
+void PreviewCache_Destroy(PreviewCache **pCache);
+
+/* NULL on a miss; a hit becomes the most recently used entry. The image stays
+   valid until the next Insert, Invalidate or Clear */
+const PreviewCache_Image *PreviewCache_Find(PreviewCache *Cache, const char *Name, uint64_t Hash);
+/* like Find, but neither counts nor reorders; for deciding what to prefetch */
+int PreviewCache_Contains(const PreviewCache *Cache, const char *Name, uint64_t Hash);
+/* takes over Pixels (malloc'd, Stride * Height bytes) even on failure and
+   evicts the least recently used entries until the cache fits again; the
+   newest entry is always kept, however large. NULL if out of memory */
+const PreviewCache_Image *PreviewCache_Insert(PreviewCache *Cache, const char *Name, uint64_t Hash,
+											  int Width, int Height, ptrdiff_t Stride, void *Pixels);
+/* drops every entry for Name, whatever its hash */
+void PreviewCache_Invalidate(PreviewCache *Cache, const char *Name);
+void PreviewCache_Clear(PreviewCache *Cache);
+
+void PreviewCache_GetStats(const PreviewCache *Cache, PreviewCache_Stats *Stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
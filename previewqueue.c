@@ -0,0 +1,285 @@
+/**
+ * @file previewqueue.c
+ *
+ * One worker thread from threadpool.c. Every request submits a task, but a
+ * task does not carry its request: it runs whatever is at the front of the
+ * pending list when it starts, so reordering and cancelling only touch the
+ * list and leftover tasks find it empty.
+ */
+#include "previewqueue.h"
+#include "threadpool.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct	PreviewQueue_Job
+{
+	struct PreviewQueue_Job	*Next;
+	char					Name[_MAX_PATH];
+	uint64_t				Hash;
+	void					*Data;
+	size_t					Size;
+}	PreviewQueue_Job;
+
+typedef struct	PreviewQueue_Done
+{
+	struct PreviewQueue_Done	*Next;
+	PreviewQueue_Result			Result;
+}	PreviewQueue_Done;
+
+struct PreviewQueue
+{
+	ThreadPool				*Pool;
+	ThreadPool_Group		*Group;
+	ThreadPool_Gate			*Lock;			// a gate of one, guards everything below
+
+	PreviewQueue_Job		*Pending;		// front runs next
+	PreviewQueue_Job		*Running;
+	PreviewQueue_Done		*Done;			// oldest first
+	PreviewQueue_Done		*DoneTail;
+
+	PreviewQueue_DecodeFunc	Decode;
+	PreviewQueue_NotifyFunc	Notify;
+	void					*Context;
+};
+
+
+static void PreviewQueue_FreeJob(PreviewQueue_Job *Job)
+{
+	free(Job->Data);
+	free(Job);
+}
+
+
+static int PreviewQueue_IsJob(const PreviewQueue_Job *Job, const char *Name, uint64_t Hash)
+{
+	return Job->Hash == Hash && tga2gebmp_stricmp(Job->Name, Name) == 0;
+}
+
+
+static void PreviewQueue_RunNext(void *Context, int Worker)
+{
+	PreviewQueue *Queue = (PreviewQueue*)Context;
+	PreviewQueue_Job *Job;
+	PreviewQueue_Done *Done;
+
+	(void)Worker;
+
+	ThreadPool_EnterGate(Queue->Lock);
+	Job = Queue->Pending;
+	if(Job)
+	{
+		Queue->Pending = Job->Next;
+		Queue->Running = Job;
+	}
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	if(!Job)
+		return;
+
+	Done = (PreviewQueue_Done*)calloc(1, sizeof(PreviewQueue_Done));
+	if(Done)
+	{
+		strcpy(Done->Result.Name, Job->Name);
+		Done->Result.Hash = Job->Hash;
+		Done->Result.Pixels = Queue->Decode(Queue->Context, Job->Data, Job->Size,
+											&Done->Result.Width, &Done->Result.Height, &Done->Result.Stride);
+	}
+
+	ThreadPool_EnterGate(Queue->Lock);
+	Queue->Running = NULL;
+	if(Done)
+	{
+		if(Queue->DoneTail)
+			Queue->DoneTail->Next = Done;
+		else
+			Queue->Done = Done;
+		Queue->DoneTail = Done;
+	}
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	PreviewQueue_FreeJob(Job);
+
+	if(Done && Queue->Notify)
+		Queue->Notify(Queue->Context);
+}
+
+
+PreviewQueue *PreviewQueue_Create(PreviewQueue_DecodeFunc Decode, PreviewQueue_NotifyFunc Notify, void *Context)
+{
+	PreviewQueue *Queue;
+
+	Queue = (PreviewQueue*)calloc(1, sizeof(PreviewQueue));
+	if(!Queue)
+		return NULL;
+
+	Queue->Decode = Decode;
+	Queue->Notify = Notify;
+	Queue->Context = Context;
+
+	Queue->Pool = ThreadPool_Create(1);
+	Queue->Group = ThreadPool_CreateGroup();
+	Queue->Lock = ThreadPool_CreateGate(1);
+	if(!Queue->Pool || !Queue->Group || !Queue->Lock)
+	{
+		PreviewQueue_Destroy(&Queue);
+		return NULL;
+	}
+
+	return Queue;
+}
+
+
+void PreviewQueue_Destroy(PreviewQueue **pQueue)
+{
+	PreviewQueue *Queue = *pQueue;
+	PreviewQueue_Result Result;
+
+	if(!Queue)
+		return;
+
+	if(Queue->Lock)
+		PreviewQueue_CancelPending(Queue);
+
+	// lets the running request finish, the rest of the tasks find nothing to do
+	ThreadPool_Destroy(&Queue->Pool);
+
+	if(Queue->Lock)
+	{
+		while(PreviewQueue_GetResult(Queue, &Result))
+			free(Result.Pixels);
+	}
+
+	ThreadPool_DestroyGroup(&Queue->Group);
+	ThreadPool_DestroyGate(&Queue->Lock);
+	free(Queue);
+
+	*pQueue = NULL;
+}
+
+
+int PreviewQueue_Request(PreviewQueue *Queue, const char *Name, uint64_t Hash,
+						 const void *Data, size_t Size, int Urgent)
+{
+	PreviewQueue_Job *Job, **pLink;
+
+	if(strlen(Name) >= sizeof(Job->Name))
+		return 0;
+
+	ThreadPool_EnterGate(Queue->Lock);
+
+	if(Queue->Running && PreviewQueue_IsJob(Queue->Running, Name, Hash))
+	{
+		ThreadPool_LeaveGate(Queue->Lock);
+		return 1;
+	}
+
+	for(pLink = &Queue->Pending; *pLink; pLink = &(*pLink)->Next)
+	{
+		if(PreviewQueue_IsJob(*pLink, Name, Hash))
+		{
+			if(Urgent)
+			{
+				Job = *pLink;
+				*pLink = Job->Next;
+				Job->Next = Queue->Pending;
+				Queue->Pending = Job;
+			}
+			ThreadPool_LeaveGate(Queue->Lock);
+			return 1;
+		}
+	}
+
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	// copy outside the lock, skins can be several megabytes
+	Job = (PreviewQueue_Job*)calloc(1, sizeof(PreviewQueue_Job));
+	if(!Job)
+		return 0;
+
+	Job->Data = malloc(Size ? Size : 1);
+	if(!Job->Data)
+	{
+		free(Job);
+		return 0;
+	}
+
+	memcpy(Job->Data, Data, Size);
+	Job->Size = Size;
+	Job->Hash = Hash;
+	strcpy(Job->Name, Name);
+
+	ThreadPool_EnterGate(Queue->Lock);
+	if(Urgent)
+	{
+		Job->Next = Queue->Pending;
+		Queue->Pending = Job;
+	}
+	else
+	{
+		for(pLink = &Queue->Pending; *pLink; pLink = &(*pLink)->Next)
+			;
+		*pLink = Job;
+	}
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	if(!ThreadPool_Submit(Queue->Pool, Queue->Group, PreviewQueue_RunNext, Queue))
+	{
+		// without a task of its own it may never run, take it back out
+		ThreadPool_EnterGate(Queue->Lock);
+		for(pLink = &Queue->Pending; *pLink; pLink = &(*pLink)->Next)
+		{
+			if(*pLink == Job)
+			{
+				*pLink = Job->Next;
+				PreviewQueue_FreeJob(Job);
+				break;
+			}
+		}
+		ThreadPool_LeaveGate(Queue->Lock);
+		return 0;
+	}
+
+	return 1;
+}
+
+
+void PreviewQueue_CancelPending(PreviewQueue *Queue)
+{
+	PreviewQueue_Job *Job;
+
+	ThreadPool_EnterGate(Queue->Lock);
+	Job = Queue->Pending;
+	Queue->Pending = NULL;
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	while(Job)
+	{
+		PreviewQueue_Job *Next = Job->Next;
+
+		PreviewQueue_FreeJob(Job);
+		Job = Next;
+	}
+}
+
+
+int PreviewQueue_GetResult(PreviewQueue *Queue, PreviewQueue_Result *Result)
+{
+	PreviewQueue_Done *Done;
+
+	ThreadPool_EnterGate(Queue->Lock);
+	Done = Queue->Done;
+	if(Done)
+	{
+		Queue->Done = Done->Next;
+		if(!Queue->Done)
+			Queue->DoneTail = NULL;
+	}
+	ThreadPool_LeaveGate(Queue->Lock);
+
+	if(!Done)
+		return 0;
+
+	*Result = Done->Result;
+	free(Done);
+	return 1;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file previewqueue.h
+ *
+ * Background decoding of skin previews. The dialog requests previews for
+ * the selected skin and its neighbours; a worker thread decodes them one at
+ * a time, most urgent first, and calls Notify after each so the dialog can
+ * collect the result on its own thread (PreviewQueue_GetResult). Requests
+ * that have not started yet can be cancelled when the selection moves on.
+ *
+ * Every request carries its own copy of the encoded skin, so the session may
+ * replace or free skins while the worker is busy. Decoding itself is a
+ * callback, which keeps this module free of the Genesis engine.
+ */
+#ifndef PREVIEWQUEUE_H
+#define PREVIEWQUEUE_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PreviewQueue PreviewQueue;
+
+/* runs on the worker; returns malloc'd pixels, Stride bytes per row, or NULL */
+typedef void *(*PreviewQueue_DecodeFunc)(void *Context, const void *Data, size_t Size,
+										 int *pWidth, int *pHeight, ptrdiff_t *pStride);
+/* runs on the worker after a result has been queued */
+typedef void (*PreviewQueue_NotifyFunc)(void *Context);
+
+typedef struct	PreviewQueue_Result
+{
+	char		Name[_MAX_PATH];
+	uint64_t	Hash;
+	int			Width;
+	int			Height;
+	ptrdiff_t	Stride;
+	void		*Pixels;		/* malloc'd, belongs to the caller; NULL if decoding failed */
+}	PreviewQueue_Result;
+
+PreviewQueue *PreviewQueue_Create(PreviewQueue_DecodeFunc Decode, PreviewQueue_NotifyFunc Notify, void *Context);
+/* drops pending requests and uncollected results, waits for the one running */
+void PreviewQueue_Destroy(PreviewQueue **pQueue);
+
+/* copies Data; urgent requests go ahead of everything pending, others queue
+   behind. A request that is already pending or running is not repeated, an
+   urgent one only moves it to the front */
+int PreviewQueue_Request(PreviewQueue *Queue, const char *Name, uint64_t Hash,
+						 const void *Data, size_t Size, int Urgent);
+/* forgets every request that has not started */
+void PreviewQueue_CancelPending(PreviewQueue *Queue);
+
+/* hands over the oldest finished preview, 0 if there is none */
+int PreviewQueue_GetResult(PreviewQueue *Queue, PreviewQueue_Result *Result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
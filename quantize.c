@@ -0,0 +1,647 @@
+/**
+ * @file quantize.c
+ *
+ * Palette selection and mapping, see quantize.h.
+ */
+#include "quantize.h"
+
+// SSE2 is part of every x64 target; 32-bit builds only use it when the
+// compiler is allowed to
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define QUANTIZE_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#define QUANTIZE_BINS			(1 << 15)	// 5:5:5 histogram and mapping table
+#define QUANTIZE_CELL(b, g, r)	((((b) >> 3) << 10) | (((g) >> 3) << 5) | ((r) >> 3))
+#define QUANTIZE_BAND_ROWS		64			// dithering restarts every this many rows
+#define QUANTIZE_TABLE_BAND		4096		// cells filled per task
+#define QUANTIZE_ITERATIONS		12
+#define QUANTIZE_FAR			1024		// a channel value no pixel is near
+#define QUANTIZE_ALPHA_REF		128
+
+// channels of up to QUANTIZE_MAX_COLOURS entries, padded to a multiple of 8
+typedef struct	Quantize_Colours
+{
+	int			Count;
+	int			Padded;
+	int16_t		B[QUANTIZE_MAX_COLOURS];
+	int16_t		G[QUANTIZE_MAX_COLOURS];
+	int16_t		R[QUANTIZE_MAX_COLOURS];
+}	Quantize_Colours;
+
+struct Quantize_Mapper
+{
+	Quantize_Colours	Colours;
+	uint8_t				Palette[QUANTIZE_MAX_COLOURS * 4];
+	int					Key;
+	uint32_t			Table[QUANTIZE_BINS];	// per 5:5:5 cell the nearest entry, its B, G, R and index
+};
+
+typedef int (*Quantize_BandFunc)(void *Context, int First, int End);
+
+typedef struct	Quantize_Band
+{
+	Quantize_BandFunc	Func;
+	void				*Context;
+	int					First;
+	int					End;
+	int					Failed;
+}	Quantize_Band;
+
+typedef struct	Quantize_Job
+{
+	const Quantize_Mapper	*Mapper;
+	const Quantize_Image	*Image;
+	uint8_t					*Indices;
+	ptrdiff_t				IndexStride;
+}	Quantize_Job;
+
+typedef struct	Quantize_Point
+{
+	int			B, G, R;
+	uint32_t	Weight;
+}	Quantize_Point;
+
+
+static void Quantize_InitColours(Quantize_Colours *Colours, int Count)
+{
+	int i;
+
+	Colours->Count = Count;
+	Colours->Padded = (Count + 7) & ~7;
+
+	for(i = Count; i < Colours->Padded; i++)
+		Colours->B[i] = Colours->G[i] = Colours->R[i] = QUANTIZE_FAR;
+}
+
+
+#ifndef QUANTIZE_HAVE_SSE2
+
+static int Quantize_Nearest_C(const Quantize_Colours *Colours, int b, int g, int r)
+{
+	int32_t Best = 0x7fffffff;
+	int BestIndex = 0;
+	int i;
+
+	for(i = 0; i < Colours->Count; i++)
+	{
+		int32_t db = Colours->B[i] - b, dg = Colours->G[i] - g, dr = Colours->R[i] - r;
+		int32_t d = db * db + dg * dg + dr * dr;
+
+		if(d < Best)
+		{
+			Best = d;
+			BestIndex = i;
+		}
+	}
+
+	return BestIndex;
+}
+
+#endif
+
+
+#ifdef QUANTIZE_HAVE_SSE2
+
+// eight entries at a time; squared distances are 32-bit sums from madd, and
+// ties go to the lowest index like the C version
+static int Quantize_Nearest_SSE2(const Quantize_Colours *Colours, int b, int g, int r)
+{
+	const __m128i vb = _mm_set1_epi16((short)b), vg = _mm_set1_epi16((short)g), vr = _mm_set1_epi16((short)r);
+	const __m128i Zero = _mm_setzero_si128();
+	__m128i Best = _mm_set1_epi32(0x7fffffff);
+	__m128i BestIndex = _mm_setzero_si128();
+	__m128i Index = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i Four = _mm_set1_epi32(4);
+	int32_t Dist[4], Which[4];
+	int i, k, Result;
+
+	for(i = 0; i < Colours->Padded; i += 8)
+	{
+		__m128i db = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(Colours->B + i)), vb);
+		__m128i dg = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(Colours->G + i)), vg);
+		__m128i dr = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(Colours->R + i)), vr);
+		__m128i bg, rr, d, Less;
+
+		for(k = 0; k < 2; k++)
+		{
+			bg = k ? _mm_unpackhi_epi16(db, dg) : _mm_unpacklo_epi16(db, dg);
+			rr = k ? _mm_unpackhi_epi16(dr, Zero) : _mm_unpacklo_epi16(dr, Zero);
+			d = _mm_add_epi32(_mm_madd_epi16(bg, bg), _mm_madd_epi16(rr, rr));
+
+			Less = _mm_cmplt_epi32(d, Best);
+			Best = _mm_or_si128(_mm_and_si128(Less, d), _mm_andnot_si128(Less, Best));
+			BestIndex = _mm_or_si128(_mm_and_si128(Less, Index), _mm_andnot_si128(Less, BestIndex));
+			Index = _mm_add_epi32(Index, Four);
+		}
+	}
+
+	_mm_storeu_si128((__m128i*)Dist, Best);
+	_mm_storeu_si128((__m128i*)Which, BestIndex);
+
+	Result = Which[0];
+	for(k = 1; k < 4; k++)
+	{
+		if(Dist[k] < Dist[0] || (Dist[k] == Dist[0] && Which[k] < Result))
+		{
+			Dist[0] = Dist[k];
+			Result = Which[k];
+		}
+	}
+
+	return Result;
+}
+
+#define Quantize_Nearest	Quantize_Nearest_SSE2
+
+#else
+
+#define Quantize_Nearest	Quantize_Nearest_C
+
+#endif
+
+
+int Quantize_HasTransparency(const Quantize_Image *Image)
+{
+	const uint8_t *Row;
+	int x, y;
+
+	if(Image->BytesPerPixel != 4)
+		return 0;
+
+	for(y = 0; y < Image->Height; y++)
+	{
+		Row = (const uint8_t*)Image->Pixels + y * Image->Stride;
+		for(x = 0; x < Image->Width; x++)
+		{
+			if(Row[x * 4 + 3] < QUANTIZE_ALPHA_REF)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static uint32_t Quantize_Random(uint64_t *State)
+{
+	*State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(*State >> 33);
+}
+
+
+static int32_t Quantize_Distance(const Quantize_Point *p, int b, int g, int r)
+{
+	return (p->B - b) * (p->B - b) + (p->G - g) * (p->G - g) + (p->R - r) * (p->R - r);
+}
+
+
+// k-means++: every next centre is a point picked with probability
+// proportional to its weight times its squared distance to the nearest
+// centre so far
+static int Quantize_Seed(const Quantize_Point *Points, int PointCount, int K, Quantize_Colours *Centres)
+{
+	uint32_t *Nearest;
+	uint64_t State = 0x853c49e6748fea9bULL;
+	uint64_t Total, Pick;
+	int Count = 0, Last = 0;
+	int i;
+
+	Nearest = (uint32_t*)malloc(PointCount * sizeof(uint32_t));
+	if(!Nearest)
+		return 0;
+
+	// the heaviest point first
+	for(i = 1; i < PointCount; i++)
+	{
+		if(Points[i].Weight > Points[Last].Weight)
+			Last = i;
+	}
+
+	for(i = 0; i < PointCount; i++)
+		Nearest[i] = 0xffffffff;
+
+	while(Count < K)
+	{
+		Centres->B[Count] = (int16_t)Points[Last].B;
+		Centres->G[Count] = (int16_t)Points[Last].G;
+		Centres->R[Count] = (int16_t)Points[Last].R;
+		Count++;
+
+		Total = 0;
+		for(i = 0; i < PointCount; i++)
+		{
+			uint32_t d = (uint32_t)Quantize_Distance(&Points[i], Points[Last].B, Points[Last].G, Points[Last].R);
+
+			if(d < Nearest[i])
+				Nearest[i] = d;
+			Total += (uint64_t)Nearest[i] * Points[i].Weight;
+		}
+
+		// every point is a centre already
+		if(Total == 0)
+			break;
+
+		Pick = (((uint64_t)Quantize_Random(&State) << 31) ^ Quantize_Random(&State)) % Total;
+		for(i = 0; i < PointCount - 1; i++)
+		{
+			uint64_t Share = (uint64_t)Nearest[i] * Points[i].Weight;
+
+			if(Pick < Share)
+				break;
+			Pick -= Share;
+		}
+		Last = i;
+	}
+
+	free(Nearest);
+	Quantize_InitColours(Centres, Count);
+	return 1;
+}
+
+
+// weighted Lloyd iterations until no point changes its centre
+static int Quantize_Refine(const Quantize_Point *Points, int PointCount, Quantize_Colours *Centres)
+{
+	uint64_t (*Sums)[4];
+	uint8_t *Assigned;
+	int Iteration, Changed, i, c;
+
+	Sums = (uint64_t(*)[4])malloc(QUANTIZE_MAX_COLOURS * sizeof(*Sums));
+	Assigned = (uint8_t*)malloc(PointCount);
+	if(!Sums || !Assigned)
+	{
+		free(Sums);
+		free(Assigned);
+		return 0;
+	}
+
+	memset(Assigned, 0, PointCount);
+
+	for(Iteration = 0; Iteration < QUANTIZE_ITERATIONS; Iteration++)
+	{
+		memset(Sums, 0, QUANTIZE_MAX_COLOURS * sizeof(*Sums));
+		Changed = 0;
+
+		for(i = 0; i < PointCount; i++)
+		{
+			const Quantize_Point *p = &Points[i];
+
+			c = Quantize_Nearest(Centres, p->B, p->G, p->R);
+			if(c != Assigned[i] || Iteration == 0)
+				Changed++;
+			Assigned[i] = (uint8_t)c;
+
+			Sums[c][0] += (uint64_t)p->B * p->Weight;
+			Sums[c][1] += (uint64_t)p->G * p->Weight;
+			Sums[c][2] += (uint64_t)p->R * p->Weight;
+			Sums[c][3] += p->Weight;
+		}
+
+		if(!Changed)
+			break;
+
+		// a centre nobody picked stays where it is
+		for(c = 0; c < Centres->Count; c++)
+		{
+			if(!Sums[c][3])
+				continue;
+
+			Centres->B[c] = (int16_t)((Sums[c][0] + Sums[c][3] / 2) / Sums[c][3]);
+			Centres->G[c] = (int16_t)((Sums[c][1] + Sums[c][3] / 2) / Sums[c][3]);
+			Centres->R[c] = (int16_t)((Sums[c][2] + Sums[c][3] / 2) / Sums[c][3]);
+		}
+	}
+
+	free(Sums);
+	free(Assigned);
+	return 1;
+}
+
+
+int Quantize_MakePalette(const Quantize_Image *Image, int MaxColours, uint8_t *Palette, int *pColours)
+{
+	uint32_t (*Bins)[4];
+	Quantize_Point *Points;
+	Quantize_Colours Centres;
+	int PointCount = 0;
+	int Bpp = Image->BytesPerPixel;
+	int x, y, i;
+
+	MaxColours = TGA2GEBMP_MAX(1, TGA2GEBMP_MIN(MaxColours, QUANTIZE_MAX_COLOURS));
+
+	// count and colour sums per 5:5:5 cell, the points k-means works on
+	Bins = (uint32_t(*)[4])calloc(QUANTIZE_BINS, sizeof(*Bins));
+	if(!Bins)
+		return 0;
+
+	for(y = 0; y < Image->Height; y++)
+	{
+		const uint8_t *p = (const uint8_t*)Image->Pixels + y * Image->Stride;
+
+		for(x = 0; x < Image->Width; x++, p += Bpp)
+		{
+			uint32_t *Bin;
+
+			if(Bpp == 4 && p[3] < QUANTIZE_ALPHA_REF)
+				continue;
+
+			Bin = Bins[QUANTIZE_CELL(p[0], p[1], p[2])];
+			Bin[0] += p[0];
+			Bin[1] += p[1];
+			Bin[2] += p[2];
+			Bin[3]++;
+		}
+	}
+
+	for(i = 0; i < QUANTIZE_BINS; i++)
+	{
+		if(Bins[i][3])
+			PointCount++;
+	}
+
+	Points = (Quantize_Point*)malloc(TGA2GEBMP_MAX(PointCount, 1) * sizeof(Quantize_Point));
+	if(!Points)
+	{
+		free(Bins);
+		return 0;
+	}
+
+	PointCount = 0;
+	for(i = 0; i < QUANTIZE_BINS; i++)
+	{
+		uint32_t n = Bins[i][3];
+
+		if(!n)
+			continue;
+
+		Points[PointCount].B = (int)((Bins[i][0] + n / 2) / n);
+		Points[PointCount].G = (int)((Bins[i][1] + n / 2) / n);
+		Points[PointCount].R = (int)((Bins[i][2] + n / 2) / n);
+		Points[PointCount].Weight = n;
+		PointCount++;
+	}
+	free(Bins);
+
+	if(PointCount == 0)
+	{
+		// nothing opaque, any colour will do
+		Quantize_InitColours(&Centres, 1);
+		Centres.B[0] = Centres.G[0] = Centres.R[0] = 0;
+	}
+	else if(!Quantize_Seed(Points, PointCount, TGA2GEBMP_MIN(MaxColours, PointCount), &Centres) ||
+			!Quantize_Refine(Points, PointCount, &Centres))
+	{
+		free(Points);
+		return 0;
+	}
+	free(Points);
+
+	for(i = 0; i < Centres.Count; i++)
+	{
+		Palette[i * 4 + 0] = (uint8_t)Centres.B[i];
+		Palette[i * 4 + 1] = (uint8_t)Centres.G[i];
+		Palette[i * 4 + 2] = (uint8_t)Centres.R[i];
+		Palette[i * 4 + 3] = 0;
+	}
+
+	*pColours = Centres.Count;
+	return 1;
+}
+
+
+static void Quantize_RunBand(void *Context, int Worker)
+{
+	Quantize_Band *Band = (Quantize_Band*)Context;
+
+	(void)Worker;
+
+	Band->Failed = !Band->Func(Band->Context, Band->First, Band->End);
+}
+
+
+// runs Func over Count items in bands of BandSize, on Pool if there is more
+// than one band; the bands are the same either way
+static int Quantize_RunBands(Quantize_BandFunc Func, void *Context, int Count, int BandSize, ThreadPool *Pool)
+{
+	int BandCount = (Count + BandSize - 1) / BandSize;
+	ThreadPool_Group *Group = NULL;
+	Quantize_Band *Bands;
+	int Failed = 0;
+	int i;
+
+	Bands = (Quantize_Band*)malloc(TGA2GEBMP_MAX(BandCount, 1) * sizeof(Quantize_Band));
+	if(!Bands)
+		return 0;
+
+	if(Pool && BandCount > 1)
+		Group = ThreadPool_CreateGroup();
+
+	for(i = 0; i < BandCount; i++)
+	{
+		Bands[i].Func = Func;
+		Bands[i].Context = Context;
+		Bands[i].First = i * BandSize;
+		Bands[i].End = TGA2GEBMP_MIN(Count, (i + 1) * BandSize);
+		Bands[i].Failed = 0;
+
+		if(!Group || !ThreadPool_Submit(Pool, Group, Quantize_RunBand, &Bands[i]))
+			Quantize_RunBand(&Bands[i], -1);
+	}
+
+	if(Group)
+	{
+		ThreadPool_Wait(Pool, Group);
+		ThreadPool_DestroyGroup(&Group);
+	}
+
+	for(i = 0; i < BandCount; i++)
+		Failed |= Bands[i].Failed;
+
+	free(Bands);
+	return !Failed;
+}
+
+
+// every cell maps to the entry nearest its centre
+static int Quantize_FillTable(void *Context, int First, int End)
+{
+	Quantize_Mapper *Mapper = (Quantize_Mapper*)Context;
+	int Cell;
+
+	for(Cell = First; Cell < End; Cell++)
+	{
+		int b = ((Cell >> 10) << 3) | 4, g = (((Cell >> 5) & 31) << 3) | 4, r = ((Cell & 31) << 3) | 4;
+		int Index = Quantize_Nearest(&Mapper->Colours, b, g, r);
+		const uint8_t *Colour = Mapper->Palette + Index * 4;
+
+		Mapper->Table[Cell] = Colour[0] | (Colour[1] << 8) | (Colour[2] << 16) | ((uint32_t)Index << 24);
+	}
+
+	return 1;
+}
+
+
+Quantize_Mapper *Quantize_CreateMapper(const uint8_t *Palette, int Colours, int Key, ThreadPool *Pool)
+{
+	Quantize_Mapper *Mapper;
+	int i;
+
+	Mapper = (Quantize_Mapper*)malloc(sizeof(Quantize_Mapper));
+	if(!Mapper)
+		return NULL;
+
+	Colours = TGA2GEBMP_MAX(1, TGA2GEBMP_MIN(Colours, QUANTIZE_MAX_COLOURS));
+	memcpy(Mapper->Palette, Palette, Colours * 4);
+	Mapper->Key = Key < Colours ? Key : -1;
+
+	// the key entry is moved out of reach of every real colour
+	Quantize_InitColours(&Mapper->Colours, Colours);
+	for(i = 0; i < Colours; i++)
+	{
+		Mapper->Colours.B[i] = i == Key ? QUANTIZE_FAR : Palette[i * 4 + 0];
+		Mapper->Colours.G[i] = i == Key ? QUANTIZE_FAR : Palette[i * 4 + 1];
+		Mapper->Colours.R[i] = i == Key ? QUANTIZE_FAR : Palette[i * 4 + 2];
+	}
+
+	Quantize_RunBands(Quantize_FillTable, Mapper, QUANTIZE_BINS, QUANTIZE_TABLE_BAND, Pool);
+	return Mapper;
+}
+
+
+void Quantize_DestroyMapper(Quantize_Mapper **pMapper)
+{
+	free(*pMapper);
+	*pMapper = NULL;
+}
+
+
+static int Quantize_Clamp(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+
+// Floyd-Steinberg, every other row right to left; errors are kept in
+// sixteenths and do not cross transparent pixels or band edges. What goes
+// to the next pixel and the row below is carried in locals, each entry of
+// the next row is written once
+static int Quantize_MapDither(void *Context, int First, int End)
+{
+	const Quantize_Job *Job = (const Quantize_Job*)Context;
+	const Quantize_Mapper *Mapper = Job->Mapper;
+	int Bpp = Job->Image->BytesPerPixel;
+	int Width = Job->Image->Width;
+	int *Errors, *Cur, *Next, *Swap;
+	int x, y, c;
+
+	// two rows of three channels with a pixel of slack at either end
+	Errors = (int*)calloc((size_t)(Width + 2) * 3 * 2, sizeof(int));
+	if(!Errors)
+		return 0;
+
+	Cur = Errors;
+	Next = Errors + (Width + 2) * 3;
+
+	for(y = First; y < End; y++)
+	{
+		const uint8_t *Row = (const uint8_t*)Job->Image->Pixels + y * Job->Image->Stride;
+		uint8_t *Out = Job->Indices + y * Job->IndexStride;
+		int Step = (y & 1) ? -1 : 1;
+		int Right[3] = { 0, 0, 0 };		// to the next pixel
+		int Behind[3] = { 0, 0, 0 };	// below the previous pixel
+		int Below[3] = { 0, 0, 0 };		// below this pixel
+		int *d;
+
+		x = (y & 1) ? Width - 1 : 0;
+		d = Next + (x + 1) * 3;
+
+		for(; x >= 0 && x < Width; x += Step, d += Step * 3)
+		{
+			const uint8_t *p = Row + x * Bpp;
+			const int *e = Cur + (x + 1) * 3;
+			int Value[3], Error, Shift;
+			uint32_t Entry;
+
+			if(Bpp == 4 && p[3] < QUANTIZE_ALPHA_REF && Mapper->Key >= 0)
+			{
+				Out[x] = (uint8_t)Mapper->Key;
+				for(c = 0; c < 3; c++)
+				{
+					d[-Step * 3 + c] = Behind[c];
+					Behind[c] = Below[c];
+					Below[c] = Right[c] = 0;
+				}
+				continue;
+			}
+
+			for(c = 0; c < 3; c++)
+				Value[c] = Quantize_Clamp(p[c] + ((e[c] + Right[c] + 8) >> 4));
+
+			Entry = Mapper->Table[QUANTIZE_CELL(Value[0], Value[1], Value[2])];
+			Out[x] = (uint8_t)(Entry >> 24);
+
+			for(c = 0, Shift = 0; c < 3; c++, Shift += 8)
+			{
+				Error = Value[c] - (int)((Entry >> Shift) & 0xff);
+				d[-Step * 3 + c] = Behind[c] + Error * 3;
+				Behind[c] = Below[c] + Error * 5;
+				Below[c] = Error;
+				Right[c] = Error * 7;
+			}
+		}
+
+		// this row's last pixel and the slack entry past it
+		for(c = 0; c < 3; c++)
+		{
+			d[-Step * 3 + c] = Behind[c];
+			d[c] = Below[c];
+		}
+
+		Swap = Cur;
+		Cur = Next;
+		Next = Swap;
+	}
+
+	free(Errors);
+	return 1;
+}
+
+
+static int Quantize_MapPlain(void *Context, int First, int End)
+{
+	const Quantize_Job *Job = (const Quantize_Job*)Context;
+	const Quantize_Mapper *Mapper = Job->Mapper;
+	int Bpp = Job->Image->BytesPerPixel;
+	int x, y;
+
+	for(y = First; y < End; y++)
+	{
+		const uint8_t *p = (const uint8_t*)Job->Image->Pixels + y * Job->Image->Stride;
+		uint8_t *Out = Job->Indices + y * Job->IndexStride;
+
+		for(x = 0; x < Job->Image->Width; x++, p += Bpp)
+		{
+			if(Bpp == 4 && p[3] < QUANTIZE_ALPHA_REF && Mapper->Key >= 0)
+				Out[x] = (uint8_t)Mapper->Key;
+			else
+				Out[x] = (uint8_t)(Mapper->Table[QUANTIZE_CELL(p[0], p[1], p[2])] >> 24);
+		}
+	}
+
+	return 1;
+}
+
+
+int Quantize_Map(const Quantize_Mapper *Mapper, const Quantize_Image *Image, int Dither, uint8_t *Indices, ptrdiff_t IndexStride, ThreadPool *Pool)
+{
+	Quantize_Job Job;
+
+	Job.Mapper = Mapper;
+	Job.Image = Image;
+	Job.Indices = Indices;
+	Job.IndexStride = IndexStride;
+
+	return Quantize_RunBands(Dither ? Quantize_MapDither : Quantize_MapPlain, &Job, Image->Height, QUANTIZE_BAND_ROWS, Pool);
+}
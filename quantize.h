@@ -0,0 +1,62 @@
+/**
+ * @file quantize.h
+ *
+ * Colour reduction for 8-bit palettized skins. A palette is chosen by
+ * weighted k-means (k-means++ seeding) over a 5:5:5 histogram of the image,
+ * and pixels are mapped to it through a 5:5:5 lookup table filled by an SSE2
+ * nearest-colour search, optionally with Floyd-Steinberg error diffusion.
+ * Pixels with alpha below 128 can be sent to a reserved colour-key entry,
+ * which is how the engine draws cut-outs in 8 bits.
+ *
+ * Mapping runs in bands of rows on a thread pool; error diffusion starts
+ * afresh in every band, and the bands do not depend on the thread count, so
+ * neither does the output. The seeding uses a fixed random sequence.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "threadpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QUANTIZE_MAX_COLOURS		256
+
+typedef struct Quantize_Mapper Quantize_Mapper;
+
+/* rows of B, G, R or B, G, R, A bytes */
+typedef struct	Quantize_Image
+{
+	int			Width;
+	int			Height;
+	int			BytesPerPixel;
+	ptrdiff_t	Stride;			/* in bytes */
+	const void	*Pixels;
+}	Quantize_Image;
+
+/* whether any pixel has alpha below 128 */
+int Quantize_HasTransparency(const Quantize_Image *Image);
+
+/* picks at most MaxColours colours for Image, ignoring pixels with alpha
+   below 128; Palette receives B, G, R, 0 per colour. 0 if out of memory */
+int Quantize_MakePalette(const Quantize_Image *Image, int MaxColours, uint8_t *Palette, int *pColours);
+
+/* Palette as above; Key is the entry transparent pixels get and no other
+   pixel does, -1 for none */
+Quantize_Mapper *Quantize_CreateMapper(const uint8_t *Palette, int Colours, int Key, ThreadPool *Pool);
+void Quantize_DestroyMapper(Quantize_Mapper **pMapper);
+
+/* writes one palette index per pixel, in bands of rows on Pool, which may
+   be NULL; 0 if out of memory */
+int Quantize_Map(const Quantize_Mapper *Mapper, const Quantize_Image *Image, int Dither, uint8_t *Indices, ptrdiff_t IndexStride, ThreadPool *Pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file test.h
+ *
+ * Checks for the unit tests. Each test is a program of its own that prints
+ * the checks that fail and returns TEST_RESULT from main, so ctest sees 1 if
+ * any did.
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include "platform.h"
+
+static int Test_Failures = 0;
+
+#define TEST_CHECK(Condition) \
+	do \
+	{ \
+		if(!(Condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition); \
+			Test_Failures++; \
+		} \
+	} while(0)
+
+#define TEST_RESULT		(Test_Failures ? 1 : 0)
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * @file test_downsample.c
+ *
+ * downsample.h against small images whose box averages are known.
+ */
+#include "test.h"
+#include "downsample.h"
+
+#define PADDING		0xcd
+
+
+static uint32_t Test_Random(uint32_t *State)
+{
+	*State ^= *State << 13;
+	*State ^= *State >> 17;
+	*State ^= *State << 5;
+	return *State;
+}
+
+
+static void Test_FitSize(void)
+{
+	int Width, Height;
+
+	Downsample_FitSize(8192, 4096, 512, 512, &Width, &Height);
+	TEST_CHECK(Width == 512 && Height == 256);
+
+	Downsample_FitSize(1000, 3000, 512, 512, &Width, &Height);
+	TEST_CHECK(Width == 171 && Height == 512);
+
+	// images that fit are left alone, and nothing goes below a pixel
+	Downsample_FitSize(100, 10, 512, 512, &Width, &Height);
+	TEST_CHECK(Width == 100 && Height == 10);
+
+	Downsample_FitSize(5000, 1, 512, 512, &Width, &Height);
+	TEST_CHECK(Width == 512 && Height == 1);
+}
+
+
+static void Test_DibStride(void)
+{
+	TEST_CHECK(Downsample_GetDibStride(3, 24) == 12);
+	TEST_CHECK(Downsample_GetDibStride(4, 24) == 12);
+	TEST_CHECK(Downsample_GetDibStride(5, 24) == 16);
+	TEST_CHECK(Downsample_GetDibStride(3, 32) == 12);
+}
+
+
+// a halving is the rounded mean of every 2x2 block; wide enough that the
+// SIMD loop runs as well as the scalar tail
+static void Test_Halve(void)
+{
+	enum { SrcWidth = 70, SrcHeight = 6, DestWidth = 35, DestHeight = 3 };
+	uint8_t Src[SrcHeight][SrcWidth * 4];
+	uint8_t Dest[DestHeight][DestWidth * 4];
+	uint32_t State = 12345;
+	int x, y, c, Sum, Wrong = 0;
+
+	for(y = 0; y < SrcHeight; y++)
+		for(x = 0; x < SrcWidth * 4; x++)
+			Src[y][x] = (uint8_t)Test_Random(&State);
+
+	TEST_CHECK(Downsample_Resize32(Src, SrcWidth, SrcHeight, sizeof(Src[0]), Dest, DestWidth, DestHeight, sizeof(Dest[0])));
+
+	for(y = 0; y < DestHeight; y++)
+	{
+		for(x = 0; x < DestWidth; x++)
+		{
+			for(c = 0; c < 4; c++)
+			{
+				Sum = Src[y * 2][x * 8 + c] + Src[y * 2][x * 8 + 4 + c] +
+					  Src[y * 2 + 1][x * 8 + c] + Src[y * 2 + 1][x * 8 + 4 + c];
+				Wrong += Dest[y][x * 4 + c] != (Sum + 2) >> 2;
+			}
+		}
+	}
+	TEST_CHECK(Wrong == 0);
+}
+
+
+// 3 pixels into 2: the first output covers pixel 0 and a third of pixel 1,
+// the second the other two thirds of pixel 1 and pixel 2
+static void Test_Fraction(void)
+{
+	const uint8_t Src[3 * 4] = { 0, 0, 0, 0,  90, 90, 90, 90,  180, 180, 180, 180 };
+	uint8_t Dest[2 * 4];
+	int c;
+
+	TEST_CHECK(Downsample_Resize32(Src, 3, 1, sizeof(Src), Dest, 2, 1, sizeof(Dest)));
+
+	for(c = 0; c < 4; c++)
+	{
+		TEST_CHECK(Dest[c] == 30);
+		TEST_CHECK(Dest[4 + c] == 150);
+	}
+}
+
+
+// odd ratios on both axes keep a flat colour flat, and rows end at the
+// width, not at the padded stride
+static void Test_Flat(void)
+{
+	enum { SrcWidth = 1001, SrcHeight = 603, DestWidth = 7, DestHeight = 5 };
+	const uint8_t Pixel[4] = { 200, 17, 255, 1 };
+	uint8_t *Src;
+	uint8_t Dest[DestHeight][32];
+	int x, y, Wrong = 0, Touched = 0;
+
+	Src = (uint8_t*)malloc((size_t)SrcWidth * SrcHeight * 4);
+	TEST_CHECK(Src != NULL);
+	if(!Src)
+		return;
+
+	for(x = 0; x < SrcWidth * SrcHeight; x++)
+		memcpy(Src + x * 4, Pixel, 4);
+	memset(Dest, PADDING, sizeof(Dest));
+
+	TEST_CHECK(Downsample_Resize32(Src, SrcWidth, SrcHeight, SrcWidth * 4, Dest, DestWidth, DestHeight, sizeof(Dest[0])));
+
+	for(y = 0; y < DestHeight; y++)
+	{
+		for(x = 0; x < DestWidth * 4; x++)
+			Wrong += Dest[y][x] != Pixel[x % 4];
+		for(; x < (int)sizeof(Dest[0]); x++)
+			Touched += Dest[y][x] != PADDING;
+	}
+	TEST_CHECK(Wrong == 0);
+	TEST_CHECK(Touched == 0);
+
+	free(Src);
+}
+
+
+// a ramp stays a ramp, whichever axis is reduced more
+static void Test_Ramp(void)
+{
+	enum { SrcWidth = 256, SrcHeight = 3, DestWidth = 10, DestHeight = 2 };
+	uint8_t Src[SrcHeight][SrcWidth * 4];
+	uint8_t Dest[DestHeight][DestWidth * 4];
+	int x, y, c, Wrong = 0;
+
+	for(y = 0; y < SrcHeight; y++)
+		for(x = 0; x < SrcWidth; x++)
+			for(c = 0; c < 4; c++)
+				Src[y][x * 4 + c] = (uint8_t)x;
+
+	TEST_CHECK(Downsample_Resize32(Src, SrcWidth, SrcHeight, sizeof(Src[0]), Dest, DestWidth, DestHeight, sizeof(Dest[0])));
+
+	for(y = 0; y < DestHeight; y++)
+	{
+		for(x = 1; x < DestWidth; x++)
+			Wrong += Dest[y][x * 4] <= Dest[y][(x - 1) * 4];
+		Wrong += Dest[y][0] > 25 || Dest[y][(DestWidth - 1) * 4] < 230;
+	}
+	TEST_CHECK(Wrong == 0);
+}
+
+
+static void Test_BadSizes(void)
+{
+	uint8_t Pixel[4] = { 0 };
+
+	TEST_CHECK(!Downsample_Resize32(Pixel, 0, 1, 4, Pixel, 1, 1, 4));
+	TEST_CHECK(!Downsample_Resize32(Pixel, 1, 1, 4, Pixel, 1, 0, 4));
+}
+
+
+int main(void)
+{
+	Test_FitSize();
+	Test_DibStride();
+	Test_Halve();
+	Test_Fraction();
+	Test_Flat();
+	Test_Ramp();
+	Test_BadSizes();
+
+	return TEST_RESULT;
+}
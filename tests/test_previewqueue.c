@@ -0,0 +1,260 @@
+/**
+ * @file test_previewqueue.c
+ *
+ * previewqueue.h with a decoder that waits for the test before each preview,
+ * so the order of pending requests, cancelling and shutdown can be checked
+ * while one request is known to be running.
+ */
+#include "test.h"
+#include "previewqueue.h"
+#include "threadpool.h"
+
+#define TEST_MAX_DECODES	16
+
+
+typedef struct	Test_Decoder
+{
+	ThreadPool_Gate	*Started;		// left by the worker as each decode starts
+	ThreadPool_Gate	*Go;			// entered by the worker before it finishes one
+	ThreadPool_Gate	*Notified;		// left by the worker after each result
+	char			Order[TEST_MAX_DECODES];
+	int				Count;
+}	Test_Decoder;
+
+
+// the first byte of a request's data names it; '!' fails to decode and '.'
+// does not wait for the test
+static void *Test_Decode(void *Context, const void *Data, size_t Size,
+						 int *pWidth, int *pHeight, ptrdiff_t *pStride)
+{
+	Test_Decoder *Decoder = (Test_Decoder*)Context;
+	char Name = *(const char*)Data;
+	uint8_t *Pixels;
+
+	(void)Size;
+
+	if(Name != '.')
+	{
+		ThreadPool_LeaveGate(Decoder->Started);
+		ThreadPool_EnterGate(Decoder->Go);
+	}
+
+	if(Decoder->Count < TEST_MAX_DECODES)
+		Decoder->Order[Decoder->Count] = Name;
+	Decoder->Count++;
+
+	if(Name == '!')
+		return NULL;
+
+	Pixels = (uint8_t*)malloc(4);
+	if(!Pixels)
+		return NULL;
+
+	memset(Pixels, Name, 4);
+	*pWidth = 1;
+	*pHeight = 1;
+	*pStride = 4;
+	return Pixels;
+}
+
+
+static void Test_Notify(void *Context)
+{
+	Test_Decoder *Decoder = (Test_Decoder*)Context;
+
+	ThreadPool_LeaveGate(Decoder->Notified);
+}
+
+
+// gates start open, these have to start closed
+static int Test_CreateDecoder(Test_Decoder *Decoder)
+{
+	memset(Decoder, 0, sizeof(*Decoder));
+	Decoder->Started = ThreadPool_CreateGate(1);
+	Decoder->Go = ThreadPool_CreateGate(1);
+	Decoder->Notified = ThreadPool_CreateGate(1);
+	if(!Decoder->Started || !Decoder->Go || !Decoder->Notified)
+		return 0;
+
+	ThreadPool_EnterGate(Decoder->Started);
+	ThreadPool_EnterGate(Decoder->Go);
+	ThreadPool_EnterGate(Decoder->Notified);
+	return 1;
+}
+
+
+static void Test_DestroyDecoder(Test_Decoder *Decoder)
+{
+	ThreadPool_DestroyGate(&Decoder->Started);
+	ThreadPool_DestroyGate(&Decoder->Go);
+	ThreadPool_DestroyGate(&Decoder->Notified);
+}
+
+
+static int Test_Request(PreviewQueue *Queue, const char *Name, int Urgent)
+{
+	return PreviewQueue_Request(Queue, Name, (uint64_t)(uint8_t)Name[0], Name, strlen(Name) + 1, Urgent);
+}
+
+
+// lets Count decodes finish and waits for their results
+static void Test_Finish(Test_Decoder *Decoder, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+		ThreadPool_LeaveGate(Decoder->Go);
+	for(i = 0; i < Count; i++)
+		ThreadPool_EnterGate(Decoder->Notified);
+}
+
+
+static void Test_Order(void)
+{
+	Test_Decoder Decoder;
+	PreviewQueue *Queue;
+	PreviewQueue_Result Result;
+	const char Expected[] = "abdc";
+	int i;
+
+	TEST_CHECK(Test_CreateDecoder(&Decoder));
+	Queue = PreviewQueue_Create(Test_Decode, Test_Notify, &Decoder);
+	TEST_CHECK(Queue != NULL);
+	if(!Queue)
+		return;
+
+	TEST_CHECK(Test_Request(Queue, "a", 0));
+	ThreadPool_EnterGate(Decoder.Started);
+
+	// a runs; then c, b and d were asked for, d urgently, b again urgently,
+	// and a again, which is not repeated
+	TEST_CHECK(Test_Request(Queue, "b", 0));
+	TEST_CHECK(Test_Request(Queue, "c", 0));
+	TEST_CHECK(Test_Request(Queue, "d", 1));
+	TEST_CHECK(Test_Request(Queue, "b", 1));
+	TEST_CHECK(Test_Request(Queue, "a", 1));
+
+	Test_Finish(&Decoder, 4);
+
+	TEST_CHECK(Decoder.Count == 4);
+	TEST_CHECK(memcmp(Decoder.Order, Expected, 4) == 0);
+
+	for(i = 0; i < 4; i++)
+	{
+		TEST_CHECK(PreviewQueue_GetResult(Queue, &Result));
+		TEST_CHECK(Result.Name[0] == Expected[i] && Result.Name[1] == '\0');
+		TEST_CHECK(Result.Hash == (uint64_t)(uint8_t)Expected[i]);
+		TEST_CHECK(Result.Width == 1 && Result.Height == 1 && Result.Stride == 4);
+		TEST_CHECK(Result.Pixels && *(uint8_t*)Result.Pixels == (uint8_t)Expected[i]);
+		free(Result.Pixels);
+	}
+	TEST_CHECK(!PreviewQueue_GetResult(Queue, &Result));
+
+	PreviewQueue_Destroy(&Queue);
+	TEST_CHECK(Queue == NULL);
+	Test_DestroyDecoder(&Decoder);
+}
+
+
+static void Test_Cancel(void)
+{
+	Test_Decoder Decoder;
+	PreviewQueue *Queue;
+	PreviewQueue_Result Result;
+
+	TEST_CHECK(Test_CreateDecoder(&Decoder));
+	Queue = PreviewQueue_Create(Test_Decode, Test_Notify, &Decoder);
+	TEST_CHECK(Queue != NULL);
+	if(!Queue)
+		return;
+
+	TEST_CHECK(Test_Request(Queue, "!", 0));
+	ThreadPool_EnterGate(Decoder.Started);
+	TEST_CHECK(Test_Request(Queue, "b", 0));
+	TEST_CHECK(Test_Request(Queue, "c", 1));
+
+	// the running request is not cancelled, and fails on its own
+	PreviewQueue_CancelPending(Queue);
+	Test_Finish(&Decoder, 1);
+
+	TEST_CHECK(PreviewQueue_GetResult(Queue, &Result));
+	TEST_CHECK(Result.Name[0] == '!' && Result.Pixels == NULL);
+	TEST_CHECK(!PreviewQueue_GetResult(Queue, &Result));
+
+	// a cancelled request can be asked for again
+	TEST_CHECK(Test_Request(Queue, "b", 0));
+	ThreadPool_EnterGate(Decoder.Started);
+	Test_Finish(&Decoder, 1);
+	TEST_CHECK(PreviewQueue_GetResult(Queue, &Result));
+	TEST_CHECK(Result.Name[0] == 'b' && Result.Pixels != NULL);
+	free(Result.Pixels);
+
+	// the tasks left over from b and c found nothing to run
+	PreviewQueue_Destroy(&Queue);
+	TEST_CHECK(Decoder.Count == 2);
+	TEST_CHECK(memcmp(Decoder.Order, "!b", 2) == 0);
+	Test_DestroyDecoder(&Decoder);
+}
+
+
+static void Test_Release(void *Context, int Worker)
+{
+	(void)Worker;
+
+	ThreadPool_LeaveGate(((Test_Decoder*)Context)->Go);
+}
+
+
+static void Test_Shutdown(void)
+{
+	Test_Decoder Decoder;
+	PreviewQueue *Queue;
+	ThreadPool *Helper;
+	ThreadPool_Group *Group;
+
+	TEST_CHECK(Test_CreateDecoder(&Decoder));
+	Queue = PreviewQueue_Create(Test_Decode, Test_Notify, &Decoder);
+	TEST_CHECK(Queue != NULL);
+	if(!Queue)
+		return;
+
+	Helper = ThreadPool_Create(1);
+	Group = ThreadPool_CreateGroup();
+	TEST_CHECK(Helper && Group);
+	if(!Helper || !Group)
+		return;
+
+	// a finishes and is never collected, b is running, two more are pending
+	TEST_CHECK(Test_Request(Queue, "a", 0));
+	ThreadPool_EnterGate(Decoder.Started);
+	Test_Finish(&Decoder, 1);
+	TEST_CHECK(Test_Request(Queue, "b", 0));
+	ThreadPool_EnterGate(Decoder.Started);
+	TEST_CHECK(Test_Request(Queue, ".c", 0));
+	TEST_CHECK(Test_Request(Queue, ".d", 0));
+
+	// b is let go from another thread, before or while the queue is
+	// destroyed; either way destroying waits for it and frees a and b. The
+	// pending two may or may not have started by the time it cancels them
+	TEST_CHECK(ThreadPool_Submit(Helper, Group, Test_Release, &Decoder));
+	PreviewQueue_Destroy(&Queue);
+	TEST_CHECK(Queue == NULL);
+
+	TEST_CHECK(Decoder.Count >= 2 && Decoder.Count <= 4);
+	TEST_CHECK(memcmp(Decoder.Order, "ab", 2) == 0);
+
+	ThreadPool_Wait(Helper, Group);
+	ThreadPool_DestroyGroup(&Group);
+	ThreadPool_Destroy(&Helper);
+	Test_DestroyDecoder(&Decoder);
+}
+
+
+int main(void)
+{
+	Test_Order();
+	Test_Cancel();
+	Test_Shutdown();
+
+	return TEST_RESULT;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file test_watchdir.c
+ *
+ * watchdir.h on a directory made for the test: files written, renamed into
+ * place and created in a new subdirectory are each reported once, in one
+ * burst. inotify only, so on other systems there is nothing to check.
+ */
+#include "test.h"
+#include "watchdir.h"
+
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#define TEST_QUIET			50			/* ms, keeps the bursts short */
+#define TEST_TIMEOUT		5000		/* ms, far longer than any burst */
+#define TEST_MAX_REPORTS	8
+
+
+typedef struct	Test_Reports
+{
+	char	Paths[TEST_MAX_REPORTS][_MAX_PATH];
+	int		Count;
+	int		Lost;						// calls with a NULL path
+}	Test_Reports;
+
+
+#ifdef __linux__
+
+static char Test_Root[] = "/tmp/test_watchdirXXXXXX";
+
+
+static void Test_Collect(const char *Path, void *Context)
+{
+	Test_Reports *Reports = (Test_Reports*)Context;
+
+	if(!Path)
+		Reports->Lost++;
+	else if(Reports->Count < TEST_MAX_REPORTS && strlen(Path) < _MAX_PATH)
+		strcpy(Reports->Paths[Reports->Count++], Path);
+}
+
+
+// Name below the test's root into Path, which must be large enough
+static void Test_Path(const char *Name, char *Path)
+{
+	sprintf(Path, "%s/%s", Test_Root, Name);
+}
+
+
+static int Test_Write(const char *Name)
+{
+	char Path[_MAX_PATH];
+	FILE *File;
+	int Result;
+
+	Test_Path(Name, Path);
+	File = fopen(Path, "wb");
+	if(!File)
+		return 0;
+
+	Result = fwrite("TRUEVISION", 10, 1, File) == 1;
+	return fclose(File) == 0 && Result;
+}
+
+
+// whether the burst reported Name, as the full path the watch makes
+static int Test_Reported(const Test_Reports *Reports, const char *Name)
+{
+	char Path[_MAX_PATH];
+	char FullPath[_MAX_PATH];
+	int i;
+
+	Test_Path(Name, Path);
+	if(!WatchDir_GetFullPath(Path, FullPath))
+		return 0;
+
+	for(i = 0; i < Reports->Count; i++)
+	{
+		if(strcmp(Reports->Paths[i], FullPath) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+
+static int Test_Wait(WatchDir *Watch, Test_Reports *Reports)
+{
+	memset(Reports, 0, sizeof(*Reports));
+	return WatchDir_Wait(Watch, TEST_TIMEOUT, Test_Collect, Reports);
+}
+
+
+static void Test_Watch(WatchDir *Watch)
+{
+	Test_Reports Reports;
+	char From[_MAX_PATH];
+	char To[_MAX_PATH];
+
+	// nothing happened, so the wait runs out
+	memset(&Reports, 0, sizeof(Reports));
+	TEST_CHECK(WatchDir_Wait(Watch, TEST_QUIET * 2, Test_Collect, &Reports) == 0);
+	TEST_CHECK(Reports.Count == 0 && Reports.Lost == 0);
+
+	// written and closed
+	TEST_CHECK(Test_Write("a.tga"));
+	TEST_CHECK(Test_Wait(Watch, &Reports) == 1);
+	TEST_CHECK(Reports.Count == 1 && Reports.Lost == 0);
+	TEST_CHECK(Test_Reported(&Reports, "a.tga"));
+
+	// saved under a temporary name, which is its own burst, then renamed
+	// into place
+	TEST_CHECK(Test_Write("b.tmp"));
+	TEST_CHECK(Test_Wait(Watch, &Reports) == 1);
+	TEST_CHECK(Test_Reported(&Reports, "b.tmp"));
+
+	Test_Path("b.tmp", From);
+	Test_Path("b.tga", To);
+	TEST_CHECK(rename(From, To) == 0);
+	TEST_CHECK(Test_Wait(Watch, &Reports) == 1);
+	TEST_CHECK(Reports.Count == 1 && Reports.Lost == 0);
+	TEST_CHECK(Test_Reported(&Reports, "b.tga"));
+
+	// several saves and a new directory make one burst, with every file once
+	TEST_CHECK(Test_Write("a.tga"));
+	TEST_CHECK(Test_Write("a.tga"));
+	Test_Path("sub", From);
+	TEST_CHECK(mkdir(From, 0700) == 0);
+	TEST_CHECK(Test_Write("sub/c.tga"));
+	TEST_CHECK(Test_Wait(Watch, &Reports) == 2);
+	TEST_CHECK(Reports.Count == 2 && Reports.Lost == 0);
+	TEST_CHECK(Test_Reported(&Reports, "a.tga"));
+	TEST_CHECK(Test_Reported(&Reports, "sub/c.tga"));
+
+	// and files in it are watched from then on
+	TEST_CHECK(Test_Write("sub/c.tga"));
+	TEST_CHECK(Test_Wait(Watch, &Reports) == 1);
+	TEST_CHECK(Test_Reported(&Reports, "sub/c.tga"));
+}
+
+
+static void Test_Remove(void)
+{
+	const char *Names[] = { "a.tga", "b.tmp", "b.tga", "sub/c.tga" };
+	char Path[_MAX_PATH];
+	int i;
+
+	for(i = 0; i < (int)(sizeof(Names) / sizeof(Names[0])); i++)
+	{
+		Test_Path(Names[i], Path);
+		remove(Path);
+	}
+
+	Test_Path("sub", Path);
+	rmdir(Path);
+	rmdir(Test_Root);
+}
+
+
+int main(void)
+{
+	WatchDir *Watch;
+
+	if(!mkdtemp(Test_Root))
+	{
+		fprintf(stderr, "cannot create a directory to watch\n");
+		return 1;
+	}
+
+	Watch = WatchDir_Open(Test_Root, TEST_QUIET);
+	TEST_CHECK(Watch != NULL);
+	if(Watch)
+	{
+		Test_Watch(Watch);
+		WatchDir_Close(&Watch);
+		TEST_CHECK(Watch == NULL);
+	}
+
+	Test_Remove();
+	return TEST_RESULT;
+}
+
+#else
+
+int main(void)
+{
+	WatchDir *Watch = WatchDir_Open(".", TEST_QUIET);
+
+	// without inotify there is no watch to test
+	TEST_CHECK(Watch == NULL);
+	return TEST_RESULT;
+}
+
+#endif
@@ -7,6 +7,10 @@
 #include "resource.h"
 #include "genesis.h"
 #include "ram.h"
+#include "tga2gebmp_core.h"
+#include "downsample.h"
+#include "previewcache.h"
+#include "previewqueue.h"
 
 #if defined _MSC_VER && _MSC_VER < 1300
     #define GetWindowLongPtr GetWindowLong
@@ -21,8 +25,9 @@ typedef struct	tga2gebmp_WindowData
 	HINSTANCE	Instance;
 	HWND		hwnd;
 	HBITMAP		hBitmap;
-	geBitmap	*PreviewSkin;
-	geVFile		*FSystem;
+	PreviewCache *Previews;
+	PreviewQueue *Decoder;
+	tga2gebmp_Session *Session;
 	char		FileName[_MAX_PATH];
 	char		TextureName[_MAX_PATH];
 	char		CurrentDirectory[_MAX_PATH];
@@ -30,18 +35,27 @@ typedef struct	tga2gebmp_WindowData
 
 static HWND tga2gebmp_DlgHandle = NULL;
 
+// previews larger than this on either side are filtered down
+#define TGA2GEBMP_PREVIEW_MAX	1024
+// decoded previews kept for revisiting skins, in bytes
+#define TGA2GEBMP_PREVIEW_CACHE_SIZE	(64 * 1024 * 1024)
+// posted by the background decoder when previews are ready
+#define WM_TGA2GEBMP_PREVIEW	(WM_APP + 1)
+
 
 void tga2gebmp_InitDialog(HWND hwnd);
 void tga2gebmp_UpdatePreview(tga2gebmp_WindowData *pData);
+void tga2gebmp_CollectPreviews(tga2gebmp_WindowData *pData);
 
 void tga2gebmp_OpenAct(tga2gebmp_WindowData *pData);
 void tga2gebmp_OpenTexture(tga2gebmp_WindowData *pData);
 
-void tga2gebmp_ExtractFile(geVFile *VFS, geVFile *File, const char *src, const char *dest);
-void tga2gebmp_CopyFile(geVFile *VFS, geVFile *Directory, const char *src, const char *dest);
 void tga2gebmp_SaveChanges(tga2gebmp_WindowData *pData);
 
-static	HBITMAP CreateHBitmapFromgeBitmap (geBitmap *Bitmap, HDC hdc);
+static	geBoolean CreatePreviewFromgeBitmap (geBitmap *Bitmap, int *pWidth, int *pHeight, void **pPixels);
+static	HBITMAP CreateHBitmapFromPreview (const PreviewCache_Image *Image, HDC hdc);
+static	void *tga2gebmp_DecodePreview(void *Context, const void *Data, size_t Size, int *pWidth, int *pHeight, ptrdiff_t *pStride);
+static	void tga2gebmp_NotifyPreview(void *Context);
 static	BOOL Render2d_Blit(HDC hDC, HBITMAP Bmp, const RECT *SourceRect, const RECT *DestRect);
 
 
@@ -77,25 +91,37 @@ static LRESULT CALLBACK PreviewWndProc
 		{
 			RECT	Source;
 			RECT	Dest;
-			HDC		hDC;
+			BITMAP	Bmp;
+			int		Width, Height;
 
+			// the preview bitmap is already reduced, show all of it
+			GetObject(pData->hBitmap, sizeof(Bmp), &Bmp);
 			Source.left = 0;
 			Source.top = 0;
-			Source.bottom = geBitmap_Height(pData->PreviewSkin);
-			Source.right = geBitmap_Width(pData->PreviewSkin);
-			/* Display bitmaps greater than 1024x1024 resolutions by scaling them into 1024x1024 bitmaps */
-			if (Source.bottom > 1024) Source.bottom = 1024;
-			if (Source.right  > 1024) Source.right  = 1024;
+			Source.right = Bmp.bmWidth;
+			Source.bottom = Bmp.bmHeight;
 
+			// as large as the window allows without distorting the skin
 			Dest = Rect;
+			Width = Rect.right - Rect.left;
+			Height = Rect.bottom - Rect.top;
+			if(Bmp.bmWidth * Height > Bmp.bmHeight * Width)
+			{
+				Height = MulDiv(Bmp.bmHeight, Width, Bmp.bmWidth);
+				Dest.top += (Rect.bottom - Rect.top - Height) / 2;
+				Dest.bottom = Dest.top + Height;
+			}
+			else
+			{
+				Width = MulDiv(Bmp.bmWidth, Height, Bmp.bmHeight);
+				Dest.left += (Rect.right - Rect.left - Width) / 2;
+				Dest.right = Dest.left + Width;
+			}
 
-			hDC = GetDC(hwnd);
-			SetStretchBltMode(hDC, HALFTONE);
 			Render2d_Blit(	hDC,
 							pData->hBitmap,
 							&Source,
 							&Dest);
-			ReleaseDC(hwnd, hDC);
 		}
 		EndPaint(hwnd, &ps);
 		return 0;
@@ -121,8 +147,9 @@ static BOOL tga2gebmp_InitWindowData(HWND hwnd)
 	pData->Instance		= (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE);
 	pData->hwnd			= hwnd;
 	pData->hBitmap		= NULL;
-	pData->PreviewSkin	= NULL;
-	pData->FSystem		= NULL;
+	pData->Previews		= NULL;
+	pData->Decoder		= NULL;
+	pData->Session		= NULL;
 
 	// set the window data pointer in the GWLP_USERDATA field
 	SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)pData);
@@ -156,34 +183,18 @@ static void tga2gebmp_Shutdown(HWND hwnd, tga2gebmp_WindowData *pData)
 {
 	if(pData != NULL)
 	{
-		if(pData->FSystem)
-		{
-			geVFile_Finder *Finder;
-			//geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.bdy");
-			geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.tmp");
-			Finder = geVFile_CreateFinder(pData->FSystem, "$temp$\\Bitmaps\\*.*");
-			if(Finder)
-			{
-				while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
-				{
-					char filename[_MAX_PATH];
-					geVFile_Properties Properties;
-					geVFile_FinderGetProperties(Finder, &Properties);
-					sprintf(filename, "$temp$\\Bitmaps\\%s", Properties.Name);
-					geVFile_DeleteFile(pData->FSystem, filename);
-				}
-
-				geVFile_DestroyFinder(Finder);
-			}
+		// first, so no decoder thread is left to post to this window
+		if(pData->Decoder)
+			PreviewQueue_Destroy(&pData->Decoder);
 
-			geVFile_Close(pData->FSystem);
+		if(pData->Session)
+			tga2gebmp_Session_Destroy(&pData->Session);
 
-			RemoveDirectory("$temp$\\Bitmaps");
-			//RemoveDirectory("$temp$");
-		}
+		if(pData->Previews)
+			PreviewCache_Destroy(&pData->Previews);
 
-		if(pData->PreviewSkin)
-			geBitmap_Destroy(&pData->PreviewSkin);
+		if(pData->hBitmap)
+			DeleteObject(pData->hBitmap);
 
 		geRam_Free(pData);
 	}
@@ -210,11 +221,12 @@ static	BOOL Render2d_Blit(HDC hDC, HBITMAP Bmp, const RECT *SourceRect, const RE
 	SourceHeight = SourceRect->bottom - SourceRect->top;
 	DestWidth = DestRect->right - DestRect->left;
 	DestHeight = DestRect->bottom - DestRect->top;
-	SetStretchBltMode(hDC, COLORONCOLOR);
+	SetStretchBltMode(hDC, HALFTONE);
+	SetBrushOrgEx(hDC, 0, 0, NULL);
 	StretchBlt(hDC,
 					DestRect->left,
 					DestRect->top,
-					DestHeight,
+					DestWidth,
 					DestHeight,
 					MemDC,
 					SourceRect->left,
@@ -250,6 +262,11 @@ static BOOL CALLBACK tga2gebmp_DlgProc
 		PostQuitMessage (0);
 		break;
 
+	case WM_TGA2GEBMP_PREVIEW:
+		if(pData)
+			tga2gebmp_CollectPreviews(pData);
+		break;
+
 	case WM_COMMAND:
 		{
 			WORD wNotifyCode = HIWORD (wParam);
@@ -295,53 +312,162 @@ static BOOL CALLBACK tga2gebmp_DlgProc
 
 void tga2gebmp_InitDialog(HWND hwnd)
 {
-	geVFile_Finder *Finder;
-
 	tga2gebmp_WindowData *pData = tga2gebmp_GetWindowData(hwnd);
 
 	GetCurrentDirectory(sizeof(pData->CurrentDirectory), pData->CurrentDirectory);
 
-	pData->FSystem = geVFile_OpenNewSystem(NULL,
-									GE_VFILE_TYPE_DOS,
-									pData->CurrentDirectory,
-									NULL,
-									GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	pData->Session = tga2gebmp_Session_Create(pData->CurrentDirectory);
+	pData->Previews = PreviewCache_Create(TGA2GEBMP_PREVIEW_CACHE_SIZE);
+	pData->Decoder = PreviewQueue_Create(tga2gebmp_DecodePreview, tga2gebmp_NotifyPreview, pData);
+}
+
+
+static void tga2gebmp_ShowPreview(tga2gebmp_WindowData *pData, const PreviewCache_Image *Image)
+{
+	HWND	PreviewWnd;
+	HDC		hDC;
+
+	PreviewWnd = GetDlgItem(pData->hwnd, IDC_PREVIEW);
 
-	geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.bdy");
-	geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.tmp");
-	Finder = geVFile_CreateFinder(pData->FSystem, "$temp$\\Bitmaps\\*.*");
+	if(pData->hBitmap)
+	{
+		DeleteObject(pData->hBitmap);
+		pData->hBitmap = NULL;
+	}
 
-	while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+	if(Image)
 	{
-		char filename[_MAX_PATH];
-		geVFile_Properties Properties;
-		geVFile_FinderGetProperties(Finder, &Properties);
-		sprintf(filename, "$temp$\\Bitmaps\\%s", Properties.Name);
-		geVFile_DeleteFile(pData->FSystem, filename);
+		hDC = GetDC(PreviewWnd);
+		pData->hBitmap = CreateHBitmapFromPreview(Image, hDC);
+		ReleaseDC(PreviewWnd, hDC);
 	}
 
-	geVFile_DestroyFinder(Finder);
+	InvalidateRect(PreviewWnd, NULL, TRUE);
+}
+
+
+// queue a skin for the background decoder unless its preview is already cached
+static void tga2gebmp_RequestPreview(tga2gebmp_WindowData *pData, const char *SkinName, geBoolean Urgent)
+{
+	int		Index;
+	uint64_t Hash;
+	const void *Data;
+	long	Size;
+
+	Index = tga2gebmp_Session_FindSkin(pData->Session, SkinName);
+	if(Index < 0)
+		return;
+
+	Hash = tga2gebmp_Session_GetSkinHash(pData->Session, Index);
+	if(PreviewCache_Contains(pData->Previews, SkinName, Hash))
+		return;
+
+	Data = tga2gebmp_Session_GetSkinData(pData->Session, Index, &Size);
+	PreviewQueue_Request(pData->Decoder, SkinName, Hash, Data, (size_t)Size, Urgent);
 }
 
 
 void tga2gebmp_UpdatePreview(tga2gebmp_WindowData *pData)
 {
-	HWND	PreviewWnd;
-	HDC		hDC;
-	char	filetys[_MAX_PATH];
+	int		Index;
+	int		ListIndex;
+	int		ListCount;
+	uint64_t Hash;
+	const PreviewCache_Image *Image = NULL;
+	char	Neighbour[_MAX_PATH];
+
+	Index = pData->Session ? tga2gebmp_Session_FindSkin(pData->Session, pData->TextureName) : -1;
+	if(Index < 0 || !pData->Previews || !pData->Decoder)
+	{
+		tga2gebmp_ShowPreview(pData, NULL);
+		return;
+	}
 
-	sprintf(filetys, "$temp$\\Bitmaps\\%s", pData->TextureName);
+	// whatever was queued for earlier selections is not wanted any more
+	PreviewQueue_CancelPending(pData->Decoder);
 
-	pData->PreviewSkin = geBitmap_CreateFromFileName(pData->FSystem, filetys);
+	Hash = tga2gebmp_Session_GetSkinHash(pData->Session, Index);
+	Image = PreviewCache_Find(pData->Previews, pData->TextureName, Hash);
+	if(!Image)
+		tga2gebmp_RequestPreview(pData, pData->TextureName, GE_TRUE);
 
-	PreviewWnd = GetDlgItem(pData->hwnd, IDC_PREVIEW);
-	hDC = GetDC(PreviewWnd);
+	// the preview stays blank until the decoder posts the skin
+	tga2gebmp_ShowPreview(pData, Image);
+
+	// keyboard navigation goes to one of these next
+	ListIndex = (int)SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETCURSEL, (WPARAM)0, (LPARAM)0);
+	ListCount = (int)SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETCOUNT, (WPARAM)0, (LPARAM)0);
+	if(ListIndex != LB_ERR)
+	{
+		if(ListIndex + 1 < ListCount && SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETTEXTLEN, (WPARAM)(ListIndex + 1), (LPARAM)0) < _MAX_PATH)
+		{
+			SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETTEXT, (WPARAM)(ListIndex + 1), (LPARAM)Neighbour);
+			tga2gebmp_RequestPreview(pData, Neighbour, GE_FALSE);
+		}
+		if(ListIndex > 0 && SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETTEXTLEN, (WPARAM)(ListIndex - 1), (LPARAM)0) < _MAX_PATH)
+		{
+			SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_GETTEXT, (WPARAM)(ListIndex - 1), (LPARAM)Neighbour);
+			tga2gebmp_RequestPreview(pData, Neighbour, GE_FALSE);
+		}
+	}
+}
 
-	pData->hBitmap = CreateHBitmapFromgeBitmap(pData->PreviewSkin, hDC);
 
-	ReleaseDC(PreviewWnd, hDC);
+// called for WM_TGA2GEBMP_PREVIEW, the decoder has finished one or more skins
+void tga2gebmp_CollectPreviews(tga2gebmp_WindowData *pData)
+{
+	PreviewQueue_Result Result;
+	const PreviewCache_Image *Image;
+	int		Index;
 
-	InvalidateRect(GetDlgItem(pData->hwnd, IDC_PREVIEW), NULL, TRUE);
+	while(PreviewQueue_GetResult(pData->Decoder, &Result))
+	{
+		if(!Result.Pixels)
+			continue;
+
+		Image = PreviewCache_Insert(pData->Previews, Result.Name, Result.Hash,
+									Result.Width, Result.Height, Result.Stride, Result.Pixels);
+
+		// a skin replaced since it was queued has a different hash and is not shown
+		if(Image && tga2gebmp_stricmp(Result.Name, pData->TextureName) == 0)
+		{
+			Index = tga2gebmp_Session_FindSkin(pData->Session, pData->TextureName);
+			if(Index >= 0 && tga2gebmp_Session_GetSkinHash(pData->Session, Index) == Result.Hash)
+				tga2gebmp_ShowPreview(pData, Image);
+		}
+	}
+}
+
+
+// runs on the decoder thread while the dialog goes on using the session, so
+// the engine calls here hold the core's engine lock
+static void *tga2gebmp_DecodePreview(void *Context, const void *Data, size_t Size,
+									 int *pWidth, int *pHeight, ptrdiff_t *pStride)
+{
+	geBitmap *Skin;
+	void	*Pixels = NULL;
+
+	Skin = tga2gebmp_CreateBitmapFromData(Data, (long)Size);
+	if(!Skin)
+		return NULL;
+
+	tga2gebmp_EnterEngine();
+
+	if(CreatePreviewFromgeBitmap(Skin, pWidth, pHeight, &Pixels))
+		*pStride = Downsample_GetDibStride(*pWidth, 32);
+
+	geBitmap_Destroy(&Skin);
+
+	tga2gebmp_LeaveEngine();
+	return Pixels;
+}
+
+
+static void tga2gebmp_NotifyPreview(void *Context)
+{
+	tga2gebmp_WindowData *pData = (tga2gebmp_WindowData*)Context;
+
+	PostMessage(pData->hwnd, WM_TGA2GEBMP_PREVIEW, 0, 0);
 }
 
 
@@ -350,9 +476,6 @@ void tga2gebmp_OpenTexture(tga2gebmp_WindowData *pData)
 	OPENFILENAME ofn;
 	char Filter[_MAX_PATH];
 	char	Dir[_MAX_PATH];
-	geVFile *file;
-	geBitmap *bitmap;
-	char WriteFileName[256];
 	char OpenFileName[_MAX_PATH];
 
 	OpenFileName[0] = '\0';
@@ -393,178 +516,31 @@ void tga2gebmp_OpenTexture(tga2gebmp_WindowData *pData)
 	if(!GetOpenFileName (&ofn))
 		return;
 
-	bitmap = geBitmap_CreateFromFileName(NULL, OpenFileName);
-
-	if(bitmap)
-	{
-		sprintf(WriteFileName, "$temp$\\Bitmaps\\%s", pData->TextureName);
-		file = geVFile_Open(pData->FSystem, WriteFileName, GE_VFILE_OPEN_CREATE);
-		if(file)
-		{
-			geBitmap_WriteToFile(bitmap, file);
-			geVFile_Close(file);
-		}
-		geBitmap_Destroy(&bitmap);
-	}
-}
-
-
-void tga2gebmp_CopyFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest)
-{
-	geVFile *SrcFile = NULL;
-	geVFile *DestFile = NULL;
-
-	SrcFile = geVFile_Open(srcVFS, src, GE_VFILE_OPEN_READONLY);
-	if(!SrcFile)
-	{
-		return;
-	}
-
-	DestFile = geVFile_Open(destVFS, dest, GE_VFILE_OPEN_CREATE);
-	if(!DestFile)
-	{
-		geVFile_Close(SrcFile);
-		return;
-	}
-
+	if(tga2gebmp_Session_ReplaceSkin(pData->Session, pData->TextureName, OpenFileName))
 	{
-		char CopyBuf[16384];
-		int CopyBufLen = 16384;
-		long Size;
-		geVFile_Properties Props;
-
-		if(!geVFile_GetProperties(SrcFile, &Props))
-			return;
-
-		if(!geVFile_Size(SrcFile, &Size))
-			return;
-
-		while(Size)
-		{
-			int CurLen = min(Size, CopyBufLen);
-
-			if(!geVFile_Read(SrcFile, CopyBuf, CurLen))
-				return;
-
-			if(!geVFile_Write(DestFile, CopyBuf, CurLen))
-				return;
-
-			Size -= CurLen;
-		}
+		if(pData->Previews)
+			PreviewCache_Invalidate(pData->Previews, pData->TextureName);
+		tga2gebmp_UpdatePreview(pData);
 	}
-
-	geVFile_Close(DestFile);
-	geVFile_Close(SrcFile);
 }
 
 
 void tga2gebmp_SaveChanges(tga2gebmp_WindowData *pData)
 {
-	char working[256];
-	geVFile_Finder	*Finder;
-	geVFile			*destVFS;
-	geVFile			*srcVFS;
-	geVFile			*Directory;
-
-	// this will become the new body file with updated textures
-	sprintf(working, "%s\\$temp$\\Body.tmp", pData->CurrentDirectory);
-	destVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_CREATE | GE_VFILE_OPEN_DIRECTORY);
-	if(!destVFS)
-	{
-		return;
-	}
-
-	// the old body we extracted from the .act file
-	sprintf(working, "%s\\$temp$\\Body.bdy", pData->CurrentDirectory);
-	srcVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
-	if(!srcVFS)
-	{
-		geVFile_Close(destVFS);
-		return;
-	}
-
-	// create bitmap directory in new body file
-	Directory = geVFile_Open(destVFS, "Bitmaps", GE_VFILE_OPEN_DIRECTORY|GE_VFILE_OPEN_CREATE);
-	if(!Directory)
-	{
-		geVFile_Close(destVFS);
-		geVFile_Close(srcVFS);
-		return;
-	}
-	geVFile_Close(Directory);
-
-	// copy the geBitmap filess from the temp folder to the new bdy file
-	Finder = geVFile_CreateFinder(pData->FSystem, "$temp$\\Bitmaps\\*.*");
-	if(!Finder)
-	{
-		geVFile_Close(destVFS);
-		geVFile_Close(srcVFS);
-		return;
-	}
-
-	while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
-	{
-		char filename[_MAX_PATH];
-		char filename2[_MAX_PATH];
-
-		geVFile_Properties	Properties;
-		geVFile_FinderGetProperties(Finder, &Properties);
-
-		sprintf(filename, "$temp$\\Bitmaps\\%s", Properties.Name);
-		sprintf(filename2, "Bitmaps\\%s", Properties.Name);
-		tga2gebmp_CopyFile(pData->FSystem, destVFS, filename, filename2);
-	}
-
-	geVFile_DestroyFinder(Finder);
-
-	// copy over the geometry
-	tga2gebmp_CopyFile(srcVFS, destVFS, "Geometry", "Geometry");
-
-	geVFile_Close(destVFS);
-	geVFile_Close(srcVFS);
-
-	// next copy the new body to the new actor file (FileName), rename the original one
-	{
-		char oldFileName[_MAX_PATH];
-		sprintf(oldFileName, "%s.old", pData->FileName);
-		rename(pData->FileName, oldFileName);
-		srcVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, oldFileName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
-		destVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, pData->FileName, NULL, GE_VFILE_OPEN_CREATE | GE_VFILE_OPEN_DIRECTORY);
-
-		if(Directory = geVFile_Open(destVFS, "Motions", GE_VFILE_OPEN_DIRECTORY|GE_VFILE_OPEN_CREATE))
-			geVFile_Close(Directory);
-
-		Finder = geVFile_CreateFinder(srcVFS, "Motions\\*.*");
-
-		while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
-		{
-			char filename[256];
-			char filename2[256];
-			geVFile_Properties	Properties;
-			geVFile_FinderGetProperties(Finder, &Properties);
-			sprintf(filename, "Motions\\%s", Properties.Name);
-			sprintf(filename2, "Motions\\%s", Properties.Name);
-			tga2gebmp_CopyFile(srcVFS, destVFS, filename, filename2);
-		}
-		geVFile_DestroyFinder(Finder);
-		tga2gebmp_CopyFile(srcVFS, destVFS, "Header", "Header");
-		tga2gebmp_CopyFile(pData->FSystem, destVFS, "$temp$\\Body.tmp", "Body");
-
-		geVFile_Close(srcVFS);
-		geVFile_Close(destVFS);
-	}
+	if(pData->Session)
+		tga2gebmp_Session_Save(pData->Session);
 }
 
 
 void tga2gebmp_OpenAct(tga2gebmp_WindowData *pData)
 {
 	OPENFILENAME ofn;
-	geVFile_Finder *Finder;
-	geVFile		*Directory;
-	geVFile		*VFS;
 	char		Filter[_MAX_PATH];
 	char		Dir[_MAX_PATH];
-	char		TempName[_MAX_PATH];
+	int			i;
+
+	if(!pData->Session)
+		return;
 
 	pData->FileName[0] = '\0';
 
@@ -603,69 +579,16 @@ void tga2gebmp_OpenAct(tga2gebmp_WindowData *pData)
 	if(!GetOpenFileName (&ofn))
 		return;
 
-	{
-		if(pData->FSystem)
-		{
-			geVFile_Finder *Finder;
-			geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.bdy");
-			geVFile_DeleteFile(pData->FSystem, "$temp$\\Body.tmp");
-			Finder = geVFile_CreateFinder(pData->FSystem, "$temp$\\Bitmaps\\*.*");
-			if(Finder)
-			{
-				while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
-				{
-					char filename[_MAX_PATH];
-					geVFile_Properties Properties;
-					geVFile_FinderGetProperties(Finder, &Properties);
-					sprintf(filename, "$temp$\\Bitmaps\\%s", Properties.Name);
-					geVFile_DeleteFile(pData->FSystem, filename);
-				}
-
-				geVFile_DestroyFinder(Finder);
-			}
-
-			RemoveDirectory("$temp$\\Bitmaps");
-			RemoveDirectory("$temp$");
-		}
-
-		SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_RESETCONTENT, (WPARAM)0, (LPARAM)0);
-	}
-
-	Directory = geVFile_Open(pData->FSystem, "$temp$", GE_VFILE_OPEN_DIRECTORY | GE_VFILE_OPEN_CREATE);
-	if(Directory)
-		geVFile_Close(Directory);
-
-	VFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, pData->FileName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_RESETCONTENT, (WPARAM)0, (LPARAM)0);
 
-	// extract the body file to the temp folder
-	tga2gebmp_ExtractFile(VFS, pData->FSystem, "Body", "Body.bdy");
-
-	// create bitmaps folder
-	Directory = geVFile_Open(pData->FSystem, "$temp$\\Bitmaps", GE_VFILE_OPEN_DIRECTORY | GE_VFILE_OPEN_CREATE);
-	if(Directory)
-		geVFile_Close(Directory);
-
-	geVFile_Close(VFS);
-
-	// extract geBitmap files from already extracted body file
-	sprintf(TempName, "%s\\$temp$\\Body.bdy", pData->CurrentDirectory);
-	VFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, TempName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!tga2gebmp_Session_OpenAct(pData->Session, pData->FileName))
+		return;
 
-	Finder = geVFile_CreateFinder(VFS, "Bitmaps\\*.*");
-	while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+	for(i = 0; i < tga2gebmp_Session_GetSkinCount(pData->Session); i++)
 	{
-		char filename[256];
-		geVFile_Properties	Properties;
-		geVFile_FinderGetProperties(Finder, &Properties);
-		sprintf(filename, "Bitmaps\\%s", Properties.Name);
-		tga2gebmp_ExtractFile(VFS, pData->FSystem, filename, filename);
-		SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_ADDSTRING, (WPARAM)0, (LPARAM)Properties.Name);
+		SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_ADDSTRING, (WPARAM)0, (LPARAM)tga2gebmp_Session_GetSkinName(pData->Session, i));
 	}
 
-	geVFile_DestroyFinder(Finder);
-
-	geVFile_Close(VFS);
-
 	SendDlgItemMessage(pData->hwnd, IDC_SKINLIST, LB_SETCURSEL, 0, 0);
 
 	{
@@ -677,57 +600,6 @@ void tga2gebmp_OpenAct(tga2gebmp_WindowData *pData)
 }
 
 
-void tga2gebmp_ExtractFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest)
-{
-	geVFile *	SrcFile;
-	geVFile *   DestFile;
-	char destTemp[_MAX_PATH];
-	sprintf(destTemp, "$temp$\\%s", dest);
-
-	SrcFile = geVFile_Open(srcVFS, src, GE_VFILE_OPEN_READONLY);
-	if(!SrcFile)
-	{
-		return;
-	}
-	DestFile = geVFile_Open(destVFS, destTemp, GE_VFILE_OPEN_CREATE);
-	if(!DestFile)
-	{
-		geVFile_Close(SrcFile);
-		return;
-	}
-
-	do
-	{
-		char CopyBuf[16384];
-		int CopyBufLen = 16384;
-		long Size;
-		geVFile_Properties Props;
-
-		if(!geVFile_GetProperties(SrcFile, &Props))
-			break;
-
-		if(!geVFile_Size(SrcFile, &Size))
-			break;
-
-		while(Size)
-		{
-			int CurLen = min(Size, CopyBufLen);
-
-			if(!geVFile_Read(SrcFile, CopyBuf, CurLen))
-				break;
-
-			if(!geVFile_Write(DestFile, CopyBuf, CurLen))
-				break;
-
-			Size -= CurLen;
-		}
-	}while(GE_FALSE);
-
-	geVFile_Close(DestFile);
-	geVFile_Close(SrcFile);
-}
-
-
 int CALLBACK WinMain
 	(
 		HINSTANCE instance,
@@ -772,14 +644,20 @@ int CALLBACK WinMain
 }
 
 
-static HBITMAP CreateHBitmapFromgeBitmap (geBitmap *Bitmap, HDC hdc)
+// called with the engine lock held, which is let go while the pixels are
+// scaled
+static geBoolean CreatePreviewFromgeBitmap (geBitmap *Bitmap, int *pWidth, int *pHeight, void **pPixels)
 {
 	geBitmap *Lock;
 	gePixelFormat Format;
 	geBitmap_Info info;
-	HBITMAP hbm = NULL;
+	geBoolean Ok = GE_FALSE;
+	void *Pixels;
+	const void *Bits;
+	int Width, Height;
 
-	Format = GE_PIXELFORMAT_24BIT_BGR;
+	// B, G, R, X in memory, the layout of a 32-bit DIB
+	Format = GE_PIXELFORMAT_32BIT_XRGB;
 
 	if(geBitmap_GetBits(Bitmap))
 	{
@@ -787,109 +665,42 @@ static HBITMAP CreateHBitmapFromgeBitmap (geBitmap *Bitmap, HDC hdc)
 	}
 	else
 	{
-
 		if(!geBitmap_LockForRead(Bitmap, &Lock, 0, 0, Format, GE_FALSE, 0))
 		{
-			return NULL;
+			return GE_FALSE;
 		}
 	}
 
 	geBitmap_GetInfo(Lock, &info, NULL);
 
-	if(info.Format != Format)
-		return NULL;
+	Bits = geBitmap_GetBits(Lock);
 
+	if(Bits && info.Format == Format)
 	{
-		void *bits;
-		BITMAPINFOHEADER bmih;
-		int pelbytes;
-
-		pelbytes = gePixelFormat_BytesPerPel(Format);
-		bits = geBitmap_GetBits(Lock);
-
-		bmih.biSize = sizeof(bmih);
-		bmih.biHeight = - info.Height;
-		bmih.biPlanes = 1;
-		bmih.biBitCount = 24;
-		bmih.biCompression = BI_RGB;
-		bmih.biSizeImage = 0;
-		bmih.biXPelsPerMeter = bmih.biYPelsPerMeter = 10000;
-		bmih.biClrUsed = bmih.biClrImportant = 0;
-
-		/* Display bitmaps greater than 1024x1024 resolutions by scaling them into 1024x1024 bitmaps */
-		if ( abs(info.Height) > 1024 ) //display large bitmaps (> 2048 x 2048)
-		{
-			void * newbits;
-			int Stride;
-
-			bmih.biWidth = 1024;
-			bmih.biHeight = - 1024;
-
-			Stride = (((1024 * pelbytes)+3)&(~3));
-			newbits = geRam_Allocate(Stride * 1024);
-
-			if(newbits)
-			{
-				char *newptr, *oldptr;
-				int y;
-				int z;
-				int c = info.Width / 1024;
-
-				newptr = (char*)newbits;
-				oldptr = (char*)bits;
+		tga2gebmp_LeaveEngine();
 
-				for(y=0; y<1024; y++)
-				{
-					newptr = (char*) newbits + (y * Stride);
-					oldptr = (char*) bits    + (c * (y * (info.Stride*pelbytes)));
-
-					for(z=0; z<1024; z++)
-					{
-						memcpy ( newptr, oldptr, pelbytes );
-						oldptr += ( c * pelbytes );
-						newptr += pelbytes;
-					}
-
-				}
-
-				hbm = CreateDIBitmap( hdc, &bmih , CBM_INIT , newbits, (BITMAPINFO *)&bmih , DIB_RGB_COLORS );
-				geRam_Free(newbits);
-			}
+		/* Display bitmaps larger than the preview limit by box filtering them down, keeping the aspect ratio */
+		Downsample_FitSize(info.Width, info.Height, TGA2GEBMP_PREVIEW_MAX, TGA2GEBMP_PREVIEW_MAX, &Width, &Height);
 
-		}
-		else
+		// rows are laid out as in a DIB, so making the bitmap is one copy
+		Pixels = malloc((size_t)Downsample_GetDibStride(Width, 32) * Height);
+		if(Pixels)
 		{
-			if((info.Stride*pelbytes) == (((info.Stride*pelbytes)+3)&(~3)))
+			if(Downsample_Resize32(Bits, info.Width, info.Height, info.Stride * 4,
+								   Pixels, Width, Height, Downsample_GetDibStride(Width, 32)))
 			{
-				bmih.biWidth = info.Stride;
-				hbm = CreateDIBitmap(hdc, &bmih , CBM_INIT , bits, (BITMAPINFO*)&bmih , DIB_RGB_COLORS);
+				*pWidth = Width;
+				*pHeight = Height;
+				*pPixels = Pixels;
+				Ok = GE_TRUE;
 			}
 			else
 			{
-				void *newbits;
-				int Stride;
-
-				bmih.biWidth = info.Width;
-				Stride = (((info.Width*pelbytes)+3)&(~3));
-				newbits = geRam_Allocate(Stride * info.Height);
-				if(newbits)
-				{
-					char *newptr, *oldptr;
-					int y;
-
-					newptr = (char*)newbits;
-					oldptr = (char*)bits;
-					for(y=0; y<info.Height; y++)
-					{
-						memcpy(newptr, oldptr, (info.Width)*pelbytes);
-						oldptr += info.Stride*pelbytes;
-						newptr += Stride;
-					}
-					hbm = CreateDIBitmap(hdc, &bmih , CBM_INIT , newbits, (BITMAPINFO*)&bmih , DIB_RGB_COLORS);
-					geRam_Free(newbits);
-				}
+				free(Pixels);
 			}
 		}
+
+		tga2gebmp_EnterEngine();
 	}
 
 	if(Lock != Bitmap)
@@ -897,6 +708,31 @@ static HBITMAP CreateHBitmapFromgeBitmap (geBitmap *Bitmap, HDC hdc)
 		geBitmap_UnLock(Lock);
 	}
 
-	return hbm;
+	return Ok;
 }
 
+
+static HBITMAP CreateHBitmapFromPreview (const PreviewCache_Image *Image, HDC hdc)
+{
+	BITMAPINFOHEADER bmih;
+	HBITMAP hbm;
+	void *bits;
+
+	memset(&bmih, 0, sizeof(bmih));
+	bmih.biSize = sizeof(bmih);
+	bmih.biWidth = Image->Width;
+	bmih.biHeight = - Image->Height;
+	bmih.biPlanes = 1;
+	bmih.biBitCount = 32;
+	bmih.biCompression = BI_RGB;
+	bmih.biXPelsPerMeter = bmih.biYPelsPerMeter = 10000;
+
+	hbm = CreateDIBSection(hdc, (BITMAPINFO*)&bmih, DIB_RGB_COLORS, &bits, NULL, 0);
+	if(hbm)
+	{
+		GdiFlush();
+		memcpy(bits, Image->Pixels, (size_t)Image->Stride * Image->Height);
+	}
+
+	return hbm;
+}
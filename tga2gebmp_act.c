@@ -0,0 +1,227 @@
+/**
+ * @file tga2gebmp_act.c
+ *
+ * Skin access for actors without the Genesis engine, on top of actfile.h.
+ * Lists skins, extracts their encoded geBitmap files and puts such files in
+ * their place; images still have to be converted by tga2gebmp_cli.
+ *
+ *   tga2gebmp_act actor.act                     list skins, sizes and hashes
+ *   tga2gebmp_act actor.act -x skin file ...    write skins to files
+ *   tga2gebmp_act [-v] [-iodepth n] actor.act skin=file ...
+ *                                               replace skins and save
+ */
+#include <stdio.h>
+#include "actfile.h"
+
+
+static void tga2gebmp_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_act [-v] [-iodepth n] actor.act [-x skin file ...] [skin=bitmap ...]\n"
+		"\n"
+		"  -v          report what the save wrote\n"
+		"  -iodepth n  copy unchanged entries with n reads and writes in flight\n"
+		"              (slower than the default copy_file_range on local disks)\n"
+		"  -x skin file  write the skin's encoded geBitmap to file\n"
+		"  skin=bitmap put an encoded geBitmap file (e.g. one written by -x) in\n"
+		"              place of the skin\n"
+		"\n"
+		"Without -x or replacements the skins are listed.\n");
+}
+
+
+static int tga2gebmp_ReadFile(const char *FileName, void **pData, size_t *pSize)
+{
+	FILE	*File;
+	void	*Data = NULL;
+	long	Size;
+
+	File = fopen(FileName, "rb");
+	if(!File)
+		return 0;
+
+	if(fseek(File, 0, SEEK_END) == 0 && (Size = ftell(File)) > 0 && fseek(File, 0, SEEK_SET) == 0)
+	{
+		Data = malloc(Size);
+		if(Data && fread(Data, 1, Size, File) != (size_t)Size)
+		{
+			free(Data);
+			Data = NULL;
+		}
+	}
+	fclose(File);
+
+	if(!Data)
+		return 0;
+
+	*pData = Data;
+	*pSize = (size_t)Size;
+	return 1;
+}
+
+
+static int tga2gebmp_WriteFile(const char *FileName, const void *Data, size_t Size)
+{
+	FILE *File;
+	int Result;
+
+	File = fopen(FileName, "wb");
+	if(!File)
+		return 0;
+
+	Result = fwrite(Data, 1, Size, File) == Size;
+	return (fclose(File) == 0 && Result) ? 1 : 0;
+}
+
+
+static void tga2gebmp_ListSkins(ActFile *Act)
+{
+	int i;
+
+	for(i = 0; i < ActFile_GetSkinCount(Act); i++)
+	{
+		uint64_t Hash = ActFile_GetSkinHash(Act, i);
+		size_t Size;
+
+		ActFile_GetSkinData(Act, i, &Size);
+		printf("%-32s %10lu  %08lx%08lx\n", ActFile_GetSkinName(Act, i), (unsigned long)Size,
+			   (unsigned long)(Hash >> 32), (unsigned long)(Hash & 0xffffffff));
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	ActFile		*Act = NULL;
+	IoQueue		*Queue = NULL;
+	const char	*ActFileName;
+	ActFile_Stats Stats;
+	int			Verbose = 0;
+	int			IoDepth = 0;
+	int			Actions = 0;
+	int			Failures = 0;
+	int			i;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(strcmp(argv[i], "-v") == 0)
+			Verbose = 1;
+		else if(strcmp(argv[i], "-iodepth") == 0 && i + 1 < argc)
+			IoDepth = atoi(argv[++i]);
+		else
+		{
+			tga2gebmp_Usage();
+			return strcmp(argv[i], "-h") == 0 ? 0 : 2;
+		}
+	}
+
+	if(i >= argc)
+	{
+		tga2gebmp_Usage();
+		return 2;
+	}
+
+	ActFileName = argv[i];
+	Act = ActFile_Open(ActFileName);
+	if(!Act)
+	{
+		fprintf(stderr, "%s: cannot open actor\n", ActFileName);
+		return 1;
+	}
+
+	if(IoDepth > 0)
+	{
+		Queue = IoQueue_Create(IoDepth, 0, IOQUEUE_BACKEND_AUTO);
+		if(Queue)
+			ActFile_SetIoQueue(Act, Queue);
+		else
+			fprintf(stderr, "tga2gebmp_act: no asynchronous I/O on this system, ignoring -iodepth\n");
+	}
+
+	for(i++; i < argc; i++)
+	{
+		const char *Separator = strchr(argv[i], '=');
+		char SkinName[_MAX_PATH];
+		const void *Data;
+		void *NewData;
+		size_t Size;
+		int Skin;
+
+		Actions++;
+
+		if(strcmp(argv[i], "-x") == 0 && i + 2 < argc)
+		{
+			Skin = ActFile_FindSkin(Act, argv[i + 1]);
+			Data = Skin >= 0 ? ActFile_GetSkinData(Act, Skin, &Size) : NULL;
+			if(!Data)
+			{
+				fprintf(stderr, "%s: no skin '%s'\n", ActFileName, argv[i + 1]);
+				Failures++;
+			}
+			else if(!tga2gebmp_WriteFile(argv[i + 2], Data, Size))
+			{
+				fprintf(stderr, "%s: cannot write '%s'\n", ActFileName, argv[i + 2]);
+				Failures++;
+			}
+			i += 2;
+			continue;
+		}
+
+		if(!Separator || Separator == argv[i] || Separator - argv[i] >= (int)sizeof(SkinName))
+		{
+			tga2gebmp_Usage();
+			ActFile_Close(&Act);
+			IoQueue_Destroy(&Queue);
+			return 2;
+		}
+
+		memcpy(SkinName, argv[i], Separator - argv[i]);
+		SkinName[Separator - argv[i]] = '\0';
+
+		Skin = ActFile_FindSkin(Act, SkinName);
+		if(Skin < 0)
+		{
+			fprintf(stderr, "%s: no skin '%s'\n", ActFileName, SkinName);
+			Failures++;
+		}
+		else if(!tga2gebmp_ReadFile(Separator + 1, &NewData, &Size))
+		{
+			fprintf(stderr, "%s: cannot read '%s'\n", ActFileName, Separator + 1);
+			Failures++;
+		}
+		else
+		{
+			ActFile_SetSkinData(Act, Skin, NewData, Size, free);
+		}
+	}
+
+	if(Actions == 0)
+	{
+		tga2gebmp_ListSkins(Act);
+		ActFile_Close(&Act);
+		IoQueue_Destroy(&Queue);
+		return 0;
+	}
+
+	// nothing is written if any replacement failed
+	if(Failures == 0 && ActFile_GetDirtyCount(Act) > 0)
+	{
+		if(!ActFile_Save(&Act))
+		{
+			fprintf(stderr, "%s: cannot save actor\n", ActFileName);
+			ActFile_Close(&Act);
+			IoQueue_Destroy(&Queue);
+			return 1;
+		}
+
+		ActFile_GetStats(Act, &Stats);
+		if(Verbose)
+			printf("%s: %d skin(s) written, %d entries reused, %lu of %lu bytes copied unchanged\n",
+				   ActFileName, Stats.EntriesRewritten, Stats.EntriesReused,
+				   (unsigned long)Stats.BytesReused, (unsigned long)Stats.BytesWritten);
+	}
+
+	ActFile_Close(&Act);
+	IoQueue_Destroy(&Queue);
+	return Failures > 0 ? 1 : 0;
+}
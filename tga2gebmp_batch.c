@@ -0,0 +1,227 @@
+/**
+ * @file tga2gebmp_batch.c
+ *
+ * Parallel per-actor jobs, one session per worker thread.
+ */
+#include "tga2gebmp_batch.h"
+
+
+typedef struct	tga2gebmp_BatchJob
+{
+	tga2gebmp_Batch		*Batch;
+	tga2gebmp_BatchFunc	Func;
+	void				*Context;
+}	tga2gebmp_BatchJob;
+
+struct tga2gebmp_Batch
+{
+	ThreadPool			*Pool;
+	ThreadPool_Group	*Group;
+	ThreadPool_Gate		*IoGate;
+	int					ThreadCount;
+	tga2gebmp_Session	**Sessions;		// one per worker
+	IoQueue				**Queues;		// one per session, NULL until SetIoDepth
+	int					*Failures;		// one per worker, only touched by that worker
+};
+
+
+static void tga2gebmp_Batch_RunJob(void *Context, int Worker)
+{
+	tga2gebmp_BatchJob *Job = (tga2gebmp_BatchJob*)Context;
+	tga2gebmp_Batch *Batch = Job->Batch;
+	tga2gebmp_Session *Session = Batch->Sessions[Worker];
+
+	if(!Job->Func(Session, Job->Context))
+		Batch->Failures[Worker]++;
+
+	// a job that bailed out early must not leave its actor open for the next one
+	tga2gebmp_Session_CloseAct(Session);
+
+	tga2gebmp_RamFree(Job);
+}
+
+
+tga2gebmp_Batch *tga2gebmp_Batch_Create(const char *WorkDir, int ThreadCount, int MaxIo)
+{
+	tga2gebmp_Batch *Batch;
+	int i;
+
+	Batch = (tga2gebmp_Batch*)tga2gebmp_RamAllocate(sizeof(tga2gebmp_Batch));
+	if(!Batch)
+		return NULL;
+
+	memset(Batch, 0, sizeof(*Batch));
+
+	Batch->Pool = ThreadPool_Create(ThreadCount);
+	Batch->Group = ThreadPool_CreateGroup();
+	Batch->IoGate = ThreadPool_CreateGate(MaxIo > 0 ? MaxIo : TGA2GEBMP_BATCH_DEFAULT_IO);
+	if(!Batch->Pool || !Batch->Group || !Batch->IoGate)
+	{
+		tga2gebmp_Batch_Destroy(&Batch);
+		return NULL;
+	}
+
+	Batch->ThreadCount = ThreadPool_GetThreadCount(Batch->Pool);
+	Batch->Sessions = (tga2gebmp_Session**)tga2gebmp_RamAllocate(Batch->ThreadCount * sizeof(tga2gebmp_Session*));
+	Batch->Failures = (int*)tga2gebmp_RamAllocate(Batch->ThreadCount * sizeof(int));
+	if(!Batch->Sessions || !Batch->Failures)
+	{
+		tga2gebmp_Batch_Destroy(&Batch);
+		return NULL;
+	}
+
+	memset(Batch->Sessions, 0, Batch->ThreadCount * sizeof(tga2gebmp_Session*));
+	memset(Batch->Failures, 0, Batch->ThreadCount * sizeof(int));
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+	{
+		Batch->Sessions[i] = tga2gebmp_Session_Create(WorkDir);
+		if(!Batch->Sessions[i])
+		{
+			tga2gebmp_Batch_Destroy(&Batch);
+			return NULL;
+		}
+
+		tga2gebmp_Session_SetIoGate(Batch->Sessions[i], Batch->IoGate);
+		tga2gebmp_Session_SetThreadPool(Batch->Sessions[i], Batch->Pool);
+	}
+
+	return Batch;
+}
+
+
+void tga2gebmp_Batch_Destroy(tga2gebmp_Batch **pBatch)
+{
+	tga2gebmp_Batch *Batch = *pBatch;
+	int i;
+
+	if(!Batch)
+		return;
+
+	// finishes whatever is still queued before the sessions go away
+	ThreadPool_Destroy(&Batch->Pool);
+	ThreadPool_DestroyGroup(&Batch->Group);
+	ThreadPool_DestroyGate(&Batch->IoGate);
+
+	if(Batch->Sessions)
+	{
+		for(i = 0; i < Batch->ThreadCount; i++)
+			tga2gebmp_Session_Destroy(&Batch->Sessions[i]);
+		tga2gebmp_RamFree(Batch->Sessions);
+	}
+
+	if(Batch->Queues)
+	{
+		for(i = 0; i < Batch->ThreadCount; i++)
+			IoQueue_Destroy(&Batch->Queues[i]);
+		tga2gebmp_RamFree(Batch->Queues);
+	}
+
+	if(Batch->Failures)
+		tga2gebmp_RamFree(Batch->Failures);
+
+	tga2gebmp_RamFree(Batch);
+	*pBatch = NULL;
+}
+
+
+int tga2gebmp_Batch_GetThreadCount(const tga2gebmp_Batch *Batch)
+{
+	return Batch->ThreadCount;
+}
+
+
+ThreadPool *tga2gebmp_Batch_GetPool(tga2gebmp_Batch *Batch)
+{
+	return Batch->Pool;
+}
+
+
+void tga2gebmp_Batch_SetConvCache(tga2gebmp_Batch *Batch, ConvCache *Cache)
+{
+	int i;
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+		tga2gebmp_Session_SetConvCache(Batch->Sessions[i], Cache);
+}
+
+
+int tga2gebmp_Batch_SetIoDepth(tga2gebmp_Batch *Batch, int Depth)
+{
+	int i;
+
+	if(!Batch->Queues)
+	{
+		Batch->Queues = (IoQueue**)tga2gebmp_RamAllocate(Batch->ThreadCount * sizeof(IoQueue*));
+		if(!Batch->Queues)
+			return 0;
+		memset(Batch->Queues, 0, Batch->ThreadCount * sizeof(IoQueue*));
+	}
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+	{
+		tga2gebmp_Session_SetIoQueue(Batch->Sessions[i], NULL);
+		IoQueue_Destroy(&Batch->Queues[i]);
+	}
+
+	if(Depth <= 0)
+		return 0;
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+	{
+		Batch->Queues[i] = IoQueue_Create(Depth, 0, IOQUEUE_BACKEND_AUTO);
+		if(!Batch->Queues[i])
+			return 0;
+		tga2gebmp_Session_SetIoQueue(Batch->Sessions[i], Batch->Queues[i]);
+	}
+
+	return IoQueue_GetBackend(Batch->Queues[0]);
+}
+
+
+void tga2gebmp_Batch_SetEncodeParams(tga2gebmp_Batch *Batch, const tga2gebmp_EncodeParams *Params)
+{
+	int i;
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+		tga2gebmp_Session_SetEncodeParams(Batch->Sessions[i], Params);
+}
+
+
+geBoolean tga2gebmp_Batch_Submit(tga2gebmp_Batch *Batch, tga2gebmp_BatchFunc Func, void *Context)
+{
+	tga2gebmp_BatchJob *Job;
+
+	Job = (tga2gebmp_BatchJob*)tga2gebmp_RamAllocate(sizeof(tga2gebmp_BatchJob));
+	if(!Job)
+		return GE_FALSE;
+
+	Job->Batch = Batch;
+	Job->Func = Func;
+	Job->Context = Context;
+
+	if(!ThreadPool_Submit(Batch->Pool, Batch->Group, tga2gebmp_Batch_RunJob, Job))
+	{
+		tga2gebmp_RamFree(Job);
+		return GE_FALSE;
+	}
+
+	return GE_TRUE;
+}
+
+
+int tga2gebmp_Batch_Wait(tga2gebmp_Batch *Batch)
+{
+	int Failures = 0;
+	int i;
+
+	ThreadPool_Wait(Batch->Pool, Batch->Group);
+
+	for(i = 0; i < Batch->ThreadCount; i++)
+	{
+		Failures += Batch->Failures[i];
+		Batch->Failures[i] = 0;
+	}
+
+	return Failures;
+}
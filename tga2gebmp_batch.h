@@ -0,0 +1,48 @@
+/**
+ * @file tga2gebmp_batch.h
+ *
+ * Runs per-actor jobs in parallel on a work-stealing pool (threadpool.h).
+ * Every worker thread owns one session, so jobs never share open actors or
+ * skin buffers, and all sessions share one I/O gate that bounds how many
+ * actors are being read or written at the same time.
+ */
+#ifndef TGA2GEBMP_BATCH_H
+#define TGA2GEBMP_BATCH_H
+
+#include "tga2gebmp_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TGA2GEBMP_BATCH_DEFAULT_IO	4
+
+typedef struct tga2gebmp_Batch tga2gebmp_Batch;
+
+/* runs on a worker with that worker's session, no actor is open on entry */
+typedef geBoolean (*tga2gebmp_BatchFunc)(tga2gebmp_Session *Session, void *Context);
+
+/* ThreadCount <= 0 uses one thread per processor, MaxIo <= 0 the default */
+tga2gebmp_Batch *tga2gebmp_Batch_Create(const char *WorkDir, int ThreadCount, int MaxIo);
+/* waits for every submitted job */
+void tga2gebmp_Batch_Destroy(tga2gebmp_Batch **pBatch);
+
+int tga2gebmp_Batch_GetThreadCount(const tga2gebmp_Batch *Batch);
+ThreadPool *tga2gebmp_Batch_GetPool(tga2gebmp_Batch *Batch);
+/* shares Cache between all sessions; call before submitting jobs */
+void tga2gebmp_Batch_SetConvCache(tga2gebmp_Batch *Batch, ConvCache *Cache);
+/* every session copies the unchanged entries of its saves through an
+   IoQueue of Depth buffers, 0 for none; call before submitting jobs.
+   Returns the IOQUEUE_BACKEND_ in use, 0 if there is none */
+int tga2gebmp_Batch_SetIoDepth(tga2gebmp_Batch *Batch, int Depth);
+void tga2gebmp_Batch_SetEncodeParams(tga2gebmp_Batch *Batch, const tga2gebmp_EncodeParams *Params);
+
+geBoolean tga2gebmp_Batch_Submit(tga2gebmp_Batch *Batch, tga2gebmp_BatchFunc Func, void *Context);
+/* waits for the jobs submitted so far and returns how many of them failed */
+int tga2gebmp_Batch_Wait(tga2gebmp_Batch *Batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
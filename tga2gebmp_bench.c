@@ -0,0 +1,424 @@
+/**
+ * @file tga2gebmp_bench.c
+ *
+ * Compares the original $temp$ extract/replace/save round-trip with the
+ * in-memory session: wall time and bytes written per replace+save.
+ *
+ *   tga2gebmp_bench [-n iterations] actor.act skin=image.tga [skin=image.tga ...]
+ *
+ * Every iteration starts from a fresh copy of the actor, the source file
+ * itself is never modified.
+ */
+#include <stdio.h>
+#include <sys/stat.h>
+#include "tga2gebmp_core.h"
+#include "ram.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <direct.h>
+	#define getcwd _getcwd
+#else
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+#define BENCH_LEGACY_ACT	"tga2gebmp_bench_legacy.act"
+#define BENCH_SESSION_ACT	"tga2gebmp_bench_session.act"
+#define BENCH_TEMP			"$temp$"
+#define BENCH_MAX_SKINS		64
+
+
+typedef struct	tga2gebmp_BenchResult
+{
+	double		Seconds;
+	double		BytesWritten;
+}	tga2gebmp_BenchResult;
+
+
+static double tga2gebmp_Bench_Now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER Frequency, Counter;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Counter);
+	return (double)Counter.QuadPart / (double)Frequency.QuadPart;
+#else
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (double)Now.tv_sec + (double)Now.tv_nsec * 1e-9;
+#endif
+}
+
+
+static double tga2gebmp_Bench_FileSize(const char *FileName)
+{
+	struct stat Stat;
+
+	if(stat(FileName, &Stat) != 0)
+		return 0.0;
+
+	return (double)Stat.st_size;
+}
+
+
+static geBoolean tga2gebmp_Bench_CopyActor(const char *src, const char *dest)
+{
+	char Buffer[65536];
+	FILE *In, *Out;
+	size_t Count;
+	geBoolean Result = GE_TRUE;
+
+	In = fopen(src, "rb");
+	if(!In)
+		return GE_FALSE;
+
+	Out = fopen(dest, "wb");
+	if(!Out)
+	{
+		fclose(In);
+		return GE_FALSE;
+	}
+
+	while((Count = fread(Buffer, 1, sizeof(Buffer), In)) > 0)
+	{
+		if(fwrite(Buffer, 1, Count, Out) != Count)
+		{
+			Result = GE_FALSE;
+			break;
+		}
+	}
+
+	fclose(Out);
+	fclose(In);
+	return Result;
+}
+
+
+/*
+ * The pre-session code path, kept here only as a baseline: extract Body to
+ * $temp$, extract every bitmap, write the replacements, rebuild Body.tmp,
+ * rename the actor to .old and copy everything into a new actor.
+ */
+static geBoolean tga2gebmp_Bench_Legacy(geVFile *FSystem, const char *WorkDir, const char *ActFileName,
+										int SkinCount, char **Skins, char **Images, double *pBytesWritten)
+{
+	char		working[_MAX_PATH];
+	char		filename[_MAX_PATH];
+	char		filename2[_MAX_PATH];
+	geVFile_Finder *Finder;
+	geVFile		*Directory;
+	geVFile		*VFS;
+	geVFile		*destVFS;
+	geVFile		*srcVFS;
+	geBoolean	Fits = GE_TRUE;
+	int			i;
+
+	*pBytesWritten = 0.0;
+
+	// every path below is checked, a cut one would time or delete another file
+
+	if((Directory = geVFile_Open(FSystem, BENCH_TEMP, GE_VFILE_OPEN_DIRECTORY | GE_VFILE_OPEN_CREATE)) != NULL)
+		geVFile_Close(Directory);
+	if((Directory = geVFile_Open(FSystem, BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps", GE_VFILE_OPEN_DIRECTORY | GE_VFILE_OPEN_CREATE)) != NULL)
+		geVFile_Close(Directory);
+
+	// open: extract Body, then every bitmap in it
+	VFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, ActFileName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!VFS)
+		return GE_FALSE;
+	tga2gebmp_ExtractFile(VFS, FSystem, "Body", BENCH_TEMP TGA2GEBMP_DIRSEP "Body.bdy");
+	geVFile_Close(VFS);
+
+	if((unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP BENCH_TEMP TGA2GEBMP_DIRSEP "Body.bdy", WorkDir) >= sizeof(working))
+		return GE_FALSE;
+	*pBytesWritten += tga2gebmp_Bench_FileSize(working);
+
+	VFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!VFS)
+		return GE_FALSE;
+
+	Finder = geVFile_CreateFinder(VFS, "Bitmaps\\*.*");
+	if(Finder)
+	{
+		while(Fits && geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+		{
+			geVFile_Properties	Properties;
+			geVFile_FinderGetProperties(Finder, &Properties);
+			Fits = (unsigned)snprintf(filename, sizeof(filename), "Bitmaps\\%s", Properties.Name) < sizeof(filename) &&
+				   (unsigned)snprintf(filename2, sizeof(filename2), BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "%s", Properties.Name) < sizeof(filename2) &&
+				   (unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP "%s", WorkDir, filename2) < sizeof(working);
+			if(Fits)
+			{
+				tga2gebmp_ExtractFile(VFS, FSystem, filename, filename2);
+				*pBytesWritten += tga2gebmp_Bench_FileSize(working);
+			}
+		}
+		geVFile_DestroyFinder(Finder);
+	}
+	geVFile_Close(VFS);
+	if(!Fits)
+		return GE_FALSE;
+
+	// replace
+	for(i = 0; i < SkinCount; i++)
+	{
+		geBitmap *bitmap;
+		geVFile *file;
+
+		if((unsigned)snprintf(filename, sizeof(filename), BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "%s", Skins[i]) >= sizeof(filename) ||
+		   (unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP "%s", WorkDir, filename) >= sizeof(working))
+			return GE_FALSE;
+
+		bitmap = geBitmap_CreateFromFileName(NULL, Images[i]);
+		if(!bitmap)
+			return GE_FALSE;
+
+		file = geVFile_Open(FSystem, filename, GE_VFILE_OPEN_CREATE);
+		if(file)
+		{
+			geBitmap_WriteToFile(bitmap, file);
+			geVFile_Close(file);
+		}
+		geBitmap_Destroy(&bitmap);
+
+		*pBytesWritten += tga2gebmp_Bench_FileSize(working);
+	}
+
+	// save: Body.tmp from the temp folder and the old body's geometry
+	if((unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP BENCH_TEMP TGA2GEBMP_DIRSEP "Body.tmp", WorkDir) >= sizeof(working))
+		return GE_FALSE;
+	destVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_CREATE | GE_VFILE_OPEN_DIRECTORY);
+	if((unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP BENCH_TEMP TGA2GEBMP_DIRSEP "Body.bdy", WorkDir) >= sizeof(working))
+	{
+		if(destVFS)
+			geVFile_Close(destVFS);
+		return GE_FALSE;
+	}
+	srcVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!destVFS || !srcVFS)
+		return GE_FALSE;
+
+	if((Directory = geVFile_Open(destVFS, "Bitmaps", GE_VFILE_OPEN_DIRECTORY|GE_VFILE_OPEN_CREATE)) != NULL)
+		geVFile_Close(Directory);
+
+	Finder = geVFile_CreateFinder(FSystem, BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "*.*");
+	if(Finder)
+	{
+		while(Fits && geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+		{
+			geVFile_Properties	Properties;
+			geVFile_FinderGetProperties(Finder, &Properties);
+			Fits = (unsigned)snprintf(filename, sizeof(filename), BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "%s", Properties.Name) < sizeof(filename) &&
+				   (unsigned)snprintf(filename2, sizeof(filename2), "Bitmaps\\%s", Properties.Name) < sizeof(filename2);
+			if(Fits)
+				tga2gebmp_CopyFile(FSystem, destVFS, filename, filename2);
+		}
+		geVFile_DestroyFinder(Finder);
+	}
+	tga2gebmp_CopyFile(srcVFS, destVFS, "Geometry", "Geometry");
+	geVFile_Close(destVFS);
+	geVFile_Close(srcVFS);
+	if(!Fits)
+		return GE_FALSE;
+
+	if((unsigned)snprintf(working, sizeof(working), "%s" TGA2GEBMP_DIRSEP BENCH_TEMP TGA2GEBMP_DIRSEP "Body.tmp", WorkDir) >= sizeof(working))
+		return GE_FALSE;
+	*pBytesWritten += tga2gebmp_Bench_FileSize(working);
+
+	if((unsigned)snprintf(working, sizeof(working), "%s.old", ActFileName) >= sizeof(working))
+		return GE_FALSE;
+	remove(working);
+	if(rename(ActFileName, working) != 0)
+		return GE_FALSE;
+
+	srcVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, working, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	destVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, ActFileName, NULL, GE_VFILE_OPEN_CREATE | GE_VFILE_OPEN_DIRECTORY);
+	if(!srcVFS || !destVFS)
+		return GE_FALSE;
+
+	if((Directory = geVFile_Open(destVFS, "Motions", GE_VFILE_OPEN_DIRECTORY|GE_VFILE_OPEN_CREATE)) != NULL)
+		geVFile_Close(Directory);
+
+	Finder = geVFile_CreateFinder(srcVFS, "Motions\\*.*");
+	if(Finder)
+	{
+		while(Fits && geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+		{
+			geVFile_Properties	Properties;
+			geVFile_FinderGetProperties(Finder, &Properties);
+			Fits = (unsigned)snprintf(filename, sizeof(filename), "Motions\\%s", Properties.Name) < sizeof(filename);
+			if(Fits)
+				tga2gebmp_CopyFile(srcVFS, destVFS, filename, filename);
+		}
+		geVFile_DestroyFinder(Finder);
+	}
+	tga2gebmp_CopyFile(srcVFS, destVFS, "Header", "Header");
+	tga2gebmp_CopyFile(FSystem, destVFS, BENCH_TEMP TGA2GEBMP_DIRSEP "Body.tmp", "Body");
+	geVFile_Close(srcVFS);
+	geVFile_Close(destVFS);
+	if(!Fits)
+		return GE_FALSE;
+
+	*pBytesWritten += tga2gebmp_Bench_FileSize(ActFileName);
+
+	// clean up the scratch files
+	remove(working);
+	Finder = geVFile_CreateFinder(FSystem, BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "*.*");
+	if(Finder)
+	{
+		while(geVFile_FinderGetNextFile(Finder) != GE_FALSE)
+		{
+			geVFile_Properties	Properties;
+			geVFile_FinderGetProperties(Finder, &Properties);
+			if((unsigned)snprintf(filename, sizeof(filename), BENCH_TEMP TGA2GEBMP_DIRSEP "Bitmaps" TGA2GEBMP_DIRSEP "%s", Properties.Name) < sizeof(filename))
+				geVFile_DeleteFile(FSystem, filename);
+		}
+		geVFile_DestroyFinder(Finder);
+	}
+	geVFile_DeleteFile(FSystem, BENCH_TEMP TGA2GEBMP_DIRSEP "Body.bdy");
+	geVFile_DeleteFile(FSystem, BENCH_TEMP TGA2GEBMP_DIRSEP "Body.tmp");
+
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Bench_Session(tga2gebmp_Session *Session, const char *ActFileName,
+										 int SkinCount, char **Skins, char **Images, double *pBytesWritten)
+{
+	tga2gebmp_SaveStats Stats;
+	int i;
+
+	*pBytesWritten = 0.0;
+
+	if(!tga2gebmp_Session_OpenAct(Session, ActFileName))
+		return GE_FALSE;
+
+	for(i = 0; i < SkinCount; i++)
+	{
+		if(!tga2gebmp_Session_ReplaceSkin(Session, Skins[i], Images[i]))
+		{
+			tga2gebmp_Session_CloseAct(Session);
+			return GE_FALSE;
+		}
+	}
+
+	if(!tga2gebmp_Session_Save(Session))
+	{
+		tga2gebmp_Session_CloseAct(Session);
+		return GE_FALSE;
+	}
+
+	tga2gebmp_Session_GetSaveStats(Session, &Stats);
+	tga2gebmp_Session_CloseAct(Session);
+
+	// the session writes nothing but the new actor, and not even that if no skin changed
+	*pBytesWritten = (double)Stats.BytesWritten;
+	return GE_TRUE;
+}
+
+
+static void tga2gebmp_Bench_Report(const char *Name, const tga2gebmp_BenchResult *Result, int Iterations)
+{
+	printf("%-8s %12.3f %16.0f\n", Name,
+		Result->Seconds * 1000.0 / Iterations,
+		Result->BytesWritten / Iterations);
+}
+
+
+int main(int argc, char **argv)
+{
+	char		WorkDir[_MAX_PATH];
+	char		*Skins[BENCH_MAX_SKINS];
+	char		*Images[BENCH_MAX_SKINS];
+	const char	*ActFileName = NULL;
+	int			SkinCount = 0;
+	int			Iterations = 5;
+	tga2gebmp_BenchResult Legacy, InMemory;
+	tga2gebmp_Session *Session;
+	geVFile		*FSystem;
+	int			i;
+
+	for(i = 1; i < argc; i++)
+	{
+		char *Equals;
+
+		if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+		{
+			Iterations = atoi(argv[++i]);
+		}
+		else if((Equals = strchr(argv[i], '=')) != NULL)
+		{
+			if(SkinCount == BENCH_MAX_SKINS)
+				continue;
+			*Equals = '\0';
+			Skins[SkinCount] = argv[i];
+			Images[SkinCount] = Equals + 1;
+			SkinCount++;
+		}
+		else
+		{
+			ActFileName = argv[i];
+		}
+	}
+
+	if(!ActFileName || SkinCount == 0 || Iterations <= 0)
+	{
+		fprintf(stderr, "usage: tga2gebmp_bench [-n iterations] actor.act skin=image.tga [skin=image.tga ...]\n");
+		return 2;
+	}
+
+	if(!getcwd(WorkDir, sizeof(WorkDir)))
+		return 1;
+
+	Session = tga2gebmp_Session_Create(WorkDir);
+	if(!Session)
+		return 1;
+	FSystem = tga2gebmp_Session_GetFileSystem(Session);
+
+	memset(&Legacy, 0, sizeof(Legacy));
+	memset(&InMemory, 0, sizeof(InMemory));
+
+	for(i = 0; i < Iterations; i++)
+	{
+		double Start, Bytes;
+
+		if(!tga2gebmp_Bench_CopyActor(ActFileName, BENCH_LEGACY_ACT) ||
+		   !tga2gebmp_Bench_CopyActor(ActFileName, BENCH_SESSION_ACT))
+		{
+			fprintf(stderr, "tga2gebmp_bench: cannot copy '%s'\n", ActFileName);
+			break;
+		}
+
+		Start = tga2gebmp_Bench_Now();
+		if(!tga2gebmp_Bench_Legacy(FSystem, WorkDir, BENCH_LEGACY_ACT, SkinCount, Skins, Images, &Bytes))
+		{
+			fprintf(stderr, "tga2gebmp_bench: legacy path failed\n");
+			break;
+		}
+		Legacy.Seconds += tga2gebmp_Bench_Now() - Start;
+		Legacy.BytesWritten += Bytes;
+
+		Start = tga2gebmp_Bench_Now();
+		if(!tga2gebmp_Bench_Session(Session, BENCH_SESSION_ACT, SkinCount, Skins, Images, &Bytes))
+		{
+			fprintf(stderr, "tga2gebmp_bench: session path failed\n");
+			break;
+		}
+		InMemory.Seconds += tga2gebmp_Bench_Now() - Start;
+		InMemory.BytesWritten += Bytes;
+	}
+
+	remove(BENCH_LEGACY_ACT);
+	remove(BENCH_SESSION_ACT);
+	tga2gebmp_Session_Destroy(&Session);
+
+	if(i < Iterations)
+		return 1;
+
+	printf("%-8s %12s %16s\n", "path", "ms/save", "bytes written");
+	tga2gebmp_Bench_Report("legacy", &Legacy, Iterations);
+	tga2gebmp_Bench_Report("session", &InMemory, Iterations);
+
+	return 0;
+}
@@ -0,0 +1,726 @@
+/**
+ * @file tga2gebmp_benchsuite.c
+ *
+ * Times every stage of a skin replacement on a synthetic actor and prints
+ * the results as JSON, so runs can be compared from one version to the next.
+ *
+ *   tga2gebmp_benchsuite [-n iterations] [-skins count] [-skinsize pixels]
+ *                        [-motions count] [-motionsize KB] [-copybuffer KB]
+ *                        [-copydepth buffers] [-w dir] [-o file]
+ *
+ * The actor is generated in the work directory: a Header, a Body holding the
+ * skins (square 32-bit images with gradients and noise) and some geometry,
+ * and a Motions directory of random bytes. Stages:
+ *
+ *   tga_decode     tgaread.c on an uncompressed 32-bit TGA
+ *   bitmap_encode  geBitmap from decoded pixels, written to a memory file
+ *   open           tga2gebmp_Session_OpenAct and CloseAct
+ *   extract        tga2gebmp_ExtractFile of every skin to the work directory
+ *   copy           tga2gebmp_CopyFile of every motion into a new actor
+ *   preview        the dialog's preview pixel path: lock as 32-bit XRGB and
+ *                  downsample to at most 1024 pixels on a side
+ *   save           replace every skin from memory and tga2gebmp_Session_Save
+ *
+ * Each stage reports operations and bytes per second; bytes are what the
+ * stage reads (the TGA, the skins, the motions, the source pixels) or, for
+ * open and save, the size of the actor. -copybuffer and -copydepth set the
+ * ring extract and copy go through (tga2gebmp_SetCopyParams); motions no
+ * larger than one buffer are copied without the reader thread.
+ */
+#include <stdio.h>
+#include <sys/stat.h>
+#include "tga2gebmp_core.h"
+#include "actwriter.h"
+#include "copypipe.h"
+#include "downsample.h"
+#include "tgaread.h"
+#include "ram.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <direct.h>
+	#define getcwd _getcwd
+#else
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+#define BENCHSUITE_ACT			"tga2gebmp_benchsuite.act"
+#define BENCHSUITE_COPY_ACT		"tga2gebmp_benchsuite_copy.act"
+#define BENCHSUITE_EXTRACTED	"tga2gebmp_benchsuite_skin.bmp"
+#define BENCHSUITE_PREVIEW_MAX	1024	// as the dialog
+#define BENCHSUITE_GEOMETRY		(256 * 1024)
+#define BENCHSUITE_MAX_STAGES	8
+
+
+typedef struct	tga2gebmp_BenchStage
+{
+	const char	*Name;
+	int			Ops;
+	double		Seconds;
+	double		Bytes;
+}	tga2gebmp_BenchStage;
+
+typedef struct	tga2gebmp_BenchConfig
+{
+	int			Iterations;
+	int			SkinCount;
+	int			SkinSize;
+	int			MotionCount;
+	int			MotionSize;		// bytes
+	int			CopyBuffer;		// bytes, 0 for the default
+	int			CopyDepth;		// 0 for the default
+	char		WorkDir[_MAX_PATH];
+	char		ActFileName[_MAX_PATH];
+	char		CopyFileName[_MAX_PATH];
+}	tga2gebmp_BenchConfig;
+
+typedef struct	tga2gebmp_BenchSuite
+{
+	tga2gebmp_BenchConfig	Config;
+	tga2gebmp_BenchStage	Stages[BENCHSUITE_MAX_STAGES];
+	int						StageCount;
+	tga2gebmp_Session		*Session;
+
+	// two versions of the skin, so every save has something to change
+	void					*Tga[2];
+	long					TgaSize;
+	void					*Pixels;
+	void					*Skin[2];
+	long					SkinBytes[2];
+}	tga2gebmp_BenchSuite;
+
+
+static double tga2gebmp_Bench_Now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER Frequency, Counter;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Counter);
+	return (double)Counter.QuadPart / (double)Frequency.QuadPart;
+#else
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (double)Now.tv_sec + (double)Now.tv_nsec * 1e-9;
+#endif
+}
+
+
+static double tga2gebmp_Bench_FileSize(const char *FileName)
+{
+	struct stat Stat;
+
+	if(stat(FileName, &Stat) != 0)
+		return 0.0;
+
+	return (double)Stat.st_size;
+}
+
+
+static uint32_t tga2gebmp_Bench_Random(uint32_t *State)
+{
+	*State = *State * 1664525u + 1013904223u;
+	return *State >> 8;
+}
+
+
+static tga2gebmp_BenchStage *tga2gebmp_Bench_AddStage(tga2gebmp_BenchSuite *Suite, const char *Name)
+{
+	tga2gebmp_BenchStage *Stage = &Suite->Stages[Suite->StageCount++];
+
+	Stage->Name = Name;
+	Stage->Ops = 0;
+	Stage->Seconds = 0.0;
+	Stage->Bytes = 0.0;
+	return Stage;
+}
+
+
+// an uncompressed, top-down 32-bit TGA: gradients with some noise on top
+static void *tga2gebmp_Bench_MakeTga(int Size, uint32_t Seed, long *pSize)
+{
+	uint8_t *Tga, *p;
+	int x, y;
+
+	*pSize = 18 + Size * Size * 4;
+	Tga = (uint8_t*)geRam_Allocate(*pSize);
+	if(!Tga)
+		return NULL;
+
+	memset(Tga, 0, 18);
+	Tga[2] = 2;
+	Tga[12] = (uint8_t)(Size & 0xff);
+	Tga[13] = (uint8_t)(Size >> 8);
+	Tga[14] = (uint8_t)(Size & 0xff);
+	Tga[15] = (uint8_t)(Size >> 8);
+	Tga[16] = 32;
+	Tga[17] = 0x28;		// 8 alpha bits, top row first
+
+	p = Tga + 18;
+	for(y = 0; y < Size; y++)
+	{
+		for(x = 0; x < Size; x++, p += 4)
+		{
+			uint32_t Noise = tga2gebmp_Bench_Random(&Seed) & 15;
+
+			p[0] = (uint8_t)(x * 255 / Size + Noise);
+			p[1] = (uint8_t)(y * 255 / Size + Noise);
+			p[2] = (uint8_t)((x + y) * 127 / Size + (Seed & 63));
+			p[3] = 255;
+		}
+	}
+
+	return Tga;
+}
+
+
+// the bytes geBitmap_WriteToFile produces for Bitmap
+static geBoolean tga2gebmp_Bench_Encode(const geBitmap *Bitmap, void **pData, long *pSize)
+{
+	geVFile_MemoryContext Context;
+	geVFile *MemFile;
+	geBoolean Result = GE_FALSE;
+
+	Context.Data = NULL;
+	Context.DataLength = 0;
+
+	MemFile = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_MEMORY, NULL, &Context, GE_VFILE_OPEN_CREATE);
+	if(!MemFile)
+		return GE_FALSE;
+
+	if(geBitmap_WriteToFile(Bitmap, MemFile) && geVFile_UpdateContext(MemFile, &Context, sizeof(Context)))
+	{
+		*pData = geRam_Allocate(Context.DataLength > 0 ? Context.DataLength : 1);
+		if(*pData)
+		{
+			memcpy(*pData, Context.Data, Context.DataLength);
+			*pSize = Context.DataLength;
+			Result = GE_TRUE;
+		}
+	}
+
+	geVFile_Close(MemFile);
+	return Result;
+}
+
+
+// a 32-bit geBitmap holding Pixels, Size x Size with no padding
+static geBitmap *tga2gebmp_Bench_CreateBitmap(const void *Pixels, int Size)
+{
+	geBitmap		*Bitmap, *Lock;
+	geBitmap_Info	Info;
+	uint8_t			*Bits;
+	int				y;
+
+	Bitmap = geBitmap_Create(Size, Size, 1, GE_PIXELFORMAT_32BIT_ARGB);
+	if(!Bitmap)
+		return NULL;
+
+	if(!geBitmap_LockForWriteFormat(Bitmap, &Lock, 0, 0, GE_PIXELFORMAT_32BIT_ARGB))
+	{
+		geBitmap_Destroy(&Bitmap);
+		return NULL;
+	}
+
+	Bits = (uint8_t*)geBitmap_GetBits(Lock);
+	geBitmap_GetInfo(Lock, &Info, NULL);
+	for(y = 0; Bits && y < Size; y++)
+		memcpy(Bits + (size_t)y * Info.Stride * 4, (const uint8_t*)Pixels + (size_t)y * Size * 4, (size_t)Size * 4);
+
+	geBitmap_UnLock(Lock);
+
+	if(!Bits)
+		geBitmap_Destroy(&Bitmap);
+	return Bitmap;
+}
+
+
+static geBoolean tga2gebmp_Bench_TgaDecode(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "tga_decode");
+	TgaRead_Info Info;
+	double Start;
+	int i;
+
+	for(i = 0; i < Suite->Config.Iterations; i++)
+	{
+		Start = tga2gebmp_Bench_Now();
+		if(!TgaRead_GetInfo(Suite->Tga[0], (size_t)Suite->TgaSize, &Info) ||
+		   !TgaRead_Decode(Suite->Tga[0], (size_t)Suite->TgaSize, &Info, Suite->Pixels, (ptrdiff_t)Info.Width * Info.BytesPerPixel))
+			return GE_FALSE;
+		Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+		Stage->Ops++;
+		Stage->Bytes += Suite->TgaSize;
+	}
+
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Bench_BitmapEncode(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "bitmap_encode");
+	TgaRead_Info Info;
+	geBitmap *Bitmap;
+	double Start;
+	void *Data;
+	long Size;
+	int i, v;
+
+	// the second version of the skin is made outside the timing
+	for(v = 1; v >= 0; v--)
+	{
+		if(!TgaRead_GetInfo(Suite->Tga[v], (size_t)Suite->TgaSize, &Info) ||
+		   !TgaRead_Decode(Suite->Tga[v], (size_t)Suite->TgaSize, &Info, Suite->Pixels, (ptrdiff_t)Info.Width * 4))
+			return GE_FALSE;
+
+		for(i = 0; i < (v ? 1 : Suite->Config.Iterations); i++)
+		{
+			Start = tga2gebmp_Bench_Now();
+			Bitmap = tga2gebmp_Bench_CreateBitmap(Suite->Pixels, Suite->Config.SkinSize);
+			if(!Bitmap || !tga2gebmp_Bench_Encode(Bitmap, &Data, &Size))
+			{
+				if(Bitmap)
+					geBitmap_Destroy(&Bitmap);
+				return GE_FALSE;
+			}
+			geBitmap_Destroy(&Bitmap);
+
+			if(!v)
+			{
+				Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+				Stage->Ops++;
+				Stage->Bytes += (double)Suite->Config.SkinSize * Suite->Config.SkinSize * 4;
+			}
+
+			if(Suite->Skin[v])
+				geRam_Free(Suite->Skin[v]);
+			Suite->Skin[v] = Data;
+			Suite->SkinBytes[v] = Size;
+		}
+	}
+
+	return GE_TRUE;
+}
+
+
+// Header, Body with Bitmaps and Geometry, Motions
+static geBoolean tga2gebmp_Bench_WriteActor(tga2gebmp_BenchSuite *Suite)
+{
+	ActWriter	*Writer;
+	uint8_t		*Random;
+	uint32_t	Seed = 12345;
+	char		Name[64];
+	size_t		RandomSize = TGA2GEBMP_MAX((size_t)Suite->Config.MotionSize, BENCHSUITE_GEOMETRY);
+	size_t		i;
+	int			Ok;
+	int			n;
+
+	Random = (uint8_t*)geRam_Allocate(RandomSize);
+	if(!Random)
+		return GE_FALSE;
+	for(i = 0; i < RandomSize; i++)
+		Random[i] = (uint8_t)tga2gebmp_Bench_Random(&Seed);
+
+	Writer = ActWriter_Create(Suite->Config.ActFileName);
+	Ok = Writer != NULL;
+
+	Ok = Ok && ActWriter_AddData(Writer, "Header", Random, 64, NULL);
+
+	Ok = Ok && ActWriter_BeginContainer(Writer, "Body", NULL);
+	Ok = Ok && ActWriter_BeginDirectory(Writer, "Bitmaps", NULL);
+	for(n = 0; Ok && n < Suite->Config.SkinCount; n++)
+	{
+		sprintf(Name, "skin%03d.bmp", n);
+		Ok = ActWriter_AddData(Writer, Name, Suite->Skin[0], (uint32_t)Suite->SkinBytes[0], NULL);
+	}
+	Ok = Ok && ActWriter_EndDirectory(Writer);
+	Ok = Ok && ActWriter_AddData(Writer, "Geometry", Random, BENCHSUITE_GEOMETRY, NULL);
+	Ok = Ok && ActWriter_EndContainer(Writer);
+
+	Ok = Ok && ActWriter_BeginDirectory(Writer, "Motions", NULL);
+	for(n = 0; Ok && n < Suite->Config.MotionCount; n++)
+	{
+		sprintf(Name, "motion%03d.mot", n);
+		Ok = ActWriter_AddData(Writer, Name, Random, (uint32_t)Suite->Config.MotionSize, NULL);
+	}
+	Ok = Ok && ActWriter_EndDirectory(Writer);
+
+	if(Ok)
+		Ok = ActWriter_Commit(&Writer, NULL);
+	else if(Writer)
+		ActWriter_Abort(&Writer);
+
+	geRam_Free(Random);
+	return Ok ? GE_TRUE : GE_FALSE;
+}
+
+
+static geBoolean tga2gebmp_Bench_Open(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "open");
+	double Size = tga2gebmp_Bench_FileSize(Suite->Config.ActFileName);
+	double Start;
+	int i;
+
+	for(i = 0; i < Suite->Config.Iterations; i++)
+	{
+		Start = tga2gebmp_Bench_Now();
+		if(!tga2gebmp_Session_OpenAct(Suite->Session, Suite->Config.ActFileName))
+			return GE_FALSE;
+		tga2gebmp_Session_CloseAct(Suite->Session);
+		Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+		Stage->Ops++;
+		Stage->Bytes += Size;
+	}
+
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Bench_Extract(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "extract");
+	geVFile *FSystem = tga2gebmp_Session_GetFileSystem(Suite->Session);
+	geVFile *ActVFS, *BodyVFS;
+	char Name[64];
+	double Start;
+	int i, n;
+
+	ActVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, Suite->Config.ActFileName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!ActVFS)
+		return GE_FALSE;
+
+	BodyVFS = geVFile_OpenNewSystem(ActVFS, GE_VFILE_TYPE_VIRTUAL, "Body", NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!BodyVFS)
+	{
+		geVFile_Close(ActVFS);
+		return GE_FALSE;
+	}
+
+	for(i = 0; i < Suite->Config.Iterations; i++)
+	{
+		for(n = 0; n < Suite->Config.SkinCount; n++)
+		{
+			sprintf(Name, "Bitmaps\\skin%03d.bmp", n);
+
+			Start = tga2gebmp_Bench_Now();
+			if(!tga2gebmp_ExtractFile(BodyVFS, FSystem, Name, BENCHSUITE_EXTRACTED))
+			{
+				geVFile_Close(BodyVFS);
+				geVFile_Close(ActVFS);
+				return GE_FALSE;
+			}
+			Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+			Stage->Ops++;
+			Stage->Bytes += Suite->SkinBytes[0];
+		}
+	}
+
+	geVFile_Close(BodyVFS);
+	geVFile_Close(ActVFS);
+	geVFile_DeleteFile(FSystem, BENCHSUITE_EXTRACTED);
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Bench_Copy(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "copy");
+	geVFile *SrcVFS, *DestVFS, *Directory;
+	char Name[64];
+	double Start;
+	int i, n;
+
+	SrcVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, Suite->Config.ActFileName, NULL, GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+	if(!SrcVFS)
+		return GE_FALSE;
+
+	for(i = 0; i < Suite->Config.Iterations; i++)
+	{
+		DestVFS = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_VIRTUAL, Suite->Config.CopyFileName, NULL, GE_VFILE_OPEN_CREATE | GE_VFILE_OPEN_DIRECTORY);
+		if(!DestVFS)
+		{
+			geVFile_Close(SrcVFS);
+			return GE_FALSE;
+		}
+
+		if((Directory = geVFile_Open(DestVFS, "Motions", GE_VFILE_OPEN_DIRECTORY | GE_VFILE_OPEN_CREATE)) != NULL)
+			geVFile_Close(Directory);
+
+		for(n = 0; n < Suite->Config.MotionCount; n++)
+		{
+			sprintf(Name, "Motions\\motion%03d.mot", n);
+
+			Start = tga2gebmp_Bench_Now();
+			if(!tga2gebmp_CopyFile(SrcVFS, DestVFS, Name, Name))
+			{
+				geVFile_Close(DestVFS);
+				geVFile_Close(SrcVFS);
+				return GE_FALSE;
+			}
+			Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+			Stage->Ops++;
+			Stage->Bytes += Suite->Config.MotionSize;
+		}
+
+		geVFile_Close(DestVFS);
+		remove(Suite->Config.CopyFileName);
+	}
+
+	geVFile_Close(SrcVFS);
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Bench_Preview(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "preview");
+	geBitmap *Bitmap, *Lock;
+	geBitmap_Info Info;
+	geBoolean Result = GE_TRUE;
+	void *Preview = NULL;
+	double Start;
+	int Width, Height;
+	int i;
+
+	Bitmap = tga2gebmp_CreateBitmapFromData(Suite->Skin[0], Suite->SkinBytes[0]);
+	if(!Bitmap)
+		return GE_FALSE;
+
+	for(i = 0; Result && i < Suite->Config.Iterations; i++)
+	{
+		Start = tga2gebmp_Bench_Now();
+
+		if(!geBitmap_LockForRead(Bitmap, &Lock, 0, 0, GE_PIXELFORMAT_32BIT_XRGB, GE_FALSE, 0))
+		{
+			Result = GE_FALSE;
+			break;
+		}
+
+		geBitmap_GetInfo(Lock, &Info, NULL);
+		Downsample_FitSize(Info.Width, Info.Height, BENCHSUITE_PREVIEW_MAX, BENCHSUITE_PREVIEW_MAX, &Width, &Height);
+
+		Preview = malloc((size_t)Downsample_GetDibStride(Width, 32) * Height);
+		Result = Preview && Downsample_Resize32(geBitmap_GetBits(Lock), Info.Width, Info.Height, Info.Stride * 4,
+											   Preview, Width, Height, Downsample_GetDibStride(Width, 32));
+		free(Preview);
+		geBitmap_UnLock(Lock);
+
+		Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+		Stage->Ops++;
+		Stage->Bytes += (double)Info.Width * Info.Height * 4;
+	}
+
+	geBitmap_Destroy(&Bitmap);
+	return Result;
+}
+
+
+static geBoolean tga2gebmp_Bench_Save(tga2gebmp_BenchSuite *Suite)
+{
+	tga2gebmp_BenchStage *Stage = tga2gebmp_Bench_AddStage(Suite, "save");
+	tga2gebmp_SaveStats Stats;
+	char Name[64];
+	double Start;
+	int i, n;
+
+	// every iteration swaps all skins to the other version
+	for(i = 0; i < Suite->Config.Iterations; i++)
+	{
+		int v = (i & 1) ? 0 : 1;
+
+		Start = tga2gebmp_Bench_Now();
+		if(!tga2gebmp_Session_OpenAct(Suite->Session, Suite->Config.ActFileName))
+			return GE_FALSE;
+
+		for(n = 0; n < Suite->Config.SkinCount; n++)
+		{
+			sprintf(Name, "skin%03d.bmp", n);
+			if(!tga2gebmp_Session_ReplaceSkinData(Suite->Session, Name, Suite->Skin[v], Suite->SkinBytes[v]))
+			{
+				tga2gebmp_Session_CloseAct(Suite->Session);
+				return GE_FALSE;
+			}
+		}
+
+		if(!tga2gebmp_Session_Save(Suite->Session))
+		{
+			tga2gebmp_Session_CloseAct(Suite->Session);
+			return GE_FALSE;
+		}
+
+		tga2gebmp_Session_GetSaveStats(Suite->Session, &Stats);
+		tga2gebmp_Session_CloseAct(Suite->Session);
+
+		Stage->Seconds += tga2gebmp_Bench_Now() - Start;
+		Stage->Ops++;
+		Stage->Bytes += (double)Stats.BytesWritten;
+	}
+
+	return GE_TRUE;
+}
+
+
+static void tga2gebmp_Bench_WriteJson(const tga2gebmp_BenchSuite *Suite, FILE *Out)
+{
+	const tga2gebmp_BenchConfig *Config = &Suite->Config;
+	int i;
+
+	fprintf(Out, "{\n");
+	fprintf(Out, "\t\"benchmark\": \"tga2gebmp_benchsuite\",\n");
+	fprintf(Out, "\t\"simd\": \"%s\",\n", TgaRead_GetSimdName(TgaRead_GetSimdLevel()));
+	fprintf(Out, "\t\"config\": {\"iterations\": %d, \"skins\": %d, \"skin_size\": %d, \"skin_bytes\": %ld, "
+				 "\"motions\": %d, \"motion_bytes\": %d, \"copy_buffer\": %d, \"copy_depth\": %d, "
+				 "\"actor_bytes\": %.0f},\n",
+			Config->Iterations, Config->SkinCount, Config->SkinSize, Suite->SkinBytes[0],
+			Config->MotionCount, Config->MotionSize,
+			Config->CopyBuffer ? Config->CopyBuffer : COPYPIPE_DEFAULT_BUFFER,
+			Config->CopyDepth ? Config->CopyDepth : COPYPIPE_DEFAULT_DEPTH,
+			tga2gebmp_Bench_FileSize(Config->ActFileName));
+	fprintf(Out, "\t\"stages\": [\n");
+
+	for(i = 0; i < Suite->StageCount; i++)
+	{
+		const tga2gebmp_BenchStage *Stage = &Suite->Stages[i];
+		double Seconds = Stage->Seconds > 0.0 ? Stage->Seconds : 1e-9;
+
+		fprintf(Out, "\t\t{\"name\": \"%s\", \"ops\": %d, \"seconds\": %.6f, \"bytes\": %.0f, "
+					 "\"ms_per_op\": %.3f, \"ops_per_s\": %.1f, \"mb_per_s\": %.1f}%s\n",
+				Stage->Name, Stage->Ops, Stage->Seconds, Stage->Bytes,
+				Stage->Ops ? Stage->Seconds * 1000.0 / Stage->Ops : 0.0,
+				Stage->Ops / Seconds, Stage->Bytes / Seconds / (1024.0 * 1024.0),
+				i + 1 < Suite->StageCount ? "," : "");
+	}
+
+	fprintf(Out, "\t]\n");
+	fprintf(Out, "}\n");
+}
+
+
+static void tga2gebmp_Bench_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_benchsuite [-n iterations] [-skins count] [-skinsize pixels]\n"
+		"                            [-motions count] [-motionsize KB] [-copybuffer KB]\n"
+		"                            [-copydepth buffers] [-w dir] [-o file]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	tga2gebmp_BenchSuite	Suite;
+	tga2gebmp_BenchConfig	*Config = &Suite.Config;
+	const char				*OutFileName = NULL;
+	geBoolean				Ok;
+	FILE					*Out = stdout;
+	int						i;
+
+	memset(&Suite, 0, sizeof(Suite));
+	Config->Iterations = 5;
+	Config->SkinCount = 8;
+	Config->SkinSize = 512;
+	Config->MotionCount = 16;
+	Config->MotionSize = 64 * 1024;
+
+	if(!getcwd(Config->WorkDir, sizeof(Config->WorkDir)))
+		return 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			Config->Iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-skins") == 0 && i + 1 < argc)
+			Config->SkinCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-skinsize") == 0 && i + 1 < argc)
+			Config->SkinSize = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-motions") == 0 && i + 1 < argc)
+			Config->MotionCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-motionsize") == 0 && i + 1 < argc)
+			Config->MotionSize = atoi(argv[++i]) * 1024;
+		else if(strcmp(argv[i], "-copybuffer") == 0 && i + 1 < argc)
+			Config->CopyBuffer = atoi(argv[++i]) * 1024;
+		else if(strcmp(argv[i], "-copydepth") == 0 && i + 1 < argc)
+			Config->CopyDepth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			strncpy(Config->WorkDir, argv[++i], sizeof(Config->WorkDir) - 1);
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			OutFileName = argv[++i];
+		else
+		{
+			tga2gebmp_Bench_Usage();
+			return 2;
+		}
+	}
+
+	if(Config->Iterations <= 0 || Config->SkinCount <= 0 || Config->SkinSize <= 0 || Config->SkinSize > 4096 ||
+	   Config->MotionCount < 0 || Config->MotionSize <= 0 || Config->CopyBuffer < 0 ||
+	   Config->CopyBuffer > (1 << 30) || Config->CopyDepth < 0 || strlen(Config->WorkDir) + 32 > sizeof(Config->WorkDir))
+	{
+		tga2gebmp_Bench_Usage();
+		return 2;
+	}
+
+	sprintf(Config->ActFileName, "%s" TGA2GEBMP_DIRSEP BENCHSUITE_ACT, Config->WorkDir);
+	sprintf(Config->CopyFileName, "%s" TGA2GEBMP_DIRSEP BENCHSUITE_COPY_ACT, Config->WorkDir);
+	tga2gebmp_SetCopyParams(Config->CopyBuffer, Config->CopyDepth);
+
+	Suite.Session = tga2gebmp_Session_Create(Config->WorkDir);
+	Suite.Tga[0] = tga2gebmp_Bench_MakeTga(Config->SkinSize, 1, &Suite.TgaSize);
+	Suite.Tga[1] = tga2gebmp_Bench_MakeTga(Config->SkinSize, 2, &Suite.TgaSize);
+	Suite.Pixels = geRam_Allocate((size_t)Config->SkinSize * Config->SkinSize * 4);
+
+	Ok = Suite.Session && Suite.Tga[0] && Suite.Tga[1] && Suite.Pixels;
+	if(!Ok)
+		fprintf(stderr, "tga2gebmp_benchsuite: out of memory\n");
+
+	// the encoded skins go into the actor, so encoding comes before the rest
+	if(Ok && !(Ok = tga2gebmp_Bench_TgaDecode(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: tga_decode failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_BitmapEncode(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: bitmap_encode failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_WriteActor(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: cannot write '%s'\n", Config->ActFileName);
+	if(Ok && !(Ok = tga2gebmp_Bench_Open(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: open failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_Extract(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: extract failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_Copy(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: copy failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_Preview(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: preview failed\n");
+	if(Ok && !(Ok = tga2gebmp_Bench_Save(&Suite)))
+		fprintf(stderr, "tga2gebmp_benchsuite: save failed\n");
+
+	if(Ok && OutFileName)
+	{
+		Out = fopen(OutFileName, "w");
+		if(!Out)
+		{
+			fprintf(stderr, "tga2gebmp_benchsuite: cannot write '%s'\n", OutFileName);
+			Ok = GE_FALSE;
+		}
+	}
+
+	if(Ok)
+	{
+		tga2gebmp_Bench_WriteJson(&Suite, Out);
+		if(Out != stdout)
+			fclose(Out);
+	}
+
+	remove(Config->ActFileName);
+	for(i = 0; i < 2; i++)
+	{
+		if(Suite.Tga[i])
+			geRam_Free(Suite.Tga[i]);
+		if(Suite.Skin[i])
+			geRam_Free(Suite.Skin[i]);
+	}
+	if(Suite.Pixels)
+		geRam_Free(Suite.Pixels);
+	if(Suite.Session)
+		tga2gebmp_Session_Destroy(&Suite.Session);
+
+	return Ok ? 0 : 1;
+}
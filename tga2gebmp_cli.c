@@ -0,0 +1,1069 @@
+/**
+ * @file tga2gebmp_cli.c
+ *
+ * Command-line driver for batch skin replacement.
+ *
+ *   tga2gebmp_cli [options] [skin=image.tga ...] actor.act [skin=image.tga ...] ...
+ *
+ * Mappings given before the first actor apply to every actor that has a
+ * skin of that name, mappings given after an actor apply to that actor only.
+ * A directory stands for every actor below it. Arguments of the form @file
+ * are read from a response file, one per line.
+ *
+ * With -watch dir the driver keeps running after the first pass. Whenever
+ * images under dir are saved, it converts them again and saves the actors
+ * their mappings apply to, nothing else. A burst of saves is handled in one
+ * go once dir has been quiet for -debounce milliseconds (watchdir.h).
+ * Ctrl+C stops it between passes.
+ */
+#include <stdio.h>
+#include <signal.h>
+#include "tga2gebmp_batch.h"
+#include "dirwalk.h"
+#include "trace.h"
+#include "watchdir.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <direct.h>
+	#define getcwd _getcwd
+#else
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+
+typedef struct	tga2gebmp_Mapping
+{
+	char		*SkinName;
+	char		*ImageFileName;
+	int			FirstActor;		// applies to Actors[FirstActor, EndActor), -1 for every actor
+	int			EndActor;
+	void		*Data;			// the encoded image, for mappings shared by several actors
+	long		Size;
+	tga2gebmp_EncodeParams Params;	// what Data was encoded with
+	geBoolean	Failed;
+	geBoolean	Selected;		// applied in this pass, always in the first one
+	char		*WatchName;		// full path of the image for -watch, NULL if it has none
+}	tga2gebmp_Mapping;
+
+typedef struct	tga2gebmp_Args
+{
+	char		**Actors;
+	int			ActorCount;
+	int			ActorCapacity;
+	int			GroupStart;		// first actor added by the last actor or directory argument
+	tga2gebmp_Mapping *Mappings;
+	int			MappingCount;
+	int			MappingCapacity;
+	geBoolean	ListSkins;
+	geBoolean	Verbose;
+	int			Threads;		// 0 for one per processor
+	int			MaxIo;
+	int			IoDepth;		// copies in flight per actor saved, 0 for synchronous
+	char		WorkDir[_MAX_PATH];
+	const char	*CacheDir;		// NULL for no conversion cache
+	uint64_t	CacheSize;		// 0 for the default
+	const char	*ReportFile;	// stage totals, NULL for none
+	const char	*TraceFile;		// Chrome trace events, NULL for none
+	const char	*WatchRoot;		// images to watch after the first pass, NULL to exit
+	int			QuietMs;		// 0 for the default
+	tga2gebmp_EncodeParams Params;
+}	tga2gebmp_Args;
+
+typedef struct	tga2gebmp_ActorJob
+{
+	const tga2gebmp_Args *Args;
+	int			Actor;
+	geBoolean	Changed;
+}	tga2gebmp_ActorJob;
+
+typedef struct	tga2gebmp_MappingJob
+{
+	const tga2gebmp_Args *Args;
+	tga2gebmp_Mapping *Mapping;
+}	tga2gebmp_MappingJob;
+
+
+static void tga2gebmp_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_cli [options] [skin=image.tga ...] actor.act|dir [skin=image.tga ...] ...\n"
+		"\n"
+		"  -l          list the skins of every actor\n"
+		"  -v          report every replaced skin\n"
+		"  -j threads  actors processed in parallel (default: one per processor)\n"
+		"  -io count   actors read or written at the same time (default: 4)\n"
+		"  -iodepth count  copy unchanged entries with this many reads and writes\n"
+		"              in flight, through io_uring where available (default: off,\n"
+		"              copy_file_range, which is faster for saves on local disks)\n"
+		"  -w dir      directory relative image names are resolved against (default:\n"
+		"              current directory)\n"
+		"  -cache dir  reuse images converted before, keeping them in dir\n"
+		"  -cachesize MB  limit of the cache directory (default: 1024)\n"
+		"  -mips count mip levels written, 0 keeps the image's own (default: as many\n"
+		"              as the skin replaced)\n"
+		"  -mipfilter box|kaiser  filter the mip levels are made with (default: kaiser)\n"
+		"  -format match|keep|565|555|1555|4444  pixel format written, match takes\n"
+		"              16 bits or a palette from the skin replaced (default: match)\n"
+		"  -palette none|new|original  write 8-bit skins with a palette made for the\n"
+		"              image or the replaced skin's palette (default: none)\n"
+		"  -dither none|ordered|diffuse  dithering when reducing colours, palettes\n"
+		"              are always diffused (default: none)\n"
+		"  -maxsize pixels  halve larger TGAs until both sides fit\n"
+		"  -memlimit MB  halve TGAs until converting one takes about this much\n"
+		"              memory; limited TGAs are read a few rows at a time\n"
+		"  -report file  write time and bytes per stage, as CSV if file ends in .csv\n"
+		"              and JSON otherwise (builds with TGA2GEBMP_TRACE only)\n"
+		"  -trace file  write every timed operation as Chrome trace events\n"
+		"  -watch dir  keep running and redo the mappings whose images are saved\n"
+		"              under dir (Linux)\n"
+		"  -debounce ms  quiet time that ends a burst of saves (default: 250)\n"
+		"  @file       read further arguments from file, one per line\n"
+		"\n"
+		"Mappings before the first actor apply to all actors that contain the skin.\n"
+		"A directory stands for every .act file below it.\n");
+}
+
+
+static char *tga2gebmp_StrDup(const char *Str, int Length)
+{
+	char *Copy;
+
+	Copy = (char*)tga2gebmp_RamAllocate(Length + 1);
+	if(Copy)
+	{
+		memcpy(Copy, Str, Length);
+		Copy[Length] = '\0';
+	}
+
+	return Copy;
+}
+
+
+static geBoolean tga2gebmp_Args_AddActor(tga2gebmp_Args *Args, const char *ActFileName)
+{
+	if(Args->ActorCount == Args->ActorCapacity)
+	{
+		char **NewActors;
+		int NewCapacity = Args->ActorCapacity ? Args->ActorCapacity * 2 : 64;
+
+		NewActors = (char**)tga2gebmp_RamRealloc(Args->Actors, NewCapacity * sizeof(char*));
+		if(!NewActors)
+			return GE_FALSE;
+
+		Args->Actors = NewActors;
+		Args->ActorCapacity = NewCapacity;
+	}
+
+	Args->Actors[Args->ActorCount] = tga2gebmp_StrDup(ActFileName, (int)strlen(ActFileName));
+	if(!Args->Actors[Args->ActorCount])
+		return GE_FALSE;
+
+	Args->ActorCount++;
+	return GE_TRUE;
+}
+
+
+static int tga2gebmp_Args_AddFoundActor(const char *ActFileName, void *Context)
+{
+	return tga2gebmp_Args_AddActor((tga2gebmp_Args*)Context, ActFileName);
+}
+
+
+static geBoolean tga2gebmp_Args_AddDirectory(tga2gebmp_Args *Args, const char *Dir)
+{
+	int First = Args->ActorCount;
+
+	if(!DirWalk_Run(Dir, ".act", tga2gebmp_Args_AddFoundActor, Args))
+	{
+		fprintf(stderr, "tga2gebmp_cli: cannot search directory '%s'\n", Dir);
+		return GE_FALSE;
+	}
+
+	if(Args->ActorCount == First)
+		fprintf(stderr, "tga2gebmp_cli: no actors found in '%s'\n", Dir);
+
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Args_AddMapping(tga2gebmp_Args *Args, const char *Arg)
+{
+	tga2gebmp_Mapping *Mapping;
+	const char *Equals = strchr(Arg, '=');
+
+	if(!Equals || Equals == Arg || Equals[1] == '\0')
+	{
+		fprintf(stderr, "tga2gebmp_cli: bad mapping '%s', expected skin=image\n", Arg);
+		return GE_FALSE;
+	}
+
+	if(Args->MappingCount == Args->MappingCapacity)
+	{
+		tga2gebmp_Mapping *NewMappings;
+		int NewCapacity = Args->MappingCapacity ? Args->MappingCapacity * 2 : 64;
+
+		NewMappings = (tga2gebmp_Mapping*)tga2gebmp_RamRealloc(Args->Mappings, NewCapacity * sizeof(tga2gebmp_Mapping));
+		if(!NewMappings)
+			return GE_FALSE;
+
+		Args->Mappings = NewMappings;
+		Args->MappingCapacity = NewCapacity;
+	}
+
+	Mapping = &Args->Mappings[Args->MappingCount];
+	Mapping->SkinName = tga2gebmp_StrDup(Arg, (int)(Equals - Arg));
+	Mapping->ImageFileName = tga2gebmp_StrDup(Equals + 1, (int)strlen(Equals + 1));
+	Mapping->FirstActor = Args->ActorCount ? Args->GroupStart : -1;
+	Mapping->EndActor = Args->ActorCount;
+	Mapping->Data = NULL;
+	Mapping->Size = 0;
+	Mapping->Failed = GE_FALSE;
+	Mapping->Selected = GE_TRUE;
+	Mapping->WatchName = NULL;
+	memset(&Mapping->Params, 0, sizeof(Mapping->Params));
+	if(!Mapping->SkinName || !Mapping->ImageFileName)
+		return GE_FALSE;
+
+	Args->MappingCount++;
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_Args_AddArgument(tga2gebmp_Args *Args, const char *Arg);
+
+
+static geBoolean tga2gebmp_Args_ReadResponseFile(tga2gebmp_Args *Args, const char *FileName)
+{
+	FILE *File;
+	char Line[_MAX_PATH * 2];
+	geBoolean Result = GE_TRUE;
+
+	File = fopen(FileName, "r");
+	if(!File)
+	{
+		fprintf(stderr, "tga2gebmp_cli: cannot read response file '%s'\n", FileName);
+		return GE_FALSE;
+	}
+
+	while(Result && fgets(Line, sizeof(Line), File))
+	{
+		char *Start = Line;
+		char *End;
+
+		while(*Start == ' ' || *Start == '\t')
+			Start++;
+
+		End = Start + strlen(Start);
+		while(End > Start && (End[-1] == '\n' || End[-1] == '\r' || End[-1] == ' ' || End[-1] == '\t'))
+			*--End = '\0';
+
+		if(*Start == '\0' || *Start == '#')
+			continue;
+
+		Result = tga2gebmp_Args_AddArgument(Args, Start);
+	}
+
+	fclose(File);
+	return Result;
+}
+
+
+static geBoolean tga2gebmp_Args_AddArgument(tga2gebmp_Args *Args, const char *Arg)
+{
+	if(Arg[0] == '@')
+		return tga2gebmp_Args_ReadResponseFile(Args, Arg + 1);
+
+	if(strchr(Arg, '='))
+		return tga2gebmp_Args_AddMapping(Args, Arg);
+
+	Args->GroupStart = Args->ActorCount;
+
+	if(DirWalk_IsDirectory(Arg))
+		return tga2gebmp_Args_AddDirectory(Args, Arg);
+
+	return tga2gebmp_Args_AddActor(Args, Arg);
+}
+
+
+static void tga2gebmp_Args_Free(tga2gebmp_Args *Args)
+{
+	int i;
+
+	for(i = 0; i < Args->ActorCount; i++)
+		tga2gebmp_RamFree(Args->Actors[i]);
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		tga2gebmp_RamFree(Args->Mappings[i].SkinName);
+		tga2gebmp_RamFree(Args->Mappings[i].ImageFileName);
+		if(Args->Mappings[i].Data)
+			tga2gebmp_RamFree(Args->Mappings[i].Data);
+		if(Args->Mappings[i].WatchName)
+			tga2gebmp_RamFree(Args->Mappings[i].WatchName);
+	}
+
+	if(Args->Actors)
+		tga2gebmp_RamFree(Args->Actors);
+	if(Args->Mappings)
+		tga2gebmp_RamFree(Args->Mappings);
+}
+
+
+static geBoolean tga2gebmp_Mapping_AppliesTo(const tga2gebmp_Mapping *Mapping, int Actor)
+{
+	return Mapping->FirstActor == -1 || (Actor >= Mapping->FirstActor && Actor < Mapping->EndActor);
+}
+
+
+// converted once up front instead of once per actor
+static geBoolean tga2gebmp_Mapping_IsShared(const tga2gebmp_Mapping *Mapping)
+{
+	return Mapping->FirstActor == -1 || Mapping->EndActor - Mapping->FirstActor > 1;
+}
+
+
+static geBoolean tga2gebmp_ProcessActor(tga2gebmp_Session *Session, const tga2gebmp_Args *Args, int Actor, geBoolean *pChanged)
+{
+	const char *ActFileName = Args->Actors[Actor];
+	const char **SkinNames;
+	const char **ImageFileNames;
+	geBoolean *Results;
+	geBoolean Result = GE_TRUE;
+	int Replaced = 0;
+	int Count = 0;
+	int Shared = 0;
+	geBoolean Deferred = GE_FALSE;
+	int i;
+
+	*pChanged = GE_FALSE;
+
+	if(!tga2gebmp_Session_OpenAct(Session, ActFileName))
+	{
+		fprintf(stderr, "%s: cannot open actor\n", ActFileName);
+		return GE_FALSE;
+	}
+
+	if(Args->ListSkins)
+	{
+		for(i = 0; i < tga2gebmp_Session_GetSkinCount(Session); i++)
+			printf("%s\t%s\n", ActFileName, tga2gebmp_Session_GetSkinName(Session, i));
+	}
+
+	SkinNames = (const char**)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Args->MappingCount, 1) * 2 * sizeof(const char*));
+	Results = (geBoolean*)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Args->MappingCount, 1) * sizeof(geBoolean));
+	if(!SkinNames || !Results)
+	{
+		fprintf(stderr, "%s: out of memory\n", ActFileName);
+		if(SkinNames)
+			tga2gebmp_RamFree((void*)SkinNames);
+		if(Results)
+			tga2gebmp_RamFree(Results);
+		tga2gebmp_Session_CloseAct(Session);
+		return GE_FALSE;
+	}
+	ImageFileNames = SkinNames + TGA2GEBMP_MAX(Args->MappingCount, 1);
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		const tga2gebmp_Mapping *Mapping = &Args->Mappings[i];
+		tga2gebmp_EncodeParams Params;
+		int Skin;
+
+		if(!Mapping->Selected || !tga2gebmp_Mapping_AppliesTo(Mapping, Actor))
+			continue;
+
+		Skin = tga2gebmp_Session_FindSkin(Session, Mapping->SkinName);
+		if(Skin < 0)
+		{
+			// shared mappings only apply to actors that carry the skin
+			if(!tga2gebmp_Mapping_IsShared(Mapping))
+			{
+				fprintf(stderr, "%s: no skin named '%s'\n", ActFileName, Mapping->SkinName);
+				Result = GE_FALSE;
+			}
+			continue;
+		}
+
+		SkinNames[Count] = Mapping->SkinName;
+		ImageFileNames[Count] = Mapping->ImageFileName;
+
+		// shared mappings come before an actor's own ones on the command line,
+		// so applying them right away keeps the mapping order. A skin that
+		// needs other parameters than the shared image was encoded with (say
+		// another mip count) gets its own conversion, and so does everything
+		// after it
+		if(!Deferred && Mapping->Data)
+		{
+			tga2gebmp_Session_GetSkinEncodeParams(Session, Skin, &Params);
+			Deferred = memcmp(&Params, &Mapping->Params, sizeof(Params)) != 0;
+		}
+
+		if(!Deferred && Mapping->Data)
+		{
+			Results[Count] = tga2gebmp_Session_ReplaceSkinData(Session, Mapping->SkinName, Mapping->Data, Mapping->Size);
+			Shared++;
+		}
+		else
+		{
+			Deferred = GE_TRUE;
+		}
+
+		Count++;
+	}
+
+	// the actor's own images are converted at once, applied in mapping order
+	tga2gebmp_Session_ReplaceSkins(Session, Count - Shared, SkinNames + Shared, ImageFileNames + Shared, Results + Shared);
+
+	for(i = 0; i < Count; i++)
+	{
+		if(!Results[i])
+		{
+			fprintf(stderr, "%s: cannot replace '%s' with '%s'\n", ActFileName, SkinNames[i], ImageFileNames[i]);
+			Result = GE_FALSE;
+			continue;
+		}
+
+		if(Args->Verbose)
+			printf("%s: %s <- %s\n", ActFileName, SkinNames[i], ImageFileNames[i]);
+
+		Replaced++;
+	}
+
+	tga2gebmp_RamFree((void*)SkinNames);
+	tga2gebmp_RamFree(Results);
+
+	if(Replaced > 0)
+	{
+		tga2gebmp_SaveStats Stats;
+		int Changed = tga2gebmp_Session_GetDirtyCount(Session);
+
+		if(tga2gebmp_Session_Save(Session))
+		{
+			tga2gebmp_Session_GetSaveStats(Session, &Stats);
+			*pChanged = !Stats.Skipped;
+			if(Stats.Skipped)
+				printf("%s: %d skin(s) replaced, no changes\n", ActFileName, Replaced);
+			else
+				printf("%s: %d skin(s) replaced, %d changed\n", ActFileName, Replaced, Changed);
+
+			if(Args->Verbose && !Stats.Skipped)
+			{
+				printf("%s: %d entries rewritten, %d reused, %lu of %lu bytes reused\n", ActFileName,
+						Stats.EntriesRewritten, Stats.EntriesReused,
+						(unsigned long)Stats.BytesReused, (unsigned long)Stats.BytesWritten);
+			}
+		}
+		else
+		{
+			fprintf(stderr, "%s: cannot save actor\n", ActFileName);
+			Result = GE_FALSE;
+		}
+	}
+
+	tga2gebmp_Session_CloseAct(Session);
+
+	return Result;
+}
+
+
+static void tga2gebmp_PrintCacheStats(ConvCache *Cache)
+{
+	ConvCache_Stats Stats;
+	uint64_t Lookups;
+
+	ConvCache_GetStats(Cache, &Stats);
+	Lookups = Stats.Hits + Stats.Misses;
+
+	printf("cache: %lu hit(s), %lu miss(es) (%.1f%% hit rate), %lu stored, %lu evicted, %lu of %lu MB used\n",
+			(unsigned long)Stats.Hits, (unsigned long)Stats.Misses,
+			Lookups ? 100.0 * (double)Stats.Hits / (double)Lookups : 0.0,
+			(unsigned long)Stats.Stores, (unsigned long)Stats.Evictions,
+			(unsigned long)(Stats.Size >> 20), (unsigned long)(Stats.MaxSize >> 20));
+}
+
+
+static geBoolean tga2gebmp_RunActorJob(tga2gebmp_Session *Session, void *Context)
+{
+	tga2gebmp_ActorJob *Job = (tga2gebmp_ActorJob*)Context;
+
+	return tga2gebmp_ProcessActor(Session, Job->Args, Job->Actor, &Job->Changed);
+}
+
+
+// the image is encoded for the first actor that has the skin, which is what
+// nearly every other actor needs as well
+static geBoolean tga2gebmp_RunEncodeJob(tga2gebmp_Session *Session, void *Context)
+{
+	const tga2gebmp_MappingJob *Job = (const tga2gebmp_MappingJob*)Context;
+	tga2gebmp_Mapping *Mapping = Job->Mapping;
+	int First = Mapping->FirstActor == -1 ? 0 : Mapping->FirstActor;
+	int End = Mapping->FirstActor == -1 ? Job->Args->ActorCount : Mapping->EndActor;
+	int Skin = -1;
+	int i;
+
+	for(i = First; i < End && Skin < 0; i++)
+	{
+		if(!tga2gebmp_Session_OpenAct(Session, Job->Args->Actors[i]))
+			continue;
+
+		Skin = tga2gebmp_Session_FindSkin(Session, Mapping->SkinName);
+		if(Skin >= 0)
+			tga2gebmp_Session_GetSkinEncodeParams(Session, Skin, &Mapping->Params);
+
+		tga2gebmp_Session_CloseAct(Session);
+	}
+
+	// no actor has the skin, there is nothing to convert
+	if(Skin < 0)
+		return GE_TRUE;
+
+	if(!tga2gebmp_Session_EncodeImage(Session, Mapping->ImageFileName, &Mapping->Params, &Mapping->Data, &Mapping->Size))
+	{
+		Mapping->Failed = GE_TRUE;
+		return GE_FALSE;
+	}
+
+	return GE_TRUE;
+}
+
+
+// converts every selected image that replaces skins in more than one actor,
+// once
+static geBoolean tga2gebmp_EncodeSharedImages(tga2gebmp_Batch *Batch, tga2gebmp_Args *Args)
+{
+	tga2gebmp_MappingJob *Jobs;
+	geBoolean Result = GE_TRUE;
+	int i;
+
+	Jobs = (tga2gebmp_MappingJob*)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Args->MappingCount, 1) * sizeof(tga2gebmp_MappingJob));
+	if(!Jobs)
+		return GE_FALSE;
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		tga2gebmp_Mapping *Mapping = &Args->Mappings[i];
+
+		Jobs[i].Args = Args;
+		Jobs[i].Mapping = Mapping;
+
+		if(!Mapping->Selected || !tga2gebmp_Mapping_IsShared(Mapping))
+			continue;
+
+		// an image saved again is converted again
+		if(Mapping->Data)
+		{
+			tga2gebmp_RamFree(Mapping->Data);
+			Mapping->Data = NULL;
+			Mapping->Size = 0;
+		}
+		Mapping->Failed = GE_FALSE;
+
+		if(!tga2gebmp_Batch_Submit(Batch, tga2gebmp_RunEncodeJob, &Jobs[i]))
+			Mapping->Failed = GE_TRUE;
+	}
+
+	tga2gebmp_Batch_Wait(Batch);
+	tga2gebmp_RamFree(Jobs);
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		const tga2gebmp_Mapping *Mapping = &Args->Mappings[i];
+
+		if(Mapping->Selected && Mapping->Failed)
+		{
+			fprintf(stderr, "tga2gebmp_cli: cannot convert '%s'\n", Mapping->ImageFileName);
+			Result = GE_FALSE;
+		}
+	}
+
+	return Result;
+}
+
+
+static geBoolean tga2gebmp_IsActorSelected(const tga2gebmp_Args *Args, int Actor)
+{
+	int i;
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		if(Args->Mappings[i].Selected && tga2gebmp_Mapping_AppliesTo(&Args->Mappings[i], Actor))
+			return GE_TRUE;
+	}
+
+	return GE_FALSE;
+}
+
+
+// runs every actor, or only those a selected mapping applies to; returns how
+// many failed
+static int tga2gebmp_RunActors(tga2gebmp_Batch *Batch, const tga2gebmp_Args *Args, tga2gebmp_ActorJob *Jobs,
+							   geBoolean AllActors, int *pProcessed, int *pChanged)
+{
+	int Failures = 0;
+	int i;
+
+	*pProcessed = 0;
+	*pChanged = 0;
+
+	for(i = 0; i < Args->ActorCount; i++)
+	{
+		Jobs[i].Args = Args;
+		Jobs[i].Actor = i;
+		Jobs[i].Changed = GE_FALSE;
+		if(!AllActors && !tga2gebmp_IsActorSelected(Args, i))
+			continue;
+
+		(*pProcessed)++;
+		if(!tga2gebmp_Batch_Submit(Batch, tga2gebmp_RunActorJob, &Jobs[i]))
+		{
+			fprintf(stderr, "%s: cannot queue actor\n", Args->Actors[i]);
+			Failures++;
+		}
+	}
+
+	Failures += tga2gebmp_Batch_Wait(Batch);
+
+	for(i = 0; i < Args->ActorCount; i++)
+	{
+		if(Jobs[i].Changed)
+			(*pChanged)++;
+	}
+
+	return Failures;
+}
+
+
+static double tga2gebmp_Now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER Frequency, Counter;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Counter);
+	return (double)Counter.QuadPart / (double)Frequency.QuadPart;
+#else
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (double)Now.tv_sec + (double)Now.tv_nsec * 1e-9;
+#endif
+}
+
+
+static volatile sig_atomic_t tga2gebmp_Stop = 0;
+
+static void tga2gebmp_OnSignal(int Signal)
+{
+	(void)Signal;
+	tga2gebmp_Stop = 1;
+}
+
+
+// selects the mappings whose image is Path, or all of them if changes were lost
+static void tga2gebmp_SelectChanged(const char *Path, void *Context)
+{
+	tga2gebmp_Args *Args = (tga2gebmp_Args*)Context;
+	int i;
+
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		tga2gebmp_Mapping *Mapping = &Args->Mappings[i];
+
+		if(!Path || (Mapping->WatchName && strcmp(Mapping->WatchName, Path) == 0))
+			Mapping->Selected = GE_TRUE;
+	}
+}
+
+
+// opened before the first pass, so images saved while it runs are not missed
+static WatchDir *tga2gebmp_OpenWatch(tga2gebmp_Args *Args)
+{
+	WatchDir *Watch;
+	char FullPath[_MAX_PATH];
+	char Path[_MAX_PATH];
+	int i;
+
+	Watch = WatchDir_Open(Args->WatchRoot, Args->QuietMs);
+	if(!Watch)
+	{
+		fprintf(stderr, "tga2gebmp_cli: cannot watch directory '%s' (-watch needs inotify)\n", Args->WatchRoot);
+		return NULL;
+	}
+
+	// the watch reports full paths; relative image names are found in the
+	// working directory, as the session finds them
+	for(i = 0; i < Args->MappingCount; i++)
+	{
+		tga2gebmp_Mapping *Mapping = &Args->Mappings[i];
+		const char *Name = Mapping->ImageFileName;
+		int Fits = 1;
+
+		if(Name[0] != '/' && Name[0] != '\\' && !(Name[0] != '\0' && Name[1] == ':'))
+		{
+			Fits = (unsigned)snprintf(Path, sizeof(Path), "%s" TGA2GEBMP_DIRSEP "%s", Args->WorkDir, Name) < sizeof(Path);
+			Name = Path;
+		}
+
+		if(Fits && WatchDir_GetFullPath(Name, FullPath))
+			Mapping->WatchName = tga2gebmp_StrDup(FullPath, (int)strlen(FullPath));
+		if(!Mapping->WatchName)
+			fprintf(stderr, "tga2gebmp_cli: cannot watch '%s'\n", Mapping->ImageFileName);
+	}
+
+	return Watch;
+}
+
+
+// after the first pass: redoes the mappings whose images were saved, burst
+// by burst, until interrupted. 0 if the watch was lost
+static geBoolean tga2gebmp_Watch(tga2gebmp_Batch *Batch, tga2gebmp_Args *Args, tga2gebmp_ActorJob *Jobs, WatchDir *Watch)
+{
+	double Start;
+	int Images, Processed, Changed, Failures;
+	int i;
+
+	signal(SIGINT, tga2gebmp_OnSignal);
+	signal(SIGTERM, tga2gebmp_OnSignal);
+
+	// skins are listed once
+	Args->ListSkins = GE_FALSE;
+
+	printf("tga2gebmp_cli: watching '%s'\n", Args->WatchRoot);
+	fflush(stdout);
+
+	while(!tga2gebmp_Stop)
+	{
+		for(i = 0; i < Args->MappingCount; i++)
+			Args->Mappings[i].Selected = GE_FALSE;
+
+		if(WatchDir_Wait(Watch, -1, tga2gebmp_SelectChanged, Args) < 0)
+		{
+			fprintf(stderr, "tga2gebmp_cli: lost the watch on '%s'\n", Args->WatchRoot);
+			return GE_FALSE;
+		}
+
+		Start = tga2gebmp_Now();
+
+		// a shared image that cannot be converted leaves its actors alone,
+		// the next save of it is tried again
+		tga2gebmp_EncodeSharedImages(Batch, Args);
+
+		for(i = 0, Images = 0; i < Args->MappingCount; i++)
+		{
+			if(Args->Mappings[i].Failed)
+				Args->Mappings[i].Selected = GE_FALSE;
+			if(Args->Mappings[i].Selected)
+				Images++;
+		}
+
+		// files that no mapping uses, the actors being saved among them
+		if(Images == 0)
+			continue;
+
+		Failures = tga2gebmp_RunActors(Batch, Args, Jobs, GE_FALSE, &Processed, &Changed);
+
+		printf("tga2gebmp_cli: %d mapping(s) redone, %d of %d actor(s) changed in %.2f s\n",
+				Images, Changed, Processed, tga2gebmp_Now() - Start);
+		if(Failures > 0)
+			fprintf(stderr, "tga2gebmp_cli: %d of %d actor(s) failed\n", Failures, Processed);
+		fflush(stdout);
+	}
+
+	return GE_TRUE;
+}
+
+
+int main(int argc, char **argv)
+{
+	tga2gebmp_Args Args;
+	tga2gebmp_Batch *Batch;
+	ConvCache *Cache = NULL;
+	tga2gebmp_ActorJob *Jobs;
+	WatchDir *Watch = NULL;
+	geBoolean WatchLost = GE_FALSE;
+	int Failures = 0;
+	int Processed = 0;
+	int Changed = 0;
+	int i;
+
+	memset(&Args, 0, sizeof(Args));
+	tga2gebmp_EncodeParams_SetDefaults(&Args.Params);
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-l") == 0)
+		{
+			Args.ListSkins = GE_TRUE;
+		}
+		else if(strcmp(argv[i], "-v") == 0)
+		{
+			Args.Verbose = GE_TRUE;
+		}
+		else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			Args.Threads = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-io") == 0 && i + 1 < argc)
+		{
+			Args.MaxIo = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-iodepth") == 0 && i + 1 < argc)
+		{
+			Args.IoDepth = TGA2GEBMP_MAX(atoi(argv[++i]), 0);
+		}
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+		{
+			strncpy(Args.WorkDir, argv[++i], sizeof(Args.WorkDir) - 1);
+		}
+		else if(strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+		{
+			Args.CacheDir = argv[++i];
+		}
+		else if(strcmp(argv[i], "-cachesize") == 0 && i + 1 < argc)
+		{
+			Args.CacheSize = (uint64_t)TGA2GEBMP_MAX(atoi(argv[++i]), 1) << 20;
+		}
+		else if(strcmp(argv[i], "-report") == 0 && i + 1 < argc)
+		{
+			Args.ReportFile = argv[++i];
+		}
+		else if(strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+		{
+			Args.TraceFile = argv[++i];
+		}
+		else if(strcmp(argv[i], "-watch") == 0 && i + 1 < argc)
+		{
+			Args.WatchRoot = argv[++i];
+		}
+		else if(strcmp(argv[i], "-debounce") == 0 && i + 1 < argc)
+		{
+			Args.QuietMs = TGA2GEBMP_MAX(atoi(argv[++i]), 1);
+		}
+		else if(strcmp(argv[i], "-mips") == 0 && i + 1 < argc)
+		{
+			Args.Params.MipCount = TGA2GEBMP_MAX(atoi(argv[++i]), 0);
+		}
+		else if(strcmp(argv[i], "-mipfilter") == 0 && i + 1 < argc)
+		{
+			i++;
+			if(tga2gebmp_stricmp(argv[i], "box") == 0)
+				Args.Params.MipFilter = MIPGEN_FILTER_BOX;
+			else if(tga2gebmp_stricmp(argv[i], "kaiser") == 0)
+				Args.Params.MipFilter = MIPGEN_FILTER_KAISER;
+			else
+			{
+				fprintf(stderr, "tga2gebmp_cli: unknown mip filter '%s'\n", argv[i]);
+				tga2gebmp_Args_Free(&Args);
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "-palette") == 0 && i + 1 < argc)
+		{
+			i++;
+			if(tga2gebmp_stricmp(argv[i], "none") == 0)
+				Args.Params.Palette = TGA2GEBMP_PALETTE_NONE;
+			else if(tga2gebmp_stricmp(argv[i], "new") == 0)
+				Args.Params.Palette = TGA2GEBMP_PALETTE_NEW;
+			else if(tga2gebmp_stricmp(argv[i], "original") == 0)
+				Args.Params.Palette = TGA2GEBMP_PALETTE_ORIGINAL;
+			else
+			{
+				fprintf(stderr, "tga2gebmp_cli: unknown palette '%s'\n", argv[i]);
+				tga2gebmp_Args_Free(&Args);
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "-format") == 0 && i + 1 < argc)
+		{
+			i++;
+			if(tga2gebmp_stricmp(argv[i], "match") == 0)
+				Args.Params.Format = TGA2GEBMP_FORMAT_MATCH;
+			else if(tga2gebmp_stricmp(argv[i], "keep") == 0)
+				Args.Params.Format = TGA2GEBMP_FORMAT_KEEP;
+			else if(strcmp(argv[i], "565") == 0)
+				Args.Params.Format = GE_PIXELFORMAT_16BIT_565_RGB;
+			else if(strcmp(argv[i], "555") == 0)
+				Args.Params.Format = GE_PIXELFORMAT_16BIT_555_RGB;
+			else if(strcmp(argv[i], "1555") == 0)
+				Args.Params.Format = GE_PIXELFORMAT_16BIT_1555_ARGB;
+			else if(strcmp(argv[i], "4444") == 0)
+				Args.Params.Format = GE_PIXELFORMAT_16BIT_4444_ARGB;
+			else
+			{
+				fprintf(stderr, "tga2gebmp_cli: unknown format '%s'\n", argv[i]);
+				tga2gebmp_Args_Free(&Args);
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "-dither") == 0 && i + 1 < argc)
+		{
+			i++;
+			if(tga2gebmp_stricmp(argv[i], "none") == 0)
+				Args.Params.Dither = TGA2GEBMP_DITHER_NONE;
+			else if(tga2gebmp_stricmp(argv[i], "ordered") == 0)
+				Args.Params.Dither = TGA2GEBMP_DITHER_ORDERED;
+			else if(tga2gebmp_stricmp(argv[i], "diffuse") == 0)
+				Args.Params.Dither = TGA2GEBMP_DITHER_DIFFUSE;
+			else
+			{
+				fprintf(stderr, "tga2gebmp_cli: unknown dithering '%s'\n", argv[i]);
+				tga2gebmp_Args_Free(&Args);
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "-maxsize") == 0 && i + 1 < argc)
+		{
+			Args.Params.MaxSize = TGA2GEBMP_MAX(atoi(argv[++i]), 0);
+		}
+		else if(strcmp(argv[i], "-memlimit") == 0 && i + 1 < argc)
+		{
+			Args.Params.MemLimit = TGA2GEBMP_MAX(atoi(argv[++i]), 0);
+		}
+		else if(strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+		{
+			tga2gebmp_Usage();
+			tga2gebmp_Args_Free(&Args);
+			return 0;
+		}
+		else if(argv[i][0] == '-')
+		{
+			fprintf(stderr, "tga2gebmp_cli: unknown option '%s'\n", argv[i]);
+			tga2gebmp_Usage();
+			tga2gebmp_Args_Free(&Args);
+			return 2;
+		}
+		else if(!tga2gebmp_Args_AddArgument(&Args, argv[i]))
+		{
+			tga2gebmp_Args_Free(&Args);
+			return 2;
+		}
+	}
+
+	if(Args.ActorCount == 0)
+	{
+		tga2gebmp_Usage();
+		tga2gebmp_Args_Free(&Args);
+		return 2;
+	}
+
+	if(Args.WatchRoot && Args.MappingCount == 0)
+	{
+		fprintf(stderr, "tga2gebmp_cli: -watch needs skin=image mappings\n");
+		tga2gebmp_Args_Free(&Args);
+		return 2;
+	}
+
+	if((Args.ReportFile || Args.TraceFile) && !TRACE_ENABLED)
+	{
+		fprintf(stderr, "tga2gebmp_cli: -report and -trace need a build with TGA2GEBMP_TRACE\n");
+		tga2gebmp_Args_Free(&Args);
+		return 2;
+	}
+
+	if((Args.ReportFile || Args.TraceFile) && !Trace_Start(Args.TraceFile != NULL))
+	{
+		fprintf(stderr, "tga2gebmp_cli: out of memory\n");
+		tga2gebmp_Args_Free(&Args);
+		return 1;
+	}
+
+	if(Args.WorkDir[0] == '\0' && !getcwd(Args.WorkDir, sizeof(Args.WorkDir)))
+	{
+		fprintf(stderr, "tga2gebmp_cli: cannot determine the current directory\n");
+		tga2gebmp_Args_Free(&Args);
+		return 1;
+	}
+
+	if(Args.WatchRoot && (Watch = tga2gebmp_OpenWatch(&Args)) == NULL)
+	{
+		tga2gebmp_Args_Free(&Args);
+		return 1;
+	}
+
+	// a cache that cannot be opened only means converting everything again
+	if(Args.CacheDir)
+	{
+		Cache = ConvCache_Open(Args.CacheDir, Args.CacheSize);
+		if(!Cache)
+			fprintf(stderr, "tga2gebmp_cli: cannot use cache directory '%s', continuing without it\n", Args.CacheDir);
+	}
+
+	// every worker gets its own session, actors are handed out as jobs
+	Batch = tga2gebmp_Batch_Create(Args.WorkDir, Args.Threads, Args.MaxIo);
+	Jobs = (tga2gebmp_ActorJob*)tga2gebmp_RamAllocate(Args.ActorCount * sizeof(tga2gebmp_ActorJob));
+	if(!Batch || !Jobs)
+	{
+		fprintf(stderr, "tga2gebmp_cli: cannot open working directory '%s'\n", Args.WorkDir);
+		tga2gebmp_Batch_Destroy(&Batch);
+		if(Jobs)
+			tga2gebmp_RamFree(Jobs);
+		ConvCache_Close(&Cache);
+		WatchDir_Close(&Watch);
+		tga2gebmp_Args_Free(&Args);
+		return 1;
+	}
+
+	if(Cache)
+		tga2gebmp_Batch_SetConvCache(Batch, Cache);
+	tga2gebmp_Batch_SetEncodeParams(Batch, &Args.Params);
+
+	// without a queue, saves fall back to their synchronous copies
+	if(Args.IoDepth > 0)
+	{
+		int Backend = tga2gebmp_Batch_SetIoDepth(Batch, Args.IoDepth);
+
+		if(!Backend)
+			fprintf(stderr, "tga2gebmp_cli: no asynchronous I/O on this system, ignoring -iodepth\n");
+		else if(Args.Verbose)
+			printf("tga2gebmp_cli: copying unchanged entries with %s\n", IoQueue_GetBackendName(Backend));
+	}
+
+	// no actor is touched if an image that many of them need cannot be used
+	if(!tga2gebmp_EncodeSharedImages(Batch, &Args))
+	{
+		tga2gebmp_Batch_Destroy(&Batch);
+		tga2gebmp_RamFree(Jobs);
+		ConvCache_Close(&Cache);
+		WatchDir_Close(&Watch);
+		tga2gebmp_Args_Free(&Args);
+		return 1;
+	}
+
+	Failures = tga2gebmp_RunActors(Batch, &Args, Jobs, GE_TRUE, &Processed, &Changed);
+
+	if(Args.ActorCount > 1)
+		printf("tga2gebmp_cli: %d of %d actor(s) changed\n", Changed, Args.ActorCount);
+
+	// failures of the first pass are reported when the watch ends
+	if(Watch)
+	{
+		WatchLost = !tga2gebmp_Watch(Batch, &Args, Jobs, Watch);
+		WatchDir_Close(&Watch);
+	}
+
+	tga2gebmp_Batch_Destroy(&Batch);
+	tga2gebmp_RamFree(Jobs);
+
+	if(Cache)
+	{
+		if(Args.Verbose)
+			tga2gebmp_PrintCacheStats(Cache);
+		ConvCache_Close(&Cache);
+	}
+
+	if(Args.ReportFile && !Trace_WriteReport(Args.ReportFile))
+		fprintf(stderr, "tga2gebmp_cli: cannot write report '%s'\n", Args.ReportFile);
+	if(Args.TraceFile && !Trace_WriteEvents(Args.TraceFile))
+		fprintf(stderr, "tga2gebmp_cli: cannot write trace '%s'\n", Args.TraceFile);
+	Trace_Stop();
+
+	tga2gebmp_Args_Free(&Args);
+
+	if(Failures > 0)
+	{
+		fprintf(stderr, "tga2gebmp_cli: %d of %d actor(s) failed\n", Failures, Args.ActorCount);
+		return 1;
+	}
+
+	return WatchLost ? 1 : 0;
+}
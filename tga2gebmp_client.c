@@ -0,0 +1,269 @@
+/**
+ * @file tga2gebmp_client.c
+ *
+ * Sends requests to tga2gebmp_server and prints its replies, one line each:
+ *
+ *   tga2gebmp_client [-socket path] [request ...]
+ *
+ * A request is either a JSON object, given as one argument, or an op and
+ * its fields as name=value arguments:
+ *
+ *   tga2gebmp_client replace actor=soldier.act skin=face.bmp image=face.tga
+ *   tga2gebmp_client '{"op": "batch", "jobs": [...]}'
+ *
+ * Relative paths in actor=, image= and file= are made absolute here, so they
+ * mean the same to the server as they do to the caller. Without requests the
+ * client sends the lines it reads from standard input. The exit code is 1 if
+ * a reply says a request failed or the server cannot be reached.
+ *
+ * This program does not depend on the Genesis engine. POSIX only.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "json.h"
+
+#define CLIENT_SOCKET			"tga2gebmp.sock"
+
+
+static void Client_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_client [-socket path] [request ...]\n"
+		"\n"
+		"  -socket path  socket of the server (default: tga2gebmp.sock in the\n"
+		"              current directory)\n"
+		"  request     a JSON object, or an op followed by name=value fields:\n"
+		"                open|list|save|close actor=file\n"
+		"                replace actor=file skin=name image=file\n"
+		"                export actor=file skin=name file=file\n"
+		"                stats | shutdown\n"
+		"              without requests, JSON objects are read from standard input,\n"
+		"              one per line\n");
+}
+
+
+static int Client_Connect(const char *SocketPath)
+{
+	struct sockaddr_un Address;
+	int Fd;
+
+	if(strlen(SocketPath) + 1 > sizeof(Address.sun_path))
+		return -1;
+
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	strcpy(Address.sun_path, SocketPath);
+
+	Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(Fd < 0)
+		return -1;
+
+	if(connect(Fd, (struct sockaddr*)&Address, sizeof(Address)) != 0)
+	{
+		close(Fd);
+		return -1;
+	}
+
+	return Fd;
+}
+
+
+static int Client_IsPathField(const char *Name, size_t Length)
+{
+	return (Length == 5 && memcmp(Name, "actor", 5) == 0) || (Length == 5 && memcmp(Name, "image", 5) == 0) ||
+		   (Length == 4 && memcmp(Name, "file", 4) == 0);
+}
+
+
+// an op and its name=value fields as one JSON request; 0 if a field is
+// malformed, -1 if a path does not fit and the request is not to be sent
+static int Client_WriteRequest(FILE *Out, const char *Op, char **Fields, int Count)
+{
+	char Cwd[_MAX_PATH];
+	int i;
+
+	if(!getcwd(Cwd, sizeof(Cwd)))
+		return 0;
+
+	fprintf(Out, "{\"op\": ");
+	Json_WriteString(Out, Op);
+
+	for(i = 0; i < Count; i++)
+	{
+		const char *Equals = strchr(Fields[i], '=');
+		size_t Length;
+		char *Name;
+
+		if(!Equals || Equals == Fields[i])
+			return 0;
+
+		Length = Equals - Fields[i];
+		Name = (char*)malloc(Length + 1);
+		if(!Name)
+			return 0;
+		memcpy(Name, Fields[i], Length);
+		Name[Length] = '\0';
+
+		fprintf(Out, ", ");
+		Json_WriteString(Out, Name);
+		fprintf(Out, ": ");
+		free(Name);
+
+		if(Client_IsPathField(Fields[i], Length) && Equals[1] != '/' && Equals[1] != '\0')
+		{
+			char Path[_MAX_PATH * 2 + 2];
+
+			if((unsigned)snprintf(Path, sizeof(Path), "%s/%s", Cwd, Equals + 1) >= sizeof(Path))
+			{
+				fprintf(stderr, "tga2gebmp_client: path too long: %s\n", Equals + 1);
+				return -1;
+			}
+			Json_WriteString(Out, Path);
+		}
+		else
+			Json_WriteString(Out, Equals + 1);
+	}
+
+	fprintf(Out, "}\n");
+	return 1;
+}
+
+
+// sends one request line and prints the reply; 0 if the request failed
+static int Client_Send(FILE *Out, FILE *In, const char *Request, size_t Length, int *pConnected)
+{
+	Json_Value *Reply;
+	const Json_Value *Ok;
+	char *Line = NULL;
+	size_t Capacity = 0;
+	ssize_t ReplyLength;
+	int Result;
+
+	fwrite(Request, 1, Length, Out);
+	if(Length == 0 || Request[Length - 1] != '\n')
+		fputc('\n', Out);
+
+	if(fflush(Out) != 0 || (ReplyLength = getline(&Line, &Capacity, In)) <= 0)
+	{
+		fprintf(stderr, "tga2gebmp_client: the server hung up\n");
+		free(Line);
+		*pConnected = 0;
+		return 0;
+	}
+
+	fputs(Line, stdout);
+	if(Line[ReplyLength - 1] != '\n')
+		fputc('\n', stdout);
+
+	Reply = Json_Parse(Line, (size_t)ReplyLength);
+	Ok = Json_Find(Reply, "ok");
+	Result = Ok && Ok->Type == JSON_TRUE;
+
+	Json_Free(&Reply);
+	free(Line);
+	return Result;
+}
+
+
+int main(int argc, char **argv)
+{
+	char SocketPath[_MAX_PATH];
+	FILE *In, *Out;
+	int Connected = 1;
+	int Failed = 0;
+	int Fd, OutFd;
+	int i;
+
+	strcpy(SocketPath, CLIENT_SOCKET);
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(strcmp(argv[i], "-socket") == 0 && i + 1 < argc)
+		{
+			strncpy(SocketPath, argv[++i], sizeof(SocketPath) - 1);
+			SocketPath[sizeof(SocketPath) - 1] = '\0';
+		}
+		else
+		{
+			Client_Usage();
+			return 2;
+		}
+	}
+
+	Fd = Client_Connect(SocketPath);
+	if(Fd < 0)
+	{
+		fprintf(stderr, "tga2gebmp_client: cannot connect to '%s'\n", SocketPath);
+		return 1;
+	}
+
+	OutFd = dup(Fd);
+	In = fdopen(Fd, "r");
+	Out = OutFd >= 0 ? fdopen(OutFd, "w") : NULL;
+	if(!In || !Out)
+	{
+		fprintf(stderr, "tga2gebmp_client: out of memory\n");
+		return 1;
+	}
+
+	if(i == argc)
+	{
+		char *Line = NULL;
+		size_t Capacity = 0;
+		ssize_t Length;
+
+		while(Connected && (Length = getline(&Line, &Capacity, stdin)) >= 0)
+		{
+			if(Length > 0 && Line[0] != '\n')
+				Failed |= !Client_Send(Out, In, Line, (size_t)Length, &Connected);
+		}
+		free(Line);
+	}
+
+	while(Connected && i < argc)
+	{
+		if(argv[i][0] == '{')
+		{
+			Failed |= !Client_Send(Out, In, argv[i], strlen(argv[i]), &Connected);
+			i++;
+		}
+		else
+		{
+			char *Request = NULL;
+			size_t Size = 0;
+			FILE *Buffer;
+			int Count;
+			int Written;
+
+			// the op's fields run up to the next argument without '='
+			for(Count = 0; i + 1 + Count < argc && strchr(argv[i + 1 + Count], '='); Count++)
+				;
+
+			Buffer = open_memstream(&Request, &Size);
+			if(!Buffer)
+				return 1;
+			Written = Client_WriteRequest(Buffer, argv[i], argv + i + 1, Count);
+			if(!Written)
+			{
+				fclose(Buffer);
+				free(Request);
+				Client_Usage();
+				return 2;
+			}
+			fclose(Buffer);
+
+			if(Written < 0)
+				Failed = 1;
+			else
+				Failed |= !Client_Send(Out, In, Request, Size, &Connected);
+			free(Request);
+			i += 1 + Count;
+		}
+	}
+
+	fclose(In);
+	fclose(Out);
+	return Failed || !Connected ? 1 : 0;
+}
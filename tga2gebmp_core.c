@@ -0,0 +1,1468 @@
+/**
+ * @file tga2gebmp_core.c
+ *
+ * Open/replace/save logic shared by the dialog and the command-line driver.
+ *
+ * The actor itself is an ActFile (actfile.h): opening only reads its
+ * directories, skins are views into the mapped file until they are
+ * replaced, and saving splices everything unchanged in a single sequential
+ * pass. What this file adds is turning images into encoded geBitmap files.
+ *
+ * The engine is not thread-safe: geRam tracks allocations in globals and
+ * the bitmap and file code fill tables on first use. Every engine call here
+ * holds the engine lock, which is let go while the portable passes (tgaread,
+ * mipgen, quantize, pack16) work on a locked bitmap's bits, so images still
+ * convert in parallel on a session's pool.
+ */
+#ifdef _WIN32
+	#ifndef _WIN32_WINNT
+		#define _WIN32_WINNT	0x0600		/* slim reader/writer locks */
+	#endif
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+#include <stdio.h>
+#include "tga2gebmp_core.h"
+#include "actfile.h"
+#include "copypipe.h"
+#include "fasthash.h"
+#include "tgaread.h"
+#include "trace.h"
+#include "ram.h"
+
+
+struct tga2gebmp_Session
+{
+	geVFile		*FSystem;
+	char		WorkDir[_MAX_PATH];
+	ActFile		*Act;				// NULL while no actor is open
+	tga2gebmp_SaveStats SaveStats;
+	ThreadPool_Gate *IoGate;		// shared with other sessions, may be NULL
+	ThreadPool	*Pool;				// for converting several skins at once, may be NULL
+	ConvCache	*Cache;				// encoded images by source content, may be NULL
+	IoQueue		*Queue;				// for the copies of saves, may be NULL
+	tga2gebmp_EncodeParams Params;
+};
+
+// everything besides the source bytes that decides what an image encodes
+// to; change it whenever the encoder's output changes, or cached entries
+// from older builds would be handed out
+static const char tga2gebmp_EncoderVersion[] = "tga2gebmp encoder 1";
+
+// the most levels a geBitmap holds
+#define TGA2GEBMP_MAX_MIPS		8
+
+// what converting a TGA takes per pixel of the image, roughly: 4 for the
+// bitmap, a third more for its mips and the working copies the palette and
+// 16-bit stages make
+#define TGA2GEBMP_BYTES_PER_PIXEL	16
+
+// statically initialised, so it exists before any thread can ask for it
+#ifdef _WIN32
+static SRWLOCK tga2gebmp_EngineLock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t tga2gebmp_EngineLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+void tga2gebmp_EnterEngine(void)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive(&tga2gebmp_EngineLock);
+#else
+	pthread_mutex_lock(&tga2gebmp_EngineLock);
+#endif
+}
+
+
+void tga2gebmp_LeaveEngine(void)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(&tga2gebmp_EngineLock);
+#else
+	pthread_mutex_unlock(&tga2gebmp_EngineLock);
+#endif
+}
+
+
+void *tga2gebmp_RamAllocate(size_t Size)
+{
+	void *Data;
+
+	tga2gebmp_EnterEngine();
+	Data = geRam_Allocate(Size);
+	tga2gebmp_LeaveEngine();
+
+	return Data;
+}
+
+
+void *tga2gebmp_RamRealloc(void *Data, size_t Size)
+{
+	tga2gebmp_EnterEngine();
+	Data = geRam_Realloc(Data, Size);
+	tga2gebmp_LeaveEngine();
+
+	return Data;
+}
+
+
+void tga2gebmp_RamFree(void *Data)
+{
+	tga2gebmp_EnterEngine();
+	geRam_Free(Data);
+	tga2gebmp_LeaveEngine();
+}
+
+
+static geBoolean tga2gebmp_IsAbsolutePath(const char *Path)
+{
+	if(Path[0] == '/' || Path[0] == '\\')
+		return GE_TRUE;
+
+	return (Path[0] != '\0' && Path[1] == ':') ? GE_TRUE : GE_FALSE;
+}
+
+
+// the helpers that are handed geBitmaps or geVFiles are called with the
+// engine lock held
+static geVFile *tga2gebmp_OpenMemoryFile(const void *Data, long Size)
+{
+	geVFile_MemoryContext Context;
+
+	Context.Data = (void*)Data;
+	Context.DataLength = Size;
+
+	return geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_MEMORY, NULL, &Context, GE_VFILE_OPEN_READONLY);
+}
+
+
+// take a copy of what has been written to a memory file; the file owns its buffer
+static geBoolean tga2gebmp_CopyMemoryFile(geVFile *MemFile, void **pData, long *pSize)
+{
+	geVFile_MemoryContext Context;
+	void *Data;
+
+	if(!geVFile_UpdateContext(MemFile, &Context, sizeof(Context)))
+		return GE_FALSE;
+
+	Data = geRam_Allocate(Context.DataLength > 0 ? Context.DataLength : 1);
+	if(!Data)
+		return GE_FALSE;
+
+	memcpy(Data, Context.Data, Context.DataLength);
+
+	*pData = Data;
+	*pSize = Context.DataLength;
+	return GE_TRUE;
+}
+
+
+static geBoolean tga2gebmp_EncodeBitmap(const geBitmap *Bitmap, void **pData, long *pSize)
+{
+	geVFile_MemoryContext Context;
+	geVFile *MemFile;
+	geBoolean Result = GE_FALSE;
+	TRACE_SPAN(Span)
+
+	Context.Data = NULL;
+	Context.DataLength = 0;
+
+	TRACE_BEGIN(Span, TRACE_ENCODE);
+
+	MemFile = geVFile_OpenNewSystem(NULL, GE_VFILE_TYPE_MEMORY, NULL, &Context, GE_VFILE_OPEN_CREATE);
+	if(MemFile)
+	{
+		if(geBitmap_WriteToFile(Bitmap, MemFile))
+			Result = tga2gebmp_CopyMemoryFile(MemFile, pData, pSize);
+
+		geVFile_Close(MemFile);
+	}
+
+	TRACE_END(Span, 1, Result ? *pSize : 0);
+	return Result;
+}
+
+
+void tga2gebmp_EncodeParams_SetDefaults(tga2gebmp_EncodeParams *Params)
+{
+	memset(Params, 0, sizeof(*Params));
+	Params->MipCount = TGA2GEBMP_MIPS_MATCH;
+	Params->MipFilter = MIPGEN_FILTER_KAISER;
+	Params->Format = TGA2GEBMP_FORMAT_MATCH;
+	Params->Palette = TGA2GEBMP_PALETTE_NONE;
+	Params->Dither = TGA2GEBMP_DITHER_NONE;
+	Params->PaletteKey = -1;
+}
+
+
+tga2gebmp_Session *tga2gebmp_Session_Create(const char *WorkDir)
+{
+	tga2gebmp_Session *Session;
+
+	tga2gebmp_EnterEngine();
+
+	Session = GE_RAM_ALLOCATE_STRUCT(tga2gebmp_Session);
+	if(Session)
+	{
+		memset(Session, 0, sizeof(*Session));
+		strncpy(Session->WorkDir, WorkDir, sizeof(Session->WorkDir) - 1);
+		tga2gebmp_EncodeParams_SetDefaults(&Session->Params);
+
+		Session->FSystem = geVFile_OpenNewSystem(NULL,
+										GE_VFILE_TYPE_DOS,
+										Session->WorkDir,
+										NULL,
+										GE_VFILE_OPEN_READONLY | GE_VFILE_OPEN_DIRECTORY);
+		if(!Session->FSystem)
+		{
+			geRam_Free(Session);
+			Session = NULL;
+		}
+	}
+
+	tga2gebmp_LeaveEngine();
+	return Session;
+}
+
+
+void tga2gebmp_Session_Destroy(tga2gebmp_Session **pSession)
+{
+	tga2gebmp_Session *Session = *pSession;
+
+	if(!Session)
+		return;
+
+	// closing frees replaced skins, which takes the lock itself
+	tga2gebmp_Session_CloseAct(Session);
+
+	tga2gebmp_EnterEngine();
+	geVFile_Close(Session->FSystem);
+	geRam_Free(Session);
+	tga2gebmp_LeaveEngine();
+
+	*pSession = NULL;
+}
+
+
+geVFile *tga2gebmp_Session_GetFileSystem(const tga2gebmp_Session *Session)
+{
+	return Session->FSystem;
+}
+
+
+const char *tga2gebmp_Session_GetActFileName(const tga2gebmp_Session *Session)
+{
+	return Session->Act ? ActFile_GetFileName(Session->Act) : "";
+}
+
+
+int tga2gebmp_Session_GetSkinCount(const tga2gebmp_Session *Session)
+{
+	return Session->Act ? ActFile_GetSkinCount(Session->Act) : 0;
+}
+
+
+const char *tga2gebmp_Session_GetSkinName(const tga2gebmp_Session *Session, int Index)
+{
+	return Session->Act ? ActFile_GetSkinName(Session->Act, Index) : NULL;
+}
+
+
+int tga2gebmp_Session_FindSkin(const tga2gebmp_Session *Session, const char *SkinName)
+{
+	return Session->Act ? ActFile_FindSkin(Session->Act, SkinName) : -1;
+}
+
+
+int tga2gebmp_Session_GetDirtyCount(const tga2gebmp_Session *Session)
+{
+	return Session->Act ? ActFile_GetDirtyCount(Session->Act) : 0;
+}
+
+
+void tga2gebmp_Session_GetSaveStats(const tga2gebmp_Session *Session, tga2gebmp_SaveStats *Stats)
+{
+	*Stats = Session->SaveStats;
+}
+
+
+void tga2gebmp_Session_SetIoGate(tga2gebmp_Session *Session, ThreadPool_Gate *IoGate)
+{
+	Session->IoGate = IoGate;
+}
+
+
+void tga2gebmp_Session_SetThreadPool(tga2gebmp_Session *Session, ThreadPool *Pool)
+{
+	Session->Pool = Pool;
+}
+
+
+void tga2gebmp_Session_SetConvCache(tga2gebmp_Session *Session, ConvCache *Cache)
+{
+	Session->Cache = Cache;
+}
+
+
+void tga2gebmp_Session_SetIoQueue(tga2gebmp_Session *Session, IoQueue *Queue)
+{
+	Session->Queue = Queue;
+	if(Session->Act)
+		ActFile_SetIoQueue(Session->Act, Queue);
+}
+
+
+void tga2gebmp_Session_SetEncodeParams(tga2gebmp_Session *Session, const tga2gebmp_EncodeParams *Params)
+{
+	Session->Params = *Params;
+}
+
+
+static void tga2gebmp_Session_BeginIo(tga2gebmp_Session *Session)
+{
+	if(Session->IoGate)
+		ThreadPool_EnterGate(Session->IoGate);
+}
+
+
+static void tga2gebmp_Session_EndIo(tga2gebmp_Session *Session)
+{
+	if(Session->IoGate)
+		ThreadPool_LeaveGate(Session->IoGate);
+}
+
+
+void tga2gebmp_Session_CloseAct(tga2gebmp_Session *Session)
+{
+	ActFile_Close(&Session->Act);
+}
+
+
+geBoolean tga2gebmp_Session_OpenAct(tga2gebmp_Session *Session, const char *ActFileName)
+{
+	tga2gebmp_Session_CloseAct(Session);
+
+	tga2gebmp_Session_BeginIo(Session);
+	Session->Act = ActFile_Open(ActFileName);
+	tga2gebmp_Session_EndIo(Session);
+
+	if(Session->Act && Session->Queue)
+		ActFile_SetIoQueue(Session->Act, Session->Queue);
+
+	return Session->Act ? GE_TRUE : GE_FALSE;
+}
+
+
+static geBitmap *tga2gebmp_DecodeBitmap(const void *Data, long Size)
+{
+	geVFile *MemFile;
+	geBitmap *Bitmap = NULL;
+	TRACE_SPAN(Span)
+
+	TRACE_BEGIN(Span, TRACE_DECODE);
+
+	MemFile = tga2gebmp_OpenMemoryFile(Data, Size);
+	if(MemFile)
+	{
+		Bitmap = geBitmap_CreateFromFile(MemFile);
+		geVFile_Close(MemFile);
+	}
+
+	TRACE_END(Span, 1, Bitmap ? Size : 0);
+	return Bitmap;
+}
+
+
+geBitmap *tga2gebmp_CreateBitmapFromData(const void *Data, long Size)
+{
+	geBitmap *Bitmap;
+
+	tga2gebmp_EnterEngine();
+	Bitmap = tga2gebmp_DecodeBitmap(Data, Size);
+	tga2gebmp_LeaveEngine();
+
+	return Bitmap;
+}
+
+
+geBitmap *tga2gebmp_Session_LoadSkin(tga2gebmp_Session *Session, const char *SkinName)
+{
+	const void *Data;
+	size_t Size;
+	int Index;
+
+	Index = tga2gebmp_Session_FindSkin(Session, SkinName);
+	if(Index < 0)
+		return NULL;
+
+	Data = ActFile_GetSkinData(Session->Act, Index, &Size);
+
+	return tga2gebmp_CreateBitmapFromData(Data, (long)Size);
+}
+
+
+const void *tga2gebmp_Session_GetSkinData(tga2gebmp_Session *Session, int Index, long *pSize)
+{
+	const void *Data;
+	size_t Size;
+
+	Data = ActFile_GetSkinData(Session->Act, Index, &Size);
+	*pSize = (long)Size;
+	return Data;
+}
+
+
+uint64_t tga2gebmp_Session_GetSkinHash(tga2gebmp_Session *Session, int Index)
+{
+	return ActFile_GetSkinHash(Session->Act, Index);
+}
+
+
+static geBoolean tga2gebmp_IsTgaFileName(const char *FileName)
+{
+	size_t Length = strlen(FileName);
+
+	return (Length > 4 && tga2gebmp_stricmp(FileName + Length - 4, ".tga") == 0) ? GE_TRUE : GE_FALSE;
+}
+
+
+static geBoolean tga2gebmp_ReadFile(const char *FileName, void **pData, long *pSize)
+{
+	FILE			*File;
+	void			*Data = NULL;
+	long			Size = 0;
+	TRACE_SPAN(Span)
+
+	TRACE_BEGIN(Span, TRACE_READ);
+
+	File = fopen(FileName, "rb");
+	if(File)
+	{
+		if(fseek(File, 0, SEEK_END) == 0 && (Size = ftell(File)) > 0 && fseek(File, 0, SEEK_SET) == 0)
+		{
+			Data = tga2gebmp_RamAllocate(Size);
+			if(Data && fread(Data, 1, Size, File) != (size_t)Size)
+			{
+				tga2gebmp_RamFree(Data);
+				Data = NULL;
+			}
+		}
+		fclose(File);
+	}
+
+	// failed reads are timed too, with no bytes
+	TRACE_END(Span, 1, Data ? Size : 0);
+
+	if(!Data)
+		return GE_FALSE;
+	*pData = Data;
+	*pSize = Size;
+	return GE_TRUE;
+}
+
+
+static gePixelFormat tga2gebmp_GetTgaPixelFormat(const TgaRead_Info *Tga)
+{
+	switch(Tga->Format)
+	{
+		case TGAREAD_FORMAT_BGR24:	return GE_PIXELFORMAT_24BIT_BGR;
+		case TGAREAD_FORMAT_XRGB32:	return GE_PIXELFORMAT_32BIT_XRGB;
+		default:					return GE_PIXELFORMAT_32BIT_ARGB;
+	}
+}
+
+
+// decode a TGA straight into the bits of a new geBitmap, NULL if it is a
+// kind of TGA tgaread does not handle
+// takes the engine lock itself and lets it go while the pixels are decoded
+static geBitmap *tga2gebmp_CreateBitmapFromTga(const void *Data, long Size)
+{
+	TgaRead_Info	Tga;
+	geBitmap_Info	Info;
+	gePixelFormat	Format;
+	geBitmap		*Bitmap = NULL;
+	geBitmap		*Lock;
+
+	if(!TgaRead_GetInfo(Data, Size, &Tga))
+		return NULL;
+
+	Format = tga2gebmp_GetTgaPixelFormat(&Tga);
+
+	tga2gebmp_EnterEngine();
+	Bitmap = geBitmap_Create(Tga.Width, Tga.Height, 1, Format);
+	if(Bitmap && geBitmap_LockForWriteFormat(Bitmap, &Lock, 0, 0, Format))
+	{
+		void *Bits = geBitmap_GetBits(Lock);
+		geBoolean Decoded = GE_FALSE;
+
+		// Stride is in pixels
+		if(Bits && geBitmap_GetInfo(Lock, &Info, NULL))
+		{
+			tga2gebmp_LeaveEngine();
+			Decoded = TgaRead_Decode(Data, Size, &Tga, Bits, (ptrdiff_t)Info.Stride * Tga.BytesPerPixel) ? GE_TRUE : GE_FALSE;
+			tga2gebmp_EnterEngine();
+		}
+
+		geBitmap_UnLock(Lock);
+
+		if(!Decoded)
+			geBitmap_Destroy(&Bitmap);
+	}
+	else if(Bitmap)
+	{
+		geBitmap_Destroy(&Bitmap);
+	}
+	tga2gebmp_LeaveEngine();
+
+	return Bitmap;
+}
+
+
+// the smallest power-of-two reduction of an open TGA that the encode
+// parameters allow, decoded from the file into a new geBitmap; locks like
+// CreateBitmapFromTga
+static geBitmap *tga2gebmp_CreateBitmapFromTgaFile(TgaRead_File *File, const TgaRead_Info *Tga,
+												   const tga2gebmp_EncodeParams *Params)
+{
+	geBitmap_Info	Info;
+	gePixelFormat	Format = tga2gebmp_GetTgaPixelFormat(Tga);
+	geBitmap		*Bitmap;
+	geBitmap		*Lock;
+	uint64_t		MaxPixels = 0;
+	int				Factor;
+	TRACE_SPAN(Span)
+
+	// a megabyte for the reader, the rest for the bitmap and the copies
+	// the later stages make of it
+	if(Params->MemLimit > 0)
+		MaxPixels = TGA2GEBMP_MAX(((uint64_t)Params->MemLimit - 1) << 20, (uint64_t)1 << 20) / TGA2GEBMP_BYTES_PER_PIXEL;
+
+	Factor = TgaRead_GetReduction(Tga->Width, Tga->Height, Params->MaxSize, MaxPixels);
+
+	TRACE_BEGIN(Span, TRACE_DECODE);
+
+	tga2gebmp_EnterEngine();
+	Bitmap = geBitmap_Create((Tga->Width + Factor - 1) / Factor, (Tga->Height + Factor - 1) / Factor, 1, Format);
+	if(Bitmap && geBitmap_LockForWriteFormat(Bitmap, &Lock, 0, 0, Format))
+	{
+		void *Bits = geBitmap_GetBits(Lock);
+		geBoolean Decoded = GE_FALSE;
+
+		if(Bits && geBitmap_GetInfo(Lock, &Info, NULL))
+		{
+			tga2gebmp_LeaveEngine();
+			Decoded = TgaRead_DecodeFile(File, Factor, Bits, (ptrdiff_t)Info.Stride * Tga->BytesPerPixel) ? GE_TRUE : GE_FALSE;
+			tga2gebmp_EnterEngine();
+		}
+
+		geBitmap_UnLock(Lock);
+
+		if(!Decoded)
+			geBitmap_Destroy(&Bitmap);
+	}
+	else if(Bitmap)
+	{
+		geBitmap_Destroy(&Bitmap);
+	}
+	tga2gebmp_LeaveEngine();
+
+	TRACE_END(Span, 1, (uint64_t)Tga->Width * Tga->Height * Tga->BytesPerPixel);
+	return Bitmap;
+}
+
+
+// Data is the file's contents if they have been read already, or NULL
+static geBitmap *tga2gebmp_CreateBitmapFromFileName(const char *FileName, const void *Data, long Size)
+{
+	geBitmap *Bitmap = NULL;
+	TRACE_SPAN(Span)
+
+	TRACE_BEGIN(Span, TRACE_DECODE);
+
+	if(Data && tga2gebmp_IsTgaFileName(FileName))
+		Bitmap = tga2gebmp_CreateBitmapFromTga(Data, Size);
+
+	// everything else, and TGAs tgaread turns down, goes to the engine's loader
+	if(!Bitmap)
+	{
+		tga2gebmp_EnterEngine();
+		Bitmap = geBitmap_CreateFromFileName(NULL, FileName);
+		tga2gebmp_LeaveEngine();
+	}
+
+	TRACE_END(Span, 1, Data ? Size : 0);
+	return Bitmap;
+}
+
+
+// the pack16.c layout of a 16-bit format, FALSE for anything else
+static geBoolean tga2gebmp_GetPack16Layout(int Format, Pack16_Params *Params)
+{
+	Params->SwapRB = 0;
+
+	switch(Format)
+	{
+		case GE_PIXELFORMAT_16BIT_565_BGR:
+			Params->SwapRB = 1;
+			// fall through
+		case GE_PIXELFORMAT_16BIT_565_RGB:
+			Params->Layout = PACK16_565;
+			return GE_TRUE;
+
+		case GE_PIXELFORMAT_16BIT_555_BGR:
+			Params->SwapRB = 1;
+			// fall through
+		case GE_PIXELFORMAT_16BIT_555_RGB:
+			Params->Layout = PACK16_555;
+			return GE_TRUE;
+
+		case GE_PIXELFORMAT_16BIT_1555_ARGB:
+			Params->Layout = PACK16_1555;
+			return GE_TRUE;
+
+		case GE_PIXELFORMAT_16BIT_4444_ARGB:
+			Params->Layout = PACK16_4444;
+			return GE_TRUE;
+
+		default:
+			return GE_FALSE;
+	}
+}
+
+
+// fills in what Params takes from an encoded skin: its level count (0 if it
+// cannot be decoded), its format and its palette (a new one if it has none).
+// Called with the engine lock held
+static void tga2gebmp_MatchSkin(const void *Data, long Size, tga2gebmp_EncodeParams *Params)
+{
+	geBitmap			*Bitmap;
+	geBitmap_Info		Info, PaletteInfo;
+	geBitmap_Palette	*Palette;
+	Pack16_Params		Layout;
+	geBoolean			HasPalette = GE_FALSE;
+
+	Bitmap = Data ? tga2gebmp_DecodeBitmap(Data, Size) : NULL;
+	if(!Bitmap || !geBitmap_GetInfo(Bitmap, &Info, NULL))
+	{
+		if(Bitmap)
+			geBitmap_Destroy(&Bitmap);
+		Info.MaximumMip = -1;
+		Info.Format = GE_PIXELFORMAT_NO_DATA;
+	}
+
+	if(Params->MipCount == TGA2GEBMP_MIPS_MATCH)
+		Params->MipCount = Info.MaximumMip + 1;
+
+	// palettized skins stay palettized and 16-bit ones keep their layout
+	if(Params->Format == TGA2GEBMP_FORMAT_MATCH)
+	{
+		Params->Format = TGA2GEBMP_FORMAT_KEEP;
+		if(gePixelFormat_HasPalette(Info.Format) && Params->Palette == TGA2GEBMP_PALETTE_NONE)
+			Params->Palette = TGA2GEBMP_PALETTE_ORIGINAL;
+		else if(tga2gebmp_GetPack16Layout(Info.Format, &Layout))
+			Params->Format = Info.Format;
+	}
+
+	if(Params->Palette == TGA2GEBMP_PALETTE_ORIGINAL && Bitmap && gePixelFormat_HasPalette(Info.Format))
+	{
+		Palette = geBitmap_GetPalette(Bitmap);
+		if(Palette && geBitmap_Palette_GetInfo(Palette, &PaletteInfo))
+		{
+			Params->PaletteColours = TGA2GEBMP_MIN(PaletteInfo.Width, QUANTIZE_MAX_COLOURS);
+			Params->PaletteKey = Info.HasColorKey && (int)Info.ColorKey < Params->PaletteColours ? (int)Info.ColorKey : -1;
+			HasPalette = Params->PaletteColours > 0 &&
+				geBitmap_Palette_GetData(Palette, Params->PaletteData, GE_PIXELFORMAT_32BIT_XRGB, Params->PaletteColours);
+		}
+	}
+
+	if(Params->Palette == TGA2GEBMP_PALETTE_ORIGINAL && !HasPalette)
+	{
+		Params->Palette = TGA2GEBMP_PALETTE_NEW;
+		Params->PaletteColours = 0;
+		Params->PaletteKey = -1;
+		memset(Params->PaletteData, 0, sizeof(Params->PaletteData));
+	}
+
+	if(Bitmap)
+		geBitmap_Destroy(&Bitmap);
+}
+
+
+void tga2gebmp_Session_GetSkinEncodeParams(const tga2gebmp_Session *Session, int Index, tga2gebmp_EncodeParams *Params)
+{
+	const void *Stored;
+	size_t Size = 0;
+
+	*Params = Session->Params;
+
+	if(Params->MipCount == TGA2GEBMP_MIPS_MATCH || Params->Format == TGA2GEBMP_FORMAT_MATCH ||
+	   Params->Palette == TGA2GEBMP_PALETTE_ORIGINAL)
+	{
+		Stored = ActFile_GetStoredSkinData(Session->Act, Index, &Size);
+
+		tga2gebmp_EnterEngine();
+		tga2gebmp_MatchSkin(Stored, (long)Size, Params);
+		tga2gebmp_LeaveEngine();
+	}
+}
+
+
+// gives *pBitmap Params->MipCount levels made by mipgen.c, in 24-bit BGR or
+// 32-bit ARGB; bitmaps that already have that many levels are left alone.
+// Called with the engine lock held, as are Palettize and Pack16, which let it
+// go while the portable code fills locked levels
+static geBoolean tga2gebmp_BuildMips(geBitmap **pBitmap, const tga2gebmp_EncodeParams *Params, ThreadPool *Pool)
+{
+	geBitmap		*Bitmap = *pBitmap;
+	geBitmap		*Mipped;
+	geBitmap		*Lock;
+	geBitmap		*Locks[TGA2GEBMP_MAX_MIPS];
+	geBitmap_Info	Info, LockInfo;
+	gePixelFormat	Format;
+	MipGen_Params	MipParams;
+	MipGen_Image	Source, Top, Levels[TGA2GEBMP_MAX_MIPS - 1];
+	geBoolean		Result = GE_TRUE;
+	int				Count, Bpp, i, y;
+
+	if(Params->MipCount <= 0)
+		return GE_TRUE;
+
+	if(!geBitmap_GetInfo(Bitmap, &Info, NULL))
+		return GE_FALSE;
+
+	Count = TGA2GEBMP_MIN(TGA2GEBMP_MIN(Params->MipCount, TGA2GEBMP_MAX_MIPS), MipGen_GetMaxLevels(Info.Width, Info.Height));
+	if(Count == Info.MaximumMip + 1)
+		return GE_TRUE;
+
+	// colour keys become alpha, everything else without alpha 24-bit
+	if(gePixelFormat_HasAlpha(Info.Format) || Info.HasColorKey)
+		Format = GE_PIXELFORMAT_32BIT_ARGB;
+	else
+		Format = GE_PIXELFORMAT_24BIT_BGR;
+	Bpp = gePixelFormat_BytesPerPel(Format);
+
+	if(!geBitmap_LockForRead(Bitmap, &Lock, 0, 0, Format, Info.HasColorKey, 0))
+		return GE_FALSE;
+
+	Mipped = geBitmap_Create(Info.Width, Info.Height, Count, Format);
+	if(!Mipped || !geBitmap_LockForWriteFormat(Mipped, Locks, 0, Count - 1, Format))
+	{
+		if(Mipped)
+			geBitmap_Destroy(&Mipped);
+		geBitmap_UnLock(Lock);
+		return GE_FALSE;
+	}
+
+	// strides are in pixels
+	geBitmap_GetInfo(Lock, &LockInfo, NULL);
+	Source.Width = Info.Width;
+	Source.Height = Info.Height;
+	Source.BytesPerPixel = Bpp;
+	Source.Stride = (ptrdiff_t)LockInfo.Stride * Bpp;
+	Source.Pixels = geBitmap_GetBits(Lock);
+
+	for(i = 0; i < Count; i++)
+	{
+		MipGen_Image *Level = i ? &Levels[i - 1] : &Top;
+
+		Level->Pixels = geBitmap_GetBits(Locks[i]);
+		if(!Level->Pixels || !geBitmap_GetInfo(Locks[i], &LockInfo, NULL))
+		{
+			Result = GE_FALSE;
+			break;
+		}
+
+		Level->Width = LockInfo.Width;
+		Level->Height = LockInfo.Height;
+		Level->BytesPerPixel = Bpp;
+		Level->Stride = (ptrdiff_t)LockInfo.Stride * Bpp;
+	}
+
+	if(Result && Source.Pixels)
+	{
+		tga2gebmp_LeaveEngine();
+
+		// the full-size level is a straight copy
+		for(y = 0; y < Info.Height; y++)
+			memcpy((uint8_t*)Top.Pixels + y * Top.Stride, (const uint8_t*)Source.Pixels + y * Source.Stride, (size_t)Info.Width * Bpp);
+
+		// cut-outs keep as many pixels past the alpha test on every level
+		MipGen_SetDefaults(&MipParams);
+		MipParams.Filter = Params->MipFilter;
+		MipParams.AlphaCoverage = MipGen_IsCutout(&Source);
+
+		Result = MipGen_Build(&MipParams, &Source, Levels, Count - 1, Pool) ? GE_TRUE : GE_FALSE;
+
+		tga2gebmp_EnterEngine();
+	}
+	else
+	{
+		Result = GE_FALSE;
+	}
+
+	geBitmap_UnLockArray(Locks, Count);
+	geBitmap_UnLock(Lock);
+
+	if(!Result)
+	{
+		geBitmap_Destroy(&Mipped);
+		return GE_FALSE;
+	}
+
+	geBitmap_Destroy(pBitmap);
+	*pBitmap = Mipped;
+	return GE_TRUE;
+}
+
+
+// reduces *pBitmap and its mips to 8 bits, with the replaced skin's palette
+// or one quantize.c makes for the full-size level; transparent pixels go to
+// a colour-key entry. Bitmaps that already have a palette only change to
+// match the replaced skin's
+static geBoolean tga2gebmp_Palettize(geBitmap **pBitmap, const tga2gebmp_EncodeParams *Params, ThreadPool *Pool)
+{
+	geBitmap			*Bitmap = *pBitmap;
+	geBitmap			*Palettized = NULL;
+	geBitmap			*Locks[TGA2GEBMP_MAX_MIPS];
+	geBitmap			*Outs[TGA2GEBMP_MAX_MIPS];
+	geBitmap_Info		Info, LockInfo;
+	geBitmap_Palette	*Palette = NULL;
+	Quantize_Mapper		*Mapper = NULL;
+	Quantize_Image		Images[TGA2GEBMP_MAX_MIPS];
+	uint8_t				*Indices[TGA2GEBMP_MAX_MIPS];
+	ptrdiff_t			IndexStrides[TGA2GEBMP_MAX_MIPS];
+	uint8_t				PaletteData[QUANTIZE_MAX_COLOURS * 4];
+	geBoolean			Original, Locked = GE_FALSE;
+	geBoolean			Result = GE_TRUE;
+	int					Colours = 0, Key = -1, Count, i;
+
+	if(Params->Palette == TGA2GEBMP_PALETTE_NONE)
+		return GE_TRUE;
+
+	if(!geBitmap_GetInfo(Bitmap, &Info, NULL))
+		return GE_FALSE;
+
+	Original = Params->Palette == TGA2GEBMP_PALETTE_ORIGINAL && Params->PaletteColours > 0;
+	if(gePixelFormat_HasPalette(Info.Format) && !Original)
+		return GE_TRUE;
+
+	Count = TGA2GEBMP_MIN(Info.MaximumMip + 1, TGA2GEBMP_MAX_MIPS);
+
+	// colour keys become alpha
+	if(!geBitmap_LockForRead(Bitmap, Locks, 0, Count - 1, GE_PIXELFORMAT_32BIT_ARGB, Info.HasColorKey, 0))
+		return GE_FALSE;
+
+	// strides are in pixels
+	for(i = 0; i < Count; i++)
+	{
+		Images[i].Pixels = geBitmap_GetBits(Locks[i]);
+		if(!Images[i].Pixels || !geBitmap_GetInfo(Locks[i], &LockInfo, NULL))
+		{
+			Result = GE_FALSE;
+			break;
+		}
+
+		Images[i].Width = LockInfo.Width;
+		Images[i].Height = LockInfo.Height;
+		Images[i].BytesPerPixel = 4;
+		Images[i].Stride = (ptrdiff_t)LockInfo.Stride * 4;
+	}
+
+	tga2gebmp_LeaveEngine();
+
+	memset(PaletteData, 0, sizeof(PaletteData));
+	if(Result && Original)
+	{
+		memcpy(PaletteData, Params->PaletteData, sizeof(PaletteData));
+		Colours = Params->PaletteColours;
+		Key = Params->PaletteKey;
+	}
+	else if(Result)
+	{
+		// the key is the last entry, black
+		if(Quantize_HasTransparency(&Images[0]))
+			Key = QUANTIZE_MAX_COLOURS - 1;
+
+		Result = Quantize_MakePalette(&Images[0], Key < 0 ? QUANTIZE_MAX_COLOURS : Key, PaletteData, &Colours);
+		if(Key >= 0)
+			Key = Colours++;
+	}
+
+	if(Result)
+		Mapper = Quantize_CreateMapper(PaletteData, Colours, Key, Pool);
+
+	tga2gebmp_EnterEngine();
+
+	if(Result)
+	{
+		Palettized = geBitmap_Create(Info.Width, Info.Height, Count, GE_PIXELFORMAT_8BIT);
+		Palette = geBitmap_Palette_Create(GE_PIXELFORMAT_32BIT_XRGB, QUANTIZE_MAX_COLOURS);
+
+		Result = Mapper && Palettized && Palette &&
+			geBitmap_Palette_SetData(Palette, PaletteData, GE_PIXELFORMAT_32BIT_XRGB, QUANTIZE_MAX_COLOURS) &&
+			geBitmap_SetPalette(Palettized, Palette) &&
+			geBitmap_LockForWriteFormat(Palettized, Outs, 0, Count - 1, GE_PIXELFORMAT_8BIT);
+		Locked = Result;
+	}
+
+	for(i = 0; i < Count && Result; i++)
+	{
+		Indices[i] = (uint8_t*)geBitmap_GetBits(Outs[i]);
+		Result = Indices[i] && geBitmap_GetInfo(Outs[i], &LockInfo, NULL);
+		IndexStrides[i] = LockInfo.Stride;
+	}
+
+	tga2gebmp_LeaveEngine();
+	for(i = 0; i < Count && Result; i++)
+		Result = Quantize_Map(Mapper, &Images[i], Params->Dither != TGA2GEBMP_DITHER_NONE, Indices[i], IndexStrides[i], Pool);
+	tga2gebmp_EnterEngine();
+
+	if(Locked)
+		geBitmap_UnLockArray(Outs, Count);
+	geBitmap_UnLockArray(Locks, Count);
+
+	if(Result && Key >= 0)
+		Result = geBitmap_SetColorKey(Palettized, GE_TRUE, (uint32)Key, GE_FALSE);
+
+	if(Palette)
+		geBitmap_Palette_Destroy(&Palette);
+	Quantize_DestroyMapper(&Mapper);
+
+	if(!Result)
+	{
+		if(Palettized)
+			geBitmap_Destroy(&Palettized);
+		return GE_FALSE;
+	}
+
+	geBitmap_Destroy(pBitmap);
+	*pBitmap = Palettized;
+	return GE_TRUE;
+}
+
+
+// converts *pBitmap and its mips to Params->Format when that is a 16-bit
+// format; transparent pixels of formats without alpha become a colour key.
+// Nothing happens when the skin gets a palette
+static geBoolean tga2gebmp_Pack16(geBitmap **pBitmap, const tga2gebmp_EncodeParams *Params, ThreadPool *Pool)
+{
+	geBitmap			*Bitmap = *pBitmap;
+	geBitmap			*Packed;
+	geBitmap			*Locks[TGA2GEBMP_MAX_MIPS];
+	geBitmap			*Outs[TGA2GEBMP_MAX_MIPS];
+	geBitmap_Info		Info, LockInfo;
+	Pack16_Params		PackParams;
+	Pack16_Image		Images[TGA2GEBMP_MAX_MIPS];
+	uint16_t			*Dests[TGA2GEBMP_MAX_MIPS];
+	ptrdiff_t			DestStrides[TGA2GEBMP_MAX_MIPS];
+	geBoolean			Result = GE_TRUE;
+	int					Count, i;
+
+	if(Params->Palette != TGA2GEBMP_PALETTE_NONE || !tga2gebmp_GetPack16Layout(Params->Format, &PackParams))
+		return GE_TRUE;
+
+	if(!geBitmap_GetInfo(Bitmap, &Info, NULL))
+		return GE_FALSE;
+
+	if((int)Info.Format == Params->Format)
+		return GE_TRUE;
+
+	PackParams.Dither = Params->Dither;
+	PackParams.ColorKey = (gePixelFormat_HasAlpha(Info.Format) || Info.HasColorKey) && !Pack16_HasAlpha(PackParams.Layout);
+
+	Count = TGA2GEBMP_MIN(Info.MaximumMip + 1, TGA2GEBMP_MAX_MIPS);
+
+	// colour keys become alpha
+	if(!geBitmap_LockForRead(Bitmap, Locks, 0, Count - 1, GE_PIXELFORMAT_32BIT_ARGB, Info.HasColorKey, 0))
+		return GE_FALSE;
+
+	Packed = geBitmap_Create(Info.Width, Info.Height, Count, (gePixelFormat)Params->Format);
+	if(!Packed || !geBitmap_LockForWriteFormat(Packed, Outs, 0, Count - 1, (gePixelFormat)Params->Format))
+	{
+		if(Packed)
+			geBitmap_Destroy(&Packed);
+		geBitmap_UnLockArray(Locks, Count);
+		return GE_FALSE;
+	}
+
+	// strides are in pixels
+	for(i = 0; i < Count && Result; i++)
+	{
+		Dests[i] = (uint16_t*)geBitmap_GetBits(Outs[i]);
+		Images[i].Pixels = geBitmap_GetBits(Locks[i]);
+		if(!Dests[i] || !Images[i].Pixels || !geBitmap_GetInfo(Locks[i], &LockInfo, NULL))
+		{
+			Result = GE_FALSE;
+			break;
+		}
+
+		Images[i].Width = LockInfo.Width;
+		Images[i].Height = LockInfo.Height;
+		Images[i].Stride = (ptrdiff_t)LockInfo.Stride * 4;
+
+		Result = geBitmap_GetInfo(Outs[i], &LockInfo, NULL);
+		DestStrides[i] = (ptrdiff_t)LockInfo.Stride * 2;
+	}
+
+	tga2gebmp_LeaveEngine();
+	for(i = 0; i < Count && Result; i++)
+		Result = Pack16_Convert(&PackParams, &Images[i], Dests[i], DestStrides[i], Pool);
+	tga2gebmp_EnterEngine();
+
+	geBitmap_UnLockArray(Outs, Count);
+	geBitmap_UnLockArray(Locks, Count);
+
+	if(Result && PackParams.ColorKey)
+		Result = geBitmap_SetColorKey(Packed, GE_TRUE, PACK16_KEY, GE_FALSE);
+
+	if(!Result)
+	{
+		geBitmap_Destroy(&Packed);
+		return GE_FALSE;
+	}
+
+	geBitmap_Destroy(pBitmap);
+	*pBitmap = Packed;
+	return GE_TRUE;
+}
+
+
+// touches no session state but WorkDir and the conversion cache, so several
+// images can be converted at the same time
+geBoolean tga2gebmp_Session_EncodeImage(const tga2gebmp_Session *Session, const char *ImageFileName,
+										const tga2gebmp_EncodeParams *Params, void **pData, long *pSize)
+{
+	char		FullName[_MAX_PATH];
+	char		ParamsKey[160];
+	const char	*FileName = ImageFileName;
+	geBitmap	*bitmap;
+	geBoolean	Result;
+	void		*Source = NULL;
+	long		SourceSize = 0;
+	TgaRead_File *TgaFile = NULL;
+	TgaRead_Info Tga;
+	ConvCache_Key Key;
+	geBoolean	HaveKey = GE_FALSE;
+	size_t		CachedSize;
+	TRACE_SPAN(Span)
+
+	// relative names are resolved against the session's directory by path
+	// rather than through its file system, which is not shared between threads
+	if(!tga2gebmp_IsAbsolutePath(ImageFileName))
+	{
+		if((unsigned)snprintf(FullName, sizeof(FullName), "%s" TGA2GEBMP_DIRSEP "%s", Session->WorkDir, ImageFileName) >= sizeof(FullName))
+			return GE_FALSE;
+		FileName = FullName;
+	}
+
+	// limited TGAs are decoded from the file, never held in memory whole
+	if((Params->MaxSize > 0 || Params->MemLimit > 0) && tga2gebmp_IsTgaFileName(FileName))
+		TgaFile = TgaRead_OpenFile(FileName, 0, &Tga);
+
+	// otherwise the cache needs the bytes for its key, tgaread to decode them
+	if(!TgaFile && (Session->Cache || tga2gebmp_IsTgaFileName(FileName)))
+		tga2gebmp_ReadFile(FileName, &Source, &SourceSize);
+
+	if(Session->Cache && (Source || TgaFile))
+	{
+		size_t Length;
+
+		// the encoder version and every parameter that changes the output; a
+		// key that does not fit is not used, a cut one could match other output
+		Length = (size_t)snprintf(ParamsKey, sizeof(ParamsKey), "%s mips=%d filter=%d format=%d palette=%d dither=%d maxsize=%d memlimit=%d",
+								  tga2gebmp_EncoderVersion, Params->MipCount, Params->MipFilter, Params->Format, Params->Palette,
+								  Params->Dither, Params->MaxSize, Params->MemLimit);
+		if(Length < sizeof(ParamsKey) && Params->Palette == TGA2GEBMP_PALETTE_ORIGINAL && Params->PaletteColours > 0)
+		{
+			uint64_t PaletteHash = FastHash_64(Params->PaletteData, Params->PaletteColours * 4, 0);
+
+			if((unsigned)snprintf(ParamsKey + Length, sizeof(ParamsKey) - Length, " colours=%d key=%d %08lx%08lx",
+								  Params->PaletteColours, Params->PaletteKey,
+								  (unsigned long)(PaletteHash >> 32), (unsigned long)(PaletteHash & 0xffffffff)) >= sizeof(ParamsKey) - Length)
+				Length = sizeof(ParamsKey);
+		}
+		if(Length >= sizeof(ParamsKey))
+			HaveKey = GE_FALSE;
+		else if(TgaFile)
+			HaveKey = ConvCache_MakeFileKey(&Key, FileName, ParamsKey, strlen(ParamsKey)) ? GE_TRUE : GE_FALSE;
+		else
+		{
+			ConvCache_MakeKey(&Key, Source, (size_t)SourceSize, ParamsKey, strlen(ParamsKey));
+			HaveKey = GE_TRUE;
+		}
+
+		if(HaveKey && ConvCache_Load(Session->Cache, &Key, tga2gebmp_RamAllocate, tga2gebmp_RamFree, pData, &CachedSize))
+		{
+			if(Source)
+				tga2gebmp_RamFree(Source);
+			TgaRead_CloseFile(&TgaFile);
+			*pSize = (long)CachedSize;
+			return GE_TRUE;
+		}
+	}
+
+	if(TgaFile)
+	{
+		bitmap = tga2gebmp_CreateBitmapFromTgaFile(TgaFile, &Tga, Params);
+		TgaRead_CloseFile(&TgaFile);
+	}
+	else
+		bitmap = tga2gebmp_CreateBitmapFromFileName(FileName, Source, SourceSize);
+
+	if(!bitmap)
+	{
+		if(Source)
+			tga2gebmp_RamFree(Source);
+		return GE_FALSE;
+	}
+
+	tga2gebmp_EnterEngine();
+
+	TRACE_BEGIN(Span, TRACE_MIPS);
+	Result = tga2gebmp_BuildMips(&bitmap, Params, Session->Pool);
+	TRACE_END(Span, 1, 0);
+
+	if(Result)
+	{
+		TRACE_BEGIN(Span, TRACE_PALETTE);
+		Result = tga2gebmp_Palettize(&bitmap, Params, Session->Pool);
+		TRACE_END(Span, 1, 0);
+	}
+
+	if(Result)
+	{
+		TRACE_BEGIN(Span, TRACE_PACK16);
+		Result = tga2gebmp_Pack16(&bitmap, Params, Session->Pool);
+		TRACE_END(Span, 1, 0);
+	}
+
+	Result = Result && tga2gebmp_EncodeBitmap(bitmap, pData, pSize);
+	geBitmap_Destroy(&bitmap);
+
+	tga2gebmp_LeaveEngine();
+
+	if(Result && Session->Cache && HaveKey)
+		ConvCache_Store(Session->Cache, &Key, *pData, (size_t)*pSize);
+
+	if(Source)
+		tga2gebmp_RamFree(Source);
+
+	return Result;
+}
+
+
+// Data came from EncodeImage and now belongs to the actor
+static void tga2gebmp_Session_SetSkinData(tga2gebmp_Session *Session, int Index, void *Data, long Size)
+{
+	ActFile_SetSkinData(Session->Act, Index, Data, (size_t)Size, tga2gebmp_RamFree);
+}
+
+
+geBoolean tga2gebmp_Session_ReplaceSkin(tga2gebmp_Session *Session, const char *SkinName, const char *ImageFileName)
+{
+	tga2gebmp_EncodeParams Params;
+	void *Data;
+	long Size;
+	int Index;
+
+	Index = tga2gebmp_Session_FindSkin(Session, SkinName);
+	if(Index < 0)
+		return GE_FALSE;
+
+	tga2gebmp_Session_GetSkinEncodeParams(Session, Index, &Params);
+	if(!tga2gebmp_Session_EncodeImage(Session, ImageFileName, &Params, &Data, &Size))
+		return GE_FALSE;
+
+	tga2gebmp_Session_SetSkinData(Session, Index, Data, Size);
+
+	return GE_TRUE;
+}
+
+
+geBoolean tga2gebmp_Session_ReplaceSkinData(tga2gebmp_Session *Session, const char *SkinName, const void *Data, long Size)
+{
+	int Index;
+
+	Index = tga2gebmp_Session_FindSkin(Session, SkinName);
+	if(Index < 0)
+		return GE_FALSE;
+
+	return ActFile_PutSkinData(Session->Act, Index, Data, (size_t)Size) ? GE_TRUE : GE_FALSE;
+}
+
+
+typedef struct	tga2gebmp_EncodeJob
+{
+	const tga2gebmp_Session *Session;
+	const char	*ImageFileName;
+	int			Skin;
+	void		*Data;
+	long		Size;
+	geBoolean	Result;
+}	tga2gebmp_EncodeJob;
+
+
+static void tga2gebmp_Session_RunEncodeJob(void *Context, int Worker)
+{
+	tga2gebmp_EncodeJob *Job = (tga2gebmp_EncodeJob*)Context;
+	tga2gebmp_EncodeParams Params;
+
+	(void)Worker;
+
+	// looking at the skin being replaced decodes it, so that happens here too
+	tga2gebmp_Session_GetSkinEncodeParams(Job->Session, Job->Skin, &Params);
+	Job->Result = tga2gebmp_Session_EncodeImage(Job->Session, Job->ImageFileName, &Params, &Job->Data, &Job->Size);
+}
+
+
+geBoolean tga2gebmp_Session_ReplaceSkins(tga2gebmp_Session *Session, int Count,
+										 const char **SkinNames, const char **ImageFileNames, geBoolean *Results)
+{
+	tga2gebmp_EncodeJob *Jobs;
+	ThreadPool_Group *Group = NULL;
+	geBoolean	AllReplaced = GE_TRUE;
+	int			i;
+
+	if(Count <= 0)
+		return GE_TRUE;
+
+	Jobs = (tga2gebmp_EncodeJob*)tga2gebmp_RamAllocate(Count * sizeof(tga2gebmp_EncodeJob));
+	if(!Jobs)
+		return GE_FALSE;
+
+	memset(Jobs, 0, Count * sizeof(tga2gebmp_EncodeJob));
+
+	if(Session->Pool && Count > 1)
+		Group = ThreadPool_CreateGroup();
+
+	// decode and encode every image at once, each into its own buffer
+	for(i = 0; i < Count; i++)
+	{
+		tga2gebmp_EncodeJob *Job = &Jobs[i];
+
+		Job->Session = Session;
+		Job->ImageFileName = ImageFileNames[i];
+		Job->Skin = tga2gebmp_Session_FindSkin(Session, SkinNames[i]);
+		if(Job->Skin < 0)
+			continue;
+
+		if(!Group || !ThreadPool_Submit(Session->Pool, Group, tga2gebmp_Session_RunEncodeJob, Job))
+			tga2gebmp_Session_RunEncodeJob(Job, -1);
+	}
+
+	if(Group)
+	{
+		ThreadPool_Wait(Session->Pool, Group);
+		ThreadPool_DestroyGroup(&Group);
+	}
+
+	// then apply the results in argument order, exactly as one ReplaceSkin after another
+	for(i = 0; i < Count; i++)
+	{
+		if(Jobs[i].Result)
+			tga2gebmp_Session_SetSkinData(Session, Jobs[i].Skin, Jobs[i].Data, Jobs[i].Size);
+		else
+			AllReplaced = GE_FALSE;
+
+		if(Results)
+			Results[i] = Jobs[i].Result;
+	}
+
+	tga2gebmp_RamFree(Jobs);
+
+	return AllReplaced;
+}
+
+
+static size_t tga2gebmp_CopyBufferSize = COPYPIPE_DEFAULT_BUFFER;
+static int tga2gebmp_CopyDepth = COPYPIPE_DEFAULT_DEPTH;
+
+// kept between copies, so its buffers and reader thread are made once; taken
+// and put back under the engine lock, a copy that finds it taken makes its own
+static CopyPipe *tga2gebmp_CopyPipe = NULL;
+
+
+void tga2gebmp_SetCopyParams(int BufferSize, int Depth)
+{
+	CopyPipe *Pipe;
+
+	tga2gebmp_EnterEngine();
+	Pipe = tga2gebmp_CopyPipe;
+	tga2gebmp_CopyPipe = NULL;
+	tga2gebmp_CopyBufferSize = BufferSize > 0 ? (size_t)BufferSize : COPYPIPE_DEFAULT_BUFFER;
+	tga2gebmp_CopyDepth = Depth > 0 ? Depth : COPYPIPE_DEFAULT_DEPTH;
+	tga2gebmp_LeaveEngine();
+
+	CopyPipe_Destroy(&Pipe);
+}
+
+
+// reading and writing an open DOS file, or a virtual one opened on a DOS
+// file, only passes its handle to the system, so the copy runs outside the
+// engine lock; opening and closing allocate. A memory file grows its buffer
+// with geRam_Realloc on write, so it must not be a copy's destination
+static int tga2gebmp_ReadVFile(void *Context, void *Buffer, size_t Size)
+{
+	return geVFile_Read((geVFile*)Context, Buffer, (int)Size) ? 1 : 0;
+}
+
+
+static int tga2gebmp_WriteVFile(void *Context, const void *Buffer, size_t Size)
+{
+	return geVFile_Write((geVFile*)Context, Buffer, (int)Size) ? 1 : 0;
+}
+
+
+// one buffer at a time on this thread
+static geBoolean tga2gebmp_CopyVFileDirect(geVFile *SrcFile, geVFile *DestFile, long Size, size_t BufferSize)
+{
+	void *Buffer;
+	long Offset;
+	geBoolean Result = GE_TRUE;
+	TRACE_SPAN(Span)
+
+	if(Size == 0)
+		return GE_TRUE;
+
+	BufferSize = TGA2GEBMP_MIN(BufferSize, (size_t)Size);
+	Buffer = tga2gebmp_RamAllocate(BufferSize);
+	if(!Buffer)
+		return GE_FALSE;
+
+	for(Offset = 0; Result && Offset < Size; )
+	{
+		size_t Length = TGA2GEBMP_MIN(BufferSize, (size_t)(Size - Offset));
+
+		TRACE_BEGIN(Span, TRACE_READ);
+		Result = tga2gebmp_ReadVFile(SrcFile, Buffer, Length) ? GE_TRUE : GE_FALSE;
+		TRACE_END(Span, 1, Length);
+
+		if(Result)
+		{
+			TRACE_BEGIN(Span, TRACE_WRITE);
+			Result = tga2gebmp_WriteVFile(DestFile, Buffer, Length) ? GE_TRUE : GE_FALSE;
+			TRACE_END(Span, 1, Length);
+		}
+		Offset += (long)Length;
+	}
+
+	tga2gebmp_RamFree(Buffer);
+	return Result;
+}
+
+
+// destVFS is a DOS system or a virtual one on disk, never a memory file,
+// see tga2gebmp_ReadVFile
+static geBoolean tga2gebmp_CopyVFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest)
+{
+	geVFile *SrcFile;
+	geVFile *DestFile;
+	CopyPipe *Pipe = NULL;
+	long Size;
+	size_t BufferSize;
+	int Depth;
+	geBoolean Result = GE_FALSE;
+	geBoolean HaveSize;
+
+	tga2gebmp_EnterEngine();
+
+	SrcFile = geVFile_Open(srcVFS, src, GE_VFILE_OPEN_READONLY);
+	DestFile = SrcFile ? geVFile_Open(destVFS, dest, GE_VFILE_OPEN_CREATE) : NULL;
+	if(!DestFile)
+	{
+		if(SrcFile)
+			geVFile_Close(SrcFile);
+		tga2gebmp_LeaveEngine();
+		return GE_FALSE;
+	}
+
+	HaveSize = geVFile_Size(SrcFile, &Size);
+	BufferSize = tga2gebmp_CopyBufferSize;
+	Depth = tga2gebmp_CopyDepth;
+
+	// entries that fit in one buffer gain nothing from the reader thread, and
+	// two files of one system are not used from two threads
+	if(HaveSize && Size > 0 && (size_t)Size > BufferSize && srcVFS != destVFS && Depth > 1)
+	{
+		Pipe = tga2gebmp_CopyPipe;
+		tga2gebmp_CopyPipe = NULL;
+	}
+	tga2gebmp_LeaveEngine();
+
+	if(HaveSize && Size >= 0)
+	{
+		if((size_t)Size <= BufferSize || srcVFS == destVFS || Depth < 2)
+			Result = tga2gebmp_CopyVFileDirect(SrcFile, DestFile, Size, BufferSize);
+		else
+		{
+			if(!Pipe)
+				Pipe = CopyPipe_Create(BufferSize, Depth);
+			if(Pipe && CopyPipe_Run(Pipe, (uint64_t)Size, tga2gebmp_ReadVFile, SrcFile, tga2gebmp_WriteVFile, DestFile))
+				Result = GE_TRUE;
+		}
+	}
+
+	tga2gebmp_EnterEngine();
+	geVFile_Close(DestFile);
+	geVFile_Close(SrcFile);
+
+	// the pipe goes back for the next copy unless another one got there first
+	// or the parameters changed meanwhile
+	if(Pipe && !tga2gebmp_CopyPipe && BufferSize == tga2gebmp_CopyBufferSize && Depth == tga2gebmp_CopyDepth)
+	{
+		tga2gebmp_CopyPipe = Pipe;
+		Pipe = NULL;
+	}
+	tga2gebmp_LeaveEngine();
+
+	CopyPipe_Destroy(&Pipe);
+	return Result;
+}
+
+
+geBoolean tga2gebmp_CopyFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest)
+{
+	return tga2gebmp_CopyVFile(srcVFS, destVFS, src, dest);
+}
+
+
+geBoolean tga2gebmp_Session_Save(tga2gebmp_Session *Session)
+{
+	ActFile_Stats Stats;
+	geBoolean	Dirty;
+	geBoolean	Result;
+
+	memset(&Session->SaveStats, 0, sizeof(Session->SaveStats));
+
+	if(!Session->Act)
+		return GE_FALSE;
+
+	// nothing to write needs no turn at the disk
+	Dirty = ActFile_GetDirtyCount(Session->Act) > 0 ? GE_TRUE : GE_FALSE;
+	if(Dirty)
+		tga2gebmp_Session_BeginIo(Session);
+	Result = ActFile_Save(&Session->Act) ? GE_TRUE : GE_FALSE;
+	if(Dirty)
+		tga2gebmp_Session_EndIo(Session);
+
+	// a failed save may have closed the actor
+	if(Session->Act)
+	{
+		ActFile_GetStats(Session->Act, &Stats);
+		Session->SaveStats.Skipped = Stats.Skipped ? GE_TRUE : GE_FALSE;
+		Session->SaveStats.EntriesRewritten = Stats.EntriesRewritten;
+		Session->SaveStats.EntriesReused = Stats.EntriesReused;
+		Session->SaveStats.BytesWritten = Stats.BytesWritten;
+		Session->SaveStats.BytesReused = Stats.BytesReused;
+	}
+
+	return Result;
+}
+
+
+geBoolean tga2gebmp_ExtractFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest)
+{
+	return tga2gebmp_CopyVFile(srcVFS, destVFS, src, dest);
+}
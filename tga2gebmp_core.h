@@ -0,0 +1,182 @@
+/**
+ * @file tga2gebmp_core.h
+ *
+ * UI-free actor skin replacement. A session opens one .act file at a time,
+ * lists the skins stored under Body\Bitmaps, replaces them with images and
+ * writes the changed actor back. Opening reads only the actor's directories;
+ * a skin's bytes are read from the mapped file when something asks for them.
+ * The actor is held by an ActFile (actfile.h), which does not need the
+ * engine; the session adds converting images into encoded geBitmaps.
+ * The same session (and its geVFile system) can be reused for any number of
+ * actors. A session is used by one thread at a time; tga2gebmp_batch.h runs
+ * one per worker thread.
+ *
+ * The Genesis engine is not thread-safe, down to geRam's allocation
+ * tracking. The functions here hold one process-wide engine lock around
+ * every engine call and let it go for the pixel work in between; code that
+ * calls the engine itself while other threads may be using sessions takes
+ * the same lock, or allocates through tga2gebmp_RamAllocate and friends.
+ */
+#ifndef TGA2GEBMP_CORE_H
+#define TGA2GEBMP_CORE_H
+
+#include "genesis.h"
+#include "platform.h"
+#include "threadpool.h"
+#include "convcache.h"
+#include "ioqueue.h"
+#include "mipgen.h"
+#include "quantize.h"
+#include "pack16.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tga2gebmp_Session tga2gebmp_Session;
+
+#define TGA2GEBMP_MIPS_KEEP		0		/* whatever the image loader produced */
+#define TGA2GEBMP_MIPS_MATCH	(-1)	/* as many levels as the skin being replaced */
+
+#define TGA2GEBMP_FORMAT_KEEP		GE_PIXELFORMAT_NO_DATA	/* what the loader and mips produce */
+#define TGA2GEBMP_FORMAT_MATCH		(-1)	/* 16 bits or a palette if the skin being replaced
+											   has them, TGA2GEBMP_FORMAT_KEEP otherwise */
+
+#define TGA2GEBMP_DITHER_NONE		PACK16_DITHER_NONE
+#define TGA2GEBMP_DITHER_DIFFUSE	PACK16_DITHER_DIFFUSE
+#define TGA2GEBMP_DITHER_ORDERED	PACK16_DITHER_ORDERED	/* 16 bits only, palettes diffuse */
+
+#define TGA2GEBMP_PALETTE_NONE		0	/* keep the image's colours */
+#define TGA2GEBMP_PALETTE_NEW		1	/* 8 bits with a palette made for the image */
+#define TGA2GEBMP_PALETTE_ORIGINAL	2	/* 8 bits with the replaced skin's palette, a new
+										   one if that skin has none */
+
+/* how replacement images are turned into skins */
+typedef struct	tga2gebmp_EncodeParams
+{
+	int			MipCount;			/* levels written, or TGA2GEBMP_MIPS_ */
+	int			MipFilter;			/* MIPGEN_FILTER_ */
+	int			Format;				/* a 16-bit gePixelFormat, or TGA2GEBMP_FORMAT_ */
+	int			Palette;			/* TGA2GEBMP_PALETTE_, takes precedence over Format */
+	int			Dither;				/* TGA2GEBMP_DITHER_, when reducing colours */
+	/* TGAs larger than MaxSize pixels on a side, or needing more than MemLimit
+	   MB to convert, are read from their file a few rows at a time and halved
+	   until they fit; 0 for no limit */
+	int			MaxSize;
+	int			MemLimit;
+	/* the replaced skin's palette for TGA2GEBMP_PALETTE_ORIGINAL, filled in by
+	   tga2gebmp_Session_GetSkinEncodeParams */
+	int			PaletteColours;
+	int			PaletteKey;			/* colour-key entry, -1 for none */
+	uint8_t		PaletteData[QUANTIZE_MAX_COLOURS * 4];	/* B, G, R, 0 per colour */
+}	tga2gebmp_EncodeParams;
+
+/* what the last tga2gebmp_Session_Save did */
+typedef struct	tga2gebmp_SaveStats
+{
+	geBoolean	Skipped;			/* nothing was dirty, no file was written */
+	int			EntriesRewritten;	/* skins written from memory */
+	int			EntriesReused;		/* files copied unchanged from the original */
+	uint64_t	BytesWritten;		/* size of the new actor */
+	uint64_t	BytesReused;		/* part of BytesWritten copied unchanged */
+}	tga2gebmp_SaveStats;
+
+/* the engine lock; not recursive, and none of the functions below may be
+   called while holding it */
+void tga2gebmp_EnterEngine(void);
+void tga2gebmp_LeaveEngine(void);
+/* geRam_Allocate, geRam_Realloc and geRam_Free under the engine lock */
+void *tga2gebmp_RamAllocate(size_t Size);
+void *tga2gebmp_RamRealloc(void *Data, size_t Size);
+void tga2gebmp_RamFree(void *Data);
+
+/* mips and format matched to the replaced skin, Kaiser filtered, no
+   dithering */
+void tga2gebmp_EncodeParams_SetDefaults(tga2gebmp_EncodeParams *Params);
+
+/* relative image file names are resolved against WorkDir */
+tga2gebmp_Session *tga2gebmp_Session_Create(const char *WorkDir);
+void tga2gebmp_Session_Destroy(tga2gebmp_Session **pSession);
+
+geVFile *tga2gebmp_Session_GetFileSystem(const tga2gebmp_Session *Session);
+/* opening and saving actors passes through IoGate, so sessions sharing a
+   gate never have more files in flight than the gate allows */
+void tga2gebmp_Session_SetIoGate(tga2gebmp_Session *Session, ThreadPool_Gate *IoGate);
+/* lets tga2gebmp_Session_ReplaceSkins convert images in parallel on Pool */
+void tga2gebmp_Session_SetThreadPool(tga2gebmp_Session *Session, ThreadPool *Pool);
+/* images found in Cache are not converted again, new conversions are added */
+void tga2gebmp_Session_SetConvCache(tga2gebmp_Session *Session, ConvCache *Cache);
+/* saves copy unchanged entries through Queue (ioqueue.h), NULL for the
+   synchronous copies; the queue is the caller's and only this session's */
+void tga2gebmp_Session_SetIoQueue(tga2gebmp_Session *Session, IoQueue *Queue);
+/* used by ReplaceSkin and ReplaceSkins, the defaults until set */
+void tga2gebmp_Session_SetEncodeParams(tga2gebmp_Session *Session, const tga2gebmp_EncodeParams *Params);
+
+geBoolean tga2gebmp_Session_OpenAct(tga2gebmp_Session *Session, const char *ActFileName);
+void tga2gebmp_Session_CloseAct(tga2gebmp_Session *Session);
+const char *tga2gebmp_Session_GetActFileName(const tga2gebmp_Session *Session);
+
+int tga2gebmp_Session_GetSkinCount(const tga2gebmp_Session *Session);
+const char *tga2gebmp_Session_GetSkinName(const tga2gebmp_Session *Session, int Index);
+/* case-insensitive lookup, returns -1 if the actor has no such skin */
+int tga2gebmp_Session_FindSkin(const tga2gebmp_Session *Session, const char *SkinName);
+
+/* the encoded skin, valid until the skin is replaced or the actor saved or
+   closed */
+const void *tga2gebmp_Session_GetSkinData(tga2gebmp_Session *Session, int Index, long *pSize);
+/* hash of the skin's encoded bytes, changes whenever the skin is replaced */
+uint64_t tga2gebmp_Session_GetSkinHash(tga2gebmp_Session *Session, int Index);
+
+/* the session's encode parameters with everything that depends on the skin
+   being replaced filled in; reads the skin from the file, not a replacement */
+void tga2gebmp_Session_GetSkinEncodeParams(const tga2gebmp_Session *Session, int Index, tga2gebmp_EncodeParams *Params);
+/* loads an image and encodes it as a geBitmap file, *pData is freed with
+   tga2gebmp_RamFree. Params must not use TGA2GEBMP_MIPS_MATCH or
+   TGA2GEBMP_FORMAT_MATCH, and TGA2GEBMP_PALETTE_ORIGINAL without
+   PaletteColours makes a new palette. May be called from several threads on
+   one session, e.g. to convert an image once for
+   tga2gebmp_Session_ReplaceSkinData on many actors */
+geBoolean tga2gebmp_Session_EncodeImage(const tga2gebmp_Session *Session, const char *ImageFileName,
+										const tga2gebmp_EncodeParams *Params, void **pData, long *pSize);
+
+/* the returned bitmap belongs to the caller */
+geBitmap *tga2gebmp_Session_LoadSkin(tga2gebmp_Session *Session, const char *SkinName);
+geBoolean tga2gebmp_Session_ReplaceSkin(tga2gebmp_Session *Session, const char *SkinName, const char *ImageFileName);
+/* replaces a skin with an image already encoded by EncodeImage; Data is
+   copied */
+geBoolean tga2gebmp_Session_ReplaceSkinData(tga2gebmp_Session *Session, const char *SkinName, const void *Data, long Size);
+/* same result as calling ReplaceSkin for each pair in order, but the images
+   are decoded and encoded concurrently when the session has a thread pool.
+   Results (may be NULL) receives the outcome of every pair; returns GE_TRUE
+   if all of them succeeded */
+geBoolean tga2gebmp_Session_ReplaceSkins(tga2gebmp_Session *Session, int Count,
+										 const char **SkinNames, const char **ImageFileNames, geBoolean *Results);
+/* number of skins that differ from the file, replacing a skin with an image
+   that encodes to the bytes already stored does not count */
+int tga2gebmp_Session_GetDirtyCount(const tga2gebmp_Session *Session);
+/* writes only if something is dirty */
+geBoolean tga2gebmp_Session_Save(tga2gebmp_Session *Session);
+void tga2gebmp_Session_GetSaveStats(const tga2gebmp_Session *Session, tga2gebmp_SaveStats *Stats);
+
+/* decodes an encoded skin, e.g. a copy of tga2gebmp_Session_GetSkinData; safe
+   to call from any thread */
+geBitmap *tga2gebmp_CreateBitmapFromData(const void *Data, long Size);
+
+/* plain geVFile to geVFile copies, through a ring of large buffers that a
+   reader thread fills while the calling thread writes (copypipe.h); the ring
+   is kept for the next copy. Entries that fit in one buffer, and copies
+   within one file system, are copied on the calling thread. GE_FALSE if a
+   file could not be opened, read or written; the files are closed either
+   way. The files are read and written outside the engine lock, so destVFS
+   must be a DOS system or a virtual one opened on disk, not a memory file */
+geBoolean tga2gebmp_ExtractFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest);
+geBoolean tga2gebmp_CopyFile(geVFile *srcVFS, geVFile *destVFS, const char *src, const char *dest);
+/* buffer size in bytes and number of buffers for those copies, 0 for the
+   defaults; set before copies start, for benchmarks. Frees the kept ring */
+void tga2gebmp_SetCopyParams(int BufferSize, int Depth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,610 @@
+/**
+ * @file tga2gebmp_iobench.c
+ *
+ * Copy throughput of the ways unchanged actor entries can be moved, on a
+ * batch of synthetic actors, printed as JSON. Needs no engine; POSIX only,
+ * as ioqueue.h does nothing on Windows.
+ *
+ *   tga2gebmp_iobench [-n iterations] [-actors count] [-motions count]
+ *                     [-motionsize KB] [-buffer KB] [-warm] [-w dir] [-o file]
+ *
+ * Every actor holds a Header, a Body with one skin and a Motions directory
+ * of random bytes. Methods:
+ *
+ *   blocking_16k       every entry of every actor copied to a new file with
+ *                      16 KB pread and pwrite pairs, one after another, as
+ *                      the geVFile copy loops did before copypipe.c
+ *   copypipe_d4        each entry through a CopyPipe of four buffers, read
+ *                      on its thread while the last one is written
+ *   pread              the same through an IoQueue on the pread backend
+ *   io_uring_dN        through one IoQueue for the whole batch on io_uring,
+ *                      N chunks in flight across entries and actors
+ *   save_sync          ActFile_Save of every actor with its skin replaced,
+ *                      splicing with copy_file_range or sendfile
+ *   save_io_uring_d16  the same with an io_uring IoQueue of depth 16
+ *
+ * Copies end with fsync, and before each run the actors are dropped from
+ * the page cache (posix_fadvise) so reads come from the device; -warm keeps
+ * them cached. Bytes are those of the entries copied, or of the actors
+ * saved, and "speedup" is relative to blocking_16k.
+ */
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "actfile.h"
+#include "actindex.h"
+#include "actwriter.h"
+#include "copypipe.h"
+#include "ioqueue.h"
+
+#define IOBENCH_ACT				"tga2gebmp_iobench%02d.act"
+#define IOBENCH_COPY			"tga2gebmp_iobench%02d.copy"
+#define IOBENCH_SKIN_SIZE		(64 * 1024)
+#define IOBENCH_BLOCK			16384		// the old geVFile copy loops' buffer
+#define IOBENCH_PIPE			(-1)		// a Backend for CopyPipe copies
+#define IOBENCH_MAX_METHODS		12
+
+
+typedef struct	tga2gebmp_IoBenchMethod
+{
+	char		Name[32];
+	int			Backend;		// IOQUEUE_BACKEND_, IOBENCH_PIPE, 0 for the plain 16 KB loop
+	int			Depth;
+	int			Save;			// ActFile_Save instead of entry copies
+	int			Ops;
+	double		Seconds;
+	double		Bytes;
+}	tga2gebmp_IoBenchMethod;
+
+/* an entry to copy, at the same offset in the new file */
+typedef struct	tga2gebmp_IoBenchRange
+{
+	int			Actor;
+	uint64_t	Offset;
+	uint32_t	Size;
+}	tga2gebmp_IoBenchRange;
+
+typedef struct	tga2gebmp_IoBench
+{
+	int			Iterations;
+	int			ActorCount;
+	int			MotionCount;
+	int			MotionSize;		// bytes
+	int			BufferSize;		// bytes
+	int			Warm;
+	char		WorkDir[_MAX_PATH];
+
+	tga2gebmp_IoBenchRange	*Ranges;
+	int			RangeCount;
+	double		ActorBytes;
+
+	tga2gebmp_IoBenchMethod	Methods[IOBENCH_MAX_METHODS];
+	int			MethodCount;
+	int			SaveCount;		// new skin bytes for every save
+}	tga2gebmp_IoBench;
+
+
+static double tga2gebmp_IoBench_Now(void)
+{
+	struct timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (double)Now.tv_sec + (double)Now.tv_nsec * 1e-9;
+}
+
+
+static uint32_t tga2gebmp_IoBench_Random(uint32_t *State)
+{
+	*State = *State * 1664525u + 1013904223u;
+	return *State >> 8;
+}
+
+
+static void tga2gebmp_IoBench_FillRandom(uint8_t *Data, size_t Size, uint32_t Seed)
+{
+	size_t i;
+
+	for(i = 0; i < Size; i++)
+		Data[i] = (uint8_t)tga2gebmp_IoBench_Random(&Seed);
+}
+
+
+// 0 when the name does not fit in FileName, which holds _MAX_PATH bytes
+static int tga2gebmp_IoBench_GetFileName(const tga2gebmp_IoBench *Bench, const char *Format, int Actor, char *FileName)
+{
+	char Name[64];
+
+	if((unsigned)snprintf(Name, sizeof(Name), Format, Actor) >= sizeof(Name))
+		return 0;
+	return (unsigned)snprintf(FileName, _MAX_PATH, "%s" TGA2GEBMP_DIRSEP "%s", Bench->WorkDir, Name) < _MAX_PATH;
+}
+
+
+// writes the actors and lists the file entries of each
+static int tga2gebmp_IoBench_WriteActors(tga2gebmp_IoBench *Bench)
+{
+	char FileName[_MAX_PATH];
+	char Name[32];
+	uint8_t *Data;
+	int a, n, e;
+
+	Data = (uint8_t*)malloc(TGA2GEBMP_MAX(Bench->MotionSize, IOBENCH_SKIN_SIZE));
+	Bench->Ranges = (tga2gebmp_IoBenchRange*)malloc(Bench->ActorCount * (Bench->MotionCount + 2) * sizeof(tga2gebmp_IoBenchRange));
+	if(!Data || !Bench->Ranges)
+	{
+		free(Data);
+		return 0;
+	}
+
+	for(a = 0; a < Bench->ActorCount; a++)
+	{
+		ActWriter *Writer;
+		ActIndex *Index;
+
+		Writer = tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_ACT, a, FileName) ? ActWriter_Create(FileName) : NULL;
+		if(!Writer)
+		{
+			free(Data);
+			return 0;
+		}
+
+		tga2gebmp_IoBench_FillRandom(Data, 64, a);
+		ActWriter_AddData(Writer, "Header", Data, 64, NULL);
+		ActWriter_BeginContainer(Writer, "Body", NULL);
+		ActWriter_BeginDirectory(Writer, "Bitmaps", NULL);
+		tga2gebmp_IoBench_FillRandom(Data, IOBENCH_SKIN_SIZE, a + 1000);
+		ActWriter_AddData(Writer, "skin.bmp", Data, IOBENCH_SKIN_SIZE, NULL);
+		ActWriter_EndDirectory(Writer);
+		ActWriter_EndContainer(Writer);
+		ActWriter_BeginDirectory(Writer, "Motions", NULL);
+		for(n = 0; n < Bench->MotionCount; n++)
+		{
+			snprintf(Name, sizeof(Name), "motion%03d.mot", n);
+			tga2gebmp_IoBench_FillRandom(Data, Bench->MotionSize, a * 1000 + n);
+			ActWriter_AddData(Writer, Name, Data, Bench->MotionSize, NULL);
+		}
+		ActWriter_EndDirectory(Writer);
+
+		if(!ActWriter_Commit(&Writer, NULL))
+		{
+			free(Data);
+			return 0;
+		}
+
+		Index = ActIndex_Open(FileName);
+		if(!Index)
+		{
+			free(Data);
+			return 0;
+		}
+
+		Bench->ActorBytes += (double)ActIndex_GetSize(Index);
+		for(e = 0; e < ActIndex_GetEntryCount(Index); e++)
+		{
+			const ActIndex_Entry *Entry = ActIndex_GetEntry(Index, e);
+
+			if(Entry->Flags & (ACTINDEX_DIRECTORY | ACTINDEX_CONTAINER))
+				continue;
+
+			Bench->Ranges[Bench->RangeCount].Actor = a;
+			Bench->Ranges[Bench->RangeCount].Offset = Entry->Offset;
+			Bench->Ranges[Bench->RangeCount].Size = Entry->Size;
+			Bench->RangeCount++;
+		}
+		ActIndex_Destroy(&Index);
+	}
+
+	free(Data);
+	return 1;
+}
+
+
+static void tga2gebmp_IoBench_DropCache(const tga2gebmp_IoBench *Bench)
+{
+	char FileName[_MAX_PATH];
+	int a;
+
+	if(Bench->Warm)
+		return;
+
+	for(a = 0; a < Bench->ActorCount; a++)
+	{
+		int fd;
+
+		if(!tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_ACT, a, FileName))
+			continue;
+		fd = open(FileName, O_RDONLY);
+		if(fd < 0)
+			continue;
+		fdatasync(fd);
+	#ifdef POSIX_FADV_DONTNEED
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	#endif
+		close(fd);
+	}
+}
+
+
+static int tga2gebmp_IoBench_CopyBlocking(int SrcFd, int DestFd, uint64_t Offset, uint32_t Size)
+{
+	char Buffer[IOBENCH_BLOCK];
+	uint32_t Done;
+
+	for(Done = 0; Done < Size; )
+	{
+		size_t Length = TGA2GEBMP_MIN(Size - Done, (uint32_t)IOBENCH_BLOCK);
+
+		if(pread(SrcFd, Buffer, Length, (off_t)(Offset + Done)) != (ssize_t)Length ||
+		   pwrite(DestFd, Buffer, Length, (off_t)(Offset + Done)) != (ssize_t)Length)
+			return 0;
+		Done += (uint32_t)Length;
+	}
+
+	return 1;
+}
+
+
+typedef struct	tga2gebmp_IoBenchStream
+{
+	int			Fd;
+	uint64_t	Offset;
+}	tga2gebmp_IoBenchStream;
+
+
+static int tga2gebmp_IoBench_ReadStream(void *Context, void *Buffer, size_t Size)
+{
+	tga2gebmp_IoBenchStream *Stream = (tga2gebmp_IoBenchStream*)Context;
+
+	if(pread(Stream->Fd, Buffer, Size, (off_t)Stream->Offset) != (ssize_t)Size)
+		return 0;
+	Stream->Offset += Size;
+	return 1;
+}
+
+
+static int tga2gebmp_IoBench_WriteStream(void *Context, const void *Buffer, size_t Size)
+{
+	tga2gebmp_IoBenchStream *Stream = (tga2gebmp_IoBenchStream*)Context;
+
+	if(pwrite(Stream->Fd, Buffer, Size, (off_t)Stream->Offset) != (ssize_t)Size)
+		return 0;
+	Stream->Offset += Size;
+	return 1;
+}
+
+
+static int tga2gebmp_IoBench_CopyPipe(CopyPipe *Pipe, int SrcFd, int DestFd, uint64_t Offset, uint32_t Size)
+{
+	tga2gebmp_IoBenchStream Src, Dest;
+
+	Src.Fd = SrcFd;
+	Src.Offset = Offset;
+	Dest.Fd = DestFd;
+	Dest.Offset = Offset;
+	return CopyPipe_Run(Pipe, Size, tga2gebmp_IoBench_ReadStream, &Src, tga2gebmp_IoBench_WriteStream, &Dest);
+}
+
+
+// every entry of every actor into a new file per actor
+static int tga2gebmp_IoBench_RunCopy(tga2gebmp_IoBench *Bench, tga2gebmp_IoBenchMethod *Method)
+{
+	char FileName[_MAX_PATH];
+	IoQueue *Queue = NULL;
+	CopyPipe *Pipe = NULL;
+	int *SrcFds, *DestFds;
+	double Start, Bytes = 0.0;
+	int Ok = 1;
+	int a, r;
+
+	SrcFds = (int*)malloc(Bench->ActorCount * sizeof(int));
+	DestFds = (int*)malloc(Bench->ActorCount * sizeof(int));
+	if(!SrcFds || !DestFds)
+	{
+		free(SrcFds);
+		free(DestFds);
+		return 0;
+	}
+
+	if(Method->Backend == IOBENCH_PIPE)
+		Pipe = CopyPipe_Create(Bench->BufferSize, Method->Depth);
+	else if(Method->Backend)
+		Queue = IoQueue_Create(Method->Depth, Bench->BufferSize, Method->Backend);
+	if(Method->Backend && !Queue && !Pipe)
+	{
+		free(SrcFds);
+		free(DestFds);
+		return 0;
+	}
+
+	tga2gebmp_IoBench_DropCache(Bench);
+
+	for(a = 0; a < Bench->ActorCount; a++)
+	{
+		SrcFds[a] = DestFds[a] = -1;
+		if(tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_ACT, a, FileName))
+			SrcFds[a] = open(FileName, O_RDONLY);
+		if(tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_COPY, a, FileName))
+			DestFds[a] = open(FileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		Ok = Ok && SrcFds[a] >= 0 && DestFds[a] >= 0;
+	}
+
+	Start = tga2gebmp_IoBench_Now();
+
+	for(r = 0; Ok && r < Bench->RangeCount; r++)
+	{
+		const tga2gebmp_IoBenchRange *Range = &Bench->Ranges[r];
+
+		if(Queue)
+			Ok = IoQueue_Copy(Queue, SrcFds[Range->Actor], Range->Offset, DestFds[Range->Actor], Range->Offset, Range->Size);
+		else if(Pipe)
+			Ok = tga2gebmp_IoBench_CopyPipe(Pipe, SrcFds[Range->Actor], DestFds[Range->Actor], Range->Offset, Range->Size);
+		else
+			Ok = tga2gebmp_IoBench_CopyBlocking(SrcFds[Range->Actor], DestFds[Range->Actor], Range->Offset, Range->Size);
+		Bytes += Range->Size;
+	}
+
+	if(Queue)
+		Ok = IoQueue_Wait(Queue) && Ok;
+
+	for(a = 0; a < Bench->ActorCount; a++)
+		Ok = Ok && fsync(DestFds[a]) == 0;
+
+	Method->Seconds += tga2gebmp_IoBench_Now() - Start;
+	Method->Bytes += Bytes;
+	Method->Ops++;
+
+	for(a = 0; a < Bench->ActorCount; a++)
+	{
+		if(SrcFds[a] >= 0)
+			close(SrcFds[a]);
+		if(DestFds[a] >= 0)
+			close(DestFds[a]);
+		if(tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_COPY, a, FileName))
+			remove(FileName);
+	}
+
+	IoQueue_Destroy(&Queue);
+	CopyPipe_Destroy(&Pipe);
+	free(SrcFds);
+	free(DestFds);
+	return Ok;
+}
+
+
+// replaces every actor's skin with new bytes and saves it
+static int tga2gebmp_IoBench_RunSave(tga2gebmp_IoBench *Bench, tga2gebmp_IoBenchMethod *Method)
+{
+	char FileName[_MAX_PATH];
+	IoQueue *Queue = NULL;
+	ActFile_Stats Stats;
+	uint8_t *Skin;
+	double Start;
+	int Ok = 1;
+	int a;
+
+	Skin = (uint8_t*)malloc(IOBENCH_SKIN_SIZE);
+	if(!Skin)
+		return 0;
+
+	if(Method->Backend)
+	{
+		Queue = IoQueue_Create(Method->Depth, Bench->BufferSize, Method->Backend);
+		if(!Queue)
+		{
+			free(Skin);
+			return 0;
+		}
+	}
+
+	tga2gebmp_IoBench_DropCache(Bench);
+
+	Start = tga2gebmp_IoBench_Now();
+
+	for(a = 0; Ok && a < Bench->ActorCount; a++)
+	{
+		ActFile *Act;
+
+		Act = tga2gebmp_IoBench_GetFileName(Bench, IOBENCH_ACT, a, FileName) ? ActFile_Open(FileName) : NULL;
+		if(!Act)
+		{
+			Ok = 0;
+			break;
+		}
+
+		if(Queue)
+			ActFile_SetIoQueue(Act, Queue);
+
+		tga2gebmp_IoBench_FillRandom(Skin, IOBENCH_SKIN_SIZE, (uint32_t)(++Bench->SaveCount) * 7919u);
+		Ok = ActFile_PutSkinData(Act, ActFile_FindSkin(Act, "skin.bmp"), Skin, IOBENCH_SKIN_SIZE) && ActFile_Save(&Act);
+		if(Act)
+		{
+			ActFile_GetStats(Act, &Stats);
+			Method->Bytes += (double)Stats.BytesWritten;
+		}
+		ActFile_Close(&Act);
+	}
+
+	Method->Seconds += tga2gebmp_IoBench_Now() - Start;
+	Method->Ops++;
+
+	IoQueue_Destroy(&Queue);
+	free(Skin);
+	return Ok;
+}
+
+
+static void tga2gebmp_IoBench_AddMethod(tga2gebmp_IoBench *Bench, const char *Name, int Backend, int Depth, int Save)
+{
+	tga2gebmp_IoBenchMethod *Method = &Bench->Methods[Bench->MethodCount++];
+
+	memset(Method, 0, sizeof(*Method));
+	strncpy(Method->Name, Name, sizeof(Method->Name) - 1);
+	Method->Backend = Backend;
+	Method->Depth = Depth;
+	Method->Save = Save;
+}
+
+
+static void tga2gebmp_IoBench_WriteJson(const tga2gebmp_IoBench *Bench, const char *UringBackend, FILE *Out)
+{
+	double Baseline = 0.0;
+	int i;
+
+	fprintf(Out, "{\n");
+	fprintf(Out, "\t\"benchmark\": \"tga2gebmp_iobench\",\n");
+	fprintf(Out, "\t\"io_uring\": \"%s\",\n", UringBackend);
+	fprintf(Out, "\t\"config\": {\"iterations\": %d, \"actors\": %d, \"motions\": %d, \"motion_bytes\": %d, "
+				 "\"buffer_bytes\": %d, \"cold\": %s, \"batch_bytes\": %.0f},\n",
+			Bench->Iterations, Bench->ActorCount, Bench->MotionCount, Bench->MotionSize,
+			Bench->BufferSize, Bench->Warm ? "false" : "true", Bench->ActorBytes);
+	fprintf(Out, "\t\"methods\": [\n");
+
+	for(i = 0; i < Bench->MethodCount; i++)
+	{
+		const tga2gebmp_IoBenchMethod *Method = &Bench->Methods[i];
+		double Seconds = Method->Seconds > 0.0 ? Method->Seconds : 1e-9;
+		double Rate = Method->Bytes / Seconds / (1024.0 * 1024.0);
+
+		if(i == 0)
+			Baseline = Rate;
+
+		fprintf(Out, "\t\t{\"name\": \"%s\", \"ops\": %d, \"seconds\": %.6f, \"bytes\": %.0f, "
+					 "\"ms_per_op\": %.3f, \"mb_per_s\": %.1f, \"speedup\": %.2f}%s\n",
+				Method->Name, Method->Ops, Method->Seconds, Method->Bytes,
+				Method->Ops ? Method->Seconds * 1000.0 / Method->Ops : 0.0,
+				Rate, Baseline > 0.0 ? Rate / Baseline : 0.0,
+				i + 1 < Bench->MethodCount ? "," : "");
+	}
+
+	fprintf(Out, "\t]\n");
+	fprintf(Out, "}\n");
+}
+
+
+static void tga2gebmp_IoBench_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_iobench [-n iterations] [-actors count] [-motions count]\n"
+		"                         [-motionsize KB] [-buffer KB] [-warm] [-w dir] [-o file]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	static const int Depths[] = { 1, 4, 16, 64 };
+	tga2gebmp_IoBench	Bench;
+	const char			*OutFileName = NULL;
+	const char			*UringBackend = "unavailable";
+	char				FileName[_MAX_PATH];
+	IoQueue				*Probe;
+	FILE				*Out = stdout;
+	int					Ok;
+	int					i, m;
+
+	memset(&Bench, 0, sizeof(Bench));
+	Bench.Iterations = 3;
+	Bench.ActorCount = 8;
+	Bench.MotionCount = 32;
+	Bench.MotionSize = 1024 * 1024;
+	Bench.BufferSize = IOQUEUE_DEFAULT_BUFFER;
+
+	if(!getcwd(Bench.WorkDir, sizeof(Bench.WorkDir)))
+		return 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			Bench.Iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-actors") == 0 && i + 1 < argc)
+			Bench.ActorCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-motions") == 0 && i + 1 < argc)
+			Bench.MotionCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-motionsize") == 0 && i + 1 < argc)
+			Bench.MotionSize = atoi(argv[++i]) * 1024;
+		else if(strcmp(argv[i], "-buffer") == 0 && i + 1 < argc)
+			Bench.BufferSize = atoi(argv[++i]) * 1024;
+		else if(strcmp(argv[i], "-warm") == 0)
+			Bench.Warm = 1;
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			strncpy(Bench.WorkDir, argv[++i], sizeof(Bench.WorkDir) - 1);
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			OutFileName = argv[++i];
+		else
+		{
+			tga2gebmp_IoBench_Usage();
+			return 2;
+		}
+	}
+
+	if(Bench.Iterations <= 0 || Bench.ActorCount <= 0 || Bench.ActorCount > 99 || Bench.MotionCount < 0 ||
+	   Bench.MotionSize <= 0 || Bench.BufferSize <= 0 || strlen(Bench.WorkDir) + 32 > sizeof(Bench.WorkDir))
+	{
+		tga2gebmp_IoBench_Usage();
+		return 2;
+	}
+
+	// the io_uring methods only where the kernel allows io_uring
+	tga2gebmp_IoBench_AddMethod(&Bench, "blocking_16k", 0, 1, 0);
+	tga2gebmp_IoBench_AddMethod(&Bench, "copypipe_d4", IOBENCH_PIPE, 4, 0);
+	tga2gebmp_IoBench_AddMethod(&Bench, "pread", IOQUEUE_BACKEND_PREAD, 1, 0);
+	Probe = IoQueue_Create(1, 0, IOQUEUE_BACKEND_URING);
+	if(Probe)
+	{
+		UringBackend = "available";
+		for(i = 0; i < (int)(sizeof(Depths) / sizeof(Depths[0])); i++)
+		{
+			char Name[32];
+
+			snprintf(Name, sizeof(Name), "io_uring_d%d", Depths[i]);
+			tga2gebmp_IoBench_AddMethod(&Bench, Name, IOQUEUE_BACKEND_URING, Depths[i], 0);
+		}
+	}
+	tga2gebmp_IoBench_AddMethod(&Bench, "save_sync", 0, 1, 1);
+	if(Probe)
+		tga2gebmp_IoBench_AddMethod(&Bench, "save_io_uring_d16", IOQUEUE_BACKEND_URING, 16, 1);
+	IoQueue_Destroy(&Probe);
+
+	Ok = tga2gebmp_IoBench_WriteActors(&Bench);
+	if(!Ok)
+		fprintf(stderr, "tga2gebmp_iobench: cannot write the actors in '%s'\n", Bench.WorkDir);
+
+	// methods take turns, so drift in the device's state hits all of them
+	for(i = 0; Ok && i < Bench.Iterations; i++)
+	{
+		for(m = 0; Ok && m < Bench.MethodCount; m++)
+		{
+			tga2gebmp_IoBenchMethod *Method = &Bench.Methods[m];
+
+			Ok = Method->Save ? tga2gebmp_IoBench_RunSave(&Bench, Method) : tga2gebmp_IoBench_RunCopy(&Bench, Method);
+			if(!Ok)
+				fprintf(stderr, "tga2gebmp_iobench: %s failed\n", Method->Name);
+		}
+	}
+
+	if(Ok && OutFileName)
+	{
+		Out = fopen(OutFileName, "w");
+		if(!Out)
+		{
+			fprintf(stderr, "tga2gebmp_iobench: cannot write '%s'\n", OutFileName);
+			Ok = 0;
+		}
+	}
+
+	if(Ok)
+	{
+		tga2gebmp_IoBench_WriteJson(&Bench, UringBackend, Out);
+		if(Out != stdout)
+			fclose(Out);
+	}
+
+	for(i = 0; i < Bench.ActorCount; i++)
+	{
+		if(tga2gebmp_IoBench_GetFileName(&Bench, IOBENCH_ACT, i, FileName))
+			remove(FileName);
+	}
+	free(Bench.Ranges);
+
+	return Ok ? 0 : 1;
+}
@@ -0,0 +1,1282 @@
+/**
+ * @file tga2gebmp_server.c
+ *
+ * Skin replacement as a long-running process for build scripts, so caches
+ * and open actors outlive a single job. Requests come over a Unix domain
+ * socket as JSON objects, one per line, and every request gets a reply of
+ * one line:
+ *
+ *   tga2gebmp_server [-socket path] [-j threads] [-io count] [-w dir]
+ *                    [-cache dir] [-cachesize MB] [-memcache MB] [-v]
+ *
+ *   {"op": "open", "actor": "models/soldier.act"}
+ *   {"op": "list", "actor": "models/soldier.act"}
+ *   {"op": "replace", "actor": "...", "skin": "face.bmp", "image": "face.tga"}
+ *   {"op": "export", "actor": "...", "skin": "face.bmp", "file": "face.bmp"}
+ *   {"op": "save", "actor": "..."}
+ *   {"op": "close", "actor": "..."}
+ *   {"op": "batch", "jobs": [{"op": "replace", ...}, {"op": "save", ...}]}
+ *   {"op": "stats"}
+ *   {"op": "shutdown"}
+ *
+ * Relative paths are resolved against the working directory (-w, the
+ * current directory by default). A reply carries "ok", the time the job
+ * waited for a worker ("wait_ms") and took to run ("ms"), the request's
+ * "id" if it had one, "error" if it failed and what the job produced; a
+ * batch reply has one such object per job under "jobs".
+ *
+ * What stays warm between requests:
+ *
+ *   actors     every actor a job names is kept open in a session of its
+ *              own, with its directories read and the file mapped, until a
+ *              close job. Names that lead to the same file through links or
+ *              ".." share it. It is opened again if the file changed on disk
+ *              and the session has nothing unsaved.
+ *   images     encoded images in memory, by file, modification time, size
+ *              and encode parameters, up to -memcache MB (least recently used
+ *              go first). A replace that hits skips decoding and encoding.
+ *   -cache     the conversion cache (convcache.h) stays open.
+ *
+ * Jobs run on one thread pool. The jobs of a batch that name the same actor
+ * run in order as one task, different actors run in parallel. Up to 64
+ * clients can be connected at once; their requests run one at a time, as
+ * each line arrives. POSIX only.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include "tga2gebmp_core.h"
+#include "json.h"
+
+#define SERVER_SOCKET			"tga2gebmp.sock"
+#define SERVER_MEMCACHE			256		// MB of encoded images, by default
+#define SERVER_ERROR_SIZE		256
+#define SERVER_MAX_CLIENTS		64		// connected at once
+#define SERVER_READ_SIZE		65536	// bytes of requests read per turn
+#define SERVER_MAX_LINE			(16 << 20)	// bytes of one request, a longer one drops its client
+
+
+typedef struct	tga2gebmp_ServerActor
+{
+	char		FileName[_MAX_PATH];	// full path with links resolved, the key
+	tga2gebmp_Session *Session;
+	uint64_t	FileTime;		// of the file the session opened or saved, ns
+	uint64_t	FileSize;
+}	tga2gebmp_ServerActor;
+
+typedef struct	tga2gebmp_ServerImage
+{
+	char		*FileName;		// full path
+	uint64_t	FileTime;
+	uint64_t	FileSize;
+	tga2gebmp_EncodeParams Params;
+	void		*Data;
+	long		Size;
+	uint64_t	LastUse;
+}	tga2gebmp_ServerImage;
+
+typedef struct	tga2gebmp_Server
+{
+	char		WorkDir[_MAX_PATH];
+	geBoolean	Verbose;
+	volatile sig_atomic_t Stop;
+	ThreadPool	*Pool;
+	ThreadPool_Group *Group;
+	ThreadPool_Gate *IoGate;
+	ConvCache	*Cache;				// NULL without -cache
+	uint64_t	Requests;
+
+	// touched by the dispatching thread only
+	tga2gebmp_ServerActor **Actors;
+	int			ActorCount;
+	int			ActorCapacity;
+
+	ThreadPool_Gate *ImageLock;		// a gate of one, guards the images
+	tga2gebmp_ServerImage *Images;
+	int			ImageCount;
+	int			ImageCapacity;
+	uint64_t	ImageBytes;
+	uint64_t	MaxImageBytes;
+	uint64_t	ImageUses;
+	uint64_t	ImageHits;
+	uint64_t	ImageMisses;
+}	tga2gebmp_Server;
+
+typedef struct	tga2gebmp_ServerJob
+{
+	const Json_Value *Request;
+	const char	*Op;
+	tga2gebmp_ServerActor *Actor;	// NULL for jobs that name none
+	geBoolean	Ok;
+	char		Error[SERVER_ERROR_SIZE];
+	double		Queued;
+	double		WaitMs;
+	double		RunMs;
+	char		*Fields;		// what the job produced, ", name: value" each
+	size_t		FieldsSize;
+	FILE		*Out;			// writes Fields while the job runs
+}	tga2gebmp_ServerJob;
+
+typedef struct	tga2gebmp_ServerClient
+{
+	int			Fd;				// -1 once it hung up
+	FILE		*Out;			// replies, on a second descriptor
+	char		*Line;			// read but not run yet, a partial line
+	size_t		Length;
+	size_t		Capacity;
+}	tga2gebmp_ServerClient;
+
+// the jobs of one request that name the same actor, run in order
+typedef struct	tga2gebmp_ServerTask
+{
+	tga2gebmp_Server *Server;
+	tga2gebmp_ServerActor *Actor;
+	tga2gebmp_ServerJob **Jobs;
+	int			Count;
+}	tga2gebmp_ServerTask;
+
+
+static tga2gebmp_Server *tga2gebmp_ActiveServer = NULL;
+
+
+static void tga2gebmp_Server_Usage(void)
+{
+	fprintf(stderr,
+		"usage: tga2gebmp_server [-socket path] [-j threads] [-io count] [-w dir]\n"
+		"                        [-cache dir] [-cachesize MB] [-memcache MB] [-v]\n"
+		"\n"
+		"  -socket path  Unix domain socket to listen on (default: tga2gebmp.sock\n"
+		"              in the working directory)\n"
+		"  -j threads  worker threads (default: one per processor)\n"
+		"  -io count   actors read or written at the same time (default: 4)\n"
+		"  -w dir      working directory, relative paths start there (default:\n"
+		"              current directory)\n"
+		"  -cache dir  reuse images converted before, keeping them in dir\n"
+		"  -cachesize MB  limit of the cache directory (default: 1024)\n"
+		"  -memcache MB  encoded images kept in memory (default: 256, 0 for none)\n"
+		"  -v          log every request\n");
+}
+
+
+static double tga2gebmp_Server_Now(void)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (double)Now.tv_sec + (double)Now.tv_nsec * 1e-9;
+}
+
+
+static uint64_t tga2gebmp_Server_GetFileTime(const struct stat *Stat)
+{
+#ifdef __linux__
+	return (uint64_t)Stat->st_mtim.tv_sec * 1000000000u + (uint64_t)Stat->st_mtim.tv_nsec;
+#else
+	return (uint64_t)Stat->st_mtime * 1000000000u;
+#endif
+}
+
+
+static void tga2gebmp_Server_OnSignal(int Signal)
+{
+	(void)Signal;
+	if(tga2gebmp_ActiveServer)
+		tga2gebmp_ActiveServer->Stop = 1;
+}
+
+
+// Path against the working directory into FullPath of _MAX_PATH characters
+static geBoolean tga2gebmp_Server_ResolvePath(const tga2gebmp_Server *Server, const char *Path, char *FullPath)
+{
+	if(Path[0] == '/')
+	{
+		if(strlen(Path) + 1 > _MAX_PATH)
+			return GE_FALSE;
+		strcpy(FullPath, Path);
+		return GE_TRUE;
+	}
+
+	if(strlen(Server->WorkDir) + strlen(Path) + 2 > _MAX_PATH)
+		return GE_FALSE;
+
+	sprintf(FullPath, "%s/%s", Server->WorkDir, Path);
+	return GE_TRUE;
+}
+
+
+// a message cut short by a long path ends in "..."
+static void tga2gebmp_ServerJob_Fail(tga2gebmp_ServerJob *Job, const char *Format, const char *Arg)
+{
+	Job->Ok = GE_FALSE;
+	if((unsigned)snprintf(Job->Error, sizeof(Job->Error), Format, Arg ? Arg : "") >= sizeof(Job->Error))
+		strcpy(Job->Error + sizeof(Job->Error) - 4, "...");
+}
+
+
+/*
+ * Actors
+ */
+
+static tga2gebmp_ServerActor *tga2gebmp_Server_GetActor(tga2gebmp_Server *Server, const char *FileName)
+{
+	tga2gebmp_ServerActor *Actor;
+	char Path[_MAX_PATH];
+	char FullPath[_MAX_PATH];
+	int i;
+
+	if(!tga2gebmp_Server_ResolvePath(Server, FileName, Path))
+		return NULL;
+
+	// one actor however it is named, through links, "." or ".."; a file that
+	// is not there keeps its name and fails to open
+	if(!realpath(Path, FullPath))
+		strcpy(FullPath, Path);
+
+	for(i = 0; i < Server->ActorCount; i++)
+	{
+		if(strcmp(Server->Actors[i]->FileName, FullPath) == 0)
+			return Server->Actors[i];
+	}
+
+	if(Server->ActorCount == Server->ActorCapacity)
+	{
+		tga2gebmp_ServerActor **NewActors;
+		int NewCapacity = Server->ActorCapacity ? Server->ActorCapacity * 2 : 16;
+
+		NewActors = (tga2gebmp_ServerActor**)tga2gebmp_RamRealloc(Server->Actors, NewCapacity * sizeof(tga2gebmp_ServerActor*));
+		if(!NewActors)
+			return NULL;
+
+		Server->Actors = NewActors;
+		Server->ActorCapacity = NewCapacity;
+	}
+
+	Actor = (tga2gebmp_ServerActor*)tga2gebmp_RamAllocate(sizeof(tga2gebmp_ServerActor));
+	if(!Actor)
+		return NULL;
+
+	memset(Actor, 0, sizeof(*Actor));
+	strcpy(Actor->FileName, FullPath);
+	Actor->Session = tga2gebmp_Session_Create(Server->WorkDir);
+	if(!Actor->Session)
+	{
+		tga2gebmp_RamFree(Actor);
+		return NULL;
+	}
+
+	tga2gebmp_Session_SetIoGate(Actor->Session, Server->IoGate);
+	tga2gebmp_Session_SetThreadPool(Actor->Session, Server->Pool);
+	if(Server->Cache)
+		tga2gebmp_Session_SetConvCache(Actor->Session, Server->Cache);
+
+	Server->Actors[Server->ActorCount++] = Actor;
+	return Actor;
+}
+
+
+static void tga2gebmp_Server_DestroyActor(tga2gebmp_ServerActor *Actor)
+{
+	tga2gebmp_Session_Destroy(&Actor->Session);
+	tga2gebmp_RamFree(Actor);
+}
+
+
+static geBoolean tga2gebmp_ServerActor_IsOpen(const tga2gebmp_ServerActor *Actor)
+{
+	return tga2gebmp_Session_GetActFileName(Actor->Session)[0] != '\0';
+}
+
+
+// actors closed by the request just finished, or that failed to open or save
+static void tga2gebmp_Server_DropClosedActors(tga2gebmp_Server *Server)
+{
+	int i;
+
+	for(i = 0; i < Server->ActorCount; )
+	{
+		if(!tga2gebmp_ServerActor_IsOpen(Server->Actors[i]))
+		{
+			tga2gebmp_Server_DestroyActor(Server->Actors[i]);
+			Server->Actors[i] = Server->Actors[--Server->ActorCount];
+		}
+		else
+			i++;
+	}
+}
+
+
+static void tga2gebmp_ServerActor_Stat(tga2gebmp_ServerActor *Actor)
+{
+	struct stat Stat;
+
+	if(stat(Actor->FileName, &Stat) == 0)
+	{
+		Actor->FileTime = tga2gebmp_Server_GetFileTime(&Stat);
+		Actor->FileSize = (uint64_t)Stat.st_size;
+	}
+}
+
+
+// opens the actor unless the session has it open already, and again if the
+// file changed on disk and nothing would be lost
+static geBoolean tga2gebmp_ServerActor_Open(tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	struct stat Stat;
+
+	if(tga2gebmp_ServerActor_IsOpen(Actor))
+	{
+		if(stat(Actor->FileName, &Stat) != 0 ||
+		   (tga2gebmp_Server_GetFileTime(&Stat) == Actor->FileTime && (uint64_t)Stat.st_size == Actor->FileSize) ||
+		   tga2gebmp_Session_GetDirtyCount(Actor->Session) > 0)
+			return GE_TRUE;
+	}
+
+	if(!tga2gebmp_Session_OpenAct(Actor->Session, Actor->FileName))
+	{
+		tga2gebmp_ServerJob_Fail(Job, "cannot open actor '%s'", Actor->FileName);
+		return GE_FALSE;
+	}
+
+	tga2gebmp_ServerActor_Stat(Actor);
+	return GE_TRUE;
+}
+
+
+/*
+ * Encoded images
+ */
+
+static void tga2gebmp_Server_EvictImages(tga2gebmp_Server *Server, uint64_t MaxBytes)
+{
+	while(Server->ImageCount > 0 && Server->ImageBytes > MaxBytes)
+	{
+		tga2gebmp_ServerImage *Oldest = &Server->Images[0];
+		int i;
+
+		for(i = 1; i < Server->ImageCount; i++)
+		{
+			if(Server->Images[i].LastUse < Oldest->LastUse)
+				Oldest = &Server->Images[i];
+		}
+
+		Server->ImageBytes -= (uint64_t)Oldest->Size;
+		tga2gebmp_RamFree(Oldest->FileName);
+		tga2gebmp_RamFree(Oldest->Data);
+		*Oldest = Server->Images[--Server->ImageCount];
+	}
+}
+
+
+static geBoolean tga2gebmp_ServerImage_Matches(const tga2gebmp_ServerImage *Image, const char *FileName,
+											   const struct stat *Stat, const tga2gebmp_EncodeParams *Params)
+{
+	return Image->FileTime == tga2gebmp_Server_GetFileTime(Stat) && Image->FileSize == (uint64_t)Stat->st_size &&
+		   strcmp(Image->FileName, FileName) == 0 && memcmp(&Image->Params, Params, sizeof(*Params)) == 0;
+}
+
+
+// a copy of the image encoded with Params, NULL if it is not in memory
+static void *tga2gebmp_Server_FindImage(tga2gebmp_Server *Server, const char *FileName, const struct stat *Stat,
+										const tga2gebmp_EncodeParams *Params, long *pSize)
+{
+	void *Copy = NULL;
+	int i;
+
+	ThreadPool_EnterGate(Server->ImageLock);
+
+	for(i = 0; i < Server->ImageCount; i++)
+	{
+		tga2gebmp_ServerImage *Image = &Server->Images[i];
+
+		if(!tga2gebmp_ServerImage_Matches(Image, FileName, Stat, Params))
+			continue;
+
+		Copy = tga2gebmp_RamAllocate(Image->Size);
+		if(Copy)
+		{
+			memcpy(Copy, Image->Data, Image->Size);
+			*pSize = Image->Size;
+			Image->LastUse = ++Server->ImageUses;
+		}
+		break;
+	}
+
+	if(Copy)
+		Server->ImageHits++;
+	else
+		Server->ImageMisses++;
+
+	ThreadPool_LeaveGate(Server->ImageLock);
+	return Copy;
+}
+
+
+// takes Data over, or frees it if it does not fit
+static void tga2gebmp_Server_AddImage(tga2gebmp_Server *Server, const char *FileName, const struct stat *Stat,
+									  const tga2gebmp_EncodeParams *Params, void *Data, long Size)
+{
+	tga2gebmp_ServerImage *Image;
+	char *Copy;
+	int i;
+
+	if((uint64_t)Size > Server->MaxImageBytes || (Copy = (char*)tga2gebmp_RamAllocate(strlen(FileName) + 1)) == NULL)
+	{
+		tga2gebmp_RamFree(Data);
+		return;
+	}
+	strcpy(Copy, FileName);
+
+	ThreadPool_EnterGate(Server->ImageLock);
+
+	// two jobs that missed the same image at once both encode it
+	for(i = 0; i < Server->ImageCount; i++)
+	{
+		if(tga2gebmp_ServerImage_Matches(&Server->Images[i], FileName, Stat, Params))
+		{
+			ThreadPool_LeaveGate(Server->ImageLock);
+			tga2gebmp_RamFree(Copy);
+			tga2gebmp_RamFree(Data);
+			return;
+		}
+	}
+
+	tga2gebmp_Server_EvictImages(Server, Server->MaxImageBytes - (uint64_t)Size);
+
+	if(Server->ImageCount == Server->ImageCapacity)
+	{
+		tga2gebmp_ServerImage *NewImages;
+		int NewCapacity = Server->ImageCapacity ? Server->ImageCapacity * 2 : 64;
+
+		NewImages = (tga2gebmp_ServerImage*)tga2gebmp_RamRealloc(Server->Images, NewCapacity * sizeof(tga2gebmp_ServerImage));
+		if(!NewImages)
+		{
+			ThreadPool_LeaveGate(Server->ImageLock);
+			tga2gebmp_RamFree(Copy);
+			tga2gebmp_RamFree(Data);
+			return;
+		}
+
+		Server->Images = NewImages;
+		Server->ImageCapacity = NewCapacity;
+	}
+
+	Image = &Server->Images[Server->ImageCount++];
+	Image->FileName = Copy;
+	Image->FileTime = tga2gebmp_Server_GetFileTime(Stat);
+	Image->FileSize = (uint64_t)Stat->st_size;
+	Image->Params = *Params;
+	Image->Data = Data;
+	Image->Size = Size;
+	Image->LastUse = ++Server->ImageUses;
+	Server->ImageBytes += (uint64_t)Size;
+
+	ThreadPool_LeaveGate(Server->ImageLock);
+}
+
+
+/*
+ * Jobs, on the worker threads
+ */
+
+static void tga2gebmp_Server_List(tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	int Count = tga2gebmp_Session_GetSkinCount(Actor->Session);
+	int i;
+
+	fprintf(Job->Out, ", \"skins\": [");
+	for(i = 0; i < Count; i++)
+	{
+		long Size = 0;
+
+		tga2gebmp_Session_GetSkinData(Actor->Session, i, &Size);
+		fprintf(Job->Out, "%s{\"name\": ", i ? ", " : "");
+		Json_WriteString(Job->Out, tga2gebmp_Session_GetSkinName(Actor->Session, i));
+		fprintf(Job->Out, ", \"size\": %ld}", Size);
+	}
+	fprintf(Job->Out, "], \"dirty\": %d", tga2gebmp_Session_GetDirtyCount(Actor->Session));
+}
+
+
+static void tga2gebmp_Server_Replace(tga2gebmp_Server *Server, tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	const char *SkinName = Json_GetString(Job->Request, "skin");
+	const char *ImageFileName = Json_GetString(Job->Request, "image");
+	tga2gebmp_EncodeParams Params;
+	char FullPath[_MAX_PATH];
+	struct stat Stat;
+	geBoolean Cached;
+	void *Data;
+	long Size;
+	int Skin;
+
+	if(!SkinName || !ImageFileName)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "replace needs \"skin\" and \"image\"%s", NULL);
+		return;
+	}
+
+	Skin = tga2gebmp_Session_FindSkin(Actor->Session, SkinName);
+	if(Skin < 0)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "no skin named '%s'", SkinName);
+		return;
+	}
+
+	if(!tga2gebmp_Server_ResolvePath(Server, ImageFileName, FullPath) || stat(FullPath, &Stat) != 0)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "cannot read '%s'", ImageFileName);
+		return;
+	}
+
+	tga2gebmp_Session_GetSkinEncodeParams(Actor->Session, Skin, &Params);
+
+	Data = tga2gebmp_Server_FindImage(Server, FullPath, &Stat, &Params, &Size);
+	Cached = Data != NULL;
+	if(!Data && !tga2gebmp_Session_EncodeImage(Actor->Session, FullPath, &Params, &Data, &Size))
+	{
+		tga2gebmp_ServerJob_Fail(Job, "cannot convert '%s'", ImageFileName);
+		return;
+	}
+
+	if(!tga2gebmp_Session_ReplaceSkinData(Actor->Session, SkinName, Data, Size))
+		tga2gebmp_ServerJob_Fail(Job, "cannot replace '%s'", SkinName);
+	else
+		fprintf(Job->Out, ", \"cached\": %s, \"bytes\": %ld, \"dirty\": %d", Cached ? "true" : "false", Size,
+				tga2gebmp_Session_GetDirtyCount(Actor->Session));
+
+	if(Cached)
+		tga2gebmp_RamFree(Data);
+	else
+		tga2gebmp_Server_AddImage(Server, FullPath, &Stat, &Params, Data, Size);
+}
+
+
+static void tga2gebmp_Server_Export(tga2gebmp_Server *Server, tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	const char *SkinName = Json_GetString(Job->Request, "skin");
+	const char *FileName = Json_GetString(Job->Request, "file");
+	char FullPath[_MAX_PATH];
+	const void *Data;
+	long Size = 0;
+	FILE *File;
+	int Skin;
+
+	if(!SkinName || !FileName)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "export needs \"skin\" and \"file\"%s", NULL);
+		return;
+	}
+
+	Skin = tga2gebmp_Session_FindSkin(Actor->Session, SkinName);
+	Data = Skin >= 0 ? tga2gebmp_Session_GetSkinData(Actor->Session, Skin, &Size) : NULL;
+	if(!Data)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "no skin named '%s'", SkinName);
+		return;
+	}
+
+	if(!tga2gebmp_Server_ResolvePath(Server, FileName, FullPath) || (File = fopen(FullPath, "wb")) == NULL)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "cannot write '%s'", FileName);
+		return;
+	}
+
+	if(fwrite(Data, 1, Size, File) != (size_t)Size)
+		tga2gebmp_ServerJob_Fail(Job, "cannot write '%s'", FileName);
+	if(fclose(File) != 0 && Job->Ok)
+		tga2gebmp_ServerJob_Fail(Job, "cannot write '%s'", FileName);
+
+	if(Job->Ok)
+		fprintf(Job->Out, ", \"bytes\": %ld", Size);
+	else
+		remove(FullPath);
+}
+
+
+static void tga2gebmp_Server_Save(tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	tga2gebmp_SaveStats Stats;
+	int Dirty = tga2gebmp_Session_GetDirtyCount(Actor->Session);
+
+	if(!tga2gebmp_Session_Save(Actor->Session))
+	{
+		tga2gebmp_ServerJob_Fail(Job, "cannot save actor '%s'", Actor->FileName);
+		return;
+	}
+
+	// the saved file is the one the session has open now
+	tga2gebmp_ServerActor_Stat(Actor);
+
+	tga2gebmp_Session_GetSaveStats(Actor->Session, &Stats);
+	fprintf(Job->Out, ", \"changed\": %d, \"written\": %s, \"entries_rewritten\": %d, \"entries_reused\": %d, "
+					  "\"bytes_written\": %lu, \"bytes_reused\": %lu",
+			Stats.Skipped ? 0 : Dirty, Stats.Skipped ? "false" : "true", Stats.EntriesRewritten, Stats.EntriesReused,
+			(unsigned long)Stats.BytesWritten, (unsigned long)Stats.BytesReused);
+}
+
+
+static void tga2gebmp_Server_RunJob(tga2gebmp_Server *Server, tga2gebmp_ServerActor *Actor, tga2gebmp_ServerJob *Job)
+{
+	const char *Op = Job->Op;
+
+	// closing an actor that is not open has nothing to open it for
+	if(strcmp(Op, "close") == 0)
+	{
+		int Dirty = tga2gebmp_Session_GetDirtyCount(Actor->Session);
+
+		tga2gebmp_Session_CloseAct(Actor->Session);
+		fprintf(Job->Out, ", \"discarded\": %d", Dirty);
+		return;
+	}
+
+	if(!tga2gebmp_ServerActor_Open(Actor, Job))
+		return;
+
+	if(strcmp(Op, "open") == 0)
+		fprintf(Job->Out, ", \"skins\": %d", tga2gebmp_Session_GetSkinCount(Actor->Session));
+	else if(strcmp(Op, "list") == 0)
+		tga2gebmp_Server_List(Actor, Job);
+	else if(strcmp(Op, "replace") == 0)
+		tga2gebmp_Server_Replace(Server, Actor, Job);
+	else if(strcmp(Op, "export") == 0)
+		tga2gebmp_Server_Export(Server, Actor, Job);
+	else if(strcmp(Op, "save") == 0)
+		tga2gebmp_Server_Save(Actor, Job);
+}
+
+
+static void tga2gebmp_Server_RunTask(void *Context, int Worker)
+{
+	tga2gebmp_ServerTask *Task = (tga2gebmp_ServerTask*)Context;
+	int i;
+
+	(void)Worker;
+
+	for(i = 0; i < Task->Count; i++)
+	{
+		tga2gebmp_ServerJob *Job = Task->Jobs[i];
+		double Start = tga2gebmp_Server_Now();
+
+		Job->WaitMs = (Start - Job->Queued) * 1000.0;
+		tga2gebmp_Server_RunJob(Task->Server, Task->Actor, Job);
+		Job->RunMs = (tga2gebmp_Server_Now() - Start) * 1000.0;
+	}
+}
+
+
+/*
+ * Requests, on the dispatching thread
+ */
+
+static geBoolean tga2gebmp_Server_IsActorOp(const char *Op)
+{
+	return strcmp(Op, "open") == 0 || strcmp(Op, "list") == 0 || strcmp(Op, "replace") == 0 ||
+		   strcmp(Op, "export") == 0 || strcmp(Op, "save") == 0 || strcmp(Op, "close") == 0;
+}
+
+
+static void tga2gebmp_Server_Stats(tga2gebmp_Server *Server, tga2gebmp_ServerJob *Job)
+{
+	int Dirty = 0;
+	int i;
+
+	for(i = 0; i < Server->ActorCount; i++)
+		Dirty += tga2gebmp_Session_GetDirtyCount(Server->Actors[i]->Session);
+
+	fprintf(Job->Out, ", \"requests\": %lu, \"threads\": %d, \"actors\": %d, \"dirty\": %d, "
+					  "\"images\": %d, \"image_bytes\": %lu, \"image_hits\": %lu, \"image_misses\": %lu",
+			(unsigned long)Server->Requests, ThreadPool_GetThreadCount(Server->Pool), Server->ActorCount, Dirty,
+			Server->ImageCount, (unsigned long)Server->ImageBytes,
+			(unsigned long)Server->ImageHits, (unsigned long)Server->ImageMisses);
+
+	if(Server->Cache)
+	{
+		ConvCache_Stats Stats;
+
+		ConvCache_GetStats(Server->Cache, &Stats);
+		fprintf(Job->Out, ", \"cache_hits\": %lu, \"cache_misses\": %lu, \"cache_bytes\": %lu",
+				(unsigned long)Stats.Hits, (unsigned long)Stats.Misses, (unsigned long)Stats.Size);
+	}
+}
+
+
+// checks a job and finds its actor; jobs that need no worker run right here
+static void tga2gebmp_Server_PrepareJob(tga2gebmp_Server *Server, tga2gebmp_ServerJob *Job, const Json_Value *Request)
+{
+	const char *ActFileName;
+
+	memset(Job, 0, sizeof(*Job));
+	Job->Request = Request;
+	Job->Ok = GE_TRUE;
+	Job->Queued = tga2gebmp_Server_Now();
+	Job->Out = open_memstream(&Job->Fields, &Job->FieldsSize);
+	if(!Job->Out)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "out of memory%s", NULL);
+		return;
+	}
+
+	Job->Op = Json_GetString(Request, "op");
+	if(!Job->Op)
+	{
+		tga2gebmp_ServerJob_Fail(Job, "request needs \"op\"%s", NULL);
+		return;
+	}
+
+	if(tga2gebmp_Server_IsActorOp(Job->Op))
+	{
+		ActFileName = Json_GetString(Request, "actor");
+		if(!ActFileName)
+			tga2gebmp_ServerJob_Fail(Job, "%s needs \"actor\"", Job->Op);
+		else if((Job->Actor = tga2gebmp_Server_GetActor(Server, ActFileName)) == NULL)
+			tga2gebmp_ServerJob_Fail(Job, "cannot open actor '%s'", ActFileName);
+		return;
+	}
+
+	if(strcmp(Job->Op, "stats") == 0)
+		tga2gebmp_Server_Stats(Server, Job);
+	else if(strcmp(Job->Op, "shutdown") == 0)
+		Server->Stop = 1;
+	else if(strcmp(Job->Op, "batch") == 0)
+		tga2gebmp_ServerJob_Fail(Job, "batches do not nest%s", NULL);
+	else
+		tga2gebmp_ServerJob_Fail(Job, "unknown op '%s'", Job->Op);
+}
+
+
+// one task per actor, in the order the actors first appear
+static geBoolean tga2gebmp_Server_RunJobs(tga2gebmp_Server *Server, tga2gebmp_ServerJob *Jobs, int Count)
+{
+	tga2gebmp_ServerTask *Tasks;
+	tga2gebmp_ServerJob **Order;
+	int TaskCount = 0;
+	int Used = 0;
+	int i, j;
+
+	Tasks = (tga2gebmp_ServerTask*)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Count, 1) * sizeof(tga2gebmp_ServerTask));
+	Order = (tga2gebmp_ServerJob**)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Count, 1) * sizeof(tga2gebmp_ServerJob*));
+	if(!Tasks || !Order)
+	{
+		if(Tasks)
+			tga2gebmp_RamFree(Tasks);
+		if(Order)
+			tga2gebmp_RamFree(Order);
+		return GE_FALSE;
+	}
+
+	for(i = 0; i < Count; i++)
+	{
+		tga2gebmp_ServerTask *Task;
+
+		if(!Jobs[i].Actor || !Jobs[i].Ok)
+			continue;
+
+		for(j = 0; j < TaskCount && Tasks[j].Actor != Jobs[i].Actor; j++)
+			;
+		if(j < TaskCount)
+			continue;
+
+		// the task takes every later job of the same actor along
+		Task = &Tasks[TaskCount++];
+		Task->Server = Server;
+		Task->Actor = Jobs[i].Actor;
+		Task->Jobs = Order + Used;
+		Task->Count = 0;
+		for(j = i; j < Count; j++)
+		{
+			if(Jobs[j].Actor == Task->Actor && Jobs[j].Ok)
+				Task->Jobs[Task->Count++] = &Jobs[j];
+		}
+		Used += Task->Count;
+	}
+
+	for(i = 0; i < TaskCount; i++)
+	{
+		if(!ThreadPool_Submit(Server->Pool, Server->Group, tga2gebmp_Server_RunTask, &Tasks[i]))
+			tga2gebmp_Server_RunTask(&Tasks[i], -1);
+	}
+
+	ThreadPool_Wait(Server->Pool, Server->Group);
+
+	tga2gebmp_RamFree(Tasks);
+	tga2gebmp_RamFree(Order);
+	return GE_TRUE;
+}
+
+
+static void tga2gebmp_Server_WriteId(FILE *Out, const Json_Value *Request)
+{
+	const Json_Value *Id = Json_Find(Request, "id");
+
+	if(Id && Id->Type == JSON_STRING)
+	{
+		fprintf(Out, "\"id\": ");
+		Json_WriteString(Out, Id->String);
+		fprintf(Out, ", ");
+	}
+	else if(Id && Id->Type == JSON_NUMBER)
+		fprintf(Out, "\"id\": %.17g, ", Id->Number);
+}
+
+
+static void tga2gebmp_Server_WriteJob(FILE *Out, tga2gebmp_ServerJob *Job)
+{
+	if(Job->Out)
+		fclose(Job->Out);
+	Job->Out = NULL;
+
+	fprintf(Out, "{");
+	if(Job->Request)
+		tga2gebmp_Server_WriteId(Out, Job->Request);
+	fprintf(Out, "\"op\": ");
+	Json_WriteString(Out, Job->Op ? Job->Op : "");
+	fprintf(Out, ", \"ok\": %s, \"wait_ms\": %.3f, \"ms\": %.3f", Job->Ok ? "true" : "false", Job->WaitMs, Job->RunMs);
+	if(Job->Ok && Job->Fields)
+		fwrite(Job->Fields, 1, Job->FieldsSize, Out);
+	if(!Job->Ok)
+	{
+		fprintf(Out, ", \"error\": ");
+		Json_WriteString(Out, Job->Error);
+	}
+	fprintf(Out, "}");
+
+	free(Job->Fields);
+	Job->Fields = NULL;
+}
+
+
+// runs one request and writes its reply, without the line end
+static void tga2gebmp_Server_Run(tga2gebmp_Server *Server, const Json_Value *Request, FILE *Out)
+{
+	const Json_Value *List = Json_Find(Request, "jobs");
+	const char *Op = Json_GetString(Request, "op");
+	tga2gebmp_ServerJob *Jobs;
+	tga2gebmp_ServerJob Single;
+	geBoolean Ok = GE_TRUE;
+	double Start = tga2gebmp_Server_Now();
+	int Count;
+	int i;
+
+	Server->Requests++;
+
+	if(!Op || strcmp(Op, "batch") != 0)
+	{
+		tga2gebmp_Server_PrepareJob(Server, &Single, Request);
+		if(Single.Ok && Single.Actor && !tga2gebmp_Server_RunJobs(Server, &Single, 1))
+			tga2gebmp_ServerJob_Fail(&Single, "out of memory%s", NULL);
+		if(!Single.Actor)
+			Single.RunMs = (tga2gebmp_Server_Now() - Start) * 1000.0;
+
+		tga2gebmp_Server_WriteJob(Out, &Single);
+		tga2gebmp_Server_DropClosedActors(Server);
+		return;
+	}
+
+	Count = List && List->Type == JSON_ARRAY ? List->Count : 0;
+	Jobs = (tga2gebmp_ServerJob*)tga2gebmp_RamAllocate(TGA2GEBMP_MAX(Count, 1) * sizeof(tga2gebmp_ServerJob));
+	if(!Jobs || !List || List->Type != JSON_ARRAY)
+	{
+		if(Jobs)
+			tga2gebmp_RamFree(Jobs);
+		fprintf(Out, "{");
+		tga2gebmp_Server_WriteId(Out, Request);
+		fprintf(Out, "\"op\": \"batch\", \"ok\": false, \"error\": \"%s\"}", Jobs ? "batch needs \\\"jobs\\\"" : "out of memory");
+		return;
+	}
+
+	for(i = 0; i < Count; i++)
+		tga2gebmp_Server_PrepareJob(Server, &Jobs[i], &List->Items[i]);
+
+	if(!tga2gebmp_Server_RunJobs(Server, Jobs, Count))
+	{
+		for(i = 0; i < Count; i++)
+		{
+			if(Jobs[i].Actor && Jobs[i].Ok)
+				tga2gebmp_ServerJob_Fail(&Jobs[i], "out of memory%s", NULL);
+		}
+	}
+
+	for(i = 0; i < Count; i++)
+		Ok = Ok && Jobs[i].Ok;
+
+	fprintf(Out, "{");
+	tga2gebmp_Server_WriteId(Out, Request);
+	fprintf(Out, "\"op\": \"batch\", \"ok\": %s, \"ms\": %.3f, \"jobs\": [", Ok ? "true" : "false",
+			(tga2gebmp_Server_Now() - Start) * 1000.0);
+	for(i = 0; i < Count; i++)
+	{
+		if(i)
+			fprintf(Out, ", ");
+		tga2gebmp_Server_WriteJob(Out, &Jobs[i]);
+	}
+	fprintf(Out, "]}");
+
+	tga2gebmp_RamFree(Jobs);
+	tga2gebmp_Server_DropClosedActors(Server);
+}
+
+
+// one line of a client's, without its line end, and its reply
+static void tga2gebmp_Server_Request(tga2gebmp_Server *Server, char *Line, size_t Length, FILE *Out)
+{
+	Json_Value *Request;
+	double Start = tga2gebmp_Server_Now();
+
+	while(Length > 0 && Line[Length - 1] == '\r')
+		Line[--Length] = '\0';
+	if(Length == 0)
+		return;
+
+	Request = Json_Parse(Line, Length);
+	if(!Request || Request->Type != JSON_OBJECT)
+		fprintf(Out, "{\"ok\": false, \"error\": \"not a JSON object\"}");
+	else
+		tga2gebmp_Server_Run(Server, Request, Out);
+	fprintf(Out, "\n");
+	fflush(Out);
+
+	if(Server->Verbose)
+	{
+		const char *Op = Json_GetString(Request, "op");
+
+		printf("tga2gebmp_server: %s in %.1f ms\n", Op ? Op : "?", (tga2gebmp_Server_Now() - Start) * 1000.0);
+		fflush(stdout);
+	}
+
+	Json_Free(&Request);
+}
+
+
+static geBoolean tga2gebmp_Server_OpenClient(tga2gebmp_ServerClient *Client, int Fd)
+{
+	int OutFd = dup(Fd);
+
+	memset(Client, 0, sizeof(*Client));
+	Client->Fd = Fd;
+	Client->Out = OutFd >= 0 ? fdopen(OutFd, "w") : NULL;
+	if(!Client->Out)
+	{
+		if(OutFd >= 0)
+			close(OutFd);
+		close(Fd);
+		return GE_FALSE;
+	}
+
+	return GE_TRUE;
+}
+
+
+static void tga2gebmp_Server_CloseClient(tga2gebmp_ServerClient *Client)
+{
+	fclose(Client->Out);
+	close(Client->Fd);
+	if(Client->Line)
+		tga2gebmp_RamFree(Client->Line);
+	memset(Client, 0, sizeof(*Client));
+	Client->Fd = -1;
+}
+
+
+// one read of what poll found, and every request it completed; GE_FALSE once
+// the client hung up, after running a last line it did not end, or once its
+// line outgrew SERVER_MAX_LINE
+static geBoolean tga2gebmp_Server_ReadClient(tga2gebmp_Server *Server, tga2gebmp_ServerClient *Client)
+{
+	char *End;
+	size_t Start = 0;
+	size_t Scanned;
+	ssize_t Count;
+
+	if(Client->Capacity - Client->Length < SERVER_READ_SIZE + 1)
+	{
+		size_t NewCapacity = TGA2GEBMP_MAX(Client->Capacity * 2, Client->Length + SERVER_READ_SIZE + 1);
+		char *NewLine = (char*)tga2gebmp_RamRealloc(Client->Line, NewCapacity);
+
+		if(!NewLine)
+			return GE_FALSE;
+
+		Client->Line = NewLine;
+		Client->Capacity = NewCapacity;
+	}
+
+	Count = read(Client->Fd, Client->Line + Client->Length, SERVER_READ_SIZE);
+	if(Count < 0 && errno == EINTR)
+		return GE_TRUE;
+	if(Count <= 0)
+	{
+		if(Client->Length > 0 && !Server->Stop)
+		{
+			Client->Line[Client->Length] = '\0';
+			tga2gebmp_Server_Request(Server, Client->Line, Client->Length, Client->Out);
+		}
+		return GE_FALSE;
+	}
+
+	// only the new bytes can end a line
+	Scanned = Client->Length;
+	Client->Length += (size_t)Count;
+
+	while(!Server->Stop &&
+		  (End = (char*)memchr(Client->Line + Scanned, '\n', Client->Length - Scanned)) != NULL)
+	{
+		*End = '\0';
+		tga2gebmp_Server_Request(Server, Client->Line + Start, (size_t)(End - Client->Line) - Start, Client->Out);
+		Start = Scanned = (size_t)(End - Client->Line) + 1;
+	}
+
+	Client->Length -= Start;
+	memmove(Client->Line, Client->Line + Start, Client->Length);
+
+	if(Client->Length > SERVER_MAX_LINE)
+	{
+		fprintf(Client->Out, "{\"ok\": false, \"error\": \"request longer than %d bytes\"}\n", SERVER_MAX_LINE);
+		fflush(Client->Out);
+		return GE_FALSE;
+	}
+	return GE_TRUE;
+}
+
+
+// the listener and every client in one poll; a request runs when its line is
+// complete, so clients take turns a read at a time instead of one holding
+// the server until it hangs up
+static void tga2gebmp_Server_Serve(tga2gebmp_Server *Server, int Listener)
+{
+	tga2gebmp_ServerClient Clients[SERVER_MAX_CLIENTS];
+	struct pollfd Polls[SERVER_MAX_CLIENTS + 1];
+	int ClientCount = 0;
+	int i, j;
+
+	while(!Server->Stop)
+	{
+		for(i = 0; i < ClientCount; i++)
+		{
+			Polls[i].fd = Clients[i].Fd;
+			Polls[i].events = POLLIN;
+			Polls[i].revents = 0;
+		}
+
+		// with every slot taken, new clients wait in the listen backlog
+		Polls[ClientCount].fd = ClientCount < SERVER_MAX_CLIENTS ? Listener : -1;
+		Polls[ClientCount].events = POLLIN;
+		Polls[ClientCount].revents = 0;
+
+		// no SA_RESTART, so a signal ends the wait
+		if(poll(Polls, ClientCount + 1, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "tga2gebmp_server: cannot wait for requests\n");
+			break;
+		}
+
+		for(i = 0; i < ClientCount && !Server->Stop; i++)
+		{
+			if(Polls[i].revents && !tga2gebmp_Server_ReadClient(Server, &Clients[i]))
+				tga2gebmp_Server_CloseClient(&Clients[i]);
+		}
+
+		if(!Server->Stop && (Polls[ClientCount].revents & POLLIN))
+		{
+			int Fd = accept(Listener, NULL, NULL);
+
+			if(Fd >= 0)
+			{
+				if(tga2gebmp_Server_OpenClient(&Clients[ClientCount], Fd))
+					ClientCount++;
+			}
+			else if(errno != EINTR && errno != ECONNABORTED)
+			{
+				fprintf(stderr, "tga2gebmp_server: cannot accept connections\n");
+				break;
+			}
+		}
+
+		// the clients that hung up leave their slots
+		for(i = j = 0; i < ClientCount; i++)
+		{
+			if(Clients[i].Fd >= 0)
+				Clients[j++] = Clients[i];
+		}
+		ClientCount = j;
+	}
+
+	for(i = 0; i < ClientCount; i++)
+		tga2gebmp_Server_CloseClient(&Clients[i]);
+}
+
+
+static int tga2gebmp_Server_Listen(const char *SocketPath)
+{
+	struct sockaddr_un Address;
+	int Fd;
+
+	if(strlen(SocketPath) + 1 > sizeof(Address.sun_path))
+	{
+		fprintf(stderr, "tga2gebmp_server: socket path '%s' is too long\n", SocketPath);
+		return -1;
+	}
+
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	strcpy(Address.sun_path, SocketPath);
+
+	Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(Fd < 0)
+		return -1;
+
+	// a socket left behind by a server that died is taken over, a live one is not
+	if(connect(Fd, (struct sockaddr*)&Address, sizeof(Address)) == 0)
+	{
+		fprintf(stderr, "tga2gebmp_server: a server is already listening on '%s'\n", SocketPath);
+		close(Fd);
+		return -1;
+	}
+	close(Fd);
+	unlink(SocketPath);
+
+	Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(Fd < 0)
+		return -1;
+
+	if(bind(Fd, (struct sockaddr*)&Address, sizeof(Address)) != 0 || listen(Fd, 16) != 0)
+	{
+		fprintf(stderr, "tga2gebmp_server: cannot listen on '%s'\n", SocketPath);
+		close(Fd);
+		return -1;
+	}
+
+	return Fd;
+}
+
+
+int main(int argc, char **argv)
+{
+	tga2gebmp_Server Server;
+	struct sigaction Action;
+	char SocketPath[_MAX_PATH];
+	const char *SocketArg = NULL;
+	const char *CacheDir = NULL;
+	uint64_t CacheSize = 0;
+	int Threads = 0;
+	int MaxIo = 0;
+	int MemCache = SERVER_MEMCACHE;
+	int Listener;
+	int Unsaved = 0;
+	int i;
+
+	memset(&Server, 0, sizeof(Server));
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-socket") == 0 && i + 1 < argc)
+			SocketArg = argv[++i];
+		else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			Threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-io") == 0 && i + 1 < argc)
+			MaxIo = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			strncpy(Server.WorkDir, argv[++i], sizeof(Server.WorkDir) - 1);
+		else if(strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+			CacheDir = argv[++i];
+		else if(strcmp(argv[i], "-cachesize") == 0 && i + 1 < argc)
+			CacheSize = (uint64_t)TGA2GEBMP_MAX(atoi(argv[++i]), 1) << 20;
+		else if(strcmp(argv[i], "-memcache") == 0 && i + 1 < argc)
+			MemCache = TGA2GEBMP_MAX(atoi(argv[++i]), 0);
+		else if(strcmp(argv[i], "-v") == 0)
+			Server.Verbose = GE_TRUE;
+		else
+		{
+			tga2gebmp_Server_Usage();
+			return 2;
+		}
+	}
+
+	// paths in requests are resolved against the full working directory
+	if(Server.WorkDir[0] == '\0')
+		strcpy(Server.WorkDir, ".");
+	if(!realpath(Server.WorkDir, SocketPath))
+	{
+		fprintf(stderr, "tga2gebmp_server: cannot use working directory '%s'\n", Server.WorkDir);
+		return 1;
+	}
+	strcpy(Server.WorkDir, SocketPath);
+
+	if(SocketArg)
+		strncpy(SocketPath, SocketArg, sizeof(SocketPath) - 1);
+	else if(!tga2gebmp_Server_ResolvePath(&Server, SERVER_SOCKET, SocketPath))
+		return 1;
+	SocketPath[sizeof(SocketPath) - 1] = '\0';
+
+	Server.MaxImageBytes = (uint64_t)MemCache << 20;
+	Server.Pool = ThreadPool_Create(Threads);
+	Server.Group = ThreadPool_CreateGroup();
+	Server.IoGate = ThreadPool_CreateGate(MaxIo > 0 ? MaxIo : 4);
+	Server.ImageLock = ThreadPool_CreateGate(1);
+	if(!Server.Pool || !Server.Group || !Server.IoGate || !Server.ImageLock)
+	{
+		fprintf(stderr, "tga2gebmp_server: out of memory\n");
+		return 1;
+	}
+
+	// a cache that cannot be opened only means converting everything again
+	if(CacheDir)
+	{
+		Server.Cache = ConvCache_Open(CacheDir, CacheSize);
+		if(!Server.Cache)
+			fprintf(stderr, "tga2gebmp_server: cannot use cache directory '%s', continuing without it\n", CacheDir);
+	}
+
+	Listener = tga2gebmp_Server_Listen(SocketPath);
+	if(Listener < 0)
+	{
+		ConvCache_Close(&Server.Cache);
+		return 1;
+	}
+
+	tga2gebmp_ActiveServer = &Server;
+	memset(&Action, 0, sizeof(Action));
+	Action.sa_handler = tga2gebmp_Server_OnSignal;
+	sigemptyset(&Action.sa_mask);
+	sigaction(SIGINT, &Action, NULL);
+	sigaction(SIGTERM, &Action, NULL);
+	// a client that hangs up before its reply must not end the server
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("tga2gebmp_server: listening on '%s' with %d thread(s)\n", SocketPath, ThreadPool_GetThreadCount(Server.Pool));
+	fflush(stdout);
+
+	tga2gebmp_Server_Serve(&Server, Listener);
+
+	close(Listener);
+	unlink(SocketPath);
+
+	for(i = 0; i < Server.ActorCount; i++)
+	{
+		Unsaved += tga2gebmp_Session_GetDirtyCount(Server.Actors[i]->Session);
+		tga2gebmp_Server_DestroyActor(Server.Actors[i]);
+	}
+	if(Unsaved > 0)
+		fprintf(stderr, "tga2gebmp_server: %d unsaved skin(s) discarded\n", Unsaved);
+
+	tga2gebmp_Server_EvictImages(&Server, 0);
+	if(Server.Images)
+		tga2gebmp_RamFree(Server.Images);
+	if(Server.Actors)
+		tga2gebmp_RamFree(Server.Actors);
+
+	ThreadPool_Destroy(&Server.Pool);
+	ThreadPool_DestroyGroup(&Server.Group);
+	ThreadPool_DestroyGate(&Server.IoGate);
+	ThreadPool_DestroyGate(&Server.ImageLock);
+	ConvCache_Close(&Server.Cache);
+
+	printf("tga2gebmp_server: stopped after %lu request(s)\n", (unsigned long)Server.Requests);
+	return 0;
+}
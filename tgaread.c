@@ -0,0 +1,1124 @@
+/**
+ * @file tgaread.c
+ *
+ * TGA decoder with SSE2/AVX2 kernels.
+ */
+#include <stdio.h>
+#include "tgaread.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86)
+	#define TGAREAD_HAVE_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+/* AVX2 intrinsics need GCC/Clang or Visual C++ 2013 and later */
+#if defined(TGAREAD_HAVE_SSE2) && (defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1800))
+	#define TGAREAD_HAVE_AVX2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#define TGAREAD_AVX2_FUNC
+	#else
+		#define TGAREAD_AVX2_FUNC		__attribute__((target("avx2")))
+	#endif
+#endif
+
+#define TGAREAD_HEADER_SIZE			18
+#define TGAREAD_FILE_BUFFER			(1 << 20)
+/* 32-bit sums hold up to 4096 x 4096 bytes of 255 */
+#define TGAREAD_MAX_REDUCTION		4096
+
+
+typedef struct	TgaRead_Kernels
+{
+	void	(*Fill16)(uint8_t *Dest, uint16_t Pixel, int Count);
+	void	(*Fill24)(uint8_t *Dest, const uint8_t *Pixel, int Count);
+	void	(*Fill32)(uint8_t *Dest, uint32_t Pixel, int Count);
+	/* A1R5G5B5 to 32 bits, Alpha 0 forces an opaque result */
+	void	(*Expand16)(uint8_t *Dest, const uint8_t *Src, int Count, int Alpha);
+	void	(*SetAlpha)(uint8_t *Dest, int Count);
+	void	(*Lookup32)(uint8_t *Dest, const uint8_t *Index, const uint32_t *Palette, int Count);
+}	TgaRead_Kernels;
+
+/* run state carried from one row to the next, packets may span rows */
+typedef struct	TgaRead_Stream
+{
+	const uint8_t	*Data;
+	size_t			Size;
+	size_t			Position;
+	int				Remaining;		/* pixels left in the current packet */
+	int				Repeat;			/* current packet is a run */
+	uint8_t			Pixel[4];		/* the run's pixel */
+}	TgaRead_Stream;
+
+
+struct TgaRead_File
+{
+	FILE			*File;
+	TgaRead_Info	Info;
+	uint32_t		Palette[256];
+	uint8_t			*Buffer;		/* the file from Stream.Data + Stream.Position on */
+	size_t			BufferSize;
+	size_t			RowBytes;		/* most bytes one row can take in the file */
+	uint8_t			*Source;		/* a row of source pixels when they need converting */
+	TgaRead_Stream	Stream;
+	int				Row;			/* next row in file order */
+};
+
+
+static int TgaRead_ReadU16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+
+/* 5 bit channel to 8 bits, replicating the high bits into the low ones */
+static uint32_t TgaRead_Expand5(uint32_t v)
+{
+	return (v << 3) | (v >> 2);
+}
+
+
+static uint32_t TgaRead_Convert16(int p, int Alpha)
+{
+	uint32_t b = TgaRead_Expand5(p & 0x1f);
+	uint32_t g = TgaRead_Expand5((p >> 5) & 0x1f);
+	uint32_t r = TgaRead_Expand5((p >> 10) & 0x1f);
+	uint32_t a = (!Alpha || (p & 0x8000)) ? 0xff : 0x00;
+
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+
+static void TgaRead_Store32(uint8_t *Dest, uint32_t Pixel)
+{
+	Dest[0] = (uint8_t)(Pixel);
+	Dest[1] = (uint8_t)(Pixel >> 8);
+	Dest[2] = (uint8_t)(Pixel >> 16);
+	Dest[3] = (uint8_t)(Pixel >> 24);
+}
+
+
+/* scalar kernels */
+
+static void TgaRead_Fill16_Scalar(uint8_t *Dest, uint16_t Pixel, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+	{
+		Dest[i * 2] = (uint8_t)Pixel;
+		Dest[i * 2 + 1] = (uint8_t)(Pixel >> 8);
+	}
+}
+
+
+static void TgaRead_Fill24_Scalar(uint8_t *Dest, const uint8_t *Pixel, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+	{
+		Dest[i * 3] = Pixel[0];
+		Dest[i * 3 + 1] = Pixel[1];
+		Dest[i * 3 + 2] = Pixel[2];
+	}
+}
+
+
+static void TgaRead_Fill32_Scalar(uint8_t *Dest, uint32_t Pixel, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+		TgaRead_Store32(Dest + i * 4, Pixel);
+}
+
+
+static void TgaRead_Expand16_Scalar(uint8_t *Dest, const uint8_t *Src, int Count, int Alpha)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+		TgaRead_Store32(Dest + i * 4, TgaRead_Convert16(TgaRead_ReadU16(Src + i * 2), Alpha));
+}
+
+
+static void TgaRead_SetAlpha_Scalar(uint8_t *Dest, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+		Dest[i * 4 + 3] = 0xff;
+}
+
+
+static void TgaRead_Lookup32_Scalar(uint8_t *Dest, const uint8_t *Index, const uint32_t *Palette, int Count)
+{
+	int i;
+
+	for(i = 0; i < Count; i++)
+		TgaRead_Store32(Dest + i * 4, Palette[Index[i]]);
+}
+
+
+static const TgaRead_Kernels TgaRead_ScalarKernels =
+{
+	TgaRead_Fill16_Scalar,
+	TgaRead_Fill24_Scalar,
+	TgaRead_Fill32_Scalar,
+	TgaRead_Expand16_Scalar,
+	TgaRead_SetAlpha_Scalar,
+	TgaRead_Lookup32_Scalar
+};
+
+
+#ifdef TGAREAD_HAVE_SSE2
+
+static void TgaRead_Fill16_SSE2(uint8_t *Dest, uint16_t Pixel, int Count)
+{
+	__m128i v = _mm_set1_epi16((short)Pixel);
+	int i = 0;
+
+	for(; i + 8 <= Count; i += 8)
+		_mm_storeu_si128((__m128i*)(Dest + i * 2), v);
+
+	TgaRead_Fill16_Scalar(Dest + i * 2, Pixel, Count - i);
+}
+
+
+static void TgaRead_Fill24_SSE2(uint8_t *Dest, const uint8_t *Pixel, int Count)
+{
+	uint8_t Pattern[48];
+	__m128i v0, v1, v2;
+	int i = 0;
+
+	if(Count < 16)
+	{
+		TgaRead_Fill24_Scalar(Dest, Pixel, Count);
+		return;
+	}
+
+	// 16 pixels are exactly three vectors
+	TgaRead_Fill24_Scalar(Pattern, Pixel, 16);
+	v0 = _mm_loadu_si128((const __m128i*)Pattern);
+	v1 = _mm_loadu_si128((const __m128i*)(Pattern + 16));
+	v2 = _mm_loadu_si128((const __m128i*)(Pattern + 32));
+
+	for(; i + 16 <= Count; i += 16)
+	{
+		_mm_storeu_si128((__m128i*)(Dest + i * 3), v0);
+		_mm_storeu_si128((__m128i*)(Dest + i * 3 + 16), v1);
+		_mm_storeu_si128((__m128i*)(Dest + i * 3 + 32), v2);
+	}
+
+	TgaRead_Fill24_Scalar(Dest + i * 3, Pixel, Count - i);
+}
+
+
+static void TgaRead_Fill32_SSE2(uint8_t *Dest, uint32_t Pixel, int Count)
+{
+	__m128i v = _mm_set1_epi32((int)Pixel);
+	int i = 0;
+
+	for(; i + 4 <= Count; i += 4)
+		_mm_storeu_si128((__m128i*)(Dest + i * 4), v);
+
+	TgaRead_Fill32_Scalar(Dest + i * 4, Pixel, Count - i);
+}
+
+
+/* eight 16-bit pixels to two vectors of four 32-bit ones */
+static void TgaRead_Expand16x8_SSE2(uint8_t *Dest, __m128i p, __m128i AlphaMask)
+{
+	const __m128i Mask5 = _mm_set1_epi16(0x1f);
+	__m128i b, g, r, a, lo, hi;
+
+	b = _mm_and_si128(p, Mask5);
+	g = _mm_and_si128(_mm_srli_epi16(p, 5), Mask5);
+	r = _mm_and_si128(_mm_srli_epi16(p, 10), Mask5);
+	b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+	g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+	r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+
+	// the alpha bit becomes 0x00 or 0xff, or always 0xff
+	a = _mm_or_si128(_mm_srai_epi16(p, 15), AlphaMask);
+	a = _mm_and_si128(a, _mm_set1_epi16(0xff));
+
+	lo = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+	hi = _mm_or_si128(r, _mm_slli_epi16(a, 8));
+
+	_mm_storeu_si128((__m128i*)Dest, _mm_unpacklo_epi16(lo, hi));
+	_mm_storeu_si128((__m128i*)(Dest + 16), _mm_unpackhi_epi16(lo, hi));
+}
+
+
+static void TgaRead_Expand16_SSE2(uint8_t *Dest, const uint8_t *Src, int Count, int Alpha)
+{
+	__m128i AlphaMask = Alpha ? _mm_setzero_si128() : _mm_set1_epi16(-1);
+	int i = 0;
+
+	for(; i + 8 <= Count; i += 8)
+		TgaRead_Expand16x8_SSE2(Dest + i * 4, _mm_loadu_si128((const __m128i*)(Src + i * 2)), AlphaMask);
+
+	TgaRead_Expand16_Scalar(Dest + i * 4, Src + i * 2, Count - i, Alpha);
+}
+
+
+static void TgaRead_SetAlpha_SSE2(uint8_t *Dest, int Count)
+{
+	const __m128i Alpha = _mm_set1_epi32((int)0xff000000);
+	int i = 0;
+
+	for(; i + 4 <= Count; i += 4)
+	{
+		__m128i *p = (__m128i*)(Dest + i * 4);
+		_mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), Alpha));
+	}
+
+	TgaRead_SetAlpha_Scalar(Dest + i * 4, Count - i);
+}
+
+
+static const TgaRead_Kernels TgaRead_SSE2Kernels =
+{
+	TgaRead_Fill16_SSE2,
+	TgaRead_Fill24_SSE2,
+	TgaRead_Fill32_SSE2,
+	TgaRead_Expand16_SSE2,
+	TgaRead_SetAlpha_SSE2,
+	TgaRead_Lookup32_Scalar		/* no gather before AVX2 */
+};
+
+#endif
+
+
+#ifdef TGAREAD_HAVE_AVX2
+
+TGAREAD_AVX2_FUNC static void TgaRead_Fill16_AVX2(uint8_t *Dest, uint16_t Pixel, int Count)
+{
+	__m256i v = _mm256_set1_epi16((short)Pixel);
+	int i = 0;
+
+	for(; i + 16 <= Count; i += 16)
+		_mm256_storeu_si256((__m256i*)(Dest + i * 2), v);
+
+	TgaRead_Fill16_Scalar(Dest + i * 2, Pixel, Count - i);
+}
+
+
+TGAREAD_AVX2_FUNC static void TgaRead_Fill24_AVX2(uint8_t *Dest, const uint8_t *Pixel, int Count)
+{
+	uint8_t Pattern[96];
+	__m256i v0, v1, v2;
+	int i = 0;
+
+	if(Count < 32)
+	{
+		TgaRead_Fill24_Scalar(Dest, Pixel, Count);
+		return;
+	}
+
+	// 32 pixels are exactly three vectors
+	TgaRead_Fill24_Scalar(Pattern, Pixel, 32);
+	v0 = _mm256_loadu_si256((const __m256i*)Pattern);
+	v1 = _mm256_loadu_si256((const __m256i*)(Pattern + 32));
+	v2 = _mm256_loadu_si256((const __m256i*)(Pattern + 64));
+
+	for(; i + 32 <= Count; i += 32)
+	{
+		_mm256_storeu_si256((__m256i*)(Dest + i * 3), v0);
+		_mm256_storeu_si256((__m256i*)(Dest + i * 3 + 32), v1);
+		_mm256_storeu_si256((__m256i*)(Dest + i * 3 + 64), v2);
+	}
+
+	TgaRead_Fill24_Scalar(Dest + i * 3, Pixel, Count - i);
+}
+
+
+TGAREAD_AVX2_FUNC static void TgaRead_Fill32_AVX2(uint8_t *Dest, uint32_t Pixel, int Count)
+{
+	__m256i v = _mm256_set1_epi32((int)Pixel);
+	int i = 0;
+
+	for(; i + 8 <= Count; i += 8)
+		_mm256_storeu_si256((__m256i*)(Dest + i * 4), v);
+
+	TgaRead_Fill32_Scalar(Dest + i * 4, Pixel, Count - i);
+}
+
+
+TGAREAD_AVX2_FUNC static void TgaRead_Expand16_AVX2(uint8_t *Dest, const uint8_t *Src, int Count, int Alpha)
+{
+	const __m256i Mask5 = _mm256_set1_epi16(0x1f);
+	const __m256i Mask8 = _mm256_set1_epi16(0xff);
+	__m256i AlphaMask = Alpha ? _mm256_setzero_si256() : _mm256_set1_epi16(-1);
+	int i = 0;
+
+	for(; i + 16 <= Count; i += 16)
+	{
+		__m256i p, b, g, r, a, lo, hi, p0, p1;
+
+		p = _mm256_loadu_si256((const __m256i*)(Src + i * 2));
+		b = _mm256_and_si256(p, Mask5);
+		g = _mm256_and_si256(_mm256_srli_epi16(p, 5), Mask5);
+		r = _mm256_and_si256(_mm256_srli_epi16(p, 10), Mask5);
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 3), _mm256_srli_epi16(g, 2));
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		a = _mm256_and_si256(_mm256_or_si256(_mm256_srai_epi16(p, 15), AlphaMask), Mask8);
+
+		lo = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+		hi = _mm256_or_si256(r, _mm256_slli_epi16(a, 8));
+
+		// the unpacks work per 128-bit lane, put the pixels back in order
+		p0 = _mm256_unpacklo_epi16(lo, hi);
+		p1 = _mm256_unpackhi_epi16(lo, hi);
+		_mm256_storeu_si256((__m256i*)(Dest + i * 4), _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256((__m256i*)(Dest + i * 4 + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+	}
+
+	TgaRead_Expand16_SSE2(Dest + i * 4, Src + i * 2, Count - i, Alpha);
+}
+
+
+TGAREAD_AVX2_FUNC static void TgaRead_SetAlpha_AVX2(uint8_t *Dest, int Count)
+{
+	const __m256i Alpha = _mm256_set1_epi32((int)0xff000000);
+	int i = 0;
+
+	for(; i + 8 <= Count; i += 8)
+	{
+		__m256i *p = (__m256i*)(Dest + i * 4);
+		_mm256_storeu_si256(p, _mm256_or_si256(_mm256_loadu_si256(p), Alpha));
+	}
+
+	TgaRead_SetAlpha_SSE2(Dest + i * 4, Count - i);
+}
+
+
+TGAREAD_AVX2_FUNC static void TgaRead_Lookup32_AVX2(uint8_t *Dest, const uint8_t *Index, const uint32_t *Palette, int Count)
+{
+	int i = 0;
+
+	for(; i + 8 <= Count; i += 8)
+	{
+		__m256i Indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(Index + i)));
+		__m256i Pixels = _mm256_i32gather_epi32((const int*)Palette, Indices, 4);
+		_mm256_storeu_si256((__m256i*)(Dest + i * 4), Pixels);
+	}
+
+	TgaRead_Lookup32_Scalar(Dest + i * 4, Index + i, Palette, Count - i);
+}
+
+
+static const TgaRead_Kernels TgaRead_AVX2Kernels =
+{
+	TgaRead_Fill16_AVX2,
+	TgaRead_Fill24_AVX2,
+	TgaRead_Fill32_AVX2,
+	TgaRead_Expand16_AVX2,
+	TgaRead_SetAlpha_AVX2,
+	TgaRead_Lookup32_AVX2
+};
+
+#endif
+
+
+static int TgaRead_DetectSimdLevel(void)
+{
+	int Level = TGAREAD_SIMD_SCALAR;
+
+#if defined(TGAREAD_HAVE_SSE2)
+	#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+		Level = TGAREAD_SIMD_SSE2;
+	#elif defined(_MSC_VER)
+	{
+		int Regs[4];
+		__cpuid(Regs, 1);
+		if(Regs[3] & (1 << 26))
+			Level = TGAREAD_SIMD_SSE2;
+	}
+	#else
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("sse2"))
+			Level = TGAREAD_SIMD_SSE2;
+	#endif
+#endif
+
+#if defined(TGAREAD_HAVE_AVX2)
+	if(Level == TGAREAD_SIMD_SSE2)
+	{
+	#if defined(_MSC_VER)
+		int Regs[4];
+
+		// the OS has to save the YMM registers as well
+		__cpuid(Regs, 1);
+		if((Regs[2] & (1 << 27)) && (Regs[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(Regs, 7, 0);
+			if(Regs[1] & (1 << 5))
+				Level = TGAREAD_SIMD_AVX2;
+		}
+	#else
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			Level = TGAREAD_SIMD_AVX2;
+	#endif
+	}
+#endif
+
+	return Level;
+}
+
+
+static int TgaRead_SupportedLevel = -1;
+static int TgaRead_Level = -1;
+
+
+int TgaRead_GetSupportedSimdLevel(void)
+{
+	// detection is idempotent, a race only repeats it
+	if(TgaRead_SupportedLevel < 0)
+		TgaRead_SupportedLevel = TgaRead_DetectSimdLevel();
+
+	return TgaRead_SupportedLevel;
+}
+
+
+int TgaRead_GetSimdLevel(void)
+{
+	if(TgaRead_Level < 0)
+		TgaRead_Level = TgaRead_GetSupportedSimdLevel();
+
+	return TgaRead_Level;
+}
+
+
+int TgaRead_SetSimdLevel(int Level)
+{
+	TgaRead_Level = TGA2GEBMP_MIN(TGA2GEBMP_MAX(Level, TGAREAD_SIMD_SCALAR), TgaRead_GetSupportedSimdLevel());
+	return TgaRead_Level;
+}
+
+
+const char *TgaRead_GetSimdName(int Level)
+{
+	switch(Level)
+	{
+		case TGAREAD_SIMD_AVX2:		return "avx2";
+		case TGAREAD_SIMD_SSE2:		return "sse2";
+		default:					return "scalar";
+	}
+}
+
+
+static const TgaRead_Kernels *TgaRead_GetKernels(void)
+{
+	switch(TgaRead_GetSimdLevel())
+	{
+#ifdef TGAREAD_HAVE_AVX2
+		case TGAREAD_SIMD_AVX2:		return &TgaRead_AVX2Kernels;
+#endif
+#ifdef TGAREAD_HAVE_SSE2
+		case TGAREAD_SIMD_SSE2:		return &TgaRead_SSE2Kernels;
+#endif
+		default:					return &TgaRead_ScalarKernels;
+	}
+}
+
+
+int TgaRead_GetInfo(const void *Data, size_t Size, TgaRead_Info *Info)
+{
+	const uint8_t *Header = (const uint8_t*)Data;
+	int ColorMapType;
+	int BaseType;
+	size_t ColorMapBytes;
+
+	if(Size < TGAREAD_HEADER_SIZE)
+		return 0;
+
+	memset(Info, 0, sizeof(*Info));
+
+	ColorMapType = Header[1];
+	Info->ImageType = Header[2];
+	Info->ColorMapStart = TgaRead_ReadU16(Header + 3);
+	Info->ColorMapLength = TgaRead_ReadU16(Header + 5);
+	Info->ColorMapDepth = Header[7];
+	Info->Width = TgaRead_ReadU16(Header + 12);
+	Info->Height = TgaRead_ReadU16(Header + 14);
+	Info->PixelDepth = Header[16];
+	Info->AlphaBits = Header[17] & 0x0f;
+	Info->RightToLeft = (Header[17] & 0x10) != 0;
+	Info->TopDown = (Header[17] & 0x20) != 0;
+
+	if(Info->Width == 0 || Info->Height == 0 || ColorMapType > 1)
+		return 0;
+
+	BaseType = Info->ImageType & ~8;
+
+	switch(BaseType)
+	{
+		case 1:		// colour-mapped
+			if(ColorMapType != 1 || Info->PixelDepth != 8 || Info->ColorMapLength == 0)
+				return 0;
+			switch(Info->ColorMapDepth)
+			{
+				case 15:
+				case 16:
+					Info->Format = (Info->ColorMapDepth == 16 && Info->AlphaBits) ? TGAREAD_FORMAT_ARGB32 : TGAREAD_FORMAT_XRGB32;
+					break;
+				case 24:
+					Info->Format = TGAREAD_FORMAT_BGR24;
+					break;
+				case 32:
+					Info->Format = Info->AlphaBits ? TGAREAD_FORMAT_ARGB32 : TGAREAD_FORMAT_XRGB32;
+					break;
+				default:
+					return 0;
+			}
+			break;
+
+		case 2:		// true colour
+			switch(Info->PixelDepth)
+			{
+				case 15:
+				case 16:
+					Info->Format = (Info->PixelDepth == 16 && Info->AlphaBits) ? TGAREAD_FORMAT_ARGB32 : TGAREAD_FORMAT_XRGB32;
+					break;
+				case 24:
+					Info->Format = TGAREAD_FORMAT_BGR24;
+					break;
+				case 32:
+					Info->Format = Info->AlphaBits ? TGAREAD_FORMAT_ARGB32 : TGAREAD_FORMAT_XRGB32;
+					break;
+				default:
+					return 0;
+			}
+			break;
+
+		case 3:		// greyscale
+			if(Info->PixelDepth != 8)
+				return 0;
+			Info->Format = TGAREAD_FORMAT_BGR24;
+			break;
+
+		default:
+			return 0;
+	}
+
+	if(Info->ImageType != BaseType && Info->ImageType != (BaseType | 8))
+		return 0;
+
+	Info->BytesPerPixel = (Info->Format == TGAREAD_FORMAT_BGR24) ? 3 : 4;
+
+	ColorMapBytes = ColorMapType ? (size_t)Info->ColorMapLength * ((Info->ColorMapDepth + 7) / 8) : 0;
+	Info->ColorMapOffset = TGAREAD_HEADER_SIZE + Header[0];
+	Info->DataOffset = Info->ColorMapOffset + ColorMapBytes;
+
+	return Info->DataOffset <= Size;
+}
+
+
+/* next Count source pixels of an RLE stream into Dest, Count never exceeds a row */
+static int TgaRead_ReadRle(TgaRead_Stream *Stream, const TgaRead_Kernels *Kernels, uint8_t *Dest, int Count, int Bpp)
+{
+	while(Count > 0)
+	{
+		int n;
+
+		if(Stream->Remaining == 0)
+		{
+			int Packet;
+
+			if(Stream->Position >= Stream->Size)
+				return 0;
+
+			Packet = Stream->Data[Stream->Position++];
+			Stream->Remaining = (Packet & 0x7f) + 1;
+			Stream->Repeat = (Packet & 0x80) != 0;
+
+			if(Stream->Repeat)
+			{
+				if(Stream->Size - Stream->Position < (size_t)Bpp)
+					return 0;
+				memcpy(Stream->Pixel, Stream->Data + Stream->Position, Bpp);
+				Stream->Position += Bpp;
+			}
+		}
+
+		n = TGA2GEBMP_MIN(Count, Stream->Remaining);
+
+		if(Stream->Repeat)
+		{
+			switch(Bpp)
+			{
+				case 1:
+					memset(Dest, Stream->Pixel[0], n);
+					break;
+				case 2:
+					Kernels->Fill16(Dest, (uint16_t)TgaRead_ReadU16(Stream->Pixel), n);
+					break;
+				case 3:
+					Kernels->Fill24(Dest, Stream->Pixel, n);
+					break;
+				default:
+					Kernels->Fill32(Dest, (uint32_t)Stream->Pixel[0] | ((uint32_t)Stream->Pixel[1] << 8) |
+										  ((uint32_t)Stream->Pixel[2] << 16) | ((uint32_t)Stream->Pixel[3] << 24), n);
+					break;
+			}
+		}
+		else
+		{
+			if(Stream->Size - Stream->Position < (size_t)n * Bpp)
+				return 0;
+			memcpy(Dest, Stream->Data + Stream->Position, (size_t)n * Bpp);
+			Stream->Position += (size_t)n * Bpp;
+		}
+
+		Dest += n * Bpp;
+		Count -= n;
+		Stream->Remaining -= n;
+	}
+
+	return 1;
+}
+
+
+static void TgaRead_ReadColorMap(const uint8_t *Data, const TgaRead_Info *Info, uint32_t *Palette)
+{
+	const uint8_t *Entry = Data + Info->ColorMapOffset;
+	int EntrySize = (Info->ColorMapDepth + 7) / 8;
+	int i;
+
+	// indices outside the map come out black
+	memset(Palette, 0, 256 * sizeof(uint32_t));
+
+	for(i = 0; i < Info->ColorMapLength; i++, Entry += EntrySize)
+	{
+		int Index = Info->ColorMapStart + i;
+		uint32_t Color;
+
+		if(Index > 255)
+			break;
+
+		switch(EntrySize)
+		{
+			case 2:
+				Color = TgaRead_Convert16(TgaRead_ReadU16(Entry), Info->Format == TGAREAD_FORMAT_ARGB32);
+				break;
+			case 3:
+				Color = 0xff000000 | ((uint32_t)Entry[2] << 16) | ((uint32_t)Entry[1] << 8) | Entry[0];
+				break;
+			default:
+				Color = ((uint32_t)Entry[3] << 24) | ((uint32_t)Entry[2] << 16) | ((uint32_t)Entry[1] << 8) | Entry[0];
+				if(Info->Format != TGAREAD_FORMAT_ARGB32)
+					Color |= 0xff000000;
+				break;
+		}
+
+		Palette[Index] = Color;
+	}
+}
+
+
+/* one row of source pixels to the output layout */
+static void TgaRead_ConvertRow(const TgaRead_Info *Info, const TgaRead_Kernels *Kernels, const uint32_t *Palette,
+							   uint8_t *Dest, const uint8_t *Src)
+{
+	int Width = Info->Width;
+	int i;
+
+	switch(Info->ImageType & ~8)
+	{
+		case 1:
+			if(Info->BytesPerPixel == 4)
+			{
+				Kernels->Lookup32(Dest, Src, Palette, Width);
+			}
+			else
+			{
+				for(i = 0; i < Width; i++)
+				{
+					uint32_t Color = Palette[Src[i]];
+					Dest[i * 3] = (uint8_t)Color;
+					Dest[i * 3 + 1] = (uint8_t)(Color >> 8);
+					Dest[i * 3 + 2] = (uint8_t)(Color >> 16);
+				}
+			}
+			break;
+
+		case 3:
+			for(i = 0; i < Width; i++)
+				Dest[i * 3] = Dest[i * 3 + 1] = Dest[i * 3 + 2] = Src[i];
+			break;
+
+		default:
+			Kernels->Expand16(Dest, Src, Width, Info->Format == TGAREAD_FORMAT_ARGB32);
+			break;
+	}
+}
+
+
+static void TgaRead_MirrorRow(uint8_t *Row, int Width, int Bpp)
+{
+	int i, j, k;
+
+	for(i = 0, j = Width - 1; i < j; i++, j--)
+	{
+		for(k = 0; k < Bpp; k++)
+		{
+			uint8_t t = Row[i * Bpp + k];
+			Row[i * Bpp + k] = Row[j * Bpp + k];
+			Row[j * Bpp + k] = t;
+		}
+	}
+}
+
+
+int TgaRead_Decode(const void *Data, size_t Size, const TgaRead_Info *Info, void *Pixels, ptrdiff_t Stride)
+{
+	const TgaRead_Kernels *Kernels = TgaRead_GetKernels();
+	const uint8_t	*Bytes = (const uint8_t*)Data;
+	TgaRead_Stream	Stream;
+	uint32_t		Palette[256];
+	uint8_t			*Row = NULL;
+	int				SrcBpp = (Info->PixelDepth + 7) / 8;
+	int				Direct;
+	int				Result = 1;
+	int				y;
+
+	// 24 and 32 bit data already is in the output layout and decodes in place
+	Direct = (SrcBpp == Info->BytesPerPixel);
+
+	if((Info->ImageType & ~8) == 1)
+	{
+		if(Info->ColorMapOffset + (size_t)Info->ColorMapLength * ((Info->ColorMapDepth + 7) / 8) > Size)
+			return 0;
+		TgaRead_ReadColorMap(Bytes, Info, Palette);
+	}
+
+	if(!(Info->ImageType & 8))
+	{
+		if((Size - Info->DataOffset) / SrcBpp / Info->Width < (size_t)Info->Height)
+			return 0;
+	}
+	else if(!Direct)
+	{
+		Row = (uint8_t*)malloc((size_t)Info->Width * SrcBpp);
+		if(!Row)
+			return 0;
+	}
+
+	memset(&Stream, 0, sizeof(Stream));
+	Stream.Data = Bytes;
+	Stream.Size = Size;
+	Stream.Position = Info->DataOffset;
+
+	for(y = 0; y < Info->Height; y++)
+	{
+		int DestY = Info->TopDown ? y : Info->Height - 1 - y;
+		uint8_t *Dest = (uint8_t*)Pixels + DestY * Stride;
+		const uint8_t *Src;
+
+		if(Info->ImageType & 8)
+		{
+			if(!TgaRead_ReadRle(&Stream, Kernels, Direct ? Dest : Row, Info->Width, SrcBpp))
+			{
+				Result = 0;
+				break;
+			}
+			Src = Direct ? Dest : Row;
+		}
+		else
+		{
+			Src = Bytes + Stream.Position;
+			Stream.Position += (size_t)Info->Width * SrcBpp;
+			if(Direct)
+				memcpy(Dest, Src, (size_t)Info->Width * SrcBpp);
+		}
+
+		if(!Direct)
+			TgaRead_ConvertRow(Info, Kernels, Palette, Dest, Src);
+		else if(Info->Format == TGAREAD_FORMAT_XRGB32)
+			Kernels->SetAlpha(Dest, Info->Width);
+
+		if(Info->RightToLeft)
+			TgaRead_MirrorRow(Dest, Info->Width, Info->BytesPerPixel);
+	}
+
+	free(Row);
+
+	return Result;
+}
+
+
+TgaRead_File *TgaRead_OpenFile(const char *FileName, size_t BufferSize, TgaRead_Info *Info)
+{
+	TgaRead_File	*File;
+	uint8_t			Header[TGAREAD_HEADER_SIZE];
+	size_t			HeaderSize;
+	int				SrcBpp;
+
+	File = (TgaRead_File*)malloc(sizeof(TgaRead_File));
+	if(!File)
+		return NULL;
+	memset(File, 0, sizeof(*File));
+
+	File->File = fopen(FileName, "rb");
+	if(!File->File)
+	{
+		free(File);
+		return NULL;
+	}
+
+	// the header tells how much of the file precedes the pixels
+	if(fread(Header, 1, sizeof(Header), File->File) != sizeof(Header) ||
+	   !TgaRead_GetInfo(Header, (size_t)-1, &File->Info))
+	{
+		TgaRead_CloseFile(&File);
+		return NULL;
+	}
+
+	// room for two rows, so an RLE packet that runs across the end of the
+	// buffer is always complete after a refill
+	SrcBpp = (File->Info.PixelDepth + 7) / 8;
+	File->RowBytes = (size_t)File->Info.Width * (SrcBpp + ((File->Info.ImageType & 8) ? 1 : 0)) + 8;
+	HeaderSize = File->Info.DataOffset;
+	File->BufferSize = TGA2GEBMP_MAX(BufferSize ? BufferSize : TGAREAD_FILE_BUFFER, TGA2GEBMP_MAX(2 * File->RowBytes, HeaderSize));
+
+	File->Buffer = (uint8_t*)malloc(File->BufferSize);
+	File->Source = (uint8_t*)malloc((size_t)File->Info.Width * SrcBpp);
+	if(!File->Buffer || !File->Source)
+	{
+		TgaRead_CloseFile(&File);
+		return NULL;
+	}
+
+	memcpy(File->Buffer, Header, sizeof(Header));
+	if(fread(File->Buffer + sizeof(Header), 1, HeaderSize - sizeof(Header), File->File) != HeaderSize - sizeof(Header))
+	{
+		TgaRead_CloseFile(&File);
+		return NULL;
+	}
+
+	if((File->Info.ImageType & ~8) == 1)
+		TgaRead_ReadColorMap(File->Buffer, &File->Info, File->Palette);
+
+	File->Stream.Data = File->Buffer;
+	File->Stream.Size = HeaderSize;
+	File->Stream.Position = HeaderSize;
+
+	*Info = File->Info;
+	return File;
+}
+
+
+void TgaRead_CloseFile(TgaRead_File **pFile)
+{
+	TgaRead_File *File = *pFile;
+
+	if(!File)
+		return;
+
+	if(File->File)
+		fclose(File->File);
+	free(File->Buffer);
+	free(File->Source);
+	free(File);
+	*pFile = NULL;
+}
+
+
+/* at least a row's worth of file in the buffer, or whatever is left of it */
+static void TgaRead_FillBuffer(TgaRead_File *File)
+{
+	TgaRead_Stream *Stream = &File->Stream;
+	size_t Left = Stream->Size - Stream->Position;
+
+	if(Left >= File->RowBytes || !File->File)
+		return;
+
+	memmove(File->Buffer, File->Buffer + Stream->Position, Left);
+	Stream->Size = Left + fread(File->Buffer + Left, 1, File->BufferSize - Left, File->File);
+	Stream->Position = 0;
+
+	if(Stream->Size < File->BufferSize)
+	{
+		fclose(File->File);
+		File->File = NULL;
+	}
+}
+
+
+/* the next row in file order into Dest, returns its row in the top-down
+   image or -1 on corrupt data */
+static int TgaRead_ReadFileRow(TgaRead_File *File, const TgaRead_Kernels *Kernels, uint8_t *Dest)
+{
+	const TgaRead_Info *Info = &File->Info;
+	TgaRead_Stream *Stream = &File->Stream;
+	int SrcBpp = (Info->PixelDepth + 7) / 8;
+	int Direct = (SrcBpp == Info->BytesPerPixel);
+	size_t Bytes = (size_t)Info->Width * SrcBpp;
+	const uint8_t *Src;
+	int y;
+
+	if(File->Row >= Info->Height)
+		return -1;
+
+	TgaRead_FillBuffer(File);
+
+	if(Info->ImageType & 8)
+	{
+		if(!TgaRead_ReadRle(Stream, Kernels, Direct ? Dest : File->Source, Info->Width, SrcBpp))
+			return -1;
+		Src = Direct ? Dest : File->Source;
+	}
+	else
+	{
+		if(Stream->Size - Stream->Position < Bytes)
+			return -1;
+		Src = Stream->Data + Stream->Position;
+		Stream->Position += Bytes;
+		if(Direct)
+			memcpy(Dest, Src, Bytes);
+	}
+
+	if(!Direct)
+		TgaRead_ConvertRow(Info, Kernels, File->Palette, Dest, Src);
+	else if(Info->Format == TGAREAD_FORMAT_XRGB32)
+		Kernels->SetAlpha(Dest, Info->Width);
+
+	if(Info->RightToLeft)
+		TgaRead_MirrorRow(Dest, Info->Width, Info->BytesPerPixel);
+
+	y = Info->TopDown ? File->Row : Info->Height - 1 - File->Row;
+	File->Row++;
+	return y;
+}
+
+
+int TgaRead_GetReduction(int Width, int Height, int MaxSize, uint64_t MaxPixels)
+{
+	int Factor = 1;
+
+	while(Width > 1 || Height > 1)
+	{
+		int w = (Width + Factor - 1) / Factor;
+		int h = (Height + Factor - 1) / Factor;
+
+		if((MaxSize <= 0 || (w <= MaxSize && h <= MaxSize)) && (MaxPixels == 0 || (uint64_t)w * h <= MaxPixels))
+			break;
+		if((w == 1 && h == 1) || Factor == TGAREAD_MAX_REDUCTION)
+			break;
+		Factor *= 2;
+	}
+
+	return Factor;
+}
+
+
+int TgaRead_DecodeFile(TgaRead_File *File, int Factor, void *Pixels, ptrdiff_t Stride)
+{
+	const TgaRead_Kernels *Kernels = TgaRead_GetKernels();
+	const TgaRead_Info *Info = &File->Info;
+	int			Bpp = Info->BytesPerPixel;
+	int			Width = (Info->Width + Factor - 1) / Factor;
+	uint8_t		*Row;
+	uint32_t	*Sums;
+	int			Block = -1;		/* output row being summed */
+	int			Rows = 0;		/* source rows in it so far */
+	int			Result = 1;
+	int			i, x, y;
+
+	if(Factor <= 1)
+	{
+		// rows go straight to where they belong
+		for(i = 0; i < Info->Height; i++)
+		{
+			y = Info->TopDown ? File->Row : Info->Height - 1 - File->Row;
+			if(TgaRead_ReadFileRow(File, Kernels, (uint8_t*)Pixels + y * Stride) < 0)
+				return 0;
+		}
+		return 1;
+	}
+
+	Row = (uint8_t*)malloc((size_t)Info->Width * Bpp);
+	Sums = (uint32_t*)malloc((size_t)Width * Bpp * sizeof(uint32_t));
+	if(!Row || !Sums)
+	{
+		free(Row);
+		free(Sums);
+		return 0;
+	}
+
+	// rows come bottom-up or top-down, either way the Factor rows of an
+	// output row arrive one after the other
+	for(i = 0; i < Info->Height; i++)
+	{
+		int BlockRows;
+
+		y = TgaRead_ReadFileRow(File, Kernels, Row);
+		if(y < 0)
+		{
+			Result = 0;
+			break;
+		}
+
+		if(y / Factor != Block)
+		{
+			Block = y / Factor;
+			Rows = 0;
+			memset(Sums, 0, (size_t)Width * Bpp * sizeof(uint32_t));
+		}
+
+		for(x = 0; x < Width; x++)
+		{
+			const uint8_t *p = Row + (size_t)x * Factor * Bpp;
+			uint32_t *Sum = Sums + x * Bpp;
+			int Count = TGA2GEBMP_MIN(Factor, Info->Width - x * Factor);
+			int k;
+
+			if(Bpp == 4)
+			{
+				for(k = 0; k < Count; k++, p += 4)
+				{
+					Sum[0] += p[0];
+					Sum[1] += p[1];
+					Sum[2] += p[2];
+					Sum[3] += p[3];
+				}
+			}
+			else
+			{
+				for(k = 0; k < Count; k++, p += 3)
+				{
+					Sum[0] += p[0];
+					Sum[1] += p[1];
+					Sum[2] += p[2];
+				}
+			}
+		}
+
+		// the last block of rows may be short
+		BlockRows = TGA2GEBMP_MIN(Factor, Info->Height - Block * Factor);
+		if(++Rows == BlockRows)
+		{
+			uint8_t *Dest = (uint8_t*)Pixels + Block * Stride;
+
+			for(x = 0; x < Width * Bpp; x++)
+			{
+				uint32_t Count = (uint32_t)TGA2GEBMP_MIN(Factor, Info->Width - (x / Bpp) * Factor) * BlockRows;
+
+				Dest[x] = (uint8_t)((Sums[x] + Count / 2) / Count);
+			}
+		}
+	}
+
+	free(Row);
+	free(Sums);
+
+	return Result;
+}
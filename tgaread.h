@@ -0,0 +1,99 @@
+/**
+ * @file tgaread.h
+ *
+ * Truevision TGA decoder for the images that replace skins. Handles
+ * colour-mapped (8-bit indices into 15/16/24/32-bit maps), greyscale,
+ * 15/16-bit, 24-bit and 32-bit images, uncompressed or RLE, with either
+ * origin.
+ *
+ * Pixels are decoded straight into a caller-supplied buffer, top row first,
+ * in one of three layouts that match geBitmap pixel formats without any
+ * further conversion:
+ *
+ *   TGAREAD_FORMAT_BGR24   bytes B, G, R                 (GE_PIXELFORMAT_24BIT_BGR)
+ *   TGAREAD_FORMAT_XRGB32  uint32 0xffRRGGBB             (GE_PIXELFORMAT_32BIT_XRGB)
+ *   TGAREAD_FORMAT_ARGB32  uint32 0xAARRGGBB             (GE_PIXELFORMAT_32BIT_ARGB)
+ *
+ * The 32-bit layouts are little-endian words, i.e. the B, G, R, A byte order
+ * TGA itself uses, so 24-bit and 32-bit data are copied as is. The hot
+ * loops (RLE run fills, 15/16-bit expansion, alpha fill, palette lookup)
+ * have SSE2 and AVX2 versions picked at run time, with a scalar fallback.
+ *
+ * Images too large to hold comfortably can be decoded from their file a
+ * row at a time (TgaRead_OpenFile), optionally reduced by a power of two
+ * on the way. That needs a read buffer, a row and a row of sums, never the
+ * file or the full-size image.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef TGAREAD_H
+#define TGAREAD_H
+
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TGAREAD_FORMAT_BGR24		1
+#define TGAREAD_FORMAT_XRGB32		2
+#define TGAREAD_FORMAT_ARGB32		3
+
+/* instruction sets for TgaRead_SetSimdLevel */
+#define TGAREAD_SIMD_SCALAR			0
+#define TGAREAD_SIMD_SSE2			1
+#define TGAREAD_SIMD_AVX2			2
+
+typedef struct	TgaRead_Info
+{
+	int			Width;
+	int			Height;
+	int			Format;				/* TGAREAD_FORMAT_* of the decoded pixels */
+	int			BytesPerPixel;		/* of the decoded pixels, 3 or 4 */
+
+	/* as stored in the file */
+	int			ImageType;			/* 1, 2, 3 or RLE 9, 10, 11 */
+	int			PixelDepth;
+	int			AlphaBits;
+	int			TopDown;
+	int			RightToLeft;
+	int			ColorMapStart;
+	int			ColorMapLength;
+	int			ColorMapDepth;
+	size_t		ColorMapOffset;
+	size_t		DataOffset;
+}	TgaRead_Info;
+
+/* parse the header, 0 if the data is not a TGA this decoder supports */
+int TgaRead_GetInfo(const void *Data, size_t Size, TgaRead_Info *Info);
+/* decode into Pixels, Stride bytes per row, top row first; 0 on corrupt data */
+int TgaRead_Decode(const void *Data, size_t Size, const TgaRead_Info *Info, void *Pixels, ptrdiff_t Stride);
+
+typedef struct TgaRead_File TgaRead_File;
+
+/* opens a TGA file for decoding, reading BufferSize bytes at a time (0 for
+   1 MB); NULL if it cannot be read or is not a TGA this decoder supports */
+TgaRead_File *TgaRead_OpenFile(const char *FileName, size_t BufferSize, TgaRead_Info *Info);
+void TgaRead_CloseFile(TgaRead_File **pFile);
+/* smallest power of two Factor that brings the image within MaxSize pixels
+   on each side and MaxPixels in all (0 for no limit), at most 4096 */
+int TgaRead_GetReduction(int Width, int Height, int MaxSize, uint64_t MaxPixels);
+/* decodes the whole image, reduced by Factor x Factor box averages, into
+   Pixels: (Width + Factor - 1) / Factor by (Height + Factor - 1) / Factor,
+   Stride bytes per row, top row first. Edge blocks average the pixels they
+   have. 0 on corrupt data or out of memory; a file is decoded once */
+int TgaRead_DecodeFile(TgaRead_File *File, int Factor, void *Pixels, ptrdiff_t Stride);
+
+/* highest level the processor supports, then the one in use */
+int TgaRead_GetSupportedSimdLevel(void);
+int TgaRead_GetSimdLevel(void);
+/* for benchmarks; clamps to what is supported and returns the level set */
+int TgaRead_SetSimdLevel(int Level);
+const char *TgaRead_GetSimdName(int Level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
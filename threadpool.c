@@ -0,0 +1,578 @@
+/**
+ * @file threadpool.c
+ *
+ * Work-stealing thread pool, Win32 and pthreads.
+ */
+#include "threadpool.h"
+
+#ifdef _WIN32
+	#ifndef _WIN32_WINNT
+		#define _WIN32_WINNT	0x0600		/* condition variables */
+	#endif
+	#include <windows.h>
+	#include <process.h>
+
+	#define THREADPOOL_TLS					__declspec(thread)
+
+	typedef CRITICAL_SECTION	ThreadPool_Mutex;
+	typedef CONDITION_VARIABLE	ThreadPool_Cond;
+	typedef HANDLE				ThreadPool_Thread;
+
+	#define ThreadPool_MutexInit(m)			InitializeCriticalSection(m)
+	#define ThreadPool_MutexDestroy(m)		DeleteCriticalSection(m)
+	#define ThreadPool_Lock(m)				EnterCriticalSection(m)
+	#define ThreadPool_Unlock(m)			LeaveCriticalSection(m)
+	#define ThreadPool_CondInit(c)			InitializeConditionVariable(c)
+	#define ThreadPool_CondDestroy(c)
+	#define ThreadPool_CondWait(c, m)		SleepConditionVariableCS(c, m, INFINITE)
+	#define ThreadPool_CondSignal(c)		WakeConditionVariable(c)
+	#define ThreadPool_CondBroadcast(c)		WakeAllConditionVariable(c)
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+
+	#define THREADPOOL_TLS					__thread
+
+	typedef pthread_mutex_t		ThreadPool_Mutex;
+	typedef pthread_cond_t		ThreadPool_Cond;
+	typedef pthread_t			ThreadPool_Thread;
+
+	#define ThreadPool_MutexInit(m)			pthread_mutex_init(m, NULL)
+	#define ThreadPool_MutexDestroy(m)		pthread_mutex_destroy(m)
+	#define ThreadPool_Lock(m)				pthread_mutex_lock(m)
+	#define ThreadPool_Unlock(m)			pthread_mutex_unlock(m)
+	#define ThreadPool_CondInit(c)			pthread_cond_init(c, NULL)
+	#define ThreadPool_CondDestroy(c)		pthread_cond_destroy(c)
+	#define ThreadPool_CondWait(c, m)		pthread_cond_wait(c, m)
+	#define ThreadPool_CondSignal(c)		pthread_cond_signal(c)
+	#define ThreadPool_CondBroadcast(c)		pthread_cond_broadcast(c)
+#endif
+
+#define THREADPOOL_MAX_THREADS		256
+
+
+typedef struct	ThreadPool_Task
+{
+	ThreadPool_Func		Func;
+	void				*Context;
+	ThreadPool_Group	*Group;
+}	ThreadPool_Task;
+
+typedef struct	ThreadPool_Deque
+{
+	ThreadPool_Mutex	Lock;
+	ThreadPool_Task		*Tasks;
+	int					Capacity;
+	int					Head;			/* oldest task, taken by thieves */
+	int					Count;
+}	ThreadPool_Deque;
+
+typedef struct	ThreadPool_Worker
+{
+	ThreadPool			*Pool;
+	int					Index;
+	ThreadPool_Thread	Thread;
+}	ThreadPool_Worker;
+
+struct ThreadPool_Group
+{
+	int					Remaining;		/* guarded by the pool's Lock */
+	int					Queued;			/* of Remaining, not yet taken; the same lock */
+};
+
+struct ThreadPool_Gate
+{
+	ThreadPool_Mutex	Lock;
+	ThreadPool_Cond		Available;
+	int					Count;
+};
+
+struct ThreadPool
+{
+	int					ThreadCount;
+	int					StartedCount;
+	ThreadPool_Worker	*Workers;
+	ThreadPool_Deque	*Deques;		/* one per worker plus the shared FIFO at ThreadCount */
+	int					DequeCount;
+
+	ThreadPool_Mutex	Lock;
+	ThreadPool_Cond		WorkAvailable;
+	ThreadPool_Cond		TaskDone;
+	int					Pending;		/* queued, not yet taken */
+	int					Active;			/* queued or running */
+	int					Waiters;		/* workers sleeping in ThreadPool_Wait */
+	int					Stop;
+};
+
+static THREADPOOL_TLS ThreadPool *ThreadPool_CurrentPool;
+static THREADPOOL_TLS int ThreadPool_CurrentIndex;
+
+
+int ThreadPool_GetCpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO Info;
+
+	GetSystemInfo(&Info);
+	return (int)Info.dwNumberOfProcessors;
+#else
+	long Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return Count > 0 ? (int)Count : 1;
+#endif
+}
+
+
+static int ThreadPool_PushBottom(ThreadPool_Deque *Deque, const ThreadPool_Task *Task)
+{
+	ThreadPool_Lock(&Deque->Lock);
+
+	if(Deque->Count == Deque->Capacity)
+	{
+		ThreadPool_Task *NewTasks;
+		int NewCapacity = Deque->Capacity ? Deque->Capacity * 2 : 64;
+		int i;
+
+		NewTasks = (ThreadPool_Task*)malloc(NewCapacity * sizeof(ThreadPool_Task));
+		if(!NewTasks)
+		{
+			ThreadPool_Unlock(&Deque->Lock);
+			return 0;
+		}
+
+		for(i = 0; i < Deque->Count; i++)
+			NewTasks[i] = Deque->Tasks[(Deque->Head + i) % Deque->Capacity];
+
+		free(Deque->Tasks);
+		Deque->Tasks = NewTasks;
+		Deque->Capacity = NewCapacity;
+		Deque->Head = 0;
+	}
+
+	Deque->Tasks[(Deque->Head + Deque->Count) % Deque->Capacity] = *Task;
+	Deque->Count++;
+
+	ThreadPool_Unlock(&Deque->Lock);
+	return 1;
+}
+
+
+static int ThreadPool_PopBottom(ThreadPool_Deque *Deque, ThreadPool_Task *Task)
+{
+	int Result = 0;
+
+	ThreadPool_Lock(&Deque->Lock);
+	if(Deque->Count > 0)
+	{
+		Deque->Count--;
+		*Task = Deque->Tasks[(Deque->Head + Deque->Count) % Deque->Capacity];
+		Result = 1;
+	}
+	ThreadPool_Unlock(&Deque->Lock);
+
+	return Result;
+}
+
+
+static int ThreadPool_PopTop(ThreadPool_Deque *Deque, ThreadPool_Task *Task)
+{
+	int Result = 0;
+
+	ThreadPool_Lock(&Deque->Lock);
+	if(Deque->Count > 0)
+	{
+		*Task = Deque->Tasks[Deque->Head];
+		Deque->Head = (Deque->Head + 1) % Deque->Capacity;
+		Deque->Count--;
+		Result = 1;
+	}
+	ThreadPool_Unlock(&Deque->Lock);
+
+	return Result;
+}
+
+
+/* the newest task of Group in the deque, taken out of the middle if need be */
+static int ThreadPool_PopGroup(ThreadPool_Deque *Deque, const ThreadPool_Group *Group, ThreadPool_Task *Task)
+{
+	int Result = 0;
+	int i, j;
+
+	ThreadPool_Lock(&Deque->Lock);
+	for(i = Deque->Count - 1; i >= 0; i--)
+	{
+		if(Deque->Tasks[(Deque->Head + i) % Deque->Capacity].Group != Group)
+			continue;
+
+		*Task = Deque->Tasks[(Deque->Head + i) % Deque->Capacity];
+		for(j = i + 1; j < Deque->Count; j++)
+			Deque->Tasks[(Deque->Head + j - 1) % Deque->Capacity] = Deque->Tasks[(Deque->Head + j) % Deque->Capacity];
+		Deque->Count--;
+		Result = 1;
+		break;
+	}
+	ThreadPool_Unlock(&Deque->Lock);
+
+	return Result;
+}
+
+
+static void ThreadPool_TakeTask(ThreadPool *Pool, const ThreadPool_Task *Task)
+{
+	ThreadPool_Lock(&Pool->Lock);
+	Pool->Pending--;
+	if(Task->Group)
+		Task->Group->Queued--;
+	ThreadPool_Unlock(&Pool->Lock);
+}
+
+
+/* own deque newest first, then the shared FIFO, then steal the oldest elsewhere */
+static int ThreadPool_FindTask(ThreadPool *Pool, int Index, ThreadPool_Task *Task)
+{
+	int Found;
+	int i;
+
+	Found = ThreadPool_PopBottom(&Pool->Deques[Index], Task) ||
+			ThreadPool_PopTop(&Pool->Deques[Pool->ThreadCount], Task);
+
+	for(i = 1; !Found && i < Pool->ThreadCount; i++)
+		Found = ThreadPool_PopTop(&Pool->Deques[(Index + i) % Pool->ThreadCount], Task);
+
+	if(Found)
+		ThreadPool_TakeTask(Pool, Task);
+
+	return Found;
+}
+
+
+/* the same order, but only tasks of Group */
+static int ThreadPool_FindGroupTask(ThreadPool *Pool, int Index, const ThreadPool_Group *Group, ThreadPool_Task *Task)
+{
+	int Found;
+	int i;
+
+	Found = ThreadPool_PopGroup(&Pool->Deques[Index], Group, Task) ||
+			ThreadPool_PopGroup(&Pool->Deques[Pool->ThreadCount], Group, Task);
+
+	for(i = 1; !Found && i < Pool->ThreadCount; i++)
+		Found = ThreadPool_PopGroup(&Pool->Deques[(Index + i) % Pool->ThreadCount], Group, Task);
+
+	if(Found)
+		ThreadPool_TakeTask(Pool, Task);
+
+	return Found;
+}
+
+
+static void ThreadPool_RunTask(ThreadPool *Pool, int Index, const ThreadPool_Task *Task)
+{
+	int Notify;
+
+	Task->Func(Task->Context, Index);
+
+	ThreadPool_Lock(&Pool->Lock);
+	Pool->Active--;
+	Notify = (Pool->Active == 0);
+	if(Task->Group && --Task->Group->Remaining == 0)
+		Notify = 1;
+	if(Notify)
+		ThreadPool_CondBroadcast(&Pool->TaskDone);
+	ThreadPool_Unlock(&Pool->Lock);
+}
+
+
+#ifdef _WIN32
+static unsigned __stdcall ThreadPool_WorkerMain(void *Arg)
+#else
+static void *ThreadPool_WorkerMain(void *Arg)
+#endif
+{
+	ThreadPool_Worker *Worker = (ThreadPool_Worker*)Arg;
+	ThreadPool *Pool = Worker->Pool;
+	ThreadPool_Task Task;
+
+	ThreadPool_CurrentPool = Pool;
+	ThreadPool_CurrentIndex = Worker->Index;
+
+	for(;;)
+	{
+		if(ThreadPool_FindTask(Pool, Worker->Index, &Task))
+		{
+			ThreadPool_RunTask(Pool, Worker->Index, &Task);
+			continue;
+		}
+
+		ThreadPool_Lock(&Pool->Lock);
+		while(Pool->Pending <= 0 && !Pool->Stop)
+			ThreadPool_CondWait(&Pool->WorkAvailable, &Pool->Lock);
+		if(Pool->Pending <= 0 && Pool->Stop)
+		{
+			ThreadPool_Unlock(&Pool->Lock);
+			break;
+		}
+		ThreadPool_Unlock(&Pool->Lock);
+	}
+
+	return 0;
+}
+
+
+ThreadPool *ThreadPool_Create(int ThreadCount)
+{
+	ThreadPool *Pool;
+	int i;
+
+	if(ThreadCount <= 0)
+		ThreadCount = ThreadPool_GetCpuCount();
+	ThreadCount = TGA2GEBMP_MIN(ThreadCount, THREADPOOL_MAX_THREADS);
+
+	Pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+	if(!Pool)
+		return NULL;
+
+	Pool->Workers = (ThreadPool_Worker*)calloc(ThreadCount, sizeof(ThreadPool_Worker));
+	Pool->Deques = (ThreadPool_Deque*)calloc(ThreadCount + 1, sizeof(ThreadPool_Deque));
+	if(!Pool->Workers || !Pool->Deques)
+	{
+		free(Pool->Workers);
+		free(Pool->Deques);
+		free(Pool);
+		return NULL;
+	}
+
+	ThreadPool_MutexInit(&Pool->Lock);
+	ThreadPool_CondInit(&Pool->WorkAvailable);
+	ThreadPool_CondInit(&Pool->TaskDone);
+	Pool->DequeCount = ThreadCount + 1;
+	for(i = 0; i < Pool->DequeCount; i++)
+		ThreadPool_MutexInit(&Pool->Deques[i].Lock);
+
+	// workers index the shared FIFO by ThreadCount, so it is set before any of them starts
+	Pool->ThreadCount = ThreadCount;
+	for(i = 0; i < ThreadCount; i++)
+	{
+		ThreadPool_Worker *Worker = &Pool->Workers[i];
+
+		Worker->Pool = Pool;
+		Worker->Index = i;
+#ifdef _WIN32
+		Worker->Thread = (HANDLE)_beginthreadex(NULL, 0, ThreadPool_WorkerMain, Worker, 0, NULL);
+		if(!Worker->Thread)
+			break;
+#else
+		if(pthread_create(&Worker->Thread, NULL, ThreadPool_WorkerMain, Worker) != 0)
+			break;
+#endif
+		Pool->StartedCount++;
+	}
+
+	if(Pool->StartedCount < ThreadCount)
+	{
+		ThreadPool_Destroy(&Pool);
+		return NULL;
+	}
+
+	return Pool;
+}
+
+
+void ThreadPool_Destroy(ThreadPool **pPool)
+{
+	ThreadPool *Pool = *pPool;
+	int i;
+
+	if(!Pool)
+		return;
+
+	ThreadPool_Lock(&Pool->Lock);
+	while(Pool->Active > 0)
+		ThreadPool_CondWait(&Pool->TaskDone, &Pool->Lock);
+	Pool->Stop = 1;
+	ThreadPool_CondBroadcast(&Pool->WorkAvailable);
+	ThreadPool_Unlock(&Pool->Lock);
+
+	for(i = 0; i < Pool->StartedCount; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(Pool->Workers[i].Thread, INFINITE);
+		CloseHandle(Pool->Workers[i].Thread);
+#else
+		pthread_join(Pool->Workers[i].Thread, NULL);
+#endif
+	}
+
+	for(i = 0; i < Pool->DequeCount; i++)
+	{
+		ThreadPool_MutexDestroy(&Pool->Deques[i].Lock);
+		free(Pool->Deques[i].Tasks);
+	}
+
+	ThreadPool_CondDestroy(&Pool->TaskDone);
+	ThreadPool_CondDestroy(&Pool->WorkAvailable);
+	ThreadPool_MutexDestroy(&Pool->Lock);
+
+	free(Pool->Deques);
+	free(Pool->Workers);
+	free(Pool);
+
+	*pPool = NULL;
+}
+
+
+int ThreadPool_GetThreadCount(const ThreadPool *Pool)
+{
+	return Pool->ThreadCount;
+}
+
+
+int ThreadPool_GetCurrentWorker(const ThreadPool *Pool)
+{
+	return ThreadPool_CurrentPool == Pool ? ThreadPool_CurrentIndex : -1;
+}
+
+
+ThreadPool_Group *ThreadPool_CreateGroup(void)
+{
+	return (ThreadPool_Group*)calloc(1, sizeof(ThreadPool_Group));
+}
+
+
+void ThreadPool_DestroyGroup(ThreadPool_Group **pGroup)
+{
+	free(*pGroup);
+	*pGroup = NULL;
+}
+
+
+int ThreadPool_Submit(ThreadPool *Pool, ThreadPool_Group *Group, ThreadPool_Func Func, void *Context)
+{
+	ThreadPool_Task Task;
+	int Worker;
+
+	Task.Func = Func;
+	Task.Context = Context;
+	Task.Group = Group;
+
+	ThreadPool_Lock(&Pool->Lock);
+	Pool->Active++;
+	if(Group)
+		Group->Remaining++;
+	ThreadPool_Unlock(&Pool->Lock);
+
+	Worker = ThreadPool_GetCurrentWorker(Pool);
+	if(!ThreadPool_PushBottom(&Pool->Deques[Worker >= 0 ? Worker : Pool->ThreadCount], &Task))
+	{
+		ThreadPool_Lock(&Pool->Lock);
+		Pool->Active--;
+		if(Group)
+			Group->Remaining--;
+		ThreadPool_Unlock(&Pool->Lock);
+		return 0;
+	}
+
+	ThreadPool_Lock(&Pool->Lock);
+	Pool->Pending++;
+	if(Group)
+		Group->Queued++;
+	ThreadPool_CondSignal(&Pool->WorkAvailable);
+	if(Pool->Waiters > 0)
+		ThreadPool_CondBroadcast(&Pool->TaskDone);
+	ThreadPool_Unlock(&Pool->Lock);
+
+	return 1;
+}
+
+
+void ThreadPool_Wait(ThreadPool *Pool, ThreadPool_Group *Group)
+{
+	int Worker = ThreadPool_GetCurrentWorker(Pool);
+	ThreadPool_Task Task;
+
+	if(Worker < 0)
+	{
+		ThreadPool_Lock(&Pool->Lock);
+		while(Group->Remaining > 0)
+			ThreadPool_CondWait(&Pool->TaskDone, &Pool->Lock);
+		ThreadPool_Unlock(&Pool->Lock);
+		return;
+	}
+
+	// a worker runs the group's own tasks while it waits, otherwise a task
+	// waiting on subtasks queued behind busy workers would starve. Other
+	// tasks are left alone: the waiting task is still on this worker, and
+	// whatever state it keeps per worker must not be entered again
+	for(;;)
+	{
+		ThreadPool_Lock(&Pool->Lock);
+		if(Group->Remaining == 0)
+		{
+			ThreadPool_Unlock(&Pool->Lock);
+			break;
+		}
+		ThreadPool_Unlock(&Pool->Lock);
+
+		if(ThreadPool_FindGroupTask(Pool, Worker, Group, &Task))
+		{
+			ThreadPool_RunTask(Pool, Worker, &Task);
+			continue;
+		}
+
+		ThreadPool_Lock(&Pool->Lock);
+		Pool->Waiters++;
+		while(Group->Remaining > 0 && Group->Queued <= 0)
+			ThreadPool_CondWait(&Pool->TaskDone, &Pool->Lock);
+		Pool->Waiters--;
+		ThreadPool_Unlock(&Pool->Lock);
+	}
+}
+
+
+ThreadPool_Gate *ThreadPool_CreateGate(int Count)
+{
+	ThreadPool_Gate *Gate;
+
+	Gate = (ThreadPool_Gate*)calloc(1, sizeof(ThreadPool_Gate));
+	if(!Gate)
+		return NULL;
+
+	ThreadPool_MutexInit(&Gate->Lock);
+	ThreadPool_CondInit(&Gate->Available);
+	Gate->Count = Count > 0 ? Count : 1;
+
+	return Gate;
+}
+
+
+void ThreadPool_DestroyGate(ThreadPool_Gate **pGate)
+{
+	ThreadPool_Gate *Gate = *pGate;
+
+	if(!Gate)
+		return;
+
+	ThreadPool_CondDestroy(&Gate->Available);
+	ThreadPool_MutexDestroy(&Gate->Lock);
+	free(Gate);
+
+	*pGate = NULL;
+}
+
+
+void ThreadPool_EnterGate(ThreadPool_Gate *Gate)
+{
+	ThreadPool_Lock(&Gate->Lock);
+	while(Gate->Count == 0)
+		ThreadPool_CondWait(&Gate->Available, &Gate->Lock);
+	Gate->Count--;
+	ThreadPool_Unlock(&Gate->Lock);
+}
+
+
+void ThreadPool_LeaveGate(ThreadPool_Gate *Gate)
+{
+	ThreadPool_Lock(&Gate->Lock);
+	Gate->Count++;
+	ThreadPool_CondSignal(&Gate->Available);
+	ThreadPool_Unlock(&Gate->Lock);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file threadpool.h
+ *
+ * Fixed-size work-stealing thread pool. Every worker owns a deque: tasks a
+ * worker submits go to the bottom of its own deque and are run newest first,
+ * idle workers steal the oldest task from the top of someone else's. Tasks
+ * submitted from outside the pool go through a shared FIFO.
+ *
+ * Tasks are counted in groups so a caller can wait for the batch it
+ * submitted. A worker that waits on a group runs that group's queued tasks
+ * meanwhile, so tasks may submit and wait for subtasks without tying up the
+ * pool. It runs no other task, so a job that keeps state per worker (such
+ * as tga2gebmp_batch.c's sessions) is never started again on a worker where
+ * one is still waiting.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadPool_Group ThreadPool_Group;
+typedef struct ThreadPool_Gate ThreadPool_Gate;
+
+/* Worker is the index of the running thread, 0 .. ThreadCount - 1 */
+typedef void (*ThreadPool_Func)(void *Context, int Worker);
+
+int ThreadPool_GetCpuCount(void);
+
+/* ThreadCount <= 0 uses one thread per processor */
+ThreadPool *ThreadPool_Create(int ThreadCount);
+/* waits for every queued task */
+void ThreadPool_Destroy(ThreadPool **pPool);
+int ThreadPool_GetThreadCount(const ThreadPool *Pool);
+/* index of the calling worker of Pool, -1 on any other thread */
+int ThreadPool_GetCurrentWorker(const ThreadPool *Pool);
+
+ThreadPool_Group *ThreadPool_CreateGroup(void);
+void ThreadPool_DestroyGroup(ThreadPool_Group **pGroup);
+
+int ThreadPool_Submit(ThreadPool *Pool, ThreadPool_Group *Group, ThreadPool_Func Func, void *Context);
+/* returns once every task submitted to Group has finished */
+void ThreadPool_Wait(ThreadPool *Pool, ThreadPool_Group *Group);
+
+/* counting semaphore, used to bound how many threads do I/O at once */
+ThreadPool_Gate *ThreadPool_CreateGate(int Count);
+void ThreadPool_DestroyGate(ThreadPool_Gate **pGate);
+void ThreadPool_EnterGate(ThreadPool_Gate *Gate);
+void ThreadPool_LeaveGate(ThreadPool_Gate *Gate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
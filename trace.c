@@ -0,0 +1,399 @@
+/**
+ * @file trace.c
+ *
+ * Stage timers and counters behind trace.h, Win32 and POSIX. Totals and
+ * events are kept under one lock; a span costs two clock reads and one
+ * short critical section.
+ */
+#include "trace.h"
+
+#ifdef TGA2GEBMP_TRACE
+
+#include <stdio.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+
+	#define TRACE_TLS					__declspec(thread)
+
+	typedef CRITICAL_SECTION	Trace_Mutex;
+
+	#define Trace_MutexInit(m)			InitializeCriticalSection(m)
+	#define Trace_MutexDestroy(m)		DeleteCriticalSection(m)
+	#define Trace_Lock(m)				EnterCriticalSection(m)
+	#define Trace_Unlock(m)				LeaveCriticalSection(m)
+#else
+	#include <pthread.h>
+	#include <time.h>
+
+	#define TRACE_TLS					__thread
+
+	typedef pthread_mutex_t		Trace_Mutex;
+
+	#define Trace_MutexInit(m)			pthread_mutex_init(m, NULL)
+	#define Trace_MutexDestroy(m)		pthread_mutex_destroy(m)
+	#define Trace_Lock(m)				pthread_mutex_lock(m)
+	#define Trace_Unlock(m)				pthread_mutex_unlock(m)
+#endif
+
+/* bucket 0 is below 1 us, bucket b up to 2^b us, the last one everything longer */
+#define TRACE_BUCKETS				32
+/* about 48 MB of events, spans past that are only counted */
+#define TRACE_MAX_EVENTS			(1 << 20)
+
+
+typedef struct	Trace_Stage
+{
+	uint64_t	Calls;
+	uint64_t	Items;
+	uint64_t	Bytes;
+	uint64_t	TotalNs;
+	uint64_t	MinNs;
+	uint64_t	MaxNs;
+	uint64_t	Histogram[TRACE_BUCKETS];
+}	Trace_Stage;
+
+typedef struct	Trace_Event
+{
+	uint64_t	Start;			/* ns since Trace_Start */
+	uint64_t	Duration;
+	uint64_t	Items;
+	uint64_t	Bytes;
+	int			Stage;
+	int			Thread;
+}	Trace_Event;
+
+typedef struct	Trace_State
+{
+	Trace_Mutex	Lock;
+	volatile int Started;
+	int			KeepEvents;
+	int			ThreadCount;
+	uint64_t	StartNs;
+	Trace_Stage	Stages[TRACE_STAGE_COUNT];
+	Trace_Event	*Events;
+	size_t		EventCount;
+	size_t		EventCapacity;
+	uint64_t	EventsDropped;
+}	Trace_State;
+
+static const char *Trace_StageNames[TRACE_STAGE_COUNT] =
+{
+	"open", "find", "read", "write", "decode", "mips", "palette", "pack16", "encode", "save"
+};
+
+static Trace_State Trace;
+static TRACE_TLS int Trace_Thread;		/* 1-based once the thread has ended a span */
+
+
+static uint64_t Trace_Now(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER Frequency;
+	LARGE_INTEGER Counter;
+
+	if(!Frequency.QuadPart)
+		QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Counter);
+
+	// in two parts so the counter times 10^9 cannot overflow
+	return (uint64_t)(Counter.QuadPart / Frequency.QuadPart) * 1000000000u +
+		   (uint64_t)(Counter.QuadPart % Frequency.QuadPart) * 1000000000u / (uint64_t)Frequency.QuadPart;
+#else
+	struct timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (uint64_t)Now.tv_sec * 1000000000u + (uint64_t)Now.tv_nsec;
+#endif
+}
+
+
+static int Trace_GetBucket(uint64_t Ns)
+{
+	uint64_t Us = Ns / 1000;
+	int Bucket = 0;
+
+	while(Us && Bucket < TRACE_BUCKETS - 1)
+	{
+		Us >>= 1;
+		Bucket++;
+	}
+
+	return Bucket;
+}
+
+
+static void Trace_ClearStages(void)
+{
+	int s;
+
+	memset(Trace.Stages, 0, sizeof(Trace.Stages));
+	for(s = 0; s < TRACE_STAGE_COUNT; s++)
+		Trace.Stages[s].MinNs = (uint64_t)-1;
+
+	Trace.EventCount = 0;
+	Trace.EventsDropped = 0;
+	Trace.StartNs = Trace_Now();
+}
+
+
+int Trace_Start(int Events)
+{
+	if(Trace.Started)
+		return 1;
+
+	Trace_MutexInit(&Trace.Lock);
+	Trace.KeepEvents = Events;
+	Trace.Events = NULL;
+	Trace.EventCapacity = 0;
+	if(Events)
+	{
+		Trace.EventCapacity = 4096;
+		Trace.Events = (Trace_Event*)malloc(Trace.EventCapacity * sizeof(Trace_Event));
+		if(!Trace.Events)
+		{
+			Trace_MutexDestroy(&Trace.Lock);
+			return 0;
+		}
+	}
+
+	Trace_ClearStages();
+	Trace.Started = 1;
+	return 1;
+}
+
+
+void Trace_Stop(void)
+{
+	if(!Trace.Started)
+		return;
+
+	Trace.Started = 0;
+	free(Trace.Events);
+	Trace.Events = NULL;
+	Trace_MutexDestroy(&Trace.Lock);
+}
+
+
+void Trace_Reset(void)
+{
+	if(!Trace.Started)
+		return;
+
+	Trace_Lock(&Trace.Lock);
+	Trace_ClearStages();
+	Trace_Unlock(&Trace.Lock);
+}
+
+
+void Trace_Begin(Trace_Span *Span, int Stage)
+{
+	Span->Stage = Stage;
+	Span->Start = Trace_Now();
+}
+
+
+void Trace_End(Trace_Span *Span, uint64_t Items, uint64_t Bytes)
+{
+	uint64_t End = Trace_Now();
+	uint64_t Duration = End - Span->Start;
+	Trace_Stage *Stage;
+
+	if(!Trace.Started)
+		return;
+
+	Trace_Lock(&Trace.Lock);
+
+	if(!Trace_Thread)
+		Trace_Thread = ++Trace.ThreadCount;
+
+	Stage = &Trace.Stages[Span->Stage];
+	Stage->Calls++;
+	Stage->Items += Items;
+	Stage->Bytes += Bytes;
+	Stage->TotalNs += Duration;
+	Stage->MinNs = TGA2GEBMP_MIN(Stage->MinNs, Duration);
+	Stage->MaxNs = TGA2GEBMP_MAX(Stage->MaxNs, Duration);
+	Stage->Histogram[Trace_GetBucket(Duration)]++;
+
+	if(Trace.KeepEvents && Span->Start >= Trace.StartNs)
+	{
+		if(Trace.EventCount == Trace.EventCapacity && Trace.EventCapacity < TRACE_MAX_EVENTS)
+		{
+			size_t Capacity = TGA2GEBMP_MIN(Trace.EventCapacity * 2, (size_t)TRACE_MAX_EVENTS);
+			Trace_Event *Events = (Trace_Event*)realloc(Trace.Events, Capacity * sizeof(Trace_Event));
+
+			if(Events)
+			{
+				Trace.Events = Events;
+				Trace.EventCapacity = Capacity;
+			}
+		}
+
+		if(Trace.EventCount < Trace.EventCapacity)
+		{
+			Trace_Event *Event = &Trace.Events[Trace.EventCount++];
+
+			Event->Start = Span->Start - Trace.StartNs;
+			Event->Duration = Duration;
+			Event->Items = Items;
+			Event->Bytes = Bytes;
+			Event->Stage = Span->Stage;
+			Event->Thread = Trace_Thread;
+		}
+		else
+		{
+			Trace.EventsDropped++;
+		}
+	}
+
+	Trace_Unlock(&Trace.Lock);
+}
+
+
+// upper bound of the bucket holding the Percent'th percentile, at most the
+// longest span
+static double Trace_GetPercentileUs(const Trace_Stage *Stage, int Percent)
+{
+	uint64_t Wanted = (Stage->Calls * Percent + 99) / 100;
+	uint64_t Seen = 0;
+	int b;
+
+	for(b = 0; b < TRACE_BUCKETS - 1; b++)
+	{
+		Seen += Stage->Histogram[b];
+		if(Seen >= Wanted)
+			break;
+	}
+
+	return TGA2GEBMP_MIN((double)((uint64_t)1 << b), Stage->MaxNs / 1000.0);
+}
+
+
+static void Trace_WriteCsv(FILE *File)
+{
+	int s;
+
+	fprintf(File, "stage,calls,items,bytes,total_ms,mean_us,min_us,max_us,p50_us,p90_us,p99_us,mb_per_s\n");
+
+	for(s = 0; s < TRACE_STAGE_COUNT; s++)
+	{
+		const Trace_Stage *Stage = &Trace.Stages[s];
+
+		if(!Stage->Calls)
+			continue;
+
+		fprintf(File, "%s,%.0f,%.0f,%.0f,%.3f,%.2f,%.2f,%.2f,%.0f,%.0f,%.0f,%.1f\n", Trace_StageNames[s],
+				(double)Stage->Calls, (double)Stage->Items, (double)Stage->Bytes, Stage->TotalNs / 1e6,
+				Stage->TotalNs / 1e3 / Stage->Calls, Stage->MinNs / 1e3, Stage->MaxNs / 1e3,
+				Trace_GetPercentileUs(Stage, 50), Trace_GetPercentileUs(Stage, 90), Trace_GetPercentileUs(Stage, 99),
+				Stage->TotalNs ? Stage->Bytes / (Stage->TotalNs / 1e9) / (1024.0 * 1024.0) : 0.0);
+	}
+}
+
+
+static void Trace_WriteJson(FILE *File)
+{
+	int First = 1;
+	int s, b;
+
+	fprintf(File, "{\n");
+	fprintf(File, "\t\"wall_ms\": %.3f,\n", (Trace_Now() - Trace.StartNs) / 1e6);
+	fprintf(File, "\t\"threads\": %d,\n", Trace.ThreadCount);
+	fprintf(File, "\t\"stages\": [");
+
+	for(s = 0; s < TRACE_STAGE_COUNT; s++)
+	{
+		const Trace_Stage *Stage = &Trace.Stages[s];
+		int FirstBucket = 1;
+
+		if(!Stage->Calls)
+			continue;
+
+		fprintf(File, "%s\n\t\t{\"name\": \"%s\", \"calls\": %.0f, \"items\": %.0f, \"bytes\": %.0f, \"total_ms\": %.3f, "
+					  "\"mean_us\": %.2f, \"min_us\": %.2f, \"max_us\": %.2f, \"p50_us\": %.0f, \"p90_us\": %.0f, "
+					  "\"p99_us\": %.0f, \"mb_per_s\": %.1f,\n\t\t \"histogram_us\": [",
+				First ? "" : ",", Trace_StageNames[s],
+				(double)Stage->Calls, (double)Stage->Items, (double)Stage->Bytes, Stage->TotalNs / 1e6,
+				Stage->TotalNs / 1e3 / Stage->Calls, Stage->MinNs / 1e3, Stage->MaxNs / 1e3,
+				Trace_GetPercentileUs(Stage, 50), Trace_GetPercentileUs(Stage, 90), Trace_GetPercentileUs(Stage, 99),
+				Stage->TotalNs ? Stage->Bytes / (Stage->TotalNs / 1e9) / (1024.0 * 1024.0) : 0.0);
+		First = 0;
+
+		// [upper bound in us, count] for the buckets that were hit
+		for(b = 0; b < TRACE_BUCKETS; b++)
+		{
+			if(!Stage->Histogram[b])
+				continue;
+			fprintf(File, "%s[%.0f, %.0f]", FirstBucket ? "" : ", ", (double)((uint64_t)1 << b), (double)Stage->Histogram[b]);
+			FirstBucket = 0;
+		}
+		fprintf(File, "]}");
+	}
+
+	fprintf(File, "\n\t],\n");
+	fprintf(File, "\t\"events_dropped\": %.0f\n", (double)Trace.EventsDropped);
+	fprintf(File, "}\n");
+}
+
+
+int Trace_WriteReport(const char *FileName)
+{
+	size_t Length = strlen(FileName);
+	FILE *File;
+	int Result;
+
+	if(!Trace.Started)
+		return 0;
+
+	File = fopen(FileName, "w");
+	if(!File)
+		return 0;
+
+	Trace_Lock(&Trace.Lock);
+	if(Length > 4 && tga2gebmp_stricmp(FileName + Length - 4, ".csv") == 0)
+		Trace_WriteCsv(File);
+	else
+		Trace_WriteJson(File);
+	Trace_Unlock(&Trace.Lock);
+
+	Result = !ferror(File);
+	return (fclose(File) == 0 && Result) ? 1 : 0;
+}
+
+
+int Trace_WriteEvents(const char *FileName)
+{
+	FILE *File;
+	size_t i;
+	int Result;
+
+	if(!Trace.Started)
+		return 0;
+
+	File = fopen(FileName, "w");
+	if(!File)
+		return 0;
+
+	Trace_Lock(&Trace.Lock);
+
+	// complete events, times in microseconds
+	fprintf(File, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for(i = 0; i < Trace.EventCount; i++)
+	{
+		const Trace_Event *Event = &Trace.Events[i];
+
+		fprintf(File, "%s\n{\"name\": \"%s\", \"cat\": \"tga2gebmp\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+					  "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"items\": %.0f, \"bytes\": %.0f}}",
+				i ? "," : "", Trace_StageNames[Event->Stage], Event->Thread,
+				Event->Start / 1e3, Event->Duration / 1e3, (double)Event->Items, (double)Event->Bytes);
+	}
+	fprintf(File, "\n]}\n");
+
+	Trace_Unlock(&Trace.Lock);
+
+	Result = !ferror(File);
+	return (fclose(File) == 0 && Result) ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file trace.h
+ *
+ * Timers and counters for the stages of a job: opening actors, listing
+ * their entries, reads and writes, decoding, the encode stages and saving.
+ * Every stage keeps calls, items, bytes, total, shortest and longest time
+ * and a histogram of durations in powers of two microseconds. The totals
+ * can be written as JSON or CSV, and every span as a Chrome trace-event
+ * file (chrome://tracing, Perfetto).
+ *
+ * All of it is compiled only with TGA2GEBMP_TRACE defined (the CMake option
+ * of the same name). Without it the TRACE_ macros expand to nothing, the
+ * Trace_ functions to constants, and trace.c is empty.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_OPEN			0		/* indexing an actor */
+#define TRACE_FIND			1		/* walking a directory of entries */
+#define TRACE_READ			2
+#define TRACE_WRITE			3
+#define TRACE_DECODE		4		/* image file to pixels */
+#define TRACE_MIPS			5
+#define TRACE_PALETTE		6
+#define TRACE_PACK16		7
+#define TRACE_ENCODE		8		/* geBitmap to file bytes */
+#define TRACE_SAVE			9		/* writing an actor */
+#define TRACE_STAGE_COUNT	10
+
+#ifdef TGA2GEBMP_TRACE
+
+#define TRACE_ENABLED		1
+
+typedef struct	Trace_Span
+{
+	int			Stage;
+	uint64_t	Start;		/* ns */
+}	Trace_Span;
+
+/* starts collecting, with one trace event per span if Events is set;
+   returns 0 if out of memory. Spans outside Start and Stop are ignored */
+int Trace_Start(int Events);
+void Trace_Stop(void);
+/* clears the totals and events, e.g. between jobs */
+void Trace_Reset(void);
+
+void Trace_Begin(Trace_Span *Span, int Stage);
+void Trace_End(Trace_Span *Span, uint64_t Items, uint64_t Bytes);
+
+/* the totals, as CSV if FileName ends in .csv and JSON otherwise */
+int Trace_WriteReport(const char *FileName);
+/* the spans in Chrome trace-event format */
+int Trace_WriteEvents(const char *FileName);
+
+/* a span is declared with the block's variables, without a semicolon */
+#define TRACE_SPAN(Span)						Trace_Span Span;
+#define TRACE_BEGIN(Span, Stage)				Trace_Begin(&(Span), Stage)
+#define TRACE_END(Span, Items, Bytes)			Trace_End(&(Span), (uint64_t)(Items), (uint64_t)(Bytes))
+
+#else
+
+#define TRACE_ENABLED		0
+
+#define Trace_Start(Events)						0
+#define Trace_Stop()							((void)0)
+#define Trace_Reset()							((void)0)
+#define Trace_WriteReport(FileName)				0
+#define Trace_WriteEvents(FileName)				0
+
+#define TRACE_SPAN(Span)
+#define TRACE_BEGIN(Span, Stage)				((void)0)
+#define TRACE_END(Span, Items, Bytes)			((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,480 @@
+/**
+ * @file watchdir.c
+ *
+ * inotify behind watchdir.h. The watches map to the directories' full
+ * paths, and the files of the burst under way are collected, each once,
+ * until it is over: no change for the quiet time, or a few of them after
+ * it started, so a tree that never settles is still reported.
+ */
+#include <stdio.h>
+#include "watchdir.h"
+
+#ifdef __linux__
+	#define WATCHDIR_INOTIFY
+#endif
+
+#ifdef WATCHDIR_INOTIFY
+	#include <errno.h>
+	#include <poll.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <sys/inotify.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+#endif
+
+#define WATCHDIR_MAX_BURST			8		/* quiet times a burst may last */
+#define WATCHDIR_MASK				(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_ONLYDIR)
+
+
+typedef struct	WatchDir_Dir
+{
+	int			Wd;
+	char		*Path;
+}	WatchDir_Dir;
+
+struct WatchDir
+{
+	int				Fd;
+	int				QuietMs;
+	WatchDir_Dir	*Dirs;
+	int				DirCount;
+	int				DirCapacity;
+
+	/* the burst under way */
+	char			**Pending;
+	int				PendingCount;
+	int				PendingCapacity;
+	int				Overflow;		/* events were lost */
+	uint64_t		FirstMs;
+	uint64_t		LastMs;
+};
+
+
+static char *WatchDir_StrDup(const char *Str)
+{
+	char *Copy = (char*)malloc(strlen(Str) + 1);
+
+	if(Copy)
+		strcpy(Copy, Str);
+	return Copy;
+}
+
+
+// Dir/Name into Path of _MAX_PATH characters, 0 if it does not fit
+static int WatchDir_Join(const char *Dir, const char *Name, char *Path)
+{
+	size_t Length = strlen(Dir);
+
+	// the root directory already ends in a separator
+	if(Length && Dir[Length - 1] == TGA2GEBMP_DIRSEP[0])
+		Length--;
+
+	if(Length + strlen(Name) + 2 > _MAX_PATH)
+		return 0;
+
+	memcpy(Path, Dir, Length);
+	Path[Length] = TGA2GEBMP_DIRSEP[0];
+	strcpy(Path + Length + 1, Name);
+	return 1;
+}
+
+
+int WatchDir_GetFullPath(const char *Path, char *FullPath)
+{
+#ifdef _WIN32
+	return _fullpath(FullPath, Path, _MAX_PATH) != NULL;
+#else
+	char Dir[_MAX_PATH];
+	char Resolved[_MAX_PATH];
+	const char *Name;
+	const char *Slash;
+
+	if(realpath(Path, FullPath))
+		return 1;
+
+	// a file that is not there yet, in a directory that is
+	Slash = strrchr(Path, '/');
+	if(!Slash)
+	{
+		strcpy(Dir, ".");
+		Name = Path;
+	}
+	else
+	{
+		if((size_t)(Slash - Path) + 2 > sizeof(Dir))
+			return 0;
+		memcpy(Dir, Path, Slash == Path ? 1 : Slash - Path);
+		Dir[Slash == Path ? 1 : Slash - Path] = '\0';
+		Name = Slash + 1;
+	}
+
+	if(*Name == '\0' || !realpath(Dir, Resolved))
+		return 0;
+
+	return WatchDir_Join(Resolved, Name, FullPath);
+#endif
+}
+
+
+#ifdef WATCHDIR_INOTIFY
+
+static uint64_t WatchDir_Now(void)
+{
+	struct timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (uint64_t)Now.tv_sec * 1000 + (uint64_t)Now.tv_nsec / 1000000;
+}
+
+
+static void WatchDir_Touch(WatchDir *Watch)
+{
+	Watch->LastMs = WatchDir_Now();
+	if(Watch->PendingCount == 0 && !Watch->Overflow)
+		Watch->FirstMs = Watch->LastMs;
+}
+
+
+// out of memory loses track of which files changed, not that some did
+static void WatchDir_AddPending(WatchDir *Watch, const char *Path)
+{
+	int i;
+
+	WatchDir_Touch(Watch);
+
+	for(i = 0; i < Watch->PendingCount; i++)
+	{
+		if(strcmp(Watch->Pending[i], Path) == 0)
+			return;
+	}
+
+	if(Watch->PendingCount == Watch->PendingCapacity)
+	{
+		char **NewPending;
+		int NewCapacity = Watch->PendingCapacity ? Watch->PendingCapacity * 2 : 64;
+
+		NewPending = (char**)realloc(Watch->Pending, NewCapacity * sizeof(char*));
+		if(!NewPending)
+		{
+			Watch->Overflow = 1;
+			return;
+		}
+
+		Watch->Pending = NewPending;
+		Watch->PendingCapacity = NewCapacity;
+	}
+
+	Watch->Pending[Watch->PendingCount] = WatchDir_StrDup(Path);
+	if(Watch->Pending[Watch->PendingCount])
+		Watch->PendingCount++;
+	else
+		Watch->Overflow = 1;
+}
+
+
+static WatchDir_Dir *WatchDir_FindDir(WatchDir *Watch, int Wd)
+{
+	int i;
+
+	for(i = 0; i < Watch->DirCount; i++)
+	{
+		if(Watch->Dirs[i].Wd == Wd)
+			return &Watch->Dirs[i];
+	}
+
+	return NULL;
+}
+
+
+static void WatchDir_RemoveDir(WatchDir *Watch, WatchDir_Dir *Dir)
+{
+	free(Dir->Path);
+	*Dir = Watch->Dirs[--Watch->DirCount];
+}
+
+
+// watches Path and every directory below it; with Report set, the files
+// found count as changed, they may have been written before the watch was
+// there. 0 only if Path itself cannot be watched
+static int WatchDir_AddTree(WatchDir *Watch, const char *Path, int Report)
+{
+	WatchDir_Dir *Dir;
+	DIR *DirHandle;
+	struct dirent *Ent;
+	struct stat Stat;
+	char EntPath[_MAX_PATH];
+	char *Copy;
+	int Wd;
+
+	Wd = inotify_add_watch(Watch->Fd, Path, WATCHDIR_MASK);
+	if(Wd < 0)
+		return 0;
+
+	Copy = WatchDir_StrDup(Path);
+	if(!Copy)
+	{
+		inotify_rm_watch(Watch->Fd, Wd);
+		return 0;
+	}
+
+	// a directory watched again, say after moving it away and back, keeps its watch
+	Dir = WatchDir_FindDir(Watch, Wd);
+	if(Dir)
+		free(Dir->Path);
+	else
+	{
+		if(Watch->DirCount == Watch->DirCapacity)
+		{
+			WatchDir_Dir *NewDirs;
+			int NewCapacity = Watch->DirCapacity ? Watch->DirCapacity * 2 : 64;
+
+			NewDirs = (WatchDir_Dir*)realloc(Watch->Dirs, NewCapacity * sizeof(WatchDir_Dir));
+			if(!NewDirs)
+			{
+				free(Copy);
+				inotify_rm_watch(Watch->Fd, Wd);
+				return 0;
+			}
+
+			Watch->Dirs = NewDirs;
+			Watch->DirCapacity = NewCapacity;
+		}
+
+		Dir = &Watch->Dirs[Watch->DirCount++];
+		Dir->Wd = Wd;
+	}
+	Dir->Path = Copy;
+
+	DirHandle = opendir(Path);
+	if(!DirHandle)
+		return 1;
+
+	while((Ent = readdir(DirHandle)) != NULL)
+	{
+		if(strcmp(Ent->d_name, ".") == 0 || strcmp(Ent->d_name, "..") == 0)
+			continue;
+
+		if(!WatchDir_Join(Path, Ent->d_name, EntPath) || lstat(EntPath, &Stat) != 0)
+			continue;
+
+		if(S_ISDIR(Stat.st_mode))
+			WatchDir_AddTree(Watch, EntPath, Report);
+		else if(Report && S_ISREG(Stat.st_mode))
+			WatchDir_AddPending(Watch, EntPath);
+	}
+
+	closedir(DirHandle);
+	return 1;
+}
+
+
+// a directory moved out of the tree takes the watches below it along
+static void WatchDir_RemoveTree(WatchDir *Watch, const char *Path)
+{
+	size_t Length = strlen(Path);
+	int i;
+
+	for(i = 0; i < Watch->DirCount; )
+	{
+		const char *DirPath = Watch->Dirs[i].Path;
+
+		if(strncmp(DirPath, Path, Length) == 0 && (DirPath[Length] == '\0' || DirPath[Length] == TGA2GEBMP_DIRSEP[0]))
+		{
+			inotify_rm_watch(Watch->Fd, Watch->Dirs[i].Wd);
+			WatchDir_RemoveDir(Watch, &Watch->Dirs[i]);
+		}
+		else
+			i++;
+	}
+}
+
+
+static int WatchDir_ReadEvents(WatchDir *Watch)
+{
+	// aligned for the events
+	union
+	{
+		struct inotify_event	Event;
+		char					Bytes[64 * 1024];
+	} Buffer;
+	const struct inotify_event *Event;
+	char Path[_MAX_PATH];
+	WatchDir_Dir *Dir;
+	ssize_t Length;
+	ssize_t Offset;
+
+	Length = read(Watch->Fd, &Buffer, sizeof(Buffer));
+	if(Length < 0)
+		return errno == EAGAIN || errno == EINTR;
+
+	for(Offset = 0; Offset < Length; Offset += sizeof(struct inotify_event) + Event->len)
+	{
+		Event = (const struct inotify_event*)(Buffer.Bytes + Offset);
+
+		if(Event->mask & IN_Q_OVERFLOW)
+		{
+			WatchDir_Touch(Watch);
+			Watch->Overflow = 1;
+			continue;
+		}
+
+		Dir = WatchDir_FindDir(Watch, Event->wd);
+		if(!Dir)
+			continue;
+
+		// the directory is gone
+		if(Event->mask & IN_IGNORED)
+		{
+			WatchDir_RemoveDir(Watch, Dir);
+			continue;
+		}
+
+		if(Event->len == 0 || !WatchDir_Join(Dir->Path, Event->name, Path))
+			continue;
+
+		if(Event->mask & IN_ISDIR)
+		{
+			if(Event->mask & (IN_CREATE | IN_MOVED_TO))
+				WatchDir_AddTree(Watch, Path, 1);
+			else if(Event->mask & IN_MOVED_FROM)
+				WatchDir_RemoveTree(Watch, Path);
+		}
+		else if(Event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+			WatchDir_AddPending(Watch, Path);
+	}
+
+	return 1;
+}
+
+
+static int WatchDir_Report(WatchDir *Watch, WatchDir_Func Func, void *Context)
+{
+	int Count = Watch->PendingCount;
+	int i;
+
+	if(Watch->Overflow)
+	{
+		Func(NULL, Context);
+		Count++;
+	}
+
+	for(i = 0; i < Watch->PendingCount; i++)
+	{
+		Func(Watch->Pending[i], Context);
+		free(Watch->Pending[i]);
+	}
+
+	Watch->PendingCount = 0;
+	Watch->Overflow = 0;
+	return Count;
+}
+
+#endif
+
+
+WatchDir *WatchDir_Open(const char *Root, int QuietMs)
+{
+#ifndef WATCHDIR_INOTIFY
+	(void)Root;
+	(void)QuietMs;
+	return NULL;
+#else
+	WatchDir *Watch;
+	char FullRoot[_MAX_PATH];
+
+	if(!realpath(Root, FullRoot))
+		return NULL;
+
+	Watch = (WatchDir*)calloc(1, sizeof(WatchDir));
+	if(!Watch)
+		return NULL;
+
+	Watch->QuietMs = QuietMs > 0 ? QuietMs : WATCHDIR_DEFAULT_QUIET;
+	Watch->Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(Watch->Fd < 0 || !WatchDir_AddTree(Watch, FullRoot, 0))
+	{
+		WatchDir_Close(&Watch);
+		return NULL;
+	}
+
+	return Watch;
+#endif
+}
+
+
+void WatchDir_Close(WatchDir **pWatch)
+{
+	WatchDir *Watch = *pWatch;
+	int i;
+
+	if(!Watch)
+		return;
+
+#ifdef WATCHDIR_INOTIFY
+	// closing the descriptor drops the watches
+	if(Watch->Fd >= 0)
+		close(Watch->Fd);
+#endif
+
+	for(i = 0; i < Watch->DirCount; i++)
+		free(Watch->Dirs[i].Path);
+	for(i = 0; i < Watch->PendingCount; i++)
+		free(Watch->Pending[i]);
+
+	free(Watch->Dirs);
+	free(Watch->Pending);
+	free(Watch);
+	*pWatch = NULL;
+}
+
+
+int WatchDir_Wait(WatchDir *Watch, int TimeoutMs, WatchDir_Func Func, void *Context)
+{
+#ifndef WATCHDIR_INOTIFY
+	(void)Watch;
+	(void)TimeoutMs;
+	(void)Func;
+	(void)Context;
+	return -1;
+#else
+	struct pollfd Poll;
+	uint64_t Deadline = WatchDir_Now() + (uint64_t)TGA2GEBMP_MAX(TimeoutMs, 0);
+	uint64_t Now;
+	uint64_t Due;
+	int Wait;
+	int Result;
+
+	for(;;)
+	{
+		Now = WatchDir_Now();
+		Wait = -1;
+
+		if(Watch->PendingCount > 0 || Watch->Overflow)
+		{
+			Due = TGA2GEBMP_MIN(Watch->LastMs + Watch->QuietMs, Watch->FirstMs + (uint64_t)Watch->QuietMs * WATCHDIR_MAX_BURST);
+			if(Now >= Due)
+				return WatchDir_Report(Watch, Func, Context);
+			Wait = (int)(Due - Now);
+		}
+
+		if(TimeoutMs >= 0)
+		{
+			if(Now >= Deadline)
+				return 0;
+			Wait = Wait < 0 ? (int)(Deadline - Now) : TGA2GEBMP_MIN(Wait, (int)(Deadline - Now));
+		}
+
+		Poll.fd = Watch->Fd;
+		Poll.events = POLLIN;
+		Poll.revents = 0;
+		Result = poll(&Poll, 1, Wait);
+		if(Result < 0)
+			return errno == EINTR ? 0 : -1;
+
+		if(Result > 0 && !WatchDir_ReadEvents(Watch))
+			return -1;
+	}
+#endif
+}
@@ -0,0 +1,54 @@
+/**
+ * @file watchdir.h
+ *
+ * Change notifications for a directory tree, for picking up images as an
+ * editor saves them. A file is reported once it has been written and
+ * closed, or moved into the tree. Changes come in bursts: an editor may
+ * write a file in several goes, or save several files at once. A burst is
+ * reported together once the tree has been quiet for a while, so it causes
+ * one report.
+ *
+ * On Linux this is inotify, with one watch per directory of the tree;
+ * directories created or moved in later are watched as they appear, and the
+ * files they already hold count as changed. Linked directories are not
+ * followed. WatchDir_Open returns NULL on other systems.
+ *
+ * This module does not depend on the Genesis engine.
+ */
+#ifndef WATCHDIR_H
+#define WATCHDIR_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WATCHDIR_DEFAULT_QUIET		250		/* ms without changes that end a burst */
+
+typedef struct WatchDir WatchDir;
+
+/* Path is the full path of a changed file, as WatchDir_GetFullPath makes
+   it; NULL if notifications were lost and anything may have changed */
+typedef void (*WatchDir_Func)(const char *Path, void *Context);
+
+/* QuietMs 0 takes the default. NULL if Root cannot be watched, out of
+   memory or without inotify */
+WatchDir *WatchDir_Open(const char *Root, int QuietMs);
+void WatchDir_Close(WatchDir **pWatch);
+
+/* waits for a burst of changes to end, for at most TimeoutMs (-1 for no
+   limit), and calls Func once for every file changed in it. Returns the
+   number of calls, 0 on timeout or if a signal interrupted the wait, -1 if
+   the notifications cannot be read */
+int WatchDir_Wait(WatchDir *Watch, int TimeoutMs, WatchDir_Func Func, void *Context);
+
+/* full path of a file, which need not exist yet if its directory does, into
+   FullPath of _MAX_PATH characters; 0 if the directory does not exist */
+int WatchDir_GetFullPath(const char *Path, char *FullPath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif